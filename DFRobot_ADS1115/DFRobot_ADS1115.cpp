@@ -0,0 +1,146 @@
+/*!
+ * @file DFRobot_ADS1115.cpp
+ * @brief Define the basic structure of class DFRobot_ADS1115
+ * @details Native driver for the ADS1115 16 bit I2C ADC used with the Gravity pH / EC boards.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+#include "DFRobot_ADS1115.h"
+
+#define ADS1115_REG_POINTER_CONVERT   0x00
+#define ADS1115_REG_POINTER_CONFIG    0x01
+
+#define ADS1115_REG_CONFIG_OS_SINGLE  0x8000  //begin a single conversion / conversion finished when read
+#define ADS1115_REG_CONFIG_MUX_SINGLE 0x4000  //single ended AIN0, channel n is 0x4000 | n << 12
+#define ADS1115_REG_CONFIG_MODE_SINGLE 0x0100 //power-down single-shot mode
+#define ADS1115_REG_CONFIG_DR_128SPS  0x0080
+#define ADS1115_REG_CONFIG_CQUE_NONE  0x0003
+
+#define ADS1115_CLIP_HIGH  32760      //codes this close to full scale are treated as clipped
+#define ADS1115_CLIP_LOW  -32760
+#define ADS1115_TIMEOUT    20         //a conversion at 128SPS takes ~8ms (ms)
+
+static const float fullScale[6] = {6144.0, 4096.0, 2048.0, 1024.0, 512.0, 256.0};  //mV
+
+DFRobot_ADS1115::DFRobot_ADS1115(uint8_t addr)
+{
+    this->_addr = addr;
+    this->_maxRange = ADS1115_PGA_6_144V;
+    this->_conversions = 0;
+    this->_retries = 0;
+    for(uint8_t ch = 0; ch < 4; ch++)
+    {
+        this->_fixedGain[ch] = ADS1115_PGA_AUTO;
+        this->_gain[ch] = ADS1115_PGA_6_144V;
+        this->_lastRaw[ch] = 32767;  //no reading yet, predicts the widest range
+    }
+}
+
+void DFRobot_ADS1115::begin()
+{
+    Wire.begin();
+}
+
+void DFRobot_ADS1115::setGain(uint8_t channel, uint8_t gain)
+{
+    if(channel < 4)
+        this->_fixedGain[channel] = (gain <= ADS1115_PGA_0_256V) ? gain : ADS1115_PGA_AUTO;
+}
+
+void DFRobot_ADS1115::setMaxRange(uint8_t gain)
+{
+    if(gain <= ADS1115_PGA_0_256V)
+        this->_maxRange = gain;
+}
+
+uint8_t DFRobot_ADS1115::predictGain(uint8_t channel)
+{
+    // the last reading converted to mV, then the narrowest range that still leaves headroom for it
+    float last = fabs(this->_lastRaw[channel]/32768.0*fullScale[this->_gain[channel]]);
+    uint8_t gain = ADS1115_PGA_0_256V;
+    while(gain > this->_maxRange && last > fullScale[gain]*ADS1115_PGA_HEADROOM)
+        gain--;
+    return gain;
+}
+
+float DFRobot_ADS1115::readVoltage(uint8_t channel)
+{
+    if(channel > 3)
+        return 0.0;
+    uint8_t gain = this->_fixedGain[channel];
+    if(gain == ADS1115_PGA_AUTO)
+    {
+        gain = predictGain(channel);
+        int16_t raw = convert(channel, gain);
+        while((raw >= ADS1115_CLIP_HIGH || raw <= ADS1115_CLIP_LOW) && gain > this->_maxRange)
+        {
+            gain--;  //clipped, the input jumped since the last reading: retry with the next wider range
+            this->_retries++;
+            raw = convert(channel, gain);
+        }
+        this->_lastRaw[channel] = raw;
+    }
+    else
+    {
+        this->_lastRaw[channel] = convert(channel, gain);
+    }
+    this->_gain[channel] = gain;
+    return this->_lastRaw[channel]/32768.0*fullScale[gain];
+}
+
+uint8_t DFRobot_ADS1115::gain(uint8_t channel)
+{
+    return (channel < 4) ? this->_gain[channel] : ADS1115_PGA_6_144V;
+}
+
+float DFRobot_ADS1115::resolution(uint8_t channel)
+{
+    return fullScale[gain(channel)]/32768.0;
+}
+
+unsigned long DFRobot_ADS1115::conversions()
+{
+    return this->_conversions;
+}
+
+unsigned long DFRobot_ADS1115::retries()
+{
+    return this->_retries;
+}
+
+int16_t DFRobot_ADS1115::convert(uint8_t channel, uint8_t gain)
+{
+    uint16_t config = ADS1115_REG_CONFIG_OS_SINGLE | (ADS1115_REG_CONFIG_MUX_SINGLE | ((uint16_t)channel << 12)) |
+                      ((uint16_t)gain << 9) | ADS1115_REG_CONFIG_MODE_SINGLE | ADS1115_REG_CONFIG_DR_128SPS |
+                      ADS1115_REG_CONFIG_CQUE_NONE;
+    writeRegister(ADS1115_REG_POINTER_CONFIG, config);
+    this->_conversions++;
+    unsigned long start = millis();
+    while(!(readRegister(ADS1115_REG_POINTER_CONFIG) & ADS1115_REG_CONFIG_OS_SINGLE))  //OS reads 1 when done
+    {
+        if(millis() - start > ADS1115_TIMEOUT)
+            break;
+    }
+    return (int16_t)readRegister(ADS1115_REG_POINTER_CONVERT);
+}
+
+void DFRobot_ADS1115::writeRegister(uint8_t reg, uint16_t value)
+{
+    Wire.beginTransmission(this->_addr);
+    Wire.write(reg);
+    Wire.write((uint8_t)(value >> 8));
+    Wire.write((uint8_t)(value & 0xFF));
+    Wire.endTransmission();
+}
+
+uint16_t DFRobot_ADS1115::readRegister(uint8_t reg)
+{
+    Wire.beginTransmission(this->_addr);
+    Wire.write(reg);
+    Wire.endTransmission();
+    Wire.requestFrom(this->_addr, (uint8_t)2);
+    uint16_t value = (uint16_t)Wire.read() << 8;
+    value |= Wire.read();
+    return value;
+}
@@ -0,0 +1,114 @@
+/*!
+ * @file DFRobot_ADS1115.h
+ * @brief Define the basic structure of class DFRobot_ADS1115
+ * @details Native driver for the ADS1115 16 bit I2C ADC used with the Gravity pH / EC boards.
+ * @n Unlike the Raspberry Pi driver, which uses one global gain for all channels, the PGA range is chosen
+ * @n per channel: it is predicted from the last reading of the channel and the conversion is repeated with
+ * @n the next wider range when it clips. Low voltage EC readings thus use the full 16 bit resolution.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+#ifndef _DFROBOT_ADS1115_H_
+#define _DFROBOT_ADS1115_H_
+
+#include "Arduino.h"
+#include <Wire.h>
+
+#define ADS1115_IIC_ADDRESS0  0x48
+#define ADS1115_IIC_ADDRESS1  0x49
+
+#define ADS1115_PGA_6_144V    0  ///<+/-6.144V range = Gain 2/3
+#define ADS1115_PGA_4_096V    1  ///<+/-4.096V range = Gain 1
+#define ADS1115_PGA_2_048V    2  ///<+/-2.048V range = Gain 2 (default)
+#define ADS1115_PGA_1_024V    3  ///<+/-1.024V range = Gain 4
+#define ADS1115_PGA_0_512V    4  ///<+/-0.512V range = Gain 8
+#define ADS1115_PGA_0_256V    5  ///<+/-0.256V range = Gain 16
+#define ADS1115_PGA_AUTO      0xFF
+
+#ifndef ADS1115_PGA_HEADROOM
+#define ADS1115_PGA_HEADROOM  0.75  ///<a range is only predicted if the last reading used less than this part of it
+#endif
+
+class DFRobot_ADS1115
+{
+public:
+
+  /*!
+   * @fn DFRobot_ADS1115
+   * @brief Constructor
+   * @param addr  I2C address, ADS1115_IIC_ADDRESS0 or ADS1115_IIC_ADDRESS1
+   */
+  DFRobot_ADS1115(uint8_t addr = ADS1115_IIC_ADDRESS0);
+
+  /*!
+   * @fn begin
+   * @brief Init the I2C bus, all channels start with automatic range selection
+   */
+  void begin();
+
+  /*!
+   * @fn setGain
+   * @brief Fix the PGA range of a channel or switch it back to automatic range selection
+   * @param channel  0-3, single ended AINx against GND
+   * @param gain  ADS1115_PGA_6_144V ... ADS1115_PGA_0_256V or ADS1115_PGA_AUTO
+   */
+  void setGain(uint8_t channel, uint8_t gain);
+
+  /*!
+   * @fn setMaxRange
+   * @brief Limit the widest range used by automatic selection, a single ended input can not exceed VDD
+   * @param gain  ADS1115_PGA_6_144V for VDD = 5V (default), ADS1115_PGA_4_096V for VDD = 3.3V
+   */
+  void setMaxRange(uint8_t gain);
+
+  /*!
+   * @fn readVoltage
+   * @brief Convert one channel
+   * @param channel  0-3, single ended AINx against GND
+   * @return Voltage in mV, the same unit readPH()/readEC() expect
+   */
+  float readVoltage(uint8_t channel);
+
+  /*!
+   * @fn gain
+   * @brief Get the PGA range used by the last conversion of a channel
+   */
+  uint8_t gain(uint8_t channel);
+
+  /*!
+   * @fn resolution
+   * @brief Get the effective resolution of the last conversion of a channel
+   * @return Size of one LSB in mV, 0.1875 at +/-6.144V down to 0.0078125 at +/-0.256V
+   */
+  float resolution(uint8_t channel);
+
+  /*!
+   * @fn conversions
+   * @brief Get the number of conversions since begin(), including the ones repeated because of clipping
+   */
+  unsigned long conversions();
+
+  /*!
+   * @fn retries
+   * @brief Get the number of conversions repeated because the predicted range clipped
+   */
+  unsigned long retries();
+
+private:
+  uint8_t _addr;
+  uint8_t _maxRange;
+  uint8_t _fixedGain[4];
+  uint8_t _gain[4];               ///<range of the last conversion
+  int16_t _lastRaw[4];
+  unsigned long _conversions;
+  unsigned long _retries;
+
+private:
+  uint8_t predictGain(uint8_t channel);
+  int16_t convert(uint8_t channel, uint8_t gain);
+  void    writeRegister(uint8_t reg, uint16_t value);
+  uint16_t readRegister(uint8_t reg);
+};
+
+#endif
@@ -0,0 +1,59 @@
+/*!
+ * @file ADS1115_PH_EC.ino
+ * @brief Reads a pH probe (SEN0161-V2) and an EC probe (DFR0300-H) through an ADS1115.
+ * @n EC board -> A0, pH board -> A1 of the ADS1115. The PGA range of each channel is picked automatically,
+ * @n the printed resolution shows the size of one LSB of the last conversion.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+
+#include "DFRobot_ADS1115.h"
+#include "DFRobot_PH.h"
+#include "DFRobot_EC10.h"
+#include <EEPROM.h>
+
+#define EC_CHANNEL 0
+#define PH_CHANNEL 1
+float voltagePH,voltageEC,phValue,ecValue,temperature = 25;
+DFRobot_ADS1115 ads1115(ADS1115_IIC_ADDRESS0);
+DFRobot_PH ph;
+DFRobot_EC10 ec;
+
+void setup()
+{
+    Serial.begin(115200);
+    ads1115.begin();
+    ads1115.setMaxRange(ADS1115_PGA_6_144V);          // VDD = 5V
+    ph.begin();
+    ec.begin();
+}
+
+void loop()
+{
+    static unsigned long timepoint = millis();
+    if(millis()-timepoint>1000U){                     //time interval: 1s
+        timepoint = millis();
+        //temperature = readTemperature();            // read your temperature sensor to execute temperature compensation
+        voltageEC = ads1115.readVoltage(EC_CHANNEL);
+        ecValue   = ec.readEC(voltageEC,temperature);
+        voltagePH = ads1115.readVoltage(PH_CHANNEL);
+        phValue   = ph.readPH(voltagePH,temperature);
+        Serial.print("temperature:");
+        Serial.print(temperature,1);
+        Serial.print("^C  EC:");
+        Serial.print(ecValue,2);
+        Serial.print("ms/cm (");
+        Serial.print(ads1115.resolution(EC_CHANNEL)*1000,1);
+        Serial.print("uV/LSB)  pH:");
+        Serial.print(phValue,2);
+        Serial.print(" (");
+        Serial.print(ads1115.resolution(PH_CHANNEL)*1000,1);
+        Serial.println("uV/LSB)");
+    }
+}
+
+float readTemperature()
+{
+  //add your code here to get the temperature from your temperature sensor
+}
@@ -0,0 +1,167 @@
+/*!
+ * @file DFRobot_AnalogMux.cpp
+ * @brief Define the basic structure of class DFRobot_AnalogMux
+ * @details Reads up to 16 analog probes through one CD4051 (8 channels) or CD74HC4067 (16 channels) multiplexer.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "DFRobot_AnalogMux.h"
+#include "DFRobot_PH.h"
+#include "DFRobot_EC10.h"
+
+#define PROBE_NONE 0
+#define PROBE_PH   1
+#define PROBE_EC10 2
+
+#define ADC_HOLD_US 16   //the sample and hold capacitor is disconnected 1.5 ADC clocks (12us at 125kHz) after start
+
+DFRobot_AnalogMux::DFRobot_AnalogMux(byte analogPin, byte s0, byte s1, byte s2, byte s3)
+{
+    this->_analogPin = analogPin;
+    this->_selectPins[0] = s0;
+    this->_selectPins[1] = s1;
+    this->_selectPins[2] = s2;
+    this->_selectPins[3] = s3;
+    this->_channels = (s3 == MUX_NO_PIN) ? 8 : 16;
+    this->_current = 0;
+    this->_selectedAt = 0;
+    this->_reference = 5000.0;
+    this->_temperature = 25.0;
+    for(byte ch = 0; ch < MUX_MAX_CHANNELS; ch++)
+    {
+        this->_settle[ch] = MUX_DEFAULT_SETTLE;
+        this->_voltage[ch] = 0.0;
+        this->_value[ch] = 0.0;
+        this->_samples[ch] = 0;
+        this->_probe[ch] = NULL;
+        this->_probeType[ch] = PROBE_NONE;
+    }
+}
+
+void DFRobot_AnalogMux::begin()
+{
+    for(byte i = 0; i < 4; i++)
+    {
+        if(this->_selectPins[i] != MUX_NO_PIN)
+            pinMode(this->_selectPins[i], OUTPUT);
+    }
+    analogRead(this->_analogPin);  //let the core set up reference, prescaler and input channel once
+#if defined(__AVR__)
+    this->_admux = ADMUX;
+#if defined(ADCSRB) && defined(MUX5)
+    this->_adcsrb = ADCSRB;
+#endif
+#endif
+    select(0);
+}
+
+void DFRobot_AnalogMux::setReference(float millivolts)
+{
+    this->_reference = millivolts;
+}
+
+void DFRobot_AnalogMux::setSettleTime(byte channel, unsigned int micros)
+{
+    if(channel < MUX_MAX_CHANNELS)
+        this->_settle[channel] = micros;
+}
+
+void DFRobot_AnalogMux::attach(byte channel, DFRobot_PH* ph)
+{
+    if(channel < MUX_MAX_CHANNELS)
+    {
+        this->_probe[channel] = ph;
+        this->_probeType[channel] = PROBE_PH;
+    }
+}
+
+void DFRobot_AnalogMux::attach(byte channel, DFRobot_EC10* ec)
+{
+    if(channel < MUX_MAX_CHANNELS)
+    {
+        this->_probe[channel] = ec;
+        this->_probeType[channel] = PROBE_EC10;
+    }
+}
+
+void DFRobot_AnalogMux::setTemperature(float temperature)
+{
+    this->_temperature = temperature;
+}
+
+void DFRobot_AnalogMux::select(byte channel)
+{
+    for(byte i = 0; i < 4; i++)
+    {
+        if(this->_selectPins[i] != MUX_NO_PIN)
+            digitalWrite(this->_selectPins[i], (channel >> i) & 0x01);
+    }
+    this->_current = channel;
+    this->_selectedAt = micros();
+}
+
+int DFRobot_AnalogMux::convert(byte next)
+{
+#if defined(__AVR__)
+    //start the conversion by hand so the next channel can be selected as soon as the input is sampled
+#if defined(ADCSRB) && defined(MUX5)
+    ADCSRB = this->_adcsrb;
+#endif
+    ADMUX = this->_admux;
+    ADCSRA |= _BV(ADSC);
+    delayMicroseconds(ADC_HOLD_US);
+    select(next);
+    while(bit_is_set(ADCSRA, ADSC));
+    byte low = ADCL;  //ADCL must be read first
+    byte high = ADCH;
+    return (high << 8) | low;
+#else
+    int raw = analogRead(this->_analogPin);
+    select(next);
+    return raw;
+#endif
+}
+
+bool DFRobot_AnalogMux::update()
+{
+    byte ch = this->_current;
+    if((unsigned long)(micros() - this->_selectedAt) < this->_settle[ch])
+        return false;  //not settled yet, keep holding the previous reading
+
+    byte next = (ch + 1 < this->_channels) ? ch + 1 : 0;
+    int raw = convert(next);
+    float voltage = raw/1024.0*this->_reference;
+    this->_voltage[ch] = voltage;
+    this->_samples[ch]++;
+    switch(this->_probeType[ch])
+    {
+      case PROBE_PH:
+      this->_value[ch] = ((DFRobot_PH*)this->_probe[ch])->readPH(voltage, this->_temperature);
+      break;
+
+      case PROBE_EC10:
+      this->_value[ch] = ((DFRobot_EC10*)this->_probe[ch])->readEC(voltage, this->_temperature);
+      break;
+    }
+    return next == 0;
+}
+
+float DFRobot_AnalogMux::voltage(byte channel)
+{
+    return (channel < MUX_MAX_CHANNELS) ? this->_voltage[channel] : 0.0;
+}
+
+float DFRobot_AnalogMux::value(byte channel)
+{
+    return (channel < MUX_MAX_CHANNELS) ? this->_value[channel] : 0.0;
+}
+
+unsigned int DFRobot_AnalogMux::sampleCount(byte channel)
+{
+    return (channel < MUX_MAX_CHANNELS) ? this->_samples[channel] : 0;
+}
+
+byte DFRobot_AnalogMux::channels()
+{
+    return this->_channels;
+}
@@ -0,0 +1,139 @@
+/*!
+ * @file DFRobot_AnalogMux.h
+ * @brief Define the basic structure of class DFRobot_AnalogMux
+ * @details Reads up to 16 analog probes through one CD4051 (8 channels) or CD74HC4067 (16 channels) multiplexer.
+ * @n The next channel is selected while the ADC is still converting the current one, so the mux settling time
+ * @n overlaps the conversion. A channel is only converted after its settle time has passed since it was selected,
+ * @n otherwise the previous reading of that channel is held.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _DFROBOT_ANALOGMUX_H_
+#define _DFROBOT_ANALOGMUX_H_
+
+#include "Arduino.h"
+
+#define MUX_MAX_CHANNELS     16
+#define MUX_DEFAULT_SETTLE   100   ///<default settle time of a channel after it was selected (us)
+#define MUX_NO_PIN           0xFF
+
+class DFRobot_PH;
+class DFRobot_EC10;
+
+class DFRobot_AnalogMux
+{
+public:
+
+  /*!
+   * @fn DFRobot_AnalogMux
+   * @brief Constructor
+   * @param analogPin  Analog pin connected to the common output (Z / SIG) of the multiplexer
+   * @param s0 s1 s2  Channel select pins
+   * @param s3  Fourth select pin of a CD74HC4067, MUX_NO_PIN for a CD4051
+   */
+  DFRobot_AnalogMux(byte analogPin, byte s0, byte s1, byte s2, byte s3 = MUX_NO_PIN);
+
+  /*!
+   * @fn begin
+   * @brief Init the select pins and the ADC, selects channel 0
+   */
+  void begin();
+
+  /*!
+   * @fn setReference
+   * @brief Set the ADC reference voltage used to convert raw readings to millivolts
+   * @param millivolts  Reference voltage, 5000 on a 5V Uno
+   */
+  void setReference(float millivolts);
+
+  /*!
+   * @fn setSettleTime
+   * @brief Set how long a channel must be selected before its reading is trusted
+   * @param channel  Mux channel
+   * @param micros  Settle time (us), raise it for high impedance or long cabled probes
+   */
+  void setSettleTime(byte channel, unsigned int micros);
+
+  /*!
+   * @fn attach
+   * @brief Convert the readings of a channel with a pH probe instance
+   * @param channel  Mux channel
+   * @param ph  Probe instance, begin() must already have been called
+   */
+  void attach(byte channel, DFRobot_PH* ph);
+
+  /*!
+   * @fn attach
+   * @brief Convert the readings of a channel with an EC probe instance
+   * @param channel  Mux channel
+   * @param ec  Probe instance, begin() must already have been called
+   */
+  void attach(byte channel, DFRobot_EC10* ec);
+
+  /*!
+   * @fn setTemperature
+   * @brief Set the solution temperature used for the conversion of all attached probes
+   */
+  void setTemperature(float temperature);
+
+  /*!
+   * @fn update
+   * @brief Convert the currently selected channel if it has settled and select the next one. Call it from loop()
+   * @n as often as possible, one call takes at most one ADC conversion.
+   * @return true when the last channel of a scan was converted
+   */
+  bool update();
+
+  /*!
+   * @fn voltage
+   * @brief Get the last settled voltage (mV) of a channel
+   */
+  float voltage(byte channel);
+
+  /*!
+   * @fn value
+   * @brief Get the last pH or EC value of a channel with an attached probe
+   */
+  float value(byte channel);
+
+  /*!
+   * @fn sampleCount
+   * @brief Get the number of settled readings of a channel since begin(), wraps around at 65535
+   */
+  unsigned int sampleCount(byte channel);
+
+  /*!
+   * @fn channels
+   * @brief Get the number of mux channels, 8 or 16
+   */
+  byte channels();
+
+private:
+  byte  _analogPin;
+  byte  _selectPins[4];
+  byte  _channels;
+  byte  _current;                 ///<channel selected on the mux right now
+  unsigned long _selectedAt;      ///<micros() when _current was selected
+  float _reference;
+  float _temperature;
+
+  unsigned int _settle[MUX_MAX_CHANNELS];
+  float _voltage[MUX_MAX_CHANNELS];
+  float _value[MUX_MAX_CHANNELS];
+  unsigned int _samples[MUX_MAX_CHANNELS];
+  void* _probe[MUX_MAX_CHANNELS];
+  byte  _probeType[MUX_MAX_CHANNELS];
+
+#if defined(__AVR__)
+  byte _admux;
+#if defined(ADCSRB) && defined(MUX5)
+  byte _adcsrb;
+#endif
+#endif
+
+private:
+  void select(byte channel);
+  int  convert(byte next);
+};
+
+#endif
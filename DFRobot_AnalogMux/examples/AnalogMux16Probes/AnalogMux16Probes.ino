@@ -0,0 +1,69 @@
+/*!
+ * @file AnalogMux16Probes.ino
+ * @brief Reads 8 pH probes (SEN0161-V2) and 8 EC probes (DFR0300-H) on one Uno through a CD74HC4067.
+ * @n Wiring: SIG -> A0, S0..S3 -> D4..D7, EN -> GND. Channels 0-7: pH boards, channels 8-15: EC boards.
+ * @n Every probe keeps its own calibration record in EEPROM (layout in the README). Calibrate them with the rig
+ * @n examples of DFRobot_PH and DFRobot_EC10, 6 probes per run: as they are, the rigs write pH probes 0-5
+ * @n (0x00-0x2F) and EC probes 0-5 (0x40-0x57). For pH probes 6 and 7 construct the pH rig's first two
+ * @n channels with 0x30 and 0x38, for EC probes 6 and 7 the EC rig's with 0x58 and 0x5C.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+
+#include "DFRobot_AnalogMux.h"
+#include "DFRobot_PH.h"
+#include "DFRobot_EC10.h"
+#include <EEPROM.h>
+
+#define MUX_SIG A0
+#define PH_PROBES 8
+#define EC_PROBES 8
+
+DFRobot_AnalogMux mux(MUX_SIG, 4, 5, 6, 7);
+DFRobot_PH ph[PH_PROBES] = {
+    DFRobot_PH(0x00), DFRobot_PH(0x08), DFRobot_PH(0x10), DFRobot_PH(0x18),
+    DFRobot_PH(0x20), DFRobot_PH(0x28), DFRobot_PH(0x30), DFRobot_PH(0x38)
+};
+DFRobot_EC10 ec[EC_PROBES] = {
+    DFRobot_EC10(0x40), DFRobot_EC10(0x44), DFRobot_EC10(0x48), DFRobot_EC10(0x4C),
+    DFRobot_EC10(0x50), DFRobot_EC10(0x54), DFRobot_EC10(0x58), DFRobot_EC10(0x5C)
+};
+float temperature = 25;
+
+void setup()
+{
+    Serial.begin(115200);
+    for(byte i = 0; i < PH_PROBES; i++){
+        ph[i].begin();
+        mux.attach(i, &ph[i]);
+    }
+    for(byte i = 0; i < EC_PROBES; i++){
+        ec[i].begin();
+        mux.attach(PH_PROBES+i, &ec[i]);
+        mux.setSettleTime(PH_PROBES+i, 200);        // the EC boards have a higher output impedance
+    }
+    mux.begin();
+}
+
+void loop()
+{
+    static unsigned long timepoint = millis();
+    mux.update();                                     // converts one settled channel per call
+    if(millis()-timepoint>1000U){                     //time interval: 1s
+        timepoint = millis();
+        //temperature = readTemperature();            // read your temperature sensor to execute temperature compensation
+        mux.setTemperature(temperature);
+        for(byte ch = 0; ch < mux.channels(); ch++){
+            Serial.print("ch:");
+            Serial.print(ch);
+            Serial.print(ch < PH_PROBES ? "  pH:" : "  EC:");
+            Serial.print(mux.value(ch),2);
+            Serial.println(ch < PH_PROBES ? "" : "ms/cm");
+        }
+    }
+}
+
+float readTemperature()
+{
+  //add your code here to get the temperature from your temperature sensor
+}
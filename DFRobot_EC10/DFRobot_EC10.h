@@ -0,0 +1,151 @@
+/*!
+ * @file DFRobot_EC10.h
+ * @brief Define the basic structure of class DFRobot_EC10 
+ * @details This library is used to drive the analog electrical conductivity meter to measure solution EC. 
+ * @copyright   Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @License     The MIT License (MIT)
+ * @author [fengli](li.feng@dfrobot.com)
+ * @version  V1.0
+ * @date  2022-5-5
+ * @https://github.com/DFRobot/DFRobot_EC10
+ */
+#ifndef _DFROBOT_EC10_H_
+#define _DFROBOT_EC10_H_
+
+
+
+#include "Arduino.h"
+//#define ENABLE_DBG
+
+#ifdef ENABLE_DBG
+#define DBG(...) {Serial.print("["); Serial.print(__FUNCTION__); Serial.print("(): "); Serial.print(__LINE__); Serial.print(" ] "); Serial.println(__VA_ARGS__);}
+#else
+#define DBG(...)
+#endif
+
+
+
+#define ReceivedBufferLength 10  ///<length of the Serial CMD buffer
+
+#define EC_RIG_STABLE_MV      6.0   ///<default max voltage wander (mV) still counted as a settled reading, ~1 LSB on a 10 bit ADC
+#define EC_RIG_STABLE_SAMPLES 15    ///<default consecutive settled readings required before the K value is stored
+
+#define EC_RIG_NO_BUFFER    0  ///<reading is not in the 12.88ms/cm buffer solution window
+#define EC_RIG_SETTLING     1  ///<buffer solution recognized, waiting for the reading to settle
+#define EC_RIG_SAVED        2  ///<K value stored to EEPROM
+#define EC_RIG_FAILED       3  ///<settled, but the K value is out of range
+#define EC_RIG_HOLD         4  ///<result already reported, waiting for the probe to be moved
+
+class DFRobot_EC10
+{
+public:
+
+  /*!
+   * @fn DFRobot_EC10
+   * @brief Constructor 
+   */
+  DFRobot_EC10();
+
+  /*!
+   * @fn DFRobot_EC10
+   * @brief Constructor for setups with several EC probes on one board
+   * @param eepromAddress  Start address of the 4 bytes K value of this probe
+   */
+  DFRobot_EC10(int eepromAddress);
+  
+  /*!
+   * @fn ~DFRobot_EC10
+   * @brief destructor 
+   */
+  ~DFRobot_EC10();
+
+  /*!
+   * @fn begin
+   * @brief Init sensor 
+   */
+  void begin();
+  
+  /*!
+   * @fn calibration
+   * @brief Calibrate sensor. If the probe is used for the first time or has not been used for a long time, please calibrate it to improve accuracy. 
+   * @param voltage  The voltage obtained when measuring standard buffer solution(12.88ms/cm)
+   * @param temperature The calibration solution temperature 
+   * @param cmd  Calibration command 
+   */
+  void calibration(float voltage, float temperature,char* cmd);
+  
+  /*!
+   * @fn calibration
+   * @brief Calibrate sensor. If the probe is used for the first time or hasn't been used for a long time, please calibrate it to improve accuracy. 
+   * @param voltage The voltage obtained when measuring standard buffer solution(12.88ms/cm)
+   * @param temperature  The calibration solution temperature 
+   */
+  void calibration(float voltage, float temperature);   
+
+  /*!
+   * @fn readEC
+   * @brief Get solution electrical conducitivity 
+   * @param voltage  Measured analog voltage
+   * @param temperature  Temeprature of the solution to be measured
+   */
+  float readEC(float voltage, float temperature); 
+
+  /*!
+   * @fn rigCalibration
+   * @brief Unattended calibration step for a calibration rig, call it with every new reading.
+   * @n The 12.88ms/cm buffer solution is recognized automatically, the voltage is averaged once it stays
+   * @n within the setRigStability() limits and the resulting K value is written to EEPROM.
+   * @param voltage  Measured analog voltage
+   * @param temperature  The calibration solution temperature
+   * @return EC_RIG_NO_BUFFER, EC_RIG_SETTLING, EC_RIG_SAVED, EC_RIG_FAILED or EC_RIG_HOLD
+   */
+  byte rigCalibration(float voltage, float temperature);
+
+  /*!
+   * @fn setRigStability
+   * @brief Set when rigCalibration() counts a reading as settled, EC_RIG_STABLE_MV and EC_RIG_STABLE_SAMPLES by default
+   * @param millivolts  Max voltage wander (mV) still counted as a settled reading
+   * @param samples  Consecutive settled readings required before the K value is stored
+   */
+  void setRigStability(float millivolts, byte samples);
+
+  /*!
+   * @fn rigReset
+   * @brief Forget the rig calibration progress, e.g. when a new probe is plugged into the channel
+   */
+  void rigReset();
+
+  /*!
+   * @fn kvalue
+   * @brief Get the K value in use
+   */
+  float kvalue();
+
+
+private:
+    float _ecvalue;
+    float _ecvalueRaw;
+    float _kvalue;
+    float _voltage;
+    float _temperature;
+    int   _eepromAddress;
+
+    float _rigRefVoltage;   ///<first reading of the current settling run
+    float _rigSum;          ///<sum of the readings of the current settling run
+    byte  _rigCount;
+    byte  _rigState;        ///<last result reported by rigCalibration()
+    float _rigStableMv;
+    byte  _rigStableSamples;
+
+    char _cmdReceivedBuffer[ReceivedBufferLength]; 
+    byte _cmdReceivedBufferIndex;
+
+private:
+    boolean cmdSerialDataAvailable();
+    void ecCalibration(byte mode); 
+    byte    cmdParse(const char* cmd);
+    byte    cmdParse();
+	char* strupr(char* str);
+};
+
+#endif
@@ -0,0 +1,116 @@
+/*!
+ * @file EC10Rig.ino
+ * @brief Calibration rig for Gravity: Analog Electrical Conductivity Sensor / Meter Kit(K=10), SKU: DFR0300-H.
+ * @n Calibrates up to 6 EC probes at once without any serial commands: put all probes into the 12.88ms/cm
+ * @n buffer solution and wait until every channel reports SAVED or FAILED.
+ * @n Each probe keeps its own K value in EEPROM (4 bytes per channel, from 0x40 so the pH rig's records at
+ * @n 0x00-0x2F stay intact; see the EEPROM layout in DFRobot_AnalogMux/README.md).
+ * @n In order to guarantee precision, a temperature sensor such as DS18B20 is needed in the buffer solution bath.
+ * @n Every state change is reported as one machine readable line:
+ * @n  RIG,<channel>,EC,<event>,<kvalue>
+ * @n  event: BUFFER (buffer recognized, settling), SAVED, FAILED, REMOVED
+ * @n Send "RIGSTATUS" to print the current K value of every channel.
+ * @copyright Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @License The MIT License (MIT)
+ * @ version V1.0
+ * @https://github.com/DFRobot/DFRobot_EC10
+ */
+
+#include "DFRobot_EC10.h"
+#include <EEPROM.h>
+
+#define RIG_CHANNELS 6
+#define RIG_INTERVAL 200U  //sample interval of every channel (ms)
+
+const byte rigPins[RIG_CHANNELS] = {A0, A1, A2, A3, A4, A5};
+DFRobot_EC10 ec[RIG_CHANNELS] = {
+    DFRobot_EC10(0x40), DFRobot_EC10(0x44), DFRobot_EC10(0x48),
+    DFRobot_EC10(0x4C), DFRobot_EC10(0x50), DFRobot_EC10(0x54)
+};
+byte  rigState[RIG_CHANNELS];
+float temperature = 25;
+
+void setup()
+{
+  Serial.begin(115200);
+  for(byte ch = 0; ch < RIG_CHANNELS; ch++)
+  {
+    ec[ch].begin();
+    rigState[ch] = EC_RIG_NO_BUFFER;
+  }
+  Serial.println(F(">>>Calibration Rig Ready, put the probes into the 12.88ms/cm buffer solution<<<"));
+}
+
+void loop()
+{
+    char cmd[10];
+    static unsigned long timepoint = millis();
+    if(millis()-timepoint>RIG_INTERVAL)
+    {
+      timepoint = millis();
+      //temperature = readTemperature();  // read the temperature of the buffer solution bath
+      for(byte ch = 0; ch < RIG_CHANNELS; ch++)
+      {
+        float voltage = analogRead(rigPins[ch])/1024.0*5000;
+        byte state = ec[ch].rigCalibration(voltage,temperature);
+        if(state == rigState[ch] || state == EC_RIG_HOLD)
+        {
+          rigState[ch] = state;
+          continue;
+        }
+        rigState[ch] = state;
+        if(state == EC_RIG_NO_BUFFER)
+          report(ch, "REMOVED");
+        else if(state == EC_RIG_SETTLING)
+          report(ch, "BUFFER");
+        else if(state == EC_RIG_SAVED)
+          report(ch, "SAVED");
+        else if(state == EC_RIG_FAILED)
+          report(ch, "FAILED");
+      }
+    }
+    if(readSerial(cmd))
+    {
+      if(strstr(cmd,"RIGSTATUS") || strstr(cmd,"rigstatus"))
+      {
+        for(byte ch = 0; ch < RIG_CHANNELS; ch++)
+          report(ch, "STATUS");
+      }
+    }
+}
+
+void report(byte ch, const char* event)
+{
+    Serial.print(F("RIG,"));
+    Serial.print(ch);
+    Serial.print(F(",EC,"));
+    Serial.print(event);
+    Serial.print(',');
+    Serial.println(ec[ch].kvalue(),3);
+}
+
+int i = 0;
+bool readSerial(char result[])
+{
+    while(Serial.available() > 0)
+    {
+      char inChar = Serial.read();
+      if(inChar == '\n' || i == 9)
+      {
+        result[i] = '\0';
+        i = 0;
+        return true;
+      }
+      if(inChar != '\r')
+      {
+        result[i] = inChar;
+        i++;
+      }
+    }
+    return false;
+}
+
+float readTemperature()
+{
+  //add your code here to get the temperature from your temperature sensor
+}
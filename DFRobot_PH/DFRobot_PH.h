@@ -0,0 +1,126 @@
+/*!
+ * @file DFRobot_PH.h
+ * @brief Arduino library for Gravity: Analog pH Sensor / Meter Kit V2, SKU: SEN0161-V2
+ *
+ * @copyright   Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Jiawei Zhang](jiawei.zhang@dfrobot.com)
+ * @version  V1.0
+ * @date  2018-11-06
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+
+#ifndef _DFROBOT_PH_H_
+#define _DFROBOT_PH_H_
+
+#if ARDUINO >= 100
+#include "Arduino.h"
+#else
+#include "WProgram.h"
+#endif
+
+#define ReceivedBufferLength 10  //length of the Serial CMD buffer
+
+#define PH_RIG_STABLE_MV      6.0   //default max voltage wander (mV) still counted as a settled reading, ~1 LSB on a 10 bit ADC
+#define PH_RIG_STABLE_SAMPLES 15    //default consecutive settled readings required before a buffer voltage is stored
+
+#define PH_RIG_NO_BUFFER    0  //voltage is outside both buffer solution windows
+#define PH_RIG_SETTLING     1  //buffer solution recognized, waiting for the reading to settle
+#define PH_RIG_SAVED_7      2  //neutral (7.0) voltage stored to EEPROM
+#define PH_RIG_SAVED_4      3  //acid (4.0) voltage stored to EEPROM
+#define PH_RIG_HOLD         4  //buffer already stored, waiting for the probe to be moved
+
+class DFRobot_PH
+{
+public:
+  DFRobot_PH();
+  /**
+   * @fn DFRobot_PH
+   * @brief Constructor for setups with several pH probes on one board
+   *
+   * @param eepromAddress : start address of the 8 bytes of calibration data of this probe
+   */
+  DFRobot_PH(int eepromAddress);
+  ~DFRobot_PH();
+  /**
+   * @fn calibration
+   * @brief Calibrate the calibration data
+   *
+   * @param voltage     : Voltage value
+   * @param temperature : Ambient temperature
+   * @param cmd         : enterph -> enter the PH calibration mode
+   * @n                   calph   -> calibrate with the standard buffer solution, two buffer solutions(4.0 and 7.0) will be automaticlly recognized
+   * @n                   exitph  -> save the calibrated parameters and exit from PH calibration mode
+   */
+  void    calibration(float voltage, float temperature,char* cmd);  //calibration by Serial CMD
+  void    calibration(float voltage, float temperature);
+  /**
+   * @fn readPH
+   * @brief Convert voltage to PH with temperature compensation
+   * @note voltage to pH value, with temperature compensation
+   *
+   * @param voltage     : Voltage value
+   * @param temperature : Ambient temperature
+   * @return The PH value
+   */
+  float   readPH(float voltage, float temperature); 
+  /**
+   * @fn begin
+   * @brief Initialization The Analog pH Sensor
+   */
+  void begin();
+  /**
+   * @fn rigCalibration
+   * @brief Unattended calibration step for a calibration rig, call it with every new reading.
+   * @n     The buffer solution (4.0 or 7.0) is recognized automatically, the voltage is averaged once it
+   * @n     stays within the setRigStability() limits and then written to EEPROM.
+   *
+   * @param voltage     : Voltage value
+   * @param temperature : Ambient temperature
+   * @return PH_RIG_NO_BUFFER, PH_RIG_SETTLING, PH_RIG_SAVED_7, PH_RIG_SAVED_4 or PH_RIG_HOLD
+   */
+  byte    rigCalibration(float voltage, float temperature);
+  /**
+   * @fn setRigStability
+   * @brief Set when rigCalibration() counts a reading as settled, PH_RIG_STABLE_MV and PH_RIG_STABLE_SAMPLES by default
+   *
+   * @param millivolts : max voltage wander (mV) still counted as a settled reading
+   * @param samples    : consecutive settled readings required before a buffer voltage is stored
+   */
+  void    setRigStability(float millivolts, byte samples);
+  /**
+   * @fn rigReset
+   * @brief Forget the rig calibration progress, e.g. when a new probe is plugged into the channel
+   */
+  void    rigReset();
+  float   neutralVoltage();
+  float   acidVoltage();
+
+private:
+    float  _phValue;
+    float  _acidVoltage;
+    float  _neutralVoltage;
+    float  _voltage;
+    float  _temperature;
+    int    _eepromAddress;
+
+    float  _rigRefVoltage;   //first reading of the current settling run
+    float  _rigSum;          //sum of the readings of the current settling run
+    byte   _rigCount;
+    byte   _rigBuffer;       //buffer solution of the current settling run, 0 if none
+    byte   _rigSavedBuffer;  //buffer solution stored last, 0 if none
+    float  _rigStableMv;
+    byte   _rigStableSamples;
+
+    char   _cmdReceivedBuffer[ReceivedBufferLength];  //store the Serial CMD
+    byte   _cmdReceivedBufferIndex;
+
+private:
+    boolean cmdSerialDataAvailable();
+    void    phCalibration(byte mode); // calibration process, wirte key parameters to EEPROM
+    byte    cmdParse(const char* cmd);
+    byte    cmdParse();
+    byte    bufferSolution(float voltage);
+};
+
+#endif
@@ -0,0 +1,128 @@
+/*!
+ * @file DFRobot_PH_Rig.ino
+ * @brief Calibration rig for Gravity: Analog pH Sensor / Meter Kit V2, SKU:SEN0161-V2.
+ * @n Calibrates up to 6 pH probes at once without any serial commands:
+ * @n  1. put all probes into the 7.0 buffer solution, wait until every channel reports SAVED7
+ * @n  2. rinse, put all probes into the 4.0 buffer solution, wait until every channel reports DONE
+ * @n Each probe keeps its own calibration record in EEPROM (8 bytes per channel from 0x00, see the EEPROM
+ * @n layout in DFRobot_AnalogMux/README.md).
+ * @n Every state change is reported as one machine readable line:
+ * @n  RIG,<channel>,PH,<event>,<neutralVoltage>,<acidVoltage>
+ * @n  event: BUFFER7 / BUFFER4 (buffer recognized, settling), SAVED7 / SAVED4, DONE, REMOVED
+ * @n Send "RIGSTATUS" to print the current record of every channel.
+ *
+ * @copyright   Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+
+#include "DFRobot_PH.h"
+#include <EEPROM.h>
+
+#define RIG_CHANNELS 6
+#define RIG_INTERVAL 200U                              //sample interval of every channel (ms)
+
+const byte rigPins[RIG_CHANNELS] = {A0, A1, A2, A3, A4, A5};
+DFRobot_PH ph[RIG_CHANNELS] = {
+    DFRobot_PH(0x00), DFRobot_PH(0x08), DFRobot_PH(0x10),
+    DFRobot_PH(0x18), DFRobot_PH(0x20), DFRobot_PH(0x28)
+};
+byte  rigState[RIG_CHANNELS];
+byte  rigSaved[RIG_CHANNELS];                          //bit 0: 7.0 stored, bit 1: 4.0 stored
+float temperature = 25;
+
+void setup()
+{
+    Serial.begin(115200);
+    for(byte ch = 0; ch < RIG_CHANNELS; ch++){
+        ph[ch].begin();
+        rigState[ch] = PH_RIG_NO_BUFFER;
+        rigSaved[ch] = 0;
+    }
+    Serial.println(F(">>>Calibration Rig Ready, put the probes into the 7.0 or 4.0 buffer solution<<<"));
+}
+
+void loop()
+{
+    char cmd[10];
+    static unsigned long timepoint = millis();
+    if(millis()-timepoint>RIG_INTERVAL){
+        timepoint = millis();
+        //temperature = readTemperature();             // read the temperature of the buffer solution bath
+        for(byte ch = 0; ch < RIG_CHANNELS; ch++){
+            float voltage = analogRead(rigPins[ch])/1024.0*5000;
+            byte  state   = ph[ch].rigCalibration(voltage,temperature);
+            if(state == rigState[ch] || state == PH_RIG_HOLD){
+                rigState[ch] = state;
+                continue;
+            }
+            rigState[ch] = state;
+            switch(state){
+                case PH_RIG_NO_BUFFER:
+                report(ch, "REMOVED");
+                break;
+
+                case PH_RIG_SETTLING:
+                report(ch, voltage < 1700 ? "BUFFER7" : "BUFFER4");
+                break;
+
+                case PH_RIG_SAVED_7:
+                rigSaved[ch] |= 0x01;
+                report(ch, "SAVED7");
+                break;
+
+                case PH_RIG_SAVED_4:
+                rigSaved[ch] |= 0x02;
+                report(ch, "SAVED4");
+                break;
+            }
+            if(rigSaved[ch] == 0x03){
+                rigSaved[ch] = 0;
+                report(ch, "DONE");
+            }
+        }
+    }
+    if(readSerial(cmd)){
+        strupr(cmd);
+        if(strstr(cmd,"RIGSTATUS")){
+            for(byte ch = 0; ch < RIG_CHANNELS; ch++){
+                report(ch, "STATUS");
+            }
+        }
+    }
+}
+
+void report(byte ch, const char* event)
+{
+    Serial.print(F("RIG,"));
+    Serial.print(ch);
+    Serial.print(F(",PH,"));
+    Serial.print(event);
+    Serial.print(',');
+    Serial.print(ph[ch].neutralVoltage(),2);
+    Serial.print(',');
+    Serial.println(ph[ch].acidVoltage(),2);
+}
+
+int i = 0;
+bool readSerial(char result[]){
+    while(Serial.available() > 0){
+        char inChar = Serial.read();
+        if(inChar == '\n' || i == 9){
+             result[i] = '\0';
+             i=0;
+             return true;
+        }
+        if(inChar != '\r'){
+             result[i] = inChar;
+             i++;
+        }
+    }
+    return false;
+}
+
+float readTemperature()
+{
+  //add your code here to get the temperature from your temperature sensor
+}
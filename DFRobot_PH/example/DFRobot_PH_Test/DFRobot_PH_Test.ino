@@ -0,0 +1,55 @@
+/*!
+ * @file DFRobot_PH_Test.h
+ * @brief This is the sample code for Gravity: Analog pH Sensor / Meter Kit V2, SKU:SEN0161-V2.
+ * @n In order to guarantee precision, a temperature sensor such as DS18B20 is needed, to execute automatic temperature compensation.
+ * @n You can send commands in the serial monitor to execute the calibration.
+ * @n Serial Commands:
+ * @n    enterph -> enter the calibration mode
+ * @n    calph   -> calibrate with the standard buffer solution, two buffer solutions(4.0 and 7.0) will be automaticlly recognized
+ * @n    exitph  -> save the calibrated parameters and exit from calibration mode
+ *
+ * @copyright   Copyright (c) 2010 DFRobot Co.Ltd (http://www.dfrobot.com)
+ * @license     The MIT License (MIT)
+ * @author [Jiawei Zhang](jiawei.zhang@dfrobot.com)
+ * @version  V1.0
+ * @date  2018-11-06
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+
+#include "DFRobot_PH.h"
+#include "DFRobot_LineWriter.h"
+#include <EEPROM.h>
+
+#define PH_PIN A1
+float voltage,phValue,temperature = 25;
+DFRobot_PH ph;
+DFRobot_LineWriter out(Serial);                    // composes the reading line and sends it without blocking
+
+void setup()
+{
+    Serial.begin(115200);  
+    ph.begin();
+}
+
+void loop()
+{
+    static unsigned long timepoint = millis();
+    if(millis()-timepoint>1000U){                  //time interval: 1s
+        timepoint = millis();
+        //temperature = readTemperature();         // read your temperature sensor to execute temperature compensation
+        voltage = analogRead(PH_PIN)/1024.0*5000;  // read the voltage
+        phValue = ph.readPH(voltage,temperature);  // convert voltage to pH with temperature compensation
+        out.print("temperature:");
+        out.print(temperature,1);
+        out.print("^C  pH:");
+        out.print(phValue,2);
+        out.println();
+    }
+    out.update();                                  // push the rest of the line as the TX buffer drains
+    ph.calibration(voltage,temperature);           // calibration process by Serail CMD
+}
+
+float readTemperature()
+{
+  //add your code here to get the temperature from your temperature sensor
+}
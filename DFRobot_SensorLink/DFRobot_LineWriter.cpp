@@ -0,0 +1,209 @@
+/*!
+ * @file DFRobot_LineWriter.cpp
+ * @brief Define the basic structure of class DFRobot_LineWriter
+ * @details Composes a whole text reading line in a RAM buffer and pushes it to the serial port without blocking.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+#include "DFRobot_LineWriter.h"
+
+static const unsigned long powersOf10[7] = {1, 10, 100, 1000, 10000, 100000, 1000000};
+
+DFRobot_LineWriter::DFRobot_LineWriter(Print& out)
+{
+    this->_out = &out;
+    this->_head = 0;
+    this->_count = 0;
+    this->_line = 0;
+    this->_lineDropped = false;
+    this->_reportsRoom = false;
+    this->_dropped = 0;
+}
+
+byte DFRobot_LineWriter::formatUnsigned(char* buf, unsigned long value)
+{
+    char digits[10];
+    byte n = 0;
+    while(value > 0xFFFF)                     //32 bit divisions only while needed, they are slow on AVR
+    {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    }
+    unsigned int small = value;
+    do
+    {
+        digits[n++] = '0' + small % 10;
+        small /= 10;
+    }while(small);
+    for(byte i = 0; i < n; i++)
+        buf[i] = digits[n-1-i];
+    return n;
+}
+
+byte DFRobot_LineWriter::formatLong(char* buf, long value)
+{
+    if(value < 0)
+    {
+        buf[0] = '-';
+        return 1 + formatUnsigned(buf+1, -(unsigned long)value);
+    }
+    return formatUnsigned(buf, value);
+}
+
+byte DFRobot_LineWriter::formatFloat(char* buf, float value, byte decimals)
+{
+    //same special cases as Print::printFloat()
+    if(isnan(value)) { memcpy(buf, "nan", 3); return 3; }
+    if(isinf(value)) { memcpy(buf, "inf", 3); return 3; }
+    if(value > 4294967040.0 || value < -4294967040.0) { memcpy(buf, "ovf", 3); return 3; }
+    if(decimals > 6)
+        decimals = 6;
+
+    byte n = 0;
+    if(value < 0.0)
+    {
+        buf[n++] = '-';
+        value = -value;
+    }
+    unsigned long integer = (unsigned long)value;
+    unsigned long fraction = (unsigned long)((value - integer)*powersOf10[decimals] + 0.5);
+    if(fraction >= powersOf10[decimals])           //rounding carried into the integer part
+    {
+        integer++;
+        fraction -= powersOf10[decimals];
+    }
+    n += formatUnsigned(buf+n, integer);
+    if(decimals)
+    {
+        buf[n++] = '.';
+        for(byte i = decimals; i > 0; i--)
+        {
+            buf[n+i-1] = '0' + fraction % 10;
+            fraction /= 10;
+        }
+        n += decimals;
+    }
+    return n;
+}
+
+void DFRobot_LineWriter::queue(const char* data, byte length)
+{
+    if(this->_lineDropped)
+        return;
+    if(length > LINEWRITER_BUFFER_SIZE - this->_count - this->_line)
+    {
+        this->_lineDropped = true;           //never block the sketch, drop the whole line rather than its end
+        return;
+    }
+    for(byte i = 0; i < length; i++)
+    {
+        unsigned int tail = (unsigned int)this->_head + this->_count + this->_line;
+        if(tail >= LINEWRITER_BUFFER_SIZE)
+            tail -= LINEWRITER_BUFFER_SIZE;
+        this->_buffer[tail] = data[i];
+        this->_line++;
+    }
+}
+
+void DFRobot_LineWriter::endLine()
+{
+    if(this->_lineDropped)
+        this->_dropped++;
+    else
+        this->_count += this->_line;
+    this->_line = 0;
+    this->_lineDropped = false;
+    update();
+}
+
+void DFRobot_LineWriter::print(const char* str)
+{
+    queue(str, strlen(str));
+}
+
+void DFRobot_LineWriter::print(char c)
+{
+    queue(&c, 1);
+}
+
+void DFRobot_LineWriter::print(long value)
+{
+    char buf[11];
+    queue(buf, formatLong(buf, value));
+}
+
+void DFRobot_LineWriter::print(int value)
+{
+    print((long)value);
+}
+
+void DFRobot_LineWriter::print(unsigned long value)
+{
+    char buf[10];
+    queue(buf, formatUnsigned(buf, value));
+}
+
+void DFRobot_LineWriter::print(unsigned int value)
+{
+    print((unsigned long)value);
+}
+
+void DFRobot_LineWriter::print(float value, byte decimals)
+{
+    char buf[16];
+    queue(buf, formatFloat(buf, value, decimals));
+}
+
+void DFRobot_LineWriter::print(double value, byte decimals)
+{
+    print((float)value, decimals);
+}
+
+void DFRobot_LineWriter::write(const uint8_t* data, byte length)
+{
+    queue((const char*)data, length);
+    endLine();
+}
+
+void DFRobot_LineWriter::println(const char* str)
+{
+    queue(str, strlen(str));
+    queue("\r\n", 2);
+    endLine();
+}
+
+int DFRobot_LineWriter::update()
+{
+    while(this->_count)
+    {
+        int room = this->_out->availableForWrite();
+        if(room > 0)
+            this->_reportsRoom = true;
+        else if(this->_reportsRoom)
+            break;
+        else
+            room = this->_count;             //never told its room (Print, SoftwareSerial): write() blocks
+        byte chunk = this->_count;
+        if(this->_head + chunk > LINEWRITER_BUFFER_SIZE)  //only up to the end of the ring in one write
+            chunk = LINEWRITER_BUFFER_SIZE - this->_head;
+        if(chunk > room)
+            chunk = room;
+        this->_out->write((const uint8_t*)this->_buffer + this->_head, chunk);
+        this->_head += chunk;
+        if(this->_head >= LINEWRITER_BUFFER_SIZE)
+            this->_head = 0;
+        this->_count -= chunk;
+    }
+    return this->_count;
+}
+
+unsigned long DFRobot_LineWriter::dropped()
+{
+    return this->_dropped;
+}
+
+byte DFRobot_LineWriter::room()
+{
+    return LINEWRITER_BUFFER_SIZE - this->_count - this->_line;
+}
@@ -0,0 +1,129 @@
+/*!
+ * @file DFRobot_LineWriter.h
+ * @brief Define the basic structure of class DFRobot_LineWriter
+ * @details Composes a whole text reading line in a RAM buffer and pushes it to the serial port without blocking.
+ * @n Floats are formatted with integer arithmetic in fixed point instead of Print::printFloat(), which needs one
+ * @n float multiply and one float subtract per digit. The value is rounded half up at the last decimal; printFloat()
+ * @n adds its rounding in float and can print a last digit one off from that, e.g. 0.125 with 2 decimals.
+ * @n A line goes out whole or not at all: what print() queues waits until println() and is dropped with the
+ * @n rest of the line if the queue can't take all of it.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+#ifndef _DFROBOT_LINEWRITER_H_
+#define _DFROBOT_LINEWRITER_H_
+
+#include "Arduino.h"
+
+#ifndef LINEWRITER_BUFFER_SIZE
+#define LINEWRITER_BUFFER_SIZE 96  ///<bytes queued for the serial port, must hold at least one whole line, at most 255
+#endif
+
+class DFRobot_LineWriter
+{
+public:
+
+  /*!
+   * @fn DFRobot_LineWriter
+   * @brief Constructor
+   * @param out  Serial port, e.g. Serial
+   */
+  DFRobot_LineWriter(Print& out);
+
+  /*!
+   * @fn print
+   * @brief Queue a string
+   */
+  void print(const char* str);
+
+  /*!
+   * @fn print
+   * @brief Queue a character
+   */
+  void print(char c);
+
+  /*!
+   * @fn print
+   * @brief Queue an integer
+   */
+  void print(long value);
+  void print(int value);
+  void print(unsigned long value);
+  void print(unsigned int value);
+
+  /*!
+   * @fn print
+   * @brief Queue a float in fixed point, rounded half up at the last decimal
+   * @param value  Value to format
+   * @param decimals  Digits after the decimal point, 0-6
+   */
+  void print(float value, byte decimals = 2);
+  void print(double value, byte decimals = 2);
+
+  /*!
+   * @fn write
+   * @brief Queue raw bytes, e.g. a binary frame, and end the line like println() without a line end
+   */
+  void write(const uint8_t* data, byte length);
+
+  /*!
+   * @fn println
+   * @brief Queue an optional string and the line end, then start pushing the line to the serial port
+   */
+  void println(const char* str = "");
+
+  /*!
+   * @fn update
+   * @brief Push as many queued bytes as the serial TX buffer takes without blocking. Call it from loop()
+   * @n A stream that never reports room in availableForWrite() (base Print, AVR SoftwareSerial) is handed
+   * @n whole lines instead, and its write() blocks until they are out
+   * @return Number of bytes still queued
+   */
+  int update();
+
+  /*!
+   * @fn dropped
+   * @brief Get the number of lines (and frames) dropped because the queue was full
+   */
+  unsigned long dropped();
+
+  /*!
+   * @fn room
+   * @brief Get the number of bytes the rest of the line can take without being dropped
+   */
+  byte room();
+
+  /*!
+   * @fn formatFloat
+   * @brief Format a float in fixed point into a buffer
+   * @param buf  Destination, at least 16 bytes
+   * @return Number of characters written, the text is not terminated
+   */
+  static byte formatFloat(char* buf, float value, byte decimals);
+
+  /*!
+   * @fn formatLong
+   * @brief Format an integer into a buffer
+   * @param buf  Destination, at least 11 bytes
+   * @return Number of characters written, the text is not terminated
+   */
+  static byte formatLong(char* buf, long value);
+
+private:
+  Print* _out;
+  char   _buffer[LINEWRITER_BUFFER_SIZE];
+  byte   _head;                  ///<next byte to send
+  byte   _count;                 ///<bytes of whole lines queued
+  byte   _line;                  ///<bytes of the line being composed, after them
+  bool   _lineDropped;           ///<the line being composed didn't fit
+  bool   _reportsRoom;           ///<availableForWrite() has been seen above 0
+  unsigned long _dropped;
+
+private:
+  void queue(const char* data, byte length);
+  void endLine();
+  static byte formatUnsigned(char* buf, unsigned long value);
+};
+
+#endif
@@ -0,0 +1,172 @@
+/*!
+ * @file DFRobot_SensorFrame.cpp
+ * @brief Define the basic structure of class DFRobot_SensorFrame
+ * @details Binary frames for readings and window statistics, as an alternative to the text reading lines.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+#include "DFRobot_SensorFrame.h"
+
+DFRobot_SensorFrame::DFRobot_SensorFrame(DFRobot_LineWriter& out)
+{
+    this->_out = &out;
+    this->_length = 0;
+    this->_sequencing = false;
+    this->_epoch = 0;
+    this->_next = 0;
+    memset(this->_pending, 0, sizeof(this->_pending));
+    this->_lost = 0;
+    this->_rxLength = 0;
+}
+
+void DFRobot_SensorFrame::sequence(byte epoch)
+{
+    this->_sequencing = true;
+    this->_epoch = epoch;
+}
+
+unsigned long DFRobot_SensorFrame::lost()
+{
+    return this->_lost;
+}
+
+uint16_t DFRobot_SensorFrame::crc16(uint16_t crc, const uint8_t* data, byte length)
+{
+    while(length--)
+    {
+        crc ^= (uint16_t)(*data++) << 8;
+        for(byte i = 0; i < 8; i++)
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+    return crc;
+}
+
+void DFRobot_SensorFrame::begin(byte type)
+{
+    this->_frame[0] = FRAME_SYNC1;
+    this->_frame[1] = FRAME_SYNC2;
+    this->_frame[2] = type;
+    this->_frame[3] = 0;
+    this->_length = 4;
+}
+
+void DFRobot_SensorFrame::put(const void* data, byte length)
+{
+    memcpy(this->_frame + this->_length, data, length);  //AVR, ESP and ARM are little endian
+    this->_length += length;
+}
+
+void DFRobot_SensorFrame::end()
+{
+    this->_frame[3] = this->_length - 4;
+    uint16_t crc = crc16(0xFFFF, this->_frame + 2, this->_length - 2);
+    this->_frame[this->_length++] = crc & 0xFF;
+    this->_frame[this->_length++] = crc >> 8;
+    this->_out->write(this->_frame, this->_length);
+}
+
+void DFRobot_SensorFrame::reading(byte channel, byte quantity, float value)
+{
+    if(!this->_sequencing){
+        begin(FRAME_TYPE_READING);
+        put(&channel, 1);
+        put(&quantity, 1);
+        put(&value, 4);
+        end();
+        return;
+    }
+    sPendingReading_t* p = &this->_pending[0];
+    for(byte i = 0; i < FRAME_RESEND_SLOTS && p->sequence; i++){
+        if(this->_pending[i].sequence == 0 || this->_pending[i].sequence < p->sequence)
+            p = &this->_pending[i];             //a free slot, else the oldest reading
+    }
+    if(p->sequence)
+        this->_lost++;
+    p->sequence = ++this->_next;
+    p->measured = millis();
+    p->channel = channel;
+    p->quantity = quantity;
+    p->value = value;
+    send(p);
+}
+
+void DFRobot_SensorFrame::send(sPendingReading_t* p)
+{
+    unsigned long now = millis();
+    uint32_t age = now - p->measured;
+    begin(FRAME_TYPE_SEQUENCED);
+    put(&this->_epoch, 1);
+    put(&p->sequence, 4);
+    put(&age, 4);
+    put(&p->channel, 1);
+    put(&p->quantity, 1);
+    put(&p->value, 4);
+    end();
+    p->sent = now;
+}
+
+void DFRobot_SensorFrame::update()
+{
+    if(!this->_sequencing || this->_out->room() < FRAME_SEQUENCED_SIZE)
+        return;
+    unsigned long now = millis();
+    sPendingReading_t* due = NULL;
+    for(byte i = 0; i < FRAME_RESEND_SLOTS; i++){
+        sPendingReading_t* p = &this->_pending[i];
+        if(p->sequence && now - p->sent >= FRAME_RESEND_MS && (due == NULL || p->sequence < due->sequence))
+            due = p;
+    }
+    if(due)
+        send(due);                              //one per call, loop() stays short
+}
+
+bool DFRobot_SensorFrame::receive(byte c)
+{
+    if(this->_rxLength == 0 && c != FRAME_SYNC1)
+        return false;
+    if(this->_rxLength == 1 && c != FRAME_SYNC2){
+        this->_rxLength = 0;
+        return receive(c);
+    }
+    this->_rx[this->_rxLength++] = c;
+    if(this->_rxLength == 4 && (this->_rx[2] != FRAME_TYPE_ACK || this->_rx[3] != FRAME_ACK_SIZE - 6)){
+        this->_rxLength = 0;                    //not a frame for the board
+    }else if(this->_rxLength == FRAME_ACK_SIZE){
+        this->_rxLength = 0;
+        uint16_t crc = crc16(0xFFFF, this->_rx + 2, FRAME_ACK_SIZE - 4);
+        if((this->_rx[FRAME_ACK_SIZE-2] | (this->_rx[FRAME_ACK_SIZE-1] << 8)) == crc)
+            acknowledge();
+    }
+    return true;
+}
+
+void DFRobot_SensorFrame::acknowledge()
+{
+    uint32_t first, mask;
+    if(this->_rx[4] != this->_epoch)
+        return;                                 //for the readings of an earlier boot
+    memcpy(&first, this->_rx + 5, 4);
+    memcpy(&mask, this->_rx + 9, 4);
+    for(byte i = 0; i < FRAME_RESEND_SLOTS; i++){
+        uint32_t offset = this->_pending[i].sequence - first;
+        if(this->_pending[i].sequence && offset < 32 && (mask >> offset & 1))
+            this->_pending[i].sequence = 0;
+    }
+}
+
+void DFRobot_SensorFrame::stats(byte channel, byte quantity, byte window, const sStatsAccumulator_t* acc)
+{
+    uint32_t count = acc->count;
+    float stddev = DFRobot_SensorStats::stddev(acc);
+    begin(FRAME_TYPE_STATS);
+    put(&channel, 1);
+    put(&quantity, 1);
+    put(&window, 1);
+    put(&count, 4);
+    put(&acc->mean, 4);
+    put(&stddev, 4);
+    put(&acc->min, 4);
+    put(&acc->max, 4);
+    end();
+}
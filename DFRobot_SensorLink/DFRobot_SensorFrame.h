@@ -0,0 +1,138 @@
+/*!
+ * @file DFRobot_SensorFrame.h
+ * @brief Define the basic structure of class DFRobot_SensorFrame
+ * @details Binary frames for readings and window statistics, as an alternative to the text reading lines.
+ * @n Frame layout, multi byte fields little endian, floats IEEE 754 single precision:
+ * @n   0xA5 0x5A | type (1) | payload length (1) | payload | CRC-16/CCITT-FALSE of type, length and payload (2)
+ * @n   FRAME_TYPE_READING payload: channel (1) | quantity (1) | value (float)
+ * @n   FRAME_TYPE_STATS   payload: channel (1) | quantity (1) | window (1) | count (uint32) | mean | stddev | min | max (float)
+ * @n   FRAME_TYPE_SEQUENCED payload: epoch (1) | sequence (uint32) | age ms (uint32) | channel (1) | quantity (1) | value (float)
+ * @n   FRAME_TYPE_ACK (gateway to board) payload: epoch (1) | first sequence (uint32) | mask (uint32, bit i: first + i)
+ * @n After sequence() readings are numbered within the boot epoch and kept in RAM until the gateway acknowledges
+ * @n them; update() sends them again every FRAME_RESEND_MS until then, the gateway drops the copies it already has.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+#ifndef _DFROBOT_SENSORFRAME_H_
+#define _DFROBOT_SENSORFRAME_H_
+
+#include "Arduino.h"
+#include "DFRobot_LineWriter.h"
+#include "DFRobot_SensorStats.h"
+
+#define FRAME_SYNC1            0xA5
+#define FRAME_SYNC2            0x5A
+#define FRAME_MAX_PAYLOAD      32
+
+#define FRAME_TYPE_READING     0x01
+#define FRAME_TYPE_STATS       0x02
+#define FRAME_TYPE_SEQUENCED   0x03
+#define FRAME_TYPE_ACK         0x04
+
+#ifndef FRAME_RESEND_SLOTS
+#define FRAME_RESEND_SLOTS     16     ///<readings kept until acknowledged, 18 bytes of RAM each
+#endif
+#define FRAME_RESEND_MS        3000   ///<a reading not acknowledged within this time is sent again
+#define FRAME_SEQUENCED_SIZE   21
+#define FRAME_ACK_SIZE         15
+
+#define QUANTITY_PH            1   ///<pH
+#define QUANTITY_EC            2   ///<ms/cm
+#define QUANTITY_TEMPERATURE   3   ///<^C
+#define QUANTITY_VOLTAGE       4   ///<mV
+
+typedef struct {
+  uint32_t sequence;         ///<0: free
+  unsigned long measured;    ///<millis()
+  unsigned long sent;        ///<millis() of the last send
+  byte channel;
+  byte quantity;
+  float value;
+} sPendingReading_t;
+
+class DFRobot_SensorFrame
+{
+public:
+
+  /*!
+   * @fn DFRobot_SensorFrame
+   * @brief Constructor
+   * @param out  Line writer the frames are queued on, text lines and frames can share it
+   */
+  DFRobot_SensorFrame(DFRobot_LineWriter& out);
+
+  /*!
+   * @fn sequence
+   * @brief Number the readings from now on and keep each one until the gateway acknowledges it
+   * @param epoch  Boot counter, e.g. kept in EEPROM, so the gateway tells a reboot from a resend
+   */
+  void sequence(byte epoch);
+
+  /*!
+   * @fn reading
+   * @brief Send one reading, as a FRAME_TYPE_SEQUENCED frame after sequence()
+   * @n If all FRAME_RESEND_SLOTS are waiting for an acknowledgement the oldest reading is given up
+   * @param channel  Probe channel on this board
+   * @param quantity  QUANTITY_PH, QUANTITY_EC, QUANTITY_TEMPERATURE or QUANTITY_VOLTAGE
+   * @param value  Reading
+   */
+  void reading(byte channel, byte quantity, float value);
+
+  /*!
+   * @fn update
+   * @brief Send the oldest reading not acknowledged within FRAME_RESEND_MS again, if the line writer has room for
+   * @n it. Call it from loop()
+   */
+  void update();
+
+  /*!
+   * @fn receive
+   * @brief Feed a byte read from the serial port
+   * @return true if it belongs to a frame from the gateway, false if it is text for the sketch
+   */
+  bool receive(byte c);
+
+  /*!
+   * @fn lost
+   * @brief Get the number of readings given up before they were acknowledged
+   */
+  unsigned long lost();
+
+  /*!
+   * @fn stats
+   * @brief Send the statistics of one window
+   * @param channel  Probe channel on this board
+   * @param quantity  QUANTITY_*
+   * @param window  STATS_WINDOW_1MIN, STATS_WINDOW_10MIN or STATS_WINDOW_1H
+   * @param acc  Window statistics from DFRobot_SensorStats
+   */
+  void stats(byte channel, byte quantity, byte window, const sStatsAccumulator_t* acc);
+
+  /*!
+   * @fn crc16
+   * @brief CRC-16/CCITT-FALSE (poly 0x1021), start with crc = 0xFFFF
+   */
+  static uint16_t crc16(uint16_t crc, const uint8_t* data, byte length);
+
+private:
+  DFRobot_LineWriter* _out;
+  uint8_t _frame[FRAME_MAX_PAYLOAD + 6];
+  byte    _length;
+  bool    _sequencing;
+  byte    _epoch;
+  uint32_t _next;                               ///<sequence of the last reading
+  sPendingReading_t _pending[FRAME_RESEND_SLOTS];
+  unsigned long _lost;
+  uint8_t _rx[FRAME_ACK_SIZE];                  ///<frame from the gateway being received
+  byte    _rxLength;
+
+private:
+  void begin(byte type);
+  void put(const void* data, byte length);
+  void end();
+  void send(sPendingReading_t* p);
+  void acknowledge();
+};
+
+#endif
@@ -0,0 +1,92 @@
+/*!
+ * @file DFRobot_SensorStats.cpp
+ * @brief Define the basic structure of class DFRobot_SensorStats
+ * @details Min / max / mean / standard deviation of one sensor over tumbling 1 minute, 10 minute and 1 hour windows.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+#include "DFRobot_SensorStats.h"
+
+static const unsigned long windowMillis[STATS_WINDOWS] = {60000UL, 600000UL, 3600000UL};
+
+DFRobot_SensorStats::DFRobot_SensorStats()
+{
+    for(byte w = 0; w < STATS_WINDOWS; w++)
+    {
+        reset(&this->_running[w]);
+        reset(&this->_last[w]);
+        this->_start[w] = 0;
+    }
+}
+
+void DFRobot_SensorStats::reset(sStatsAccumulator_t* acc)
+{
+    acc->count = 0;
+    acc->mean = 0.0;
+    acc->m2 = 0.0;
+    acc->min = 0.0;
+    acc->max = 0.0;
+}
+
+byte DFRobot_SensorStats::add(float value)
+{
+    return add(value, millis());
+}
+
+byte DFRobot_SensorStats::add(float value, unsigned long now)
+{
+    byte closed = 0;
+    for(byte w = 0; w < STATS_WINDOWS; w++)
+    {
+        sStatsAccumulator_t* acc = &this->_running[w];
+        if(acc->count == 0)
+        {
+            this->_start[w] = now;
+        }
+        else if(now - this->_start[w] >= windowMillis[w])
+        {
+            this->_last[w] = *acc;
+            reset(acc);
+            this->_start[w] += windowMillis[w]*((now - this->_start[w])/windowMillis[w]);  //stay aligned after gaps
+            closed |= 1 << w;
+        }
+        acc->count++;
+        float delta = value - acc->mean;
+        acc->mean += delta/acc->count;
+        acc->m2 += delta*(value - acc->mean);
+        if(acc->count == 1 || value < acc->min)
+            acc->min = value;
+        if(acc->count == 1 || value > acc->max)
+            acc->max = value;
+    }
+    return closed;
+}
+
+bool DFRobot_SensorStats::summary(byte window, sStatsAccumulator_t* result)
+{
+    if(window >= STATS_WINDOWS || this->_last[window].count == 0)
+        return false;
+    *result = this->_last[window];
+    return true;
+}
+
+bool DFRobot_SensorStats::current(byte window, sStatsAccumulator_t* result)
+{
+    if(window >= STATS_WINDOWS || this->_running[window].count == 0)
+        return false;
+    *result = this->_running[window];
+    return true;
+}
+
+float DFRobot_SensorStats::stddev(const sStatsAccumulator_t* acc)
+{
+    if(acc->count < 2)
+        return 0.0;
+    return sqrt(acc->m2/(acc->count - 1));
+}
+
+unsigned long DFRobot_SensorStats::windowLength(byte window)
+{
+    return (window < STATS_WINDOWS) ? windowMillis[window] : 0;
+}
@@ -0,0 +1,86 @@
+/*!
+ * @file DFRobot_SensorStats.h
+ * @brief Define the basic structure of class DFRobot_SensorStats
+ * @details Min / max / mean / standard deviation of one sensor over tumbling 1 minute, 10 minute and 1 hour windows.
+ * @n A window starts where the previous one ended (no overlap), so a summary covers a fixed interval, not the
+ * @n last minute / 10 minutes / hour before the call.
+ * @n Every window keeps a running Welford accumulator and the summary of the last completed window, so memory
+ * @n stays constant no matter how many readings a window holds.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+#ifndef _DFROBOT_SENSORSTATS_H_
+#define _DFROBOT_SENSORSTATS_H_
+
+#include "Arduino.h"
+
+#define STATS_WINDOW_1MIN   0
+#define STATS_WINDOW_10MIN  1
+#define STATS_WINDOW_1H     2
+#define STATS_WINDOWS       3
+
+typedef struct {
+  unsigned long count;
+  float mean;
+  float m2;      ///<sum of squared differences from the mean (Welford)
+  float min;
+  float max;
+} sStatsAccumulator_t;
+
+class DFRobot_SensorStats
+{
+public:
+
+  /*!
+   * @fn DFRobot_SensorStats
+   * @brief Constructor
+   */
+  DFRobot_SensorStats();
+
+  /*!
+   * @fn add
+   * @brief Add a reading, windows that are over are closed first
+   * @param value  Reading
+   * @param now  Time of the reading (ms), millis()
+   * @return Bit mask of the windows closed by this call, bit n = STATS_WINDOW_n
+   */
+  byte add(float value, unsigned long now);
+  byte add(float value);
+
+  /*!
+   * @fn summary
+   * @brief Get the summary of the last completed window
+   * @param window  STATS_WINDOW_1MIN, STATS_WINDOW_10MIN or STATS_WINDOW_1H
+   * @return false if no window of that length has completed yet
+   */
+  bool summary(byte window, sStatsAccumulator_t* result);
+
+  /*!
+   * @fn current
+   * @brief Get the statistics of the window that is still running
+   */
+  bool current(byte window, sStatsAccumulator_t* result);
+
+  /*!
+   * @fn stddev
+   * @brief Sample standard deviation of an accumulator
+   */
+  static float stddev(const sStatsAccumulator_t* acc);
+
+  /*!
+   * @fn windowLength
+   * @brief Length of a window (ms)
+   */
+  static unsigned long windowLength(byte window);
+
+private:
+  sStatsAccumulator_t _running[STATS_WINDOWS];
+  sStatsAccumulator_t _last[STATS_WINDOWS];
+  unsigned long _start[STATS_WINDOWS];
+
+private:
+  static void reset(sStatsAccumulator_t* acc);
+};
+
+#endif
@@ -0,0 +1,159 @@
+/*!
+ * @file PH_EC_Stats.ino
+ * @brief pH (SEN0161-V2) and EC (DFR0300-H) readings with on-board 1 min / 10 min / 1 h statistics.
+ * @n Serial Commands:
+ * @n   stats  -> print min / max / mean / stddev of the last completed windows of both probes
+ * @n             (of the running window until the first one has completed)
+ * @n   binary -> switch to binary frames, a STATS frame is sent whenever a window completes; readings are
+ * @n             numbered and sent again until the gateway acknowledges them
+ * @n   text   -> switch back to text reading lines
+ * @n Stats lines: STATS,<quantity>,<window>,<count>,<mean>,<stddev>,<min>,<max>
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ * @url https://github.com/DFRobot/DFRobot_PH
+ */
+
+#include "DFRobot_PH.h"
+#include "DFRobot_EC10.h"
+#include "DFRobot_LineWriter.h"
+#include "DFRobot_SensorFrame.h"
+#include "DFRobot_SensorStats.h"
+#include <EEPROM.h>
+
+#define PH_PIN A1
+#define EC_PIN A2
+#define PH_CHANNEL 0
+#define EC_CHANNEL 1
+#define EPOCH_ADDR (EEPROM.length() - 1)                     // boot counter, clear of the calibration data
+
+float voltagePH,voltageEC,phValue,ecValue,temperature = 25;
+DFRobot_PH ph;
+DFRobot_EC10 ec;
+DFRobot_LineWriter out(Serial);
+DFRobot_SensorFrame frames(out);
+DFRobot_SensorStats phStats;
+DFRobot_SensorStats ecStats;
+bool binaryMode = false;
+byte statsPending = 0;                                       // STATS lines still to print, one per loop when the queue is empty
+
+const char* windowName[STATS_WINDOWS] = {"1m", "10m", "1h"};
+
+void setup()
+{
+    Serial.begin(115200);
+    ph.begin();
+    ec.begin();
+    byte epoch = EEPROM.read(EPOCH_ADDR) + 1;
+    EEPROM.write(EPOCH_ADDR, epoch);
+    frames.sequence(epoch);
+}
+
+void loop()
+{
+    char cmd[10];
+    static unsigned long timepoint = millis();
+    if(millis()-timepoint>1000U){                            //time interval: 1s
+        timepoint = millis();
+        //temperature = readTemperature();                   // read your temperature sensor to execute temperature compensation
+        voltagePH = analogRead(PH_PIN)/1024.0*5000;
+        phValue   = ph.readPH(voltagePH,temperature);
+        voltageEC = analogRead(EC_PIN)/1024.0*5000;
+        ecValue   = ec.readEC(voltageEC,temperature);
+        byte phClosed = phStats.add(phValue);
+        byte ecClosed = ecStats.add(ecValue);
+        if(binaryMode){
+            frames.reading(PH_CHANNEL, QUANTITY_PH, phValue);
+            frames.reading(EC_CHANNEL, QUANTITY_EC, ecValue);
+            sendClosedWindows(PH_CHANNEL, QUANTITY_PH, phStats, phClosed);
+            sendClosedWindows(EC_CHANNEL, QUANTITY_EC, ecStats, ecClosed);
+        }else{
+            out.print("pH:");
+            out.print(phValue,2);
+            out.print(", EC:");
+            out.print(ecValue,2);
+            out.println("ms/cm");
+        }
+    }
+    frames.update();
+    if(out.update() == 0 && statsPending){
+        statsPending--;
+        byte w = statsPending % STATS_WINDOWS;
+        if(statsPending >= STATS_WINDOWS){
+            printStats("pH", phStats, w);
+        }else{
+            printStats("EC", ecStats, w);
+        }
+    }
+    if(readSerial(cmd)){
+        strupr(cmd);
+        if(strstr(cmd,"STATS")){
+            statsPending = 2*STATS_WINDOWS;
+        }else if(strstr(cmd,"BINARY")){
+            binaryMode = true;
+        }else if(strstr(cmd,"TEXT")){
+            binaryMode = false;
+        }else if(strstr(cmd,"PH")){
+            ph.calibration(voltagePH,temperature,cmd);       //PH calibration process by Serail CMD
+        }else if(strstr(cmd,"EC")){
+            ec.calibration(voltageEC,temperature,cmd);       //EC calibration process by Serail CMD
+        }
+    }
+}
+
+void sendClosedWindows(byte channel, byte quantity, DFRobot_SensorStats& stats, byte closed)
+{
+    sStatsAccumulator_t acc;
+    for(byte w = 0; w < STATS_WINDOWS; w++){
+        if((closed & (1 << w)) && stats.summary(w, &acc)){
+            frames.stats(channel, quantity, w, &acc);
+        }
+    }
+}
+
+void printStats(const char* quantity, DFRobot_SensorStats& stats, byte w)
+{
+    sStatsAccumulator_t acc;
+    if(!stats.summary(w, &acc) && !stats.current(w, &acc)){  // running window until the first one completes
+        return;
+    }
+    out.print("STATS,");
+    out.print(quantity);
+    out.print(',');
+    out.print(windowName[w]);
+    out.print(',');
+    out.print((long)acc.count);
+    out.print(',');
+    out.print(acc.mean,2);
+    out.print(',');
+    out.print(DFRobot_SensorStats::stddev(&acc),3);
+    out.print(',');
+    out.print(acc.min,2);
+    out.print(',');
+    out.print(acc.max,2);
+    out.println();
+}
+
+int i = 0;
+bool readSerial(char result[]){
+    while(Serial.available() > 0){
+        char inChar = Serial.read();
+        if(frames.receive(inChar)){                          // acknowledgement from the gateway
+             continue;
+        }
+        if(inChar == '\n' || i == 9){
+             result[i] = '\0';
+             i=0;
+             return true;
+        }
+        if(inChar != '\r'){
+             result[i] = inChar;
+             i++;
+        }
+    }
+    return false;
+}
+
+float readTemperature()
+{
+  //add your code here to get the temperature from your temperature sensor
+}
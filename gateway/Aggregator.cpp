@@ -0,0 +1,141 @@
+/*!
+ * @file Aggregator.cpp
+ * @brief Define the basic structure of class Aggregator
+ * @details Parallel multi-sensor range aggregates over the column store.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Aggregator.h"
+#include "Log.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+/*!
+ * @brief Runs the aggregation kernel over the value spans of one sensor
+ */
+class AggregateVisitor : public SpanVisitor
+{
+public:
+  AggregateVisitor(float low, float high, ColumnAggregate* result) : _low(low), _high(high), _result(result) {}
+
+  virtual void span(const int64_t* timestamps, const float* values, size_t count)
+  {
+    (void)timestamps;
+    aggregateValues(values, count, this->_low, this->_high, this->_result);
+  }
+
+  virtual bool summary(size_t count, double sum, float min, float max)
+  {
+    // the thresholds must not split the block, else its values have to be counted one by one
+    if(!(max <= this->_high || min > this->_high) || !(min >= this->_low || max < this->_low)) return false;
+    ColumnAggregate block;
+    block.count = count;
+    block.sum = sum;
+    block.min = min;
+    block.max = max;
+    block.above = min > this->_high ? count : 0;
+    block.below = max < this->_low ? count : 0;
+    this->_result->merge(block);
+    return true;
+  }
+
+private:
+  float _low;
+  float _high;
+  ColumnAggregate* _result;
+};
+
+Aggregator::Aggregator(const ColumnStore& store)
+  : _store(store)
+{
+  this->_generation = 0;
+  this->_busy = 0;
+  this->_stopping = false;
+  this->_next = 0;
+}
+
+Aggregator::~Aggregator()
+{
+  end();
+}
+
+void Aggregator::begin(unsigned threads)
+{
+  for(unsigned i = 1; i < threads; i++){
+    this->_workers.emplace_back(&Aggregator::workerLoop, this);
+    char name[16];
+    snprintf(name, sizeof(name), "gw-scan%u", (uint16_t)i);
+    pthread_setname_np(this->_workers.back().native_handle(), name);
+  }
+  LOG("aggregates: %u scan threads, %s kernel", threads ? threads : 1, scanKernelName());
+}
+
+void Aggregator::end()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_stopping = true;
+  }
+  this->_start.notify_all();
+  for(size_t i = 0; i < this->_workers.size(); i++) this->_workers[i].join();
+  this->_workers.clear();
+}
+
+void Aggregator::work(const Job& job)
+{
+  while(true){
+    size_t i = this->_next.fetch_add(SCAN_SENSORS_PER_TAKE, std::memory_order_relaxed);
+    if(i >= job.count) return;
+    size_t end = i + SCAN_SENSORS_PER_TAKE < job.count ? i + SCAN_SENSORS_PER_TAKE : job.count;
+    for(; i < end; i++){
+      job.results[i] = ColumnAggregate();
+      AggregateVisitor visitor(job.low, job.high, &job.results[i]);
+      this->_store.scan(job.sensors[i], job.from, job.to, visitor);
+    }
+  }
+}
+
+void Aggregator::workerLoop()
+{
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  while(true){
+    this->_start.wait(lock, [&]{ return this->_stopping || this->_generation != seen; });
+    if(this->_stopping) return;
+    seen = this->_generation;
+    Job job = this->_job;
+    lock.unlock();
+    work(job);
+    lock.lock();
+    if(--this->_busy == 0) this->_done.notify_one();
+  }
+}
+
+void Aggregator::aggregate(const std::vector<uint32_t>& sensors, int64_t from, int64_t to, float low, float high,
+                           ColumnAggregate* results)
+{
+  std::lock_guard<std::mutex> query(this->_query);
+  Job job;
+  job.sensors = sensors.data();
+  job.count = sensors.size();
+  job.from = from;
+  job.to = to;
+  job.low = low;
+  job.high = high;
+  job.results = results;
+  this->_next = 0;
+  bool parallel = !this->_workers.empty() && job.count > SCAN_SENSORS_PER_TAKE;
+  if(parallel){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_job = job;
+    this->_busy = this->_workers.size();
+    this->_generation++;
+  }
+  if(parallel) this->_start.notify_all();
+  work(job);
+  if(parallel){
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    this->_done.wait(lock, [&]{ return this->_busy == 0; });
+  }
+}
@@ -0,0 +1,83 @@
+/*!
+ * @file Aggregator.h
+ * @brief Define the basic structure of class Aggregator
+ * @details Aggregates a time range of many sensors at once, e.g. all EC sensors of a farm for a dashboard.
+ * @n Sensors are independent, so a query is split over a pool of scan threads: every thread takes the next
+ * @n SCAN_SENSORS_PER_TAKE sensors from a shared counter, finds the range in their segments (ColumnStore::scan)
+ * @n and runs aggregateValues() over the value spans, with the calling thread working along. Results are
+ * @n written per sensor, so threads share nothing but the counter. One query runs at a time.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_AGGREGATOR_H_
+#define _GATEWAY_AGGREGATOR_H_
+
+#include "ColumnStore.h"
+#include "ScanKernels.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#define SCAN_SENSORS_PER_TAKE  4
+
+class Aggregator
+{
+public:
+  Aggregator(const ColumnStore& store);
+  ~Aggregator();
+
+  /*!
+   * @fn begin
+   * @brief Start threads - 1 scan threads, the caller of aggregate() is the last one
+   */
+  void begin(unsigned threads);
+
+  /*!
+   * @fn aggregate
+   * @brief Aggregate [from, to) of every sensor
+   * @param results  One per sensor, in the order of sensors
+   */
+  void aggregate(const std::vector<uint32_t>& sensors, int64_t from, int64_t to, float low, float high,
+                 ColumnAggregate* results);
+
+  /*!
+   * @fn end
+   * @brief Stop the scan threads
+   */
+  void end();
+
+  unsigned threads() const { return this->_workers.size() + 1; }
+
+private:
+  struct Job {
+    const uint32_t* sensors;
+    size_t count;
+    int64_t from;
+    int64_t to;
+    float low;
+    float high;
+    ColumnAggregate* results;
+  };
+
+  const ColumnStore& _store;
+  std::vector<std::thread> _workers;
+  std::mutex _query;                                    ///<one query at a time
+  std::mutex _mutex;
+  std::condition_variable _start;
+  std::condition_variable _done;
+  Job _job;
+  uint64_t _generation;                                 ///<incremented per query, wakes the workers
+  unsigned _busy;                                       ///<workers still on the current query
+  bool _stopping;
+  std::atomic<size_t> _next;
+
+private:
+  void work(const Job& job);
+  void workerLoop();
+};
+
+#endif
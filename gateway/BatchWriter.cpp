@@ -0,0 +1,231 @@
+/*!
+ * @file BatchWriter.cpp
+ * @brief Define the basic structure of class BatchWriter
+ * @details Buffers readings and inserts them into `sensor_data` in multi-row batches (group commit).
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "BatchWriter.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#define INSERT_OK        0
+#define INSERT_RETRY     1
+#define INSERT_REJECTED  2
+
+BatchWriter::BatchWriter(const DeviceMap& map, PostgrestClient& client, size_t capacity)
+  : _map(map), _client(client)
+{
+  for(int l = 0; l < 2; l++){
+    this->_lanes[l].ring.resize(capacity);
+    this->_lanes[l].order.resize(capacity);
+    this->_lanes[l].head = 0;
+    this->_lanes[l].count = 0;
+    this->_lanes[l].since = 0;
+  }
+  this->_pushed = 0;
+  this->_reported = 0;
+  this->_liveRun = 0;
+  this->_batchRows = WRITER_BATCH_ROWS;
+  this->_maxDelayMs = WRITER_MAX_DELAY_MS;
+  this->_stopping = false;
+  this->_listener = NULL;
+  memset(&this->_counters, 0, sizeof(this->_counters));
+}
+
+BatchWriter::~BatchWriter()
+{
+  end();
+}
+
+void BatchWriter::begin()
+{
+  this->_stopping = false;
+  this->_thread = std::thread(&BatchWriter::flushLoop, this);
+}
+
+void BatchWriter::end()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_stopping = true;
+  }
+  this->_notEmpty.notify_all();
+  this->_notFull.notify_all();
+  if(this->_thread.joinable()) this->_thread.join();
+}
+
+void BatchWriter::setBatch(size_t rows, int maxDelayMs)
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  this->_batchRows = rows ? rows : 1;
+  this->_maxDelayMs = maxDelayMs;
+}
+
+void BatchWriter::push(const Reading* readings, size_t count)
+{
+  int64_t now = nowMicros();
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  for(size_t i = 0; i < count; i++){
+    Lane& lane = this->_lanes[isBackfill(readings[i], now) ? WRITER_BACKFILL : WRITER_LIVE];
+    size_t capacity = lane.ring.size();
+    if(lane.count == capacity){
+      this->_counters.stalls++;
+      this->_notEmpty.notify_one();
+      this->_notFull.wait(lock, [this, &lane, capacity]{ return lane.count < capacity || this->_stopping; });
+      if(this->_stopping) return;
+    }
+    if(lane.count == 0) lane.since = now;
+    size_t tail = lane.head + lane.count;
+    if(tail >= capacity) tail -= capacity;
+    lane.ring[tail] = readings[i];
+    lane.order[tail] = this->_pushed++;
+    lane.count++;
+  }
+  if(this->_lanes[WRITER_LIVE].count >= this->_batchRows || this->_lanes[WRITER_BACKFILL].count >= this->_batchRows)
+    this->_notEmpty.notify_one();
+}
+
+WriterCounters BatchWriter::counters()
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  WriterCounters c = this->_counters;
+  c.queued = this->_lanes[WRITER_LIVE].count + this->_lanes[WRITER_BACKFILL].count;
+  return c;
+}
+
+int BatchWriter::formatTimestamp(char* buf, int64_t micros)
+{
+  time_t seconds = micros/1000000;
+  struct tm tm;
+  gmtime_r(&seconds, &tm);
+  return snprintf(buf, 32, "%04d-%02d-%02dT%02d:%02d:%02d.%06dZ", tm.tm_year + 1900, tm.tm_mon + 1,
+                  tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(micros%1000000));
+}
+
+int BatchWriter::insert(const std::vector<Reading>& batch)
+{
+  std::string& body = this->_body;
+  body.clear();
+  body.reserve(batch.size()*110);
+  body += '[';
+  char row[192];
+  char ts[32];
+  size_t rows = 0;
+  for(size_t i = 0; i < batch.size(); i++){
+    const Reading& r = batch[i];
+    if(!isfinite(r.value)) continue;                     // nan/inf is no JSON, it would get the whole batch rejected
+    formatTimestamp(ts, r.timestamp);
+    int n = snprintf(row, sizeof(row), "%s{\"sensor_id\":\"%s\",\"value\":%.7g,\"created_at\":\"%s\"}",
+                     rows++ ? "," : "", this->_map.sensor(r.sensor).sensorId.c_str(), r.value, ts);
+    body.append(row, n);
+  }
+  body += ']';
+  if(rows < batch.size()) LOG("sensor_data: %zu readings without a finite value not inserted", batch.size() - rows);
+  if(rows == 0) return INSERT_OK;
+  int status = this->_client.post("sensor_data", "on_conflict=sensor_id,created_at", body,
+                                  "return=minimal,resolution=ignore-duplicates");
+  if(status >= 200 && status < 300) return INSERT_OK;
+  if(status >= 400 && status < 500 && status != 408 && status != 429){
+    LOG("sensor_data insert rejected (%d), dropping %zu rows: %s", status, batch.size(),
+        this->_client.lastError().c_str());
+    return INSERT_REJECTED;                              // retrying would not help
+  }
+  LOG("sensor_data insert failed (%d): %s", status, this->_client.lastError().c_str());
+  return INSERT_RETRY;
+}
+
+int64_t BatchWriter::due(int lane)
+{
+  // a live batch is due when its oldest reading has waited, backfill is old already: when it was queued
+  const Lane& l = this->_lanes[lane];
+  if(l.count == 0) return INT64_MAX;
+  if(l.count >= this->_batchRows || this->_stopping) return 0;
+  int64_t since = lane == WRITER_LIVE ? l.ring[l.head].timestamp : l.since;
+  return since + (int64_t)this->_maxDelayMs*1000;
+}
+
+void BatchWriter::flushLoop()
+{
+  std::vector<Reading> batch;
+  bool lost = false;
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  while(true){
+    Lane& live = this->_lanes[WRITER_LIVE];
+    Lane& backfill = this->_lanes[WRITER_BACKFILL];
+    if(live.count == 0 && backfill.count == 0){
+      if(this->_stopping) break;
+      this->_notEmpty.wait(lock);
+      continue;
+    }
+    // wait until a batch is full or its oldest reading is due
+    int64_t now = nowMicros();
+    int64_t liveDue = due(WRITER_LIVE), backfillDue = due(WRITER_BACKFILL);
+    bool liveReady = liveDue <= now, backfillReady = backfillDue <= now;
+    if(!liveReady && !backfillReady){
+      this->_notEmpty.wait_for(lock, std::chrono::microseconds(std::min(liveDue, backfillDue) - now));
+      continue;
+    }
+    int l = WRITER_BACKFILL;
+    if(liveReady && (!backfillReady || this->_liveRun < WRITER_LIVE_WEIGHT)){
+      l = WRITER_LIVE;
+      this->_liveRun = backfillReady ? this->_liveRun + 1 : 0;
+    }else{
+      this->_liveRun = 0;
+    }
+    Lane& lane = this->_lanes[l];
+    size_t n = lane.count < this->_batchRows ? lane.count : this->_batchRows;
+    size_t capacity = lane.ring.size();
+    batch.clear();
+    for(size_t i = 0; i < n; i++){
+      batch.push_back(lane.ring[lane.head]);
+      if(++lane.head == capacity) lane.head = 0;
+    }
+    lane.count -= n;
+    if(lane.count) lane.since = now;
+    this->_notFull.notify_all();
+
+    lock.unlock();
+    int backoff = WRITER_BACKOFF_MS;
+    int result;
+    while((result = insert(batch)) == INSERT_RETRY){     // keep the batch until it is in, the queue fills meanwhile
+      lock.lock();
+      this->_counters.retries++;
+      bool stopping = this->_stopping;
+      lock.unlock();
+      if(stopping){
+        LOG("stopping with the database unreachable, %zu rows lost", batch.size());
+        lost = true;                                     // the listener counts in push order
+        break;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(backoff));
+      backoff = backoff*2 > WRITER_BACKOFF_MAX_MS ? WRITER_BACKOFF_MAX_MS : backoff*2;
+    }
+    lock.lock();
+    if(result == INSERT_OK){
+      this->_counters.rows += batch.size();
+      if(l == WRITER_BACKFILL) this->_counters.backfill += batch.size();
+      this->_counters.batches++;
+    }else if(result == INSERT_REJECTED){
+      this->_counters.rejected += batch.size();
+    }
+    if(result != INSERT_RETRY && !lost && this->_listener){
+      // done up to the oldest reading still queued in either lane
+      uint64_t done = this->_pushed;
+      if(live.count) done = std::min(done, live.order[live.head]);
+      if(backfill.count) done = std::min(done, backfill.order[backfill.head]);
+      size_t rows = done - this->_reported;
+      this->_reported = done;
+      if(rows){
+        lock.unlock();
+        this->_listener->written(rows);
+        lock.lock();
+      }
+    }
+  }
+}
@@ -0,0 +1,149 @@
+/*!
+ * @file BatchWriter.h
+ * @brief Define the basic structure of class BatchWriter
+ * @details Buffers readings and inserts them into `sensor_data` in multi-row batches (group commit).
+ * @n A batch is flushed when WRITER_BATCH_ROWS readings are queued or the oldest one has waited
+ * @n WRITER_MAX_DELAY_MS. The queue is bounded: when the database lags and the queue is full, push()
+ * @n blocks the ingest thread until the flush thread has made room (backpressure) instead of growing.
+ * @n Failed batches are retried with exponential backoff. Inserts use on_conflict=sensor_id,created_at with
+ * @n resolution=ignore-duplicates, so a batch that reached the database before its response got lost
+ * @n is not inserted twice (needs the unique index from README.md).
+ * @n Backfill (isBackfill(), e.g. a reconnected device draining its backlog, or readings replayed from the log)
+ * @n is queued in a lane of its own, so live readings never wait behind it for an insert: while both lanes
+ * @n have a batch due, every WRITER_LIVE_WEIGHT live batches are followed by one backfill batch.
+ * @n A WriterListener learns how many of the pushed readings are done, in push order, e.g. so WriteAheadLog
+ * @n can drop what the database has; a live batch done before older backfill is reported with it.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_BATCHWRITER_H_
+#define _GATEWAY_BATCHWRITER_H_
+
+#include "DeviceMap.h"
+#include "PostgrestClient.h"
+#include "Reading.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define WRITER_CAPACITY      (1 << 18)  ///<readings queued at most, per lane
+#define WRITER_BATCH_ROWS    5000       ///<rows per insert
+#define WRITER_MAX_DELAY_MS  250        ///<max time a reading waits for its batch
+#define WRITER_BACKOFF_MS    100        ///<first retry delay, doubled up to WRITER_BACKOFF_MAX_MS
+#define WRITER_BACKOFF_MAX_MS 10000
+#define WRITER_LIVE_WEIGHT   4          ///<live batches inserted per backfill batch while both are due
+
+#define WRITER_LIVE          0
+#define WRITER_BACKFILL      1
+
+struct WriterCounters {
+  uint64_t rows;          ///<rows accepted by the database
+  uint64_t backfill;      ///<of them backfill
+  uint64_t batches;
+  uint64_t retries;
+  uint64_t rejected;      ///<rows dropped because the database refused the batch (4xx)
+  uint64_t stalls;        ///<push() calls that had to wait for room
+  size_t   queued;
+};
+
+class WriterListener
+{
+public:
+  virtual ~WriterListener() {}
+
+  /*!
+   * @fn written
+   * @brief Called on the flush thread when the next rows in push order are done: inserted, or refused by the
+   * @n database. Rows given up on when stopping are not reported, nor is anything after them.
+   */
+  virtual void written(size_t rows) = 0;
+};
+
+class BatchWriter : public ReadingSink
+{
+public:
+  /*!
+   * @fn BatchWriter
+   * @brief Constructor
+   * @param map  Sensor ids of the readings
+   * @param client  Connection used only by the flush thread
+   * @param capacity  Max queued readings per lane
+   */
+  BatchWriter(const DeviceMap& map, PostgrestClient& client, size_t capacity = WRITER_CAPACITY);
+  ~BatchWriter();
+
+  /*!
+   * @fn begin
+   * @brief Start the flush thread
+   */
+  void begin();
+
+  /*!
+   * @fn end
+   * @brief Flush what is queued and stop the flush thread
+   */
+  void end();
+
+  /*!
+   * @fn setBatch
+   * @brief Change the flush thresholds
+   */
+  void setBatch(size_t rows, int maxDelayMs);
+
+  /*!
+   * @fn listen
+   * @brief Report done rows to listener, call before begin()
+   */
+  void listen(WriterListener* listener) { this->_listener = listener; }
+
+  /*!
+   * @fn push
+   * @brief Queue readings in their lane, blocks while it is full
+   */
+  virtual void push(const Reading* readings, size_t count);
+
+  WriterCounters counters();
+
+  /*!
+   * @fn formatTimestamp
+   * @brief Format unix microseconds as an ISO 8601 UTC timestamp with microseconds
+   * @return Number of characters written to buf (at least 32 bytes)
+   */
+  static int formatTimestamp(char* buf, int64_t micros);
+
+private:
+  struct Lane {
+    std::vector<Reading> ring;
+    std::vector<uint64_t> order;        ///<push order of each queued reading, for the listener
+    size_t head;
+    size_t count;
+    int64_t since;                      ///<unix us the oldest backfill reading was queued
+  };
+
+  const DeviceMap& _map;
+  PostgrestClient& _client;
+  Lane _lanes[2];                       ///<WRITER_LIVE, WRITER_BACKFILL
+  uint64_t _pushed;                     ///<readings pushed
+  uint64_t _reported;                   ///<readings reported to the listener
+  uint32_t _liveRun;                    ///<live batches in a row while backfill was due
+  size_t _batchRows;
+  int _maxDelayMs;
+  bool _stopping;
+  WriterListener* _listener;
+  std::mutex _mutex;
+  std::condition_variable _notEmpty;
+  std::condition_variable _notFull;
+  std::thread _thread;
+  WriterCounters _counters;
+  std::string _body;
+
+private:
+  void flushLoop();
+  int64_t due(int lane);
+  int  insert(const std::vector<Reading>& batch);
+};
+
+#endif
@@ -0,0 +1,173 @@
+/*!
+ * @file CalibrationRegistry.cpp
+ * @brief Define the basic structure of class CalibrationRegistry
+ * @details Versioned probe calibrations per sensor.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "CalibrationRegistry.h"
+#include "Log.h"
+#include "ProbeMath.h"
+#include "Reading.h"
+
+#include <algorithm>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+
+CalibrationRegistry::CalibrationRegistry(const DeviceMap& map)
+  : _map(map)
+{
+  this->_started = false;
+}
+
+bool CalibrationRegistry::begin(const char* path)
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    Sensor* sensor = new Sensor();
+    sensor->current = NULL;
+    sensor->mapVersion = 0;
+    this->_sensors.emplace_back(sensor);
+  }
+  if(path){
+    this->_path = path;
+    FILE* f = fopen(path, "r");
+    if(f == NULL && errno != ENOENT){
+      LOG("%s: %s", path, strerror(errno));
+      return false;
+    }
+    char line[256];
+    int lineNo = 0;
+    while(f && fgets(line, sizeof(line), f)){
+      lineNo++;
+      char sensorId[64], spec[64], source[16] = "";
+      unsigned version;
+      long long from;
+      if(sscanf(line, "%63s %u %lld %63s %15s", sensorId, &version, &from, spec, source) < 4) continue;
+      int32_t sensor = this->_map.find(sensorId);
+      Calibration c;
+      if(sensor == SENSOR_UNMAPPED) continue;            // removed from the device map
+      if(strcmp(spec, "none") == 0) c.probe = PROBE_NONE;
+      else if(!DeviceMap::parseProbe(spec, &c.probe, c.values)){
+        LOG("%s:%d: bad probe \"%s\", skipped", path, lineNo, spec);
+        continue;
+      }
+      if(version != this->_sensors[sensor]->versions.size() + 1){
+        LOG("%s:%d: version %u of %s out of order, skipped", path, lineNo, version, sensorId);
+        continue;
+      }
+      addLocked(sensor, c.probe, c.values, version == 1 ? INT64_MIN : (int64_t)from, false);
+      if(strcmp(source, "map") == 0) this->_sensors[sensor]->mapVersion = version;
+    }
+    if(f) fclose(f);
+  }
+  size_t changed = 0;
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    const SensorInfo& info = this->_map.sensor(i);
+    Sensor& s = *this->_sensors[i];
+    if(s.versions.empty()){
+      // only voltage channels can get later versions, so only theirs are worth a line in the file
+      if(addLocked(i, info.probe, info.calibration, INT64_MIN, info.quantity == QUANTITY_VOLTAGE) == 0) return false;
+      s.mapVersion = 1;
+      continue;
+    }
+    // versions added at runtime stay in force until the device map's probe field is edited
+    const Calibration& seen = s.versions[s.mapVersion ? s.mapVersion - 1 : 0];
+    if(seen.probe != info.probe || seen.values[0] != info.calibration[0] ||
+       (info.probe == PROBE_PH && seen.values[1] != info.calibration[1])){
+      if((s.mapVersion = addLocked(i, info.probe, info.calibration, nowMicros(), true)) == 0) return false;
+      changed++;
+    }
+  }
+  if(changed) LOG("%zu probe calibrations changed in the device map, new versions apply from now", changed);
+  this->_started = true;
+  return true;
+}
+
+uint16_t CalibrationRegistry::addLocked(uint32_t sensor, uint8_t probe, const float* values, int64_t from, bool save)
+{
+  Sensor& s = *this->_sensors[sensor];
+  if(s.versions.size() >= UINT16_MAX){
+    LOG("%s: too many calibration versions", this->_map.sensor(sensor).sensorId.c_str());
+    return 0;
+  }
+  Calibration c;
+  c.version = s.versions.size() + 1;
+  c.probe = probe;
+  c.values[0] = probe == PROBE_NONE ? 0 : values[0];
+  c.values[1] = probe == PROBE_PH ? values[1] : 0;
+  c.from = from;
+  if(save && !this->_path.empty()){
+    FILE* f = fopen(this->_path.c_str(), "a");
+    // versions taken from the device map are marked, begin() compares the map with the newest of them
+    bool fromMap = !this->_started;
+    int ok = f ? fprintf(f, "%s %u %lld %s%s\n", this->_map.sensor(sensor).sensorId.c_str(), c.version,
+                         (long long)(from == INT64_MIN ? 0 : from), DeviceMap::formatProbe(probe, c.values).c_str(),
+                         fromMap ? " map" : "") : -1;
+    if(f && fclose(f) != 0) ok = -1;
+    if(ok < 0){
+      LOG("%s: %s", this->_path.c_str(), strerror(errno));
+      return 0;
+    }
+  }
+  s.versions.push_back(c);
+  s.current.store(&s.versions.back(), std::memory_order_release);
+  return c.version;
+}
+
+uint16_t CalibrationRegistry::add(uint32_t sensor, const char* spec, int64_t from)
+{
+  uint8_t probe;
+  float values[2];
+  if(!DeviceMap::parseProbe(spec, &probe, values) || probe != current(sensor)->probe) return 0;
+  int64_t now = nowMicros();
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  uint16_t version = addLocked(sensor, probe, values, std::min(from, now), true);
+  if(version) LOG("%s: calibration version %u (%s)", this->_map.sensor(sensor).sensorId.c_str(), version, spec);
+  return version;
+}
+
+const Calibration* CalibrationRegistry::atLocked(const Sensor& sensor, int64_t timestamp) const
+{
+  for(size_t i = sensor.versions.size(); i-- > 0;)
+    if(sensor.versions[i].from <= timestamp) return &sensor.versions[i];
+  return &sensor.versions.front();
+}
+
+const Calibration* CalibrationRegistry::at(uint32_t sensor, int64_t timestamp) const
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  return atLocked(*this->_sensors[sensor], timestamp);
+}
+
+void CalibrationRegistry::spans(uint32_t sensor, int64_t from, int64_t to, std::vector<CalibrationSpan>& spans) const
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  const Sensor& s = *this->_sensors[sensor];
+  std::vector<int64_t> bounds(1, from);
+  for(size_t i = 0; i < s.versions.size(); i++)
+    if(s.versions[i].from > from && s.versions[i].from < to) bounds.push_back(s.versions[i].from);
+  std::sort(bounds.begin(), bounds.end());
+  bounds.erase(std::unique(bounds.begin(), bounds.end()), bounds.end());
+  bounds.push_back(to);
+  for(size_t i = 0; i + 1 < bounds.size(); i++){
+    const Calibration* c = atLocked(s, bounds[i]);
+    if(!spans.empty() && spans.back().calibration == c){
+      spans.back().to = bounds[i+1];                     // superseded by a newer version over the whole part
+      continue;
+    }
+    CalibrationSpan span;
+    span.from = bounds[i];
+    span.to = bounds[i+1];
+    span.calibration = c;
+    spans.push_back(span);
+  }
+}
+
+void CalibrationRegistry::history(uint32_t sensor, std::vector<Calibration>& versions) const
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  const Sensor& s = *this->_sensors[sensor];
+  versions.assign(s.versions.begin(), s.versions.end());
+}
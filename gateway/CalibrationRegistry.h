@@ -0,0 +1,114 @@
+/*!
+ * @file CalibrationRegistry.h
+ * @brief Define the basic structure of class CalibrationRegistry
+ * @details Versioned probe calibrations per sensor. Version 1 of a sensor is its probe field in the device map;
+ * @n later versions are added at runtime (e.g. after recalibrating with buffer solutions) and apply from a
+ * @n chosen time on, which may lie in the past to correct a bad calibration. At a time t a sensor uses the
+ * @n newest version that applies from t or earlier. Converted readings carry the version they were converted
+ * @n with and the store keeps the raw voltage and temperature next to them, so Reprocessor can convert them
+ * @n again after a correction.
+ * @n With a path the versions are kept in a text file, one per line, appended as they are added:
+ * @n   <sensor_id> <version> <applies from, unix us> <probe: ph:<neutral>:<acid> | ec10:<k> | none> [map]
+ * @n "map" marks versions taken from the device map. Editing a probe field there makes a new version from the
+ * @n next start on; versions added at runtime are kept until then.
+ * @n The converter threads read the current version of a sensor without a lock.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_CALIBRATIONREGISTRY_H_
+#define _GATEWAY_CALIBRATIONREGISTRY_H_
+
+#include "DeviceMap.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct Calibration {
+  uint16_t version;       ///<1, 2, ... per sensor
+  uint8_t  probe;         ///<PROBE_*
+  float    values[2];     ///<PROBE_PH: neutral, acid mV; PROBE_EC10: kvalue
+  int64_t  from;          ///<unix time (us) the version applies from, INT64_MIN for version 1
+};
+
+/*!
+ * @brief A part of a time range converted with one calibration version
+ */
+struct CalibrationSpan {
+  int64_t from;
+  int64_t to;
+  const Calibration* calibration;
+};
+
+class CalibrationRegistry
+{
+public:
+  CalibrationRegistry(const DeviceMap& map);
+
+  /*!
+   * @fn begin
+   * @brief Load the versions of earlier runs from path (may be NULL: keep them in memory only); a probe field
+   * @n of the device map that differs from the version last taken from it becomes a new version from now on
+   * @return false if the file can't be read or written
+   */
+  bool begin(const char* path);
+
+  /*!
+   * @fn current
+   * @brief Version in use for new readings, lock-free
+   */
+  const Calibration* current(uint32_t sensor) const
+  {
+    return this->_sensors[sensor]->current.load(std::memory_order_acquire);
+  }
+
+  /*!
+   * @fn at
+   * @brief Version that applies to a reading taken at timestamp
+   */
+  const Calibration* at(uint32_t sensor, int64_t timestamp) const;
+
+  /*!
+   * @fn spans
+   * @brief Split [from, to) into parts of one version each, in time order
+   */
+  void spans(uint32_t sensor, int64_t from, int64_t to, std::vector<CalibrationSpan>& spans) const;
+
+  /*!
+   * @fn add
+   * @brief Add a version from a probe spec as in the device map, e.g. "ph:1498.2:2030.1"
+   * @param from  Unix time (us) it applies from, at most now
+   * @return The new version, 0 if spec is malformed or names another probe than the sensor has (changing the
+   * @n probe changes what the sensor measures, that is done in the device map)
+   */
+  uint16_t add(uint32_t sensor, const char* spec, int64_t from);
+
+  /*!
+   * @fn history
+   * @brief All versions of a sensor, oldest first
+   */
+  void history(uint32_t sensor, std::vector<Calibration>& versions) const;
+
+private:
+  struct Sensor {
+    std::deque<Calibration> versions;                  ///<elements never move, current points into it
+    std::atomic<const Calibration*> current;
+    uint16_t mapVersion;                               ///<newest version taken from the device map
+  };
+
+  const DeviceMap& _map;
+  std::string _path;
+  bool _started;                                       ///<begin() is done, versions come from add()
+  mutable std::mutex _mutex;                           ///<guards versions and the file
+  std::vector<std::unique_ptr<Sensor>> _sensors;
+
+private:
+  const Calibration* atLocked(const Sensor& sensor, int64_t timestamp) const;
+  uint16_t addLocked(uint32_t sensor, uint8_t probe, const float* values, int64_t from, bool save);
+};
+
+#endif
@@ -0,0 +1,265 @@
+/*!
+ * @file Checkpoint.cpp
+ * @brief Define the basic structure of class Checkpointer
+ * @details Copy-on-write snapshots of the in-memory state, taken by a forked child and loaded with mmap.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Checkpoint.h"
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static const char checkpointMagic[8] = {'G', 'W', 'C', 'K', 'P', 'T', 0, 0};
+
+template <typename T>
+static inline void put(uint8_t* p, T value) { memcpy(p, &value, sizeof(T)); }
+
+template <typename T>
+static inline T get(const uint8_t* p) { T value; memcpy(&value, p, sizeof(T)); return value; }
+
+static bool writeAll(int fd, const void* data, size_t length)
+{
+  const char* p = (const char*)data;
+  while(length){
+    ssize_t n = ::write(fd, p, length);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return false;
+    }
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+Checkpointer::Checkpointer(const DeviceMap& map, WriteAheadLog& wal, int intervalS)
+  : _map(map), _wal(wal)
+{
+  this->_interval = (int64_t)intervalS*1000000;
+  this->_due = INT64_MAX;
+  this->_child = 0;
+  this->_childLsn = 0;
+  this->_childStarted = 0;
+}
+
+Checkpointer::~Checkpointer()
+{
+  if(this->_child) reap(true);
+}
+
+void Checkpointer::add(uint32_t tag, Checkpointable* state)
+{
+  this->_sections.push_back(Section{tag, state, false});
+}
+
+uint32_t Checkpointer::mapHash(const DeviceMap& map)
+{
+  uint32_t crc = 0;
+  for(uint32_t i = 0; i < map.sensorCount(); i++){
+    const SensorInfo& info = map.sensor(i);
+    uint8_t fields[7] = {info.quantity, info.probe, info.channel};
+    put<uint32_t>(fields + 3, info.device);
+    crc = WriteAheadLog::crc32c(crc, (const uint8_t*)info.sensorId.c_str(), info.sensorId.size() + 1);
+    crc = WriteAheadLog::crc32c(crc, (const uint8_t*)info.farmId.c_str(), info.farmId.size() + 1);
+    crc = WriteAheadLog::crc32c(crc, fields, sizeof(fields));
+  }
+  return crc;
+}
+
+bool Checkpointer::restored(uint32_t tag) const
+{
+  for(size_t i = 0; i < this->_sections.size(); i++)
+    if(this->_sections[i].tag == tag) return this->_sections[i].restored;
+  return false;
+}
+
+bool Checkpointer::load(const char* path, uint64_t* lsn)
+{
+  this->_path = path;
+  int64_t started = nowMicros();
+  this->_due = started + this->_interval;
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if(fd < 0){
+    if(errno != ENOENT) LOG("%s: %s", path, strerror(errno));
+    return false;
+  }
+  struct stat st;
+  size_t size = fstat(fd, &st) == 0 ? st.st_size : 0;
+  if(size < CHECKPOINT_HEADER_SIZE){
+    LOG("%s: not a checkpoint, ignored", path);
+    close(fd);
+    return false;
+  }
+  void* mapped = mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+  close(fd);
+  if(mapped == MAP_FAILED){
+    LOG("%s: mmap: %s", path, strerror(errno));
+    return false;
+  }
+  const uint8_t* data = (const uint8_t*)mapped;
+  uint32_t sections = get<uint32_t>(data + 12);
+  uint64_t at = get<uint64_t>(data + 16);
+  int64_t created = get<int64_t>(data + 24);
+  uint64_t table = get<uint64_t>(data + 40);
+  const char* problem = NULL;
+  if(memcmp(data, checkpointMagic, sizeof(checkpointMagic)) != 0){
+    problem = "not a checkpoint";
+  }else if(get<uint32_t>(data + 8) != CHECKPOINT_VERSION){
+    problem = "written by another version";
+  }else if(get<uint32_t>(data + 32) != mapHash(this->_map)){
+    problem = "made with another device map";
+  }else if(table > size || (size - table)/24 < sections ||
+           WriteAheadLog::crc32c(0, data + table, (size_t)sections*24) != get<uint32_t>(data + 36)){
+    problem = "damaged";
+  }else if(!this->_wal.covers(at)){
+    problem = "older than the write-ahead log";
+  }
+  if(problem){
+    LOG("%s: %s, ignored", path, problem);
+    munmap(mapped, size);
+    return false;
+  }
+
+  for(size_t i = 0; i < this->_sections.size(); i++){
+    Section& s = this->_sections[i];
+    for(uint32_t k = 0; k < sections; k++){
+      const uint8_t* entry = data + table + (size_t)k*24;
+      if(get<uint32_t>(entry) != s.tag) continue;
+      uint64_t offset = get<uint64_t>(entry + 8), bytes = get<uint64_t>(entry + 16);
+      if(offset > table || bytes > table - offset ||
+         WriteAheadLog::crc32c(0, data + offset, bytes) != get<uint32_t>(entry + 4)){
+        LOG("%s: section %u damaged", path, s.tag);
+      }else{
+        s.restored = s.state->restore(data + offset, bytes);
+        if(!s.restored) LOG("%s: section %u doesn't fit this run, that state starts cold", path, s.tag);
+      }
+      break;
+    }
+  }
+  munmap(mapped, size);
+  *lsn = at;
+  LOG("checkpoint %s restored in %lld ms: LSN %llu, taken %lld s ago", path,
+      (long long)(nowMicros() - started)/1000, (unsigned long long)at, (long long)(started - created)/1000000);
+  return true;
+}
+
+int Checkpointer::write(uint64_t lsn) const
+{
+  std::string tmp = this->_path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(fd < 0){
+    LOG("%s: %s", tmp.c_str(), strerror(errno));
+    return CHECKPOINT_FAILED;
+  }
+  uint8_t header[CHECKPOINT_HEADER_SIZE] = {0};
+  std::vector<uint8_t> table;
+  std::string out;
+  uint64_t offset = CHECKPOINT_HEADER_SIZE;
+  bool ok = writeAll(fd, header, sizeof(header));
+  for(size_t i = 0; ok && i < this->_sections.size(); i++){
+    out.clear();
+    if(!this->_sections[i].state->save(out)){
+      close(fd);
+      unlink(tmp.c_str());
+      return CHECKPOINT_BUSY;
+    }
+    uint8_t entry[24];
+    put<uint32_t>(entry, this->_sections[i].tag);
+    put<uint32_t>(entry + 4, WriteAheadLog::crc32c(0, (const uint8_t*)out.data(), out.size()));
+    put<uint64_t>(entry + 8, offset);
+    put<uint64_t>(entry + 16, out.size());
+    table.insert(table.end(), entry, entry + sizeof(entry));
+    out.resize((out.size() + 7) & ~(size_t)7, '\0');
+    ok = writeAll(fd, out.data(), out.size());
+    offset += out.size();
+  }
+  memcpy(header, checkpointMagic, sizeof(checkpointMagic));
+  put<uint32_t>(header + 8, CHECKPOINT_VERSION);
+  put<uint32_t>(header + 12, this->_sections.size());
+  put<uint64_t>(header + 16, lsn);
+  put<int64_t>(header + 24, nowMicros());
+  put<uint32_t>(header + 32, mapHash(this->_map));
+  put<uint32_t>(header + 36, WriteAheadLog::crc32c(0, table.data(), table.size()));
+  put<uint64_t>(header + 40, offset);
+  ok = ok && writeAll(fd, table.data(), table.size()) && pwrite(fd, header, sizeof(header), 0) == sizeof(header) &&
+       fsync(fd) == 0;
+  if(!ok) LOG("%s: %s", tmp.c_str(), strerror(errno));
+  close(fd);
+  if(ok && rename(tmp.c_str(), this->_path.c_str()) < 0){
+    LOG("%s: %s", this->_path.c_str(), strerror(errno));
+    ok = false;
+  }
+  if(!ok){
+    unlink(tmp.c_str());
+    return CHECKPOINT_FAILED;
+  }
+  std::string dir = this->_path.substr(0, this->_path.rfind('/') + 1);
+  int dirFd = open(dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(dirFd >= 0){
+    fsync(dirFd);                                        // the log is cut after it, the rename must not get lost
+    close(dirFd);
+  }
+  return CHECKPOINT_OK;
+}
+
+void Checkpointer::reap(bool wait)
+{
+  int status;
+  pid_t pid = waitpid(this->_child, &status, wait ? 0 : WNOHANG);
+  if(pid == 0) return;                                   // still writing
+  this->_child = 0;
+  int code = pid > 0 && WIFEXITED(status) ? WEXITSTATUS(status) : CHECKPOINT_FAILED;
+  if(code == CHECKPOINT_OK){
+    this->_wal.checkpointed(this->_childLsn);
+    DBG("checkpoint at LSN %llu written in %lld ms", (unsigned long long)this->_childLsn,
+        (long long)(nowMicros() - this->_childStarted)/1000);
+  }else if(code == CHECKPOINT_BUSY){
+    LOG("checkpoint skipped, state was being changed by another thread");
+  }else{
+    LOG("checkpoint at LSN %llu failed", (unsigned long long)this->_childLsn);
+  }
+}
+
+void Checkpointer::push(const Reading* readings, size_t count)
+{
+  (void)readings;
+  (void)count;
+  if(this->_child) reap(false);
+  int64_t now = nowMicros();
+  if(this->_child || now < this->_due) return;
+  this->_due = now + this->_interval;
+  // every sink before this one has taken the readings below lsn, and nothing else of this thread runs until
+  // fork() returns: the child's copy of the state is exactly the state at lsn
+  uint64_t lsn = this->_wal.appended();
+  pid_t pid = fork();
+  if(pid == 0) _exit(write(lsn));
+  if(pid < 0){
+    LOG("checkpoint: fork: %s", strerror(errno));
+    return;
+  }
+  this->_child = pid;
+  this->_childLsn = lsn;
+  this->_childStarted = now;
+}
+
+void Checkpointer::end()
+{
+  if(this->_child) reap(true);
+  if(this->_path.empty()) return;
+  uint64_t lsn = this->_wal.appended();
+  int code = write(lsn);
+  if(code == CHECKPOINT_OK){
+    this->_wal.checkpointed(lsn);
+    LOG("checkpoint at LSN %llu written", (unsigned long long)lsn);
+  }else if(code == CHECKPOINT_BUSY){
+    LOG("last checkpoint skipped, state was being changed by another thread");
+  }
+}
@@ -0,0 +1,145 @@
+/*!
+ * @file Checkpoint.h
+ * @brief Define the basic structure of class Checkpointer
+ * @details Periodic snapshots of the in-memory state derived from the readings (rollups, drift detector, rule
+ * @n state), so a restarted gateway serves correct figures right away instead of scanning the store and
+ * @n relearning every sensor. A checkpoint holds the state after the readings below some WriteAheadLog LSN; at
+ * @n start it is restored and the log is replayed from that LSN on.
+ * @n Snapshots are copy-on-write: between two batches the ingest thread fork()s, which freezes the state of
+ * @n every sink at one point of the stream for the cost of copying page tables, and the child writes it out and
+ * @n exits while ingest goes on. The child only reads memory and writes a file; state another thread was
+ * @n changing at the fork (e.g. a rollup lock held by a reprocess) makes the child give up, and the checkpoint
+ * @n is taken again at the next interval.
+ * @n File <dir>/checkpoint, written to a temporary name, fsync()ed and renamed, loaded with mmap:
+ * @n   header (64): magic "GWCKPT\0\0" | version (4) | sections (4) | LSN (8) | created us (8) | device map hash (4)
+ * @n                | CRC-32C of the table (4) | table offset (8) | 0 (16)
+ * @n   sections, each 8 byte aligned
+ * @n   table: per section tag (4) | CRC-32C (4) | offset (8) | bytes (8)
+ * @n A checkpoint of another format version or device map, or that doesn't pass its CRCs, is ignored and the
+ * @n state is built the slow way. A section a component refuses (e.g. the rules file changed) leaves only that
+ * @n component cold.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_CHECKPOINT_H_
+#define _GATEWAY_CHECKPOINT_H_
+
+#include "DeviceMap.h"
+#include "Reading.h"
+#include "WriteAheadLog.h"
+
+#include <stdint.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#define CHECKPOINT_VERSION      1
+#define CHECKPOINT_INTERVAL_S   300
+#define CHECKPOINT_HEADER_SIZE  64
+
+#define CHECKPOINT_ROLLUPS      1
+#define CHECKPOINT_DRIFT        2
+#define CHECKPOINT_RULES        3
+
+#define CHECKPOINT_OK           0   ///<exit codes of the child
+#define CHECKPOINT_FAILED       1
+#define CHECKPOINT_BUSY         2
+
+/*!
+ * @brief State that goes into checkpoints
+ */
+class Checkpointable
+{
+public:
+  virtual ~Checkpointable() {}
+
+  /*!
+   * @fn save
+   * @brief Append the state to out. Runs in the forked child, where no other thread exists: must not wait
+   * @n for a lock, and returns false if it finds one held
+   */
+  virtual bool save(std::string& out) const = 0;
+
+  /*!
+   * @fn restore
+   * @brief Take the state from what save() wrote in an earlier run, at start before any reading
+   * @return false if it doesn't fit this run; the component must be left as if restore wasn't called
+   */
+  virtual bool restore(const uint8_t* data, size_t size) = 0;
+};
+
+class Checkpointer : public ReadingSink
+{
+public:
+  /*!
+   * @fn Checkpointer
+   * @brief Constructor
+   * @param wal  Gives the LSN of a checkpoint and keeps the log from the last one on
+   * @param intervalS  Seconds between checkpoints
+   */
+  Checkpointer(const DeviceMap& map, WriteAheadLog& wal, int intervalS = CHECKPOINT_INTERVAL_S);
+  ~Checkpointer();
+
+  /*!
+   * @fn add
+   * @brief Save state under tag from now on, call before load()
+   */
+  void add(uint32_t tag, Checkpointable* state);
+
+  /*!
+   * @fn load
+   * @brief Restore the states from the checkpoint in path, if it fits this run and the log still has the
+   * @n readings after it
+   * @param lsn  Receives the LSN to replay the log from
+   * @return false if there is no usable checkpoint
+   */
+  bool load(const char* path, uint64_t* lsn);
+
+  /*!
+   * @fn restored
+   * @brief Whether load() restored the state saved under tag; only those states get the log replayed
+   */
+  bool restored(uint32_t tag) const;
+
+  /*!
+   * @fn push
+   * @brief Starts a checkpoint when one is due, called after the sinks whose state it saves
+   */
+  virtual void push(const Reading* readings, size_t count);
+
+  /*!
+   * @fn end
+   * @brief Wait for a running checkpoint, then write a last one on this thread; call once ingest and the
+   * @n other threads changing saved state have stopped
+   */
+  void end();
+
+  /*!
+   * @fn mapHash
+   * @brief CRC-32C over what the saved state depends on in the device map: sensor ids, farms, devices, probes
+   */
+  static uint32_t mapHash(const DeviceMap& map);
+
+private:
+  struct Section {
+    uint32_t tag;
+    Checkpointable* state;
+    bool restored;
+  };
+
+  const DeviceMap& _map;
+  WriteAheadLog& _wal;
+  int64_t _interval;                    ///<us
+  std::string _path;
+  std::vector<Section> _sections;
+  int64_t _due;
+  pid_t _child;                         ///<writing a checkpoint, 0 if none
+  uint64_t _childLsn;
+  int64_t _childStarted;
+
+private:
+  int write(uint64_t lsn) const;
+  void reap(bool wait);
+};
+
+#endif
@@ -0,0 +1,1207 @@
+/*!
+ * @file ColumnStore.cpp
+ * @brief Define the basic structure of class ColumnStore
+ * @details Per sensor append-only, memory-mapped timestamp/value columns, packed once full.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "ColumnStore.h"
+#include "Log.h"
+#include "ProbeMath.h"
+#include "SeriesCodec.h"
+
+#include <algorithm>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+static size_t segmentSize(uint32_t capacity, uint32_t columns)
+{
+  size_t row = sizeof(int64_t) + sizeof(float);
+  if(columns & STORE_COLUMNS_PROBE) row += 2*sizeof(float) + sizeof(uint16_t);
+  return STORE_HEADER_SIZE + (size_t)capacity*row;
+}
+
+/*!
+ * @brief Directory name of a sensor: its sensor_id with path separators replaced
+ */
+static std::string seriesName(const std::string& sensorId)
+{
+  std::string name = sensorId;
+  for(size_t i = 0; i < name.size(); i++)
+    if(name[i] == '/' || name[i] == '\0') name[i] = '_';
+  if(name.empty() || name[0] == '.') name.insert(0, "_");
+  return name;
+}
+
+
+static bool writeAll(int fd, const void* data, size_t length)
+{
+  const char* p = (const char*)data;
+  while(length){
+    ssize_t n = ::write(fd, p, length);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return false;
+    }
+    p += n;
+    length -= n;
+  }
+  return true;
+}
+
+ColumnStore::ReadGuard::ReadGuard(const ColumnStore& store)
+{
+  while(true){
+    uint64_t epoch = store._epoch.load();
+    this->_readers = &store._readers[epoch & 1];
+    this->_readers->fetch_add(1);
+    if(store._epoch.load() == epoch) return;             // else retire() may have looked at this counter already
+    this->_readers->fetch_sub(1);
+  }
+}
+
+ColumnStore::ColumnStore(const DeviceMap& map, uint32_t segmentRows)
+  : _map(map)
+{
+  this->_segmentRows = segmentRows;
+  this->_epoch = 0;
+  this->_readers[0] = 0;
+  this->_readers[1] = 0;
+  this->_stopping = false;
+  this->_ioUntil = 0;
+  for(int q = 0; q <= QUANTITY_VOLTAGE; q++) this->_retainDays[q] = 0;
+}
+
+bool ColumnStore::retain(const char* spec)
+{
+  const char* p = spec;
+  while(*p){
+    const char* eq = strchr(p, '=');
+    if(eq == NULL){
+      LOG("retention %s: expected <type>=<days>", spec);
+      return false;
+    }
+    std::string name(p, eq - p);
+    uint8_t quantity = name == "*" ? 0 : DeviceMap::quantityFromName(name.c_str());
+    char* end;
+    long days = strtol(eq + 1, &end, 10);
+    if((quantity == 0 && name != "*") || quantity > QUANTITY_VOLTAGE){
+      LOG("retention %s: unknown type %s, expected ph, ec, temperature, voltage or *", spec, name.c_str());
+      return false;
+    }
+    if(end == eq + 1 || (*end && *end != ',') || days < STORE_RETAIN_MIN_D){
+      LOG("retention %s: %s needs a number of days >= %d", spec, name.c_str(), STORE_RETAIN_MIN_D);
+      return false;
+    }
+    this->_retainDays[quantity] = days;
+    p = *end ? end + 1 : end;
+  }
+  return true;
+}
+
+ColumnStore::~ColumnStore()
+{
+  end();
+  for(size_t i = 0; i < this->_series.size(); i++){
+    Series& series = *this->_series[i];
+    uint32_t n = series.segmentCount.load();
+    for(uint32_t k = series.segmentFirst.load(); k < n; k++){
+      Segment* s = slot(series, k).load();
+      munmap(s->base, s->mapped);
+      delete s;
+    }
+    if(series.lateFd >= 0) close(series.lateFd);
+  }
+}
+
+bool ColumnStore::begin(const char* dir)
+{
+  this->_dir = dir;
+  if(mkdir(dir, 0755) < 0 && errno != EEXIST){
+    LOG("%s: %s", dir, strerror(errno));
+    return false;
+  }
+  uint64_t rows = 0, bytes = 0;
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    Series* series = new Series();
+    this->_series.emplace_back(series);
+    series->dir = this->_dir + "/" + seriesName(this->_map.sensor(i).sensorId);
+    series->segments.reset(new std::atomic<Segment*>[STORE_MAX_SEGMENTS]());
+    series->last = INT64_MIN;
+    series->dropped = 0;
+    series->lateFd = -1;
+    series->columns = this->_map.sensor(i).probe != PROBE_NONE ? STORE_COLUMNS_PROBE : 0;
+    const SensorInfo& info = this->_map.sensor(i);
+    uint8_t quantity = info.probe == PROBE_NONE ? info.quantity : probeQuantity(info.probe);
+    int days = quantity <= QUANTITY_VOLTAGE && this->_retainDays[quantity] ? this->_retainDays[quantity]
+                                                                            : this->_retainDays[0];
+    series->retain = (int64_t)days*86400*1000000;
+    if(mkdir(series->dir.c_str(), 0755) < 0 && errno != EEXIST){
+      LOG("%s: %s", series->dir.c_str(), strerror(errno));
+      return false;
+    }
+    if(!loadSeries(*series) || !loadLate(*series)) return false;
+    std::vector<ColdBucket> cold;
+    int64_t coldEnd;
+    series->coldEnd = loadCold(*series, cold, &coldEnd) ? coldEnd : INT64_MIN;
+    rows += this->rows(i);
+    bytes += this->bytes(i);
+  }
+  LOG("column store %s: %zu sensors, %llu rows, %.1f MB", dir, this->_series.size(), (unsigned long long)rows,
+      bytes/1048576.0);
+  this->_packer = std::thread(&ColumnStore::packLoop, this);
+  pthread_setname_np(this->_packer.native_handle(), "gw-pack");
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  for(uint32_t i = 0; i < this->_series.size(); i++) this->_pending.push_back(i);   // full segments of earlier runs
+  this->_wake.notify_one();
+  return true;
+}
+
+void ColumnStore::end()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_stopping = true;
+  }
+  this->_wake.notify_all();
+  if(this->_packer.joinable()) this->_packer.join();
+}
+
+bool ColumnStore::openSegment(Series& series, const std::string& path, bool create)
+{
+  uint32_t index = series.segmentCount.load(std::memory_order_relaxed);
+  if(index - series.segmentFirst.load(std::memory_order_relaxed) >= STORE_MAX_SEGMENTS){
+    LOG("%s: segment limit reached", series.dir.c_str());
+    return false;
+  }
+  int fd = open(path.c_str(), O_RDWR | O_CLOEXEC | (create ? O_CREAT | O_EXCL : 0), 0644);
+  if(fd < 0){
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  struct stat st;
+  uint32_t capacity = this->_segmentRows;
+  uint32_t columns = series.columns;
+  if(!create){
+    SegmentHeader h;
+    if(fstat(fd, &st) < 0 || pread(fd, &h, sizeof(h), 0) != (ssize_t)sizeof(h) || h.magic != STORE_MAGIC ||
+       h.version != STORE_VERSION || h.headerSize != STORE_HEADER_SIZE ||
+       (size_t)st.st_size < segmentSize(h.capacity, h.columns)){
+      LOG("%s: not a segment of this version, skipped", path.c_str());
+      close(fd);
+      return true;
+    }
+    capacity = h.capacity;
+    columns = h.columns;
+  }else if(ftruncate(fd, segmentSize(capacity, columns)) < 0){   // sparse, pages are allocated as rows arrive
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    close(fd);
+    unlink(path.c_str());
+    return false;
+  }
+  size_t size = segmentSize(capacity, columns);
+  void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED){
+    LOG("%s: mmap: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  Segment* s = new Segment();
+  s->base = p;
+  s->mapped = size;
+  s->header = (SegmentHeader*)p;
+  s->timestamps = (int64_t*)((uint8_t*)p + STORE_HEADER_SIZE);
+  s->values = (float*)(s->timestamps + capacity);
+  s->raw = s->temperatures = NULL;
+  s->calibrations = NULL;
+  if(columns & STORE_COLUMNS_PROBE){
+    s->raw = s->values + capacity;
+    s->temperatures = s->raw + capacity;
+    s->calibrations = (uint16_t*)(s->temperatures + capacity);
+  }
+  s->packed = NULL;
+  s->blocks = NULL;
+  if(create){
+    s->header->magic = STORE_MAGIC;
+    s->header->version = STORE_VERSION;
+    s->header->headerSize = STORE_HEADER_SIZE;
+    s->header->capacity = capacity;
+    s->header->count = 0;
+    s->header->sequence = index == 0 ? 0 : slot(series, index-1).load(std::memory_order_relaxed)->sequence + 1;
+    s->header->columns = columns;
+  }
+  s->sequence = s->header->sequence;
+  uint32_t count = s->header->count;
+  if(count > capacity) s->header->count = count = capacity;
+  if(count) series.last = std::max(series.last, s->timestamps[count-1]);
+  slot(series, index).store(s, std::memory_order_release);
+  series.segmentCount.store(index + 1, std::memory_order_release);
+  return true;
+}
+
+ColumnStore::Segment* ColumnStore::mapPacked(const std::string& path)
+{
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0){
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    return NULL;
+  }
+  struct stat st;
+  size_t size = fstat(fd, &st) == 0 ? st.st_size : 0;
+  void* p = size >= sizeof(PackedHeader) ? mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+  close(fd);
+  if(p == MAP_FAILED){
+    LOG("%s: not a packed segment, skipped", path.c_str());
+    return NULL;
+  }
+  const PackedHeader* h = (const PackedHeader*)p;
+  const PackedBlock* blocks = (const PackedBlock*)(h + 1);
+  bool ok = h->magic == STORE_PACKED_MAGIC && h->version == STORE_VERSION && h->headerSize == STORE_HEADER_SIZE &&
+            h->blocks <= (size - sizeof(PackedHeader))/sizeof(PackedBlock);
+  uint64_t rows = 0;
+  for(uint32_t b = 0; ok && b < h->blocks; b++){
+    const PackedBlock& e = blocks[b];
+    ok = e.rows && e.rows <= STORE_BLOCK_ROWS && e.offset <= size && e.ends[STORE_STREAMS-1] <= size - e.offset;
+    for(int k = 1; ok && k < STORE_STREAMS; k++) ok = e.ends[k-1] <= e.ends[k];
+    rows += e.rows;
+  }
+  if(!ok || rows != h->count){
+    LOG("%s: not a packed segment of this version, skipped", path.c_str());
+    munmap(p, size);
+    return NULL;
+  }
+  Segment* s = new Segment();
+  memset(s, 0, sizeof(*s));
+  s->sequence = h->sequence;
+  s->base = p;
+  s->mapped = size;
+  s->packed = h;
+  s->blocks = blocks;
+  return s;
+}
+
+bool ColumnStore::openPacked(Series& series, const std::string& path)
+{
+  uint32_t index = series.segmentCount.load(std::memory_order_relaxed);
+  if(index - series.segmentFirst.load(std::memory_order_relaxed) >= STORE_MAX_SEGMENTS){
+    LOG("%s: segment limit reached", series.dir.c_str());
+    return false;
+  }
+  Segment* s = mapPacked(path);
+  if(s == NULL) return false;
+  if(s->packed->count) series.last = std::max(series.last, s->packed->last);
+  slot(series, index).store(s, std::memory_order_release);
+  series.segmentCount.store(index + 1, std::memory_order_release);
+  return true;
+}
+
+bool ColumnStore::loadSeries(Series& series)
+{
+  DIR* d = opendir(series.dir.c_str());
+  if(d == NULL) return false;
+  std::vector<uint32_t> raw, packed;
+  struct dirent* e;
+  while((e = readdir(d)) != NULL){
+    char* end;
+    unsigned long sequence = strtoul(e->d_name, &end, 10);
+    if(end == e->d_name) continue;
+    if(strcmp(end, ".seg") == 0) raw.push_back(sequence);
+    else if(strcmp(end, ".pack") == 0) packed.push_back(sequence);
+    else if(strcmp(end, ".pack.tmp") == 0) unlink((series.dir + "/" + e->d_name).c_str());   // packing was cut off
+  }
+  closedir(d);
+  unlink((series.dir + "/cold.tmp").c_str());           // moving rows to the cold tier was cut off, the segments stay
+  std::vector<uint32_t> sequences(raw);
+  sequences.insert(sequences.end(), packed.begin(), packed.end());
+  std::sort(raw.begin(), raw.end());
+  std::sort(packed.begin(), packed.end());
+  std::sort(sequences.begin(), sequences.end());
+  sequences.erase(std::unique(sequences.begin(), sequences.end()), sequences.end());
+  for(size_t i = 0; i < sequences.size(); i++){
+    char name[32];
+    bool hasRaw = std::binary_search(raw.begin(), raw.end(), sequences[i]);
+    snprintf(name, sizeof(name), "/%08u.pack", sequences[i]);
+    if(std::binary_search(packed.begin(), packed.end(), sequences[i]) && openPacked(series, series.dir + name)){
+      snprintf(name, sizeof(name), "/%08u.seg", sequences[i]);
+      if(hasRaw) unlink((series.dir + name).c_str());   // packed, the gateway stopped before deleting it
+      continue;
+    }
+    snprintf(name, sizeof(name), "/%08u.seg", sequences[i]);
+    if(hasRaw && !openSegment(series, series.dir + name, false)) return false;
+  }
+  return true;
+}
+
+bool ColumnStore::loadLate(Series& series)
+{
+  // late rows the last run didn't merge, a torn record at the end is left out
+  std::string path = series.dir + "/late";
+  unlink((path + ".tmp").c_str());
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0) return true;
+  struct stat st;
+  size_t count = fstat(fd, &st) == 0 ? st.st_size/sizeof(LateRow) : 0;
+  series.late.resize(count);
+  if(count && pread(fd, series.late.data(), count*sizeof(LateRow), 0) != (ssize_t)(count*sizeof(LateRow))){
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    close(fd);
+    return false;
+  }
+  close(fd);
+  series.lateCount.store(count);
+  return writeLate(series);
+}
+
+bool ColumnStore::writeLate(Series& series)
+{
+  // the whole file under a temporary name: a crash leaves the rows before or after, never half of them
+  std::string path = series.dir + "/late", tmp = path + ".tmp";
+  if(series.lateFd >= 0) close(series.lateFd);
+  series.lateFd = -1;
+  if(series.late.empty()){
+    if(unlink(path.c_str()) < 0 && errno != ENOENT) LOG("%s: %s", path.c_str(), strerror(errno));
+    return true;
+  }
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+  if(fd < 0 || !writeAll(fd, series.late.data(), series.late.size()*sizeof(LateRow)) ||
+     rename(tmp.c_str(), path.c_str()) < 0){
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    if(fd >= 0) close(fd);
+    unlink(tmp.c_str());
+    return false;
+  }
+  series.lateFd = fd;                                    // appended to under its new name
+  return true;
+}
+
+ColumnStore::Segment* ColumnStore::appendSegment(uint32_t sensor, Series& series)
+{
+  uint32_t n = series.segmentCount.load(std::memory_order_relaxed);
+  Segment* s = n ? slot(series, n-1).load(std::memory_order_relaxed) : NULL;
+  if(s == NULL || s->packed || s->header->count == s->header->capacity){
+    char name[32];
+    snprintf(name, sizeof(name), "/%08u.seg", s ? s->sequence + 1 : 0);
+    if(!openSegment(series, series.dir + name, true)){
+      series.dropped++;
+      return NULL;
+    }
+    if(s && this->_packer.joinable()){
+      std::lock_guard<std::mutex> lock(this->_mutex);
+      this->_pending.push_back(sensor);
+      this->_wake.notify_one();
+    }
+    s = slot(series, n).load(std::memory_order_relaxed);
+  }
+  return s;
+}
+
+bool ColumnStore::appendLate(uint32_t sensor, Series& series, const LateRow& row)
+{
+  uint32_t count;
+  {
+    std::lock_guard<std::mutex> lock(series.lateMutex);
+    if(series.lateFd < 0){
+      std::string path = series.dir + "/late";
+      series.lateFd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+      if(series.lateFd < 0){
+        LOG("%s: %s", path.c_str(), strerror(errno));
+        series.dropped++;
+        return false;
+      }
+    }
+    if(!writeAll(series.lateFd, &row, sizeof(row))){
+      LOG("%s/late: %s", series.dir.c_str(), strerror(errno));
+      series.dropped++;
+      return false;
+    }
+    series.late.push_back(row);
+    count = series.lateCount.load(std::memory_order_relaxed) + 1;
+    series.lateCount.store(count, std::memory_order_release);
+  }
+  if(count == STORE_LATE_ROWS && this->_packer.joinable()){
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_pending.push_back(sensor);
+    this->_wake.notify_one();
+  }
+  return true;
+}
+
+bool ColumnStore::append(uint32_t sensor, int64_t timestamp, float value)
+{
+  Series& series = *this->_series[sensor];
+  if(timestamp < series.last){
+    LateRow row;
+    memset(&row, 0, sizeof(row));
+    row.timestamp = timestamp;
+    row.value = value;
+    row.raw = row.temperature = NAN;                     // not a probe reading, nothing to convert again
+    return appendLate(sensor, series, row);
+  }
+  Segment* s = appendSegment(sensor, series);
+  if(s == NULL) return false;
+  uint32_t count = s->header->count;
+  s->timestamps[count] = timestamp;
+  s->values[count] = value;
+  if(s->raw){
+    s->raw[count] = NAN;
+    s->temperatures[count] = NAN;
+    s->calibrations[count] = 0;
+  }
+  __atomic_store_n(&s->header->count, count + 1, __ATOMIC_RELEASE);
+  series.last = timestamp;
+  return true;
+}
+
+bool ColumnStore::append(const Reading& r)
+{
+  Series& series = *this->_series[r.sensor];
+  if(r.timestamp < series.last){
+    LateRow row;
+    memset(&row, 0, sizeof(row));
+    row.timestamp = r.timestamp;
+    row.value = r.value;
+    row.raw = r.calibration ? r.raw : NAN;
+    row.temperature = r.temperature;
+    row.calibration = r.calibration;
+    return appendLate(r.sensor, series, row);
+  }
+  Segment* s = appendSegment(r.sensor, series);
+  if(s == NULL) return false;
+  uint32_t count = s->header->count;
+  s->timestamps[count] = r.timestamp;
+  s->values[count] = r.value;
+  if(s->raw){
+    s->raw[count] = r.calibration ? r.raw : NAN;
+    s->temperatures[count] = r.temperature;
+    s->calibrations[count] = r.calibration;
+  }
+  __atomic_store_n(&s->header->count, count + 1, __ATOMIC_RELEASE);
+  series.last = r.timestamp;
+  return true;
+}
+
+void ColumnStore::push(const Reading* readings, size_t count)
+{
+  for(size_t i = 0; i < count; i++) append(readings[i]);
+}
+
+bool ColumnStore::latest(uint32_t sensor, Sample* sample) const
+{
+  const Series& series = *this->_series[sensor];
+  ReadGuard guard(*this);
+  uint32_t n = series.segmentCount.load(std::memory_order_acquire);
+  uint32_t first = series.segmentFirst.load(std::memory_order_acquire);
+  for(uint32_t k = n; k-- > first;){                     // the newest segment is empty right after a roll only
+    const Segment& s = *slot(series, k).load(std::memory_order_acquire);
+    uint32_t count = published(s);
+    if(count == 0) continue;
+    if(s.packed){
+      sample->timestamp = s.packed->last;
+      sample->value = s.packed->lastValue;
+    }else{
+      sample->timestamp = s.timestamps[count-1];
+      sample->value = s.values[count-1];
+    }
+    return true;
+  }
+  return false;
+}
+
+size_t ColumnStore::latest(uint32_t sensor, size_t n, Sample* samples) const
+{
+  const Series& series = *this->_series[sensor];
+  ReadGuard guard(*this);
+  int64_t timestamps[STORE_BLOCK_ROWS];
+  float values[STORE_BLOCK_ROWS];
+  size_t got = 0;
+  uint32_t first = series.segmentFirst.load(std::memory_order_acquire);
+  for(uint32_t k = series.segmentCount.load(std::memory_order_acquire); k-- > first && got < n;){
+    const Segment& s = *slot(series, k).load(std::memory_order_acquire);
+    if(s.packed){
+      for(uint32_t b = s.packed->blocks; b-- > 0 && got < n;){
+        decode(s, b, timestamps, values);
+        for(uint32_t i = s.blocks[b].rows; i-- > 0 && got < n; got++){
+          samples[got].timestamp = timestamps[i];
+          samples[got].value = values[i];
+        }
+      }
+      continue;
+    }
+    for(uint32_t i = published(s); i-- > 0 && got < n; got++){
+      samples[got].timestamp = s.timestamps[i];
+      samples[got].value = s.values[i];
+    }
+  }
+  return got;
+}
+
+size_t ColumnStore::lowerBound(const int64_t* timestamps, size_t count, int64_t timestamp)
+{
+  return std::lower_bound(timestamps, timestamps + count, timestamp) - timestamps;
+}
+
+uint32_t ColumnStore::firstSegment(const Series& series, uint32_t n, int64_t from) const
+{
+  // first segment whose last row is >= from; segments are in time order
+  uint32_t lo = series.segmentFirst.load(std::memory_order_acquire), hi = n;
+  while(lo < hi){
+    uint32_t mid = (lo + hi)/2;
+    const Segment& s = *slot(series, mid).load(std::memory_order_acquire);
+    uint32_t count = published(s);
+    if(count && lastTimestamp(s, count) < from) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+void ColumnStore::decode(const Segment& s, uint32_t block, int64_t* timestamps, float* values)
+{
+  const PackedBlock& e = s.blocks[block];
+  const uint8_t* data = (const uint8_t*)s.base + e.offset;
+  decodeTimestamps(data, e.ends[0], e.first, e.rows, timestamps);
+  decodeFloats(data + e.ends[0], e.ends[1] - e.ends[0], e.rows, values);
+}
+
+void ColumnStore::decodeAll(const Segment& s, Columns& columns)
+{
+  uint32_t count = s.packed->count;
+  bool probe = s.packed->columns & STORE_COLUMNS_PROBE;
+  columns.timestamps.resize(count);
+  columns.values.resize(count);
+  columns.raw.resize(probe ? count : 0);
+  columns.temperatures.resize(probe ? count : 0);
+  columns.calibrations.resize(probe ? count : 0);
+  size_t at = 0;
+  for(uint32_t b = 0; b < s.packed->blocks; b++){
+    const PackedBlock& e = s.blocks[b];
+    const uint8_t* data = (const uint8_t*)s.base + e.offset;
+    decode(s, b, &columns.timestamps[at], &columns.values[at]);
+    if(probe){
+      decodeFloats(data + e.ends[1], e.ends[2] - e.ends[1], e.rows, &columns.raw[at]);
+      decodeFloats(data + e.ends[2], e.ends[3] - e.ends[2], e.rows, &columns.temperatures[at]);
+      decodeVersions(data + e.ends[3], e.ends[4] - e.ends[3], e.rows, &columns.calibrations[at]);
+    }
+    at += e.rows;
+  }
+}
+
+size_t ColumnStore::visit(SpanVisitor& visitor, const int64_t* timestamps, const float* values, size_t count,
+                          LateCursor* late)
+{
+  if(late == NULL || late->next == late->rows.size() || late->rows[late->next].timestamp > timestamps[count-1]){
+    visitor.span(timestamps, values, count);
+    return count;
+  }
+  // late rows up to the span's last one, and those before it that fell between two spans
+  late->timestamps.clear();
+  late->values.clear();
+  for(size_t i = 0; i < count; i++){
+    for(; late->next < late->rows.size() && late->rows[late->next].timestamp < timestamps[i]; late->next++){
+      late->timestamps.push_back(late->rows[late->next].timestamp);
+      late->values.push_back(late->rows[late->next].value);
+    }
+    late->timestamps.push_back(timestamps[i]);
+    late->values.push_back(values[i]);
+  }
+  for(; late->next < late->rows.size() && late->rows[late->next].timestamp == timestamps[count-1]; late->next++){
+    late->timestamps.push_back(late->rows[late->next].timestamp);
+    late->values.push_back(late->rows[late->next].value);
+  }
+  visitor.span(late->timestamps.data(), late->values.data(), late->timestamps.size());
+  return late->timestamps.size();
+}
+
+size_t ColumnStore::scanPacked(const Segment& s, int64_t from, int64_t to, SpanVisitor& visitor, LateCursor* late)
+{
+  uint32_t lo = 0, hi = s.packed->blocks;
+  while(lo < hi){                                        // first block whose last row is >= from
+    uint32_t mid = (lo + hi)/2;
+    if(s.blocks[mid].last < from) lo = mid + 1;
+    else hi = mid;
+  }
+  int64_t timestamps[STORE_BLOCK_ROWS];
+  float values[STORE_BLOCK_ROWS];
+  size_t visited = 0;
+  for(uint32_t b = lo; b < s.packed->blocks; b++){
+    const PackedBlock& e = s.blocks[b];
+    if(e.first >= to) break;
+    bool alone = late == NULL || late->next == late->rows.size() || late->rows[late->next].timestamp > e.last;
+    if(alone && e.first >= from && e.last < to && !isnan(e.min) && visitor.summary(e.rows, e.sum, e.min, e.max)){
+      visited += e.rows;
+      continue;
+    }
+    decode(s, b, timestamps, values);
+    size_t begin = e.first >= from ? 0 : lowerBound(timestamps, e.rows, from);
+    size_t end = e.last < to ? e.rows : lowerBound(timestamps, e.rows, to);
+    if(end > begin) visited += visit(visitor, timestamps + begin, values + begin, end - begin, late);
+  }
+  return visited;
+}
+
+/*!
+ * @brief Copies visited spans into a vector of samples
+ */
+class CopyVisitor : public SpanVisitor
+{
+public:
+  CopyVisitor(std::vector<Sample>& samples) : _samples(samples) {}
+
+  virtual void span(const int64_t* timestamps, const float* values, size_t count)
+  {
+    size_t base = this->_samples.size();
+    this->_samples.resize(base + count);
+    for(size_t i = 0; i < count; i++){
+      this->_samples[base+i].timestamp = timestamps[i];
+      this->_samples[base+i].value = values[i];
+    }
+  }
+
+private:
+  std::vector<Sample>& _samples;
+};
+
+size_t ColumnStore::scan(uint32_t sensor, int64_t from, int64_t to, SpanVisitor& visitor) const
+{
+  const Series& series = *this->_series[sensor];
+  if(series.lateCount.load(std::memory_order_acquire) == 0) return scanSegments(series, from, to, visitor, NULL);
+  // late rows not merged yet go into the spans they fall in. A merge moves rows from late to a segment: it
+  // waits for the scans that took their late rows before it (lateReaders), the scans after it wait for it
+  // (odd lateVersion), so no row is visited twice
+  while(true){
+    series.lateReaders.fetch_add(1);
+    if((series.lateVersion.load() & 1) == 0) break;
+    series.lateReaders.fetch_sub(1);
+    sched_yield();
+  }
+  LateCursor late;
+  late.next = 0;
+  {
+    std::lock_guard<std::mutex> lock(series.lateMutex);
+    for(size_t i = 0; i < series.late.size(); i++){
+      const LateRow& r = series.late[i];
+      if(r.timestamp != INT64_MIN && r.timestamp >= from && r.timestamp < to) late.rows.push_back(Sample{r.timestamp, r.value});
+    }
+  }
+  if(late.rows.empty()){
+    series.lateReaders.fetch_sub(1);                     // a merge now moves none of the range's rows
+    return scanSegments(series, from, to, visitor, NULL);
+  }
+  std::stable_sort(late.rows.begin(), late.rows.end(), [](const Sample& a, const Sample& b){
+    return a.timestamp < b.timestamp;
+  });
+  size_t visited = scanSegments(series, from, to, visitor, &late);
+  series.lateReaders.fetch_sub(1);
+  return visited;
+}
+
+size_t ColumnStore::scanSegments(const Series& series, int64_t from, int64_t to, SpanVisitor& visitor,
+                                 LateCursor* late) const
+{
+  ReadGuard guard(*this);
+  uint32_t n = series.segmentCount.load(std::memory_order_acquire);
+  size_t visited = 0;
+  for(uint32_t k = firstSegment(series, n, from); k < n; k++){
+    const Segment& s = *slot(series, k).load(std::memory_order_acquire);
+    uint32_t count = published(s);
+    if(count == 0) continue;
+    if(firstTimestamp(s) >= to) break;
+    if(s.packed){
+      visited += scanPacked(s, from, to, visitor, late);
+      continue;
+    }
+    size_t begin = s.timestamps[0] >= from ? 0 : lowerBound(s.timestamps, count, from);
+    size_t end = s.timestamps[count-1] < to ? count : lowerBound(s.timestamps, count, to);
+    if(end > begin) visited += visit(visitor, s.timestamps + begin, s.values + begin, end - begin, late);
+  }
+  if(late && late->next < late->rows.size()){            // after the last stored row
+    late->timestamps.clear();
+    late->values.clear();
+    for(; late->next < late->rows.size(); late->next++){
+      late->timestamps.push_back(late->rows[late->next].timestamp);
+      late->values.push_back(late->rows[late->next].value);
+    }
+    visitor.span(late->timestamps.data(), late->values.data(), late->timestamps.size());
+    visited += late->timestamps.size();
+  }
+  return visited;
+}
+
+size_t ColumnStore::rewrite(uint32_t sensor, int64_t from, int64_t to, ProbeVisitor& visitor)
+{
+  Series& series = *this->_series[sensor];
+  std::lock_guard<std::mutex> lock(series.replacing);    // segments only change under it, no ReadGuard needed
+  uint32_t n = series.segmentCount.load(std::memory_order_acquire);
+  size_t visited = 0;
+  for(uint32_t k = firstSegment(series, n, from); k < n; k++){
+    Segment& s = *slot(series, k).load(std::memory_order_acquire);
+    uint32_t count = published(s);
+    if(count == 0) continue;
+    if(s.packed){
+      if(!(s.packed->columns & STORE_COLUMNS_PROBE)) continue;
+      if(s.packed->first >= to) break;
+      Columns columns;
+      decodeAll(s, columns);
+      size_t begin = lowerBound(columns.timestamps.data(), count, from);
+      size_t end = lowerBound(columns.timestamps.data(), count, to);
+      if(end <= begin) continue;
+      std::vector<float> values(columns.values.begin() + begin, columns.values.begin() + end);
+      std::vector<uint16_t> calibrations(columns.calibrations.begin() + begin, columns.calibrations.begin() + end);
+      ProbeSpan span;
+      span.timestamps = &columns.timestamps[begin];
+      span.values = &columns.values[begin];
+      span.raw = &columns.raw[begin];
+      span.temperatures = &columns.temperatures[begin];
+      span.calibrations = &columns.calibrations[begin];
+      span.count = end - begin;
+      visitor.span(span);
+      visited += end - begin;
+      if(memcmp(values.data(), span.values, span.count*sizeof(float)) != 0 ||
+         memcmp(calibrations.data(), span.calibrations, span.count*sizeof(uint16_t)) != 0)
+        replace(series, k, columns, count, s.packed->columns);
+      continue;
+    }
+    if(s.raw == NULL) continue;                          // segments written before the probe columns existed
+    if(s.timestamps[0] >= to) break;
+    size_t begin = s.timestamps[0] >= from ? 0 : lowerBound(s.timestamps, count, from);
+    size_t end = s.timestamps[count-1] < to ? count : lowerBound(s.timestamps, count, to);
+    if(end > begin){
+      ProbeSpan span;
+      span.timestamps = s.timestamps + begin;
+      span.values = s.values + begin;
+      span.raw = s.raw + begin;
+      span.temperatures = s.temperatures + begin;
+      span.calibrations = s.calibrations + begin;
+      span.count = end - begin;
+      visitor.span(span);
+      visited += end - begin;
+    }
+  }
+  return visited;
+}
+
+void ColumnStore::pack(const Columns& columns, size_t count, uint32_t columnSet, uint32_t sequence,
+                       std::vector<uint8_t>& file)
+{
+  uint32_t blocks = (count + STORE_BLOCK_ROWS - 1)/STORE_BLOCK_ROWS;
+  std::vector<PackedBlock> index(blocks);
+  file.assign(sizeof(PackedHeader) + blocks*sizeof(PackedBlock), 0);
+  for(uint32_t b = 0; b < blocks; b++){
+    size_t at = (size_t)b*STORE_BLOCK_ROWS, rows = std::min((size_t)STORE_BLOCK_ROWS, count - at);
+    PackedBlock& e = index[b];
+    memset(&e, 0, sizeof(e));
+    e.first = columns.timestamps[at];
+    e.last = columns.timestamps[at+rows-1];
+    e.rows = rows;
+    e.offset = file.size();
+    e.min = INFINITY;
+    e.max = -INFINITY;
+    for(size_t i = at; i < at + rows; i++){
+      float v = columns.values[i];
+      if(isnan(v)) e.min = e.max = NAN;
+      else if(!isnan(e.min)){
+        e.min = std::min(e.min, v);
+        e.max = std::max(e.max, v);
+      }
+      e.sum += v;
+    }
+    encodeTimestamps(&columns.timestamps[at], rows, file);
+    e.ends[0] = file.size() - e.offset;
+    encodeFloats(&columns.values[at], rows, file);
+    e.ends[1] = e.ends[2] = e.ends[3] = e.ends[4] = file.size() - e.offset;
+    if(columnSet & STORE_COLUMNS_PROBE){
+      encodeFloats(&columns.raw[at], rows, file);
+      e.ends[2] = file.size() - e.offset;
+      encodeFloats(&columns.temperatures[at], rows, file);
+      e.ends[3] = file.size() - e.offset;
+      encodeVersions(&columns.calibrations[at], rows, file);
+      e.ends[4] = file.size() - e.offset;
+    }
+  }
+  PackedHeader h;
+  memset(&h, 0, sizeof(h));
+  h.magic = STORE_PACKED_MAGIC;
+  h.version = STORE_VERSION;
+  h.headerSize = STORE_HEADER_SIZE;
+  h.count = count;
+  h.sequence = sequence;
+  h.columns = columnSet;
+  h.blocks = blocks;
+  h.first = count ? columns.timestamps[0] : 0;
+  h.last = count ? columns.timestamps[count-1] : 0;
+  h.lastValue = count ? columns.values[count-1] : 0;
+  memcpy(file.data(), &h, sizeof(h));
+  if(blocks) memcpy(file.data() + sizeof(h), index.data(), blocks*sizeof(PackedBlock));
+}
+
+bool ColumnStore::replace(Series& series, uint32_t index, const Columns& columns, size_t count, uint32_t columnSet)
+{
+  Segment* old = slot(series, index).load(std::memory_order_acquire);
+  std::vector<uint8_t> file;
+  pack(columns, count, columnSet, old->sequence, file);
+  char name[32];
+  snprintf(name, sizeof(name), "/%08u.pack", old->sequence);
+  std::string path = series.dir + name, tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0 && writeAll(fd, file.data(), file.size()) && fsync(fd) == 0;
+  if(fd >= 0) close(fd);
+  if(!ok || rename(tmp.c_str(), path.c_str()) < 0){
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    unlink(tmp.c_str());
+    return false;
+  }
+  int dirFd = open(series.dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(dirFd >= 0){
+    fsync(dirFd);                                        // the .pack must survive before the .seg goes
+    close(dirFd);
+  }
+  Segment* packed = mapPacked(path);
+  if(packed == NULL) return false;
+  bool wasRaw = old->packed == NULL;
+  slot(series, index).store(packed, std::memory_order_release);
+  if(wasRaw){
+    snprintf(name, sizeof(name), "/%08u.seg", old->sequence);
+    unlink((series.dir + name).c_str());
+  }
+  DBG("%s%s: %zu rows, %zu -> %zu bytes", series.dir.c_str(), name, count, old->mapped, file.size());
+  retire(old);
+  return true;
+}
+
+void ColumnStore::retire(Segment* segment)
+{
+  std::lock_guard<std::mutex> lock(this->_retiring);
+  // readers that began before the flip count on the old counter and may still look at the segment; later ones
+  // find the new one
+  uint64_t epoch = this->_epoch.fetch_add(1);
+  while(this->_readers[epoch & 1].load() != 0) usleep(1000);
+  munmap(segment->base, segment->mapped);
+  delete segment;
+}
+
+void ColumnStore::mergeLate(Series& series)
+{
+  if(series.lateCount.load(std::memory_order_acquire) == 0) return;
+  std::vector<std::pair<LateRow, size_t>> rows;          // with its index in series.late
+  {
+    std::lock_guard<std::mutex> lock(series.lateMutex);
+    for(size_t i = 0; i < series.late.size(); i++)
+      if(series.late[i].timestamp != INT64_MIN) rows.push_back(std::make_pair(series.late[i], i));
+  }
+  std::stable_sort(rows.begin(), rows.end(), [](const std::pair<LateRow, size_t>& a, const std::pair<LateRow, size_t>& b){
+    return a.first.timestamp < b.first.timestamp;
+  });
+  uint32_t n = series.segmentCount.load(std::memory_order_acquire);
+  int64_t coldEnd = series.coldEnd.load();
+  size_t i = 0, merged = 0, cold = 0;
+  while(i < rows.size() && rows[i].first.timestamp < coldEnd) i++;   // their hours are folded already
+  cold = i;
+  while(i < rows.size() && !this->_stopping){
+    uint32_t k = firstSegment(series, n, rows[i].first.timestamp);
+    if(k + 1 >= n) break;                                // the open segment's time: merged once it is full
+    const Segment& s = *slot(series, k).load(std::memory_order_acquire);
+    uint32_t count = published(s);
+    if(count == 0) break;
+    uint32_t columnSet = s.packed ? s.packed->columns : s.header->columns;
+    bool probe = columnSet & STORE_COLUMNS_PROBE;
+    Columns old;
+    if(s.packed){
+      decodeAll(s, old);
+    }else{
+      old.timestamps.assign(s.timestamps, s.timestamps + count);
+      old.values.assign(s.values, s.values + count);
+      if(probe){
+        old.raw.assign(s.raw, s.raw + count);
+        old.temperatures.assign(s.temperatures, s.temperatures + count);
+        old.calibrations.assign(s.calibrations, s.calibrations + count);
+      }
+    }
+    int64_t last = lastTimestamp(s, count);
+    size_t j = i;
+    while(j < rows.size() && rows[j].first.timestamp <= last) j++;
+    Columns columns;
+    for(size_t a = 0, b = i; a < count || b < j; ){
+      if(b == j || (a < count && old.timestamps[a] <= rows[b].first.timestamp)){
+        if(b < j && old.timestamps[a] == rows[b].first.timestamp && old.values[a] == rows[b].first.value) b++;  // merged before a crash
+        columns.timestamps.push_back(old.timestamps[a]);
+        columns.values.push_back(old.values[a]);
+        if(probe){
+          columns.raw.push_back(old.raw[a]);
+          columns.temperatures.push_back(old.temperatures[a]);
+          columns.calibrations.push_back(old.calibrations[a]);
+        }
+        a++;
+      }else{
+        const LateRow& r = rows[b++].first;
+        columns.timestamps.push_back(r.timestamp);
+        columns.values.push_back(r.value);
+        if(probe){
+          columns.raw.push_back(r.raw);
+          columns.temperatures.push_back(r.temperature);
+          columns.calibrations.push_back(r.calibration);
+        }
+      }
+    }
+    size_t mapped = s.mapped;
+    series.lateVersion.fetch_add(1);                     // odd: scans wait, the rows are in both for a moment
+    while(series.lateReaders.load() != 0) usleep(1000);  // scans that have the rows in their late ones
+    bool ok = replace(series, k, columns, columns.timestamps.size(), columnSet);
+    if(ok){
+      std::lock_guard<std::mutex> lock(series.lateMutex);
+      for(size_t m = i; m < j; m++) series.late[rows[m].second].timestamp = INT64_MIN;
+      series.lateCount.fetch_sub(j - i);
+    }
+    series.lateVersion.fetch_add(1);
+    if(!ok) break;                                       // the rows stay late, next round
+    merged += j - i;
+    throttle(mapped);
+    i = j;
+  }
+  std::lock_guard<std::mutex> lock(series.lateMutex);
+  for(size_t m = 0; m < cold; m++) series.late[rows[m].second].timestamp = INT64_MIN;
+  series.lateCount.fetch_sub(cold);
+  if(merged == 0 && cold == 0) return;
+  size_t kept = 0;
+  for(size_t m = 0; m < series.late.size(); m++)
+    if(series.late[m].timestamp != INT64_MIN) series.late[kept++] = series.late[m];
+  series.late.resize(kept);
+  writeLate(series);
+  if(cold) LOG("%s: %zu late rows older than the cold tier dropped", series.dir.c_str(), cold);
+  DBG("%s: %zu late rows merged, %zu wait for the open segment", series.dir.c_str(), merged, kept);
+}
+
+void ColumnStore::packSeries(uint32_t sensor)
+{
+  Series& series = *this->_series[sensor];
+  std::lock_guard<std::mutex> lock(series.replacing);
+  mergeLate(series);                                     // before their segments move to the cold tier
+  if(series.retain) expire(series);
+  uint32_t n = series.segmentCount.load(std::memory_order_acquire);
+  for(uint32_t k = series.segmentFirst.load(); k + 1 < n && !this->_stopping; k++){   // not the open one
+    const Segment& s = *slot(series, k).load(std::memory_order_acquire);
+    uint32_t count = published(s);
+    if(s.packed || count == 0) continue;
+    Columns columns;
+    columns.timestamps.assign(s.timestamps, s.timestamps + count);
+    columns.values.assign(s.values, s.values + count);
+    if(s.raw){
+      columns.raw.assign(s.raw, s.raw + count);
+      columns.temperatures.assign(s.temperatures, s.temperatures + count);
+      columns.calibrations.assign(s.calibrations, s.calibrations + count);
+    }
+    size_t mapped = s.mapped;
+    replace(series, k, columns, count, s.header->columns);
+    throttle(mapped);
+  }
+}
+
+bool ColumnStore::loadCold(const Series& series, std::vector<ColdBucket>& buckets, int64_t* end) const
+{
+  std::string path = series.dir + "/cold";
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if(fd < 0) return false;
+  uint8_t header[STORE_HEADER_SIZE];
+  uint32_t magic, count;
+  uint16_t version;
+  struct stat st;
+  bool ok = pread(fd, header, sizeof(header), 0) == (ssize_t)sizeof(header) && fstat(fd, &st) == 0;
+  if(ok){
+    memcpy(&magic, header, 4);
+    memcpy(&version, header + 4, 2);
+    memcpy(&count, header + 8, 4);
+    memcpy(end, header + 16, 8);
+    ok = magic == STORE_COLD_MAGIC && version == STORE_VERSION &&
+         (uint64_t)st.st_size == STORE_HEADER_SIZE + (uint64_t)count*sizeof(ColdBucket);
+  }
+  if(ok){
+    size_t base = buckets.size();
+    buckets.resize(base + count);
+    ok = pread(fd, &buckets[base], (size_t)count*sizeof(ColdBucket), STORE_HEADER_SIZE) ==
+         (ssize_t)(count*sizeof(ColdBucket));
+    if(!ok) buckets.resize(base);
+  }
+  close(fd);
+  if(!ok) LOG("%s: not a cold file of this version, ignored", path.c_str());
+  return ok;
+}
+
+size_t ColumnStore::cold(uint32_t sensor, std::vector<ColdBucket>& buckets) const
+{
+  size_t base = buckets.size();
+  int64_t end;
+  loadCold(*this->_series[sensor], buckets, &end);
+  return buckets.size() - base;
+}
+
+/*!
+ * @brief Folds rows into hourly buckets, skipping those before end
+ */
+static void foldHours(const int64_t* timestamps, const float* values, size_t count, int64_t end,
+                      std::vector<ColdBucket>& buckets)
+{
+  const int64_t hour = 3600LL*1000000;
+  for(size_t i = 0; i < count; i++){
+    if(timestamps[i] < end) continue;                    // already in the cold file
+    int64_t start = timestamps[i] - ((timestamps[i] % hour) + hour) % hour;
+    float v = values[i];
+    if(buckets.empty() || buckets.back().start != start){
+      ColdBucket b;
+      b.start = start;
+      b.count = 0;
+      b.min = b.max = b.first = v;
+      b.sum = b.sumsq = 0;
+      buckets.push_back(b);
+    }
+    ColdBucket& b = buckets.back();
+    b.count++;
+    if(v < b.min) b.min = v;
+    if(v > b.max) b.max = v;
+    b.last = v;
+    b.sum += v;
+    b.sumsq += (double)v*v;
+  }
+}
+
+bool ColumnStore::expire(Series& series)
+{
+  int64_t cutoff = nowMicros() - series.retain;
+  uint32_t first = series.segmentFirst.load(), n = series.segmentCount.load(std::memory_order_acquire), k = first;
+  while(k + 1 < n){                                      // never the open one
+    const Segment& s = *slot(series, k).load(std::memory_order_acquire);
+    uint32_t count = published(s);
+    if(count && lastTimestamp(s, count) >= cutoff) break;
+    k++;
+  }
+  if(k == first) return true;
+  std::vector<ColdBucket> buckets;
+  int64_t end = INT64_MIN;
+  if(!loadCold(series, buckets, &end)){
+    if(access((series.dir + "/cold").c_str(), F_OK) == 0) return false;   // damaged, don't replace it
+    buckets.clear();
+    end = INT64_MIN;
+  }
+  size_t read = 0;
+  int64_t skip = end;                                    // rows of these segments the file has, after a crash
+  for(uint32_t i = first; i < k; i++){
+    const Segment& s = *slot(series, i).load(std::memory_order_acquire);
+    uint32_t count = published(s);
+    if(count == 0) continue;
+    if(s.packed){
+      Columns columns;
+      decodeAll(s, columns);
+      foldHours(columns.timestamps.data(), columns.values.data(), count, skip, buckets);
+    }else{
+      foldHours(s.timestamps, s.values, count, skip, buckets);
+    }
+    end = std::max(end, lastTimestamp(s, count) + 1);
+    read += s.mapped;
+  }
+
+  uint8_t header[STORE_HEADER_SIZE] = {0};
+  uint32_t magic = STORE_COLD_MAGIC, count = buckets.size();
+  uint16_t version = STORE_VERSION;
+  memcpy(header, &magic, 4);
+  memcpy(header + 4, &version, 2);
+  memcpy(header + 8, &count, 4);
+  memcpy(header + 16, &end, 8);
+  std::string path = series.dir + "/cold", tmp = path + ".tmp";
+  int fd = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool ok = fd >= 0 && writeAll(fd, header, sizeof(header)) &&
+            writeAll(fd, buckets.data(), buckets.size()*sizeof(ColdBucket)) && fsync(fd) == 0;
+  if(fd >= 0) close(fd);
+  if(!ok || rename(tmp.c_str(), path.c_str()) < 0){
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    unlink(tmp.c_str());
+    return false;
+  }
+  int dirFd = open(series.dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(dirFd >= 0){
+    fsync(dirFd);                                        // the rows must be in the cold file before their segments go
+    close(dirFd);
+  }
+  series.coldEnd.store(end);
+  series.segmentFirst.store(k, std::memory_order_release);
+  for(uint32_t i = first; i < k; i++){
+    Segment* s = slot(series, i).load(std::memory_order_acquire);
+    char name[32];
+    snprintf(name, sizeof(name), s->packed ? "/%08u.pack" : "/%08u.seg", s->sequence);
+    unlink((series.dir + name).c_str());
+    retire(s);
+  }
+  DBG("%s: %u segments moved to the cold tier, %u hours", series.dir.c_str(), k - first, count);
+  throttle(read + sizeof(header) + buckets.size()*sizeof(ColdBucket));
+  return true;
+}
+
+void ColumnStore::throttle(size_t bytes)
+{
+  int64_t now = nowMicros();
+  this->_ioUntil = std::max(this->_ioUntil, now) + (int64_t)bytes*1000000/STORE_COMPACT_BYTES_S;
+  while(!this->_stopping && (now = nowMicros()) < this->_ioUntil)
+    usleep(std::min(this->_ioUntil - now, (int64_t)100000));
+}
+
+void ColumnStore::packLoop()
+{
+  // Linux applies nice per thread; ingest threads keep their priority
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), STORE_PACK_NICE);
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  int64_t checked = nowMicros();
+  while(!this->_stopping){
+    if(this->_pending.empty()){
+      this->_wake.wait_for(lock, std::chrono::seconds(STORE_LATE_S));
+      if(!this->_pending.empty()) continue;
+      int64_t now = nowMicros();
+      bool period = now - checked >= (int64_t)STORE_COMPACT_PERIOD_S*1000000;
+      if(period) checked = now;
+      for(uint32_t i = 0; i < this->_series.size(); i++){   // rows age out of the retention without new segments
+        const Series& series = *this->_series[i];
+        if((period && series.retain) || series.lateCount.load(std::memory_order_relaxed)) this->_pending.push_back(i);
+      }
+      continue;
+    }
+    uint32_t sensor = this->_pending.front();
+    this->_pending.pop_front();
+    lock.unlock();
+    packSeries(sensor);
+    lock.lock();
+  }
+}
+
+size_t ColumnStore::range(uint32_t sensor, int64_t from, int64_t to, std::vector<Sample>& samples) const
+{
+  CopyVisitor copy(samples);
+  return scan(sensor, from, to, copy);
+}
+
+uint64_t ColumnStore::rows(uint32_t sensor) const
+{
+  const Series& series = *this->_series[sensor];
+  ReadGuard guard(*this);
+  uint64_t rows = series.lateCount.load(std::memory_order_relaxed);
+  uint32_t n = series.segmentCount.load(std::memory_order_acquire);
+  for(uint32_t k = series.segmentFirst.load(std::memory_order_acquire); k < n; k++)
+    rows += published(*slot(series, k).load(std::memory_order_acquire));
+  return rows;
+}
+
+uint64_t ColumnStore::bytes(uint32_t sensor) const
+{
+  const Series& series = *this->_series[sensor];
+  ReadGuard guard(*this);
+  uint64_t bytes = 0;
+  uint32_t n = series.segmentCount.load(std::memory_order_acquire);
+  for(uint32_t k = series.segmentFirst.load(std::memory_order_acquire); k < n; k++)
+    bytes += slot(series, k).load(std::memory_order_acquire)->mapped;
+  return bytes;
+}
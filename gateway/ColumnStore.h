@@ -0,0 +1,425 @@
+/*!
+ * @file ColumnStore.h
+ * @brief Define the basic structure of class ColumnStore
+ * @details Local time-series store of the gateway, a hot cache in front of `sensor_data` for the queries the
+ * @n app's charts repeat: latest row, latest N rows and a time range of one sensor.
+ * @n Every sensor has a directory (named by sensor_id) of append-only segment files. A segment is mmap'd
+ * @n whole and holds a timestamp column and a value column of fixed capacity:
+ * @n   header (64 bytes) | int64 timestamps[capacity] | float values[capacity]
+ * @n Rows are published by storing the header's count after the row, so readers on other threads see whole
+ * @n rows without locks. The only writer is the thread that calls push(). Timestamps in a segment never go
+ * @n back, so time ranges are found by binary search over segments and then inside the first and last segment.
+ * @n A reading older than the sensor's last row (resent, backfill) is late: it is kept at its own time in the
+ * @n series' late rows, appended to <sensor>/late, until the packing thread merges it into the segment its
+ * @n time falls in (rewriting that one packed). Late rows of the open segment's time wait until it is full.
+ * @n scan() merges the late rows not merged yet into what it visits; latest() shows them once merged.
+ * @n Segments of sensors with a probe (converted voltages) carry three more columns, so the readings can be
+ * @n converted again after a calibration is corrected (Reprocessor):
+ * @n   ... | float raw mV[capacity] | float temperature[capacity] | uint16 calibration version[capacity]
+ * @n A full segment is never appended to again; a background thread (nice STORE_PACK_NICE) packs it into an
+ * @n immutable <sequence>.pack file and deletes the .seg (SeriesCodec.h):
+ * @n   header (64) | index: per block of STORE_BLOCK_ROWS rows first and last timestamp, sum, min, max, rows,
+ * @n   offset and the end of each column stream (64) | column streams
+ * @n Scans binary search the index and decode only the blocks in range, into spans of a block each; a block
+ * @n entirely in range is first offered to SpanVisitor::summary(), aggregates take it without decoding.
+ * @n Readers never lock: a packed segment replaces the raw one with an atomic pointer store, and the raw one
+ * @n is unmapped once every scan that began before has finished (two reader counters and an epoch).
+ * @n Tiers: the open segment is hot (written, in the page cache), packed segments are warm. With a retention
+ * @n for the sensor's type (retain()) the same thread moves segments older than it to the cold tier: their rows
+ * @n are folded into hourly buckets in <sensor>/cold, the segment is deleted, and Rollups rebuilds its hours and
+ * @n days from them. The cold file is rewritten whole (temporary name, fsync, rename) before the segment goes:
+ * @n   header (64): magic "GSC1" | version | buckets | end (rows before it are in the file) | ... | ColdBucket[]
+ * @n That thread's file I/O is throttled to STORE_COMPACT_BYTES_S.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_COLUMNSTORE_H_
+#define _GATEWAY_COLUMNSTORE_H_
+
+#include "DeviceMap.h"
+#include "Reading.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define STORE_SEGMENT_ROWS   (1 << 16)   ///<rows per segment file, 768 KB mapped
+#define STORE_MAX_SEGMENTS   1024        ///<segments per sensor
+#define STORE_MAGIC          0x31475347  ///<"GSG1"
+#define STORE_VERSION        1
+#define STORE_HEADER_SIZE    64
+#define STORE_COLUMNS_PROBE  0x1         ///<SegmentHeader::columns: raw, temperature and calibration columns
+#define STORE_PACKED_MAGIC   0x31505347  ///<"GSP1"
+#define STORE_BLOCK_ROWS     1024        ///<rows per block of a packed segment
+#define STORE_STREAMS        5           ///<timestamps, values, raw, temperatures, calibrations
+#define STORE_PACK_NICE      10
+#define STORE_COLD_MAGIC     0x31435347  ///<"GSC1"
+#define STORE_RETAIN_MIN_D   8           ///<shortest retention, the minute rollups reach back 7 days
+#define STORE_COMPACT_BYTES_S  (16 << 20)  ///<file I/O of the packing thread per second at most
+#define STORE_COMPACT_PERIOD_S 3600        ///<retention is checked at least this often
+#define STORE_LATE_ROWS      1024        ///<late rows of a sensor that get merged without waiting
+#define STORE_LATE_S         10          ///<how often late rows are merged
+
+struct Sample {
+  int64_t timestamp;      ///<unix time (us)
+  float   value;
+};
+
+/*!
+ * @brief Hourly summary of rows moved to the cold tier
+ */
+struct ColdBucket {
+  int64_t  start;         ///<unix time (us) of the hour
+  uint32_t count;
+  float    min;
+  float    max;
+  float    first;
+  float    last;
+  double   sum;
+  double   sumsq;
+};
+
+/*!
+ * @brief Receives the column spans of a range query, no rows are copied
+ */
+class SpanVisitor
+{
+public:
+  virtual ~SpanVisitor() {}
+  virtual void span(const int64_t* timestamps, const float* values, size_t count) = 0;
+
+  /*!
+   * @fn summary
+   * @brief Offered for a packed block entirely in the range before it is decoded
+   * @return true if the visitor took the block from its count, sum, min and max, false to get its span
+   */
+  virtual bool summary(size_t count, double sum, float min, float max)
+  {
+    (void)count; (void)sum; (void)min; (void)max;
+    return false;
+  }
+};
+
+/*!
+ * @brief Columns of probe rows handed to ColumnStore::rewrite(), values and calibrations may be changed in place
+ */
+struct ProbeSpan {
+  const int64_t* timestamps;
+  float* values;
+  const float* raw;
+  const float* temperatures;
+  uint16_t* calibrations;
+  size_t count;
+};
+
+class ProbeVisitor
+{
+public:
+  virtual ~ProbeVisitor() {}
+  virtual void span(const ProbeSpan& span) = 0;
+};
+
+class ColumnStore : public ReadingSink
+{
+public:
+  /*!
+   * @fn ColumnStore
+   * @brief Constructor
+   * @param map  Sensors, every sensor's directory is named by its sensor_id
+   * @param segmentRows  Capacity of new segments
+   */
+  ColumnStore(const DeviceMap& map, uint32_t segmentRows = STORE_SEGMENT_ROWS);
+  ~ColumnStore();
+
+  /*!
+   * @fn retain
+   * @brief Set how long rows are kept per sensor type before they move to the cold tier, before begin()
+   * @param spec  "<type>=<days>,...", type ph, ec, temperature, voltage or * for the others; by default rows
+   * @n are kept for ever
+   * @return false if spec is malformed or a retention is shorter than STORE_RETAIN_MIN_D
+   */
+  bool retain(const char* spec);
+
+  /*!
+   * @fn begin
+   * @brief Create the directories, map the segments written by earlier runs and start packing the full ones
+   * @return false if the data directory can't be used
+   */
+  bool begin(const char* dir);
+
+  /*!
+   * @fn end
+   * @brief Stop the packing thread, a segment being packed is finished first
+   */
+  void end();
+
+  /*!
+   * @fn push
+   * @brief Append readings, called from the ingest thread only
+   */
+  virtual void push(const Reading* readings, size_t count);
+
+  /*!
+   * @fn append
+   * @brief Append one row to a sensor
+   * @return false if the row could not be stored (no space, segment limit)
+   */
+  bool append(uint32_t sensor, int64_t timestamp, float value);
+
+  /*!
+   * @fn append
+   * @brief Append a reading with its raw value, temperature and calibration version if the sensor has a probe
+   */
+  bool append(const Reading& reading);
+
+  /*!
+   * @fn latest
+   * @brief Newest row of a sensor, O(1)
+   * @return false if the sensor has no rows
+   */
+  bool latest(uint32_t sensor, Sample* sample) const;
+
+  /*!
+   * @fn latest
+   * @brief Newest rows of a sensor, newest first (order by created_at desc limit n)
+   * @return Number of rows written to samples
+   */
+  size_t latest(uint32_t sensor, size_t n, Sample* samples) const;
+
+  /*!
+   * @fn scan
+   * @brief Visit the rows with from <= timestamp < to in time order, a span per segment or packed block;
+   * @n late rows not merged yet are merged into the span they fall in
+   * @return Number of rows visited
+   */
+  size_t scan(uint32_t sensor, int64_t from, int64_t to, SpanVisitor& visitor) const;
+
+  /*!
+   * @fn range
+   * @brief Copy the rows with from <= timestamp < to in time order
+   * @return Number of rows appended to samples
+   */
+  size_t range(uint32_t sensor, int64_t from, int64_t to, std::vector<Sample>& samples) const;
+
+  /*!
+   * @fn rewrite
+   * @brief Visit the rows with from <= timestamp < to that have probe columns, to convert them again. Only one
+   * @n rewrite of a sensor may run at a time; readers see a row's old or new value, each float is one store.
+   * @n Packed segments are decoded, and packed again if the visitor changed a row.
+   * @return Number of rows visited
+   */
+  size_t rewrite(uint32_t sensor, int64_t from, int64_t to, ProbeVisitor& visitor);
+
+  /*!
+   * @fn rows
+   * @brief Rows stored for a sensor, late rows not merged yet included
+   */
+  uint64_t rows(uint32_t sensor) const;
+
+  /*!
+   * @fn cold
+   * @brief The hourly buckets of a sensor's cold tier, oldest first
+   * @return Number of buckets appended
+   */
+  size_t cold(uint32_t sensor, std::vector<ColdBucket>& buckets) const;
+
+  /*!
+   * @fn horizon
+   * @brief Rows of a sensor before this time moved to the cold tier, INT64_MIN if none did
+   */
+  int64_t horizon(uint32_t sensor) const { return this->_series[sensor]->coldEnd.load(); }
+
+  /*!
+   * @fn bytes
+   * @brief Bytes of segment files of a sensor: mapped size of the raw ones, file size of the packed ones
+   */
+  uint64_t bytes(uint32_t sensor) const;
+
+  size_t sensorCount() const { return this->_series.size(); }
+
+private:
+  struct SegmentHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t capacity;
+    uint32_t count;       ///<published rows, written with release semantics
+    uint32_t sequence;    ///<position in the sensor's segment list
+    uint32_t columns;     ///<STORE_COLUMNS_* beyond timestamp and value, 0 in segments of earlier versions
+    uint8_t  reserved[STORE_HEADER_SIZE - 24];
+  };
+
+  struct PackedHeader {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t headerSize;
+    uint32_t count;
+    uint32_t sequence;
+    uint32_t columns;
+    uint32_t blocks;
+    int64_t  first;       ///<timestamp of the first row
+    int64_t  last;
+    float    lastValue;
+    uint8_t  reserved[STORE_HEADER_SIZE - 44];
+  };
+
+  struct PackedBlock {
+    int64_t  first;
+    int64_t  last;
+    double   sum;
+    float    min;                     ///<NaN if a value is NaN, then the block is never summarized
+    float    max;
+    uint32_t rows;
+    uint32_t offset;                  ///<of the first stream in the file
+    uint32_t ends[STORE_STREAMS];     ///<end of each stream, from offset
+    uint32_t reserved;
+  };
+
+  struct Segment {
+    uint32_t sequence;
+    void* base;
+    size_t mapped;
+    // raw segment
+    SegmentHeader* header;        ///<NULL if packed
+    int64_t* timestamps;
+    float* values;
+    float* raw;                   ///<NULL without STORE_COLUMNS_PROBE
+    float* temperatures;
+    uint16_t* calibrations;
+    // packed segment
+    const PackedHeader* packed;   ///<NULL if raw
+    const PackedBlock* blocks;
+  };
+
+  /*!
+   * @brief All columns of some rows, decoded from a packed segment or copied from a raw one
+   */
+  struct Columns {
+    std::vector<int64_t> timestamps;
+    std::vector<float> values;
+    std::vector<float> raw;
+    std::vector<float> temperatures;
+    std::vector<uint16_t> calibrations;
+  };
+
+  /*!
+   * @brief A row older than the series' last one, also the 24 byte record of <sensor>/late
+   */
+  struct LateRow {
+    int64_t  timestamp;                 ///<INT64_MIN once merged, until the next compaction
+    float    value;
+    float    raw;
+    float    temperature;
+    uint16_t calibration;
+    uint16_t reserved;
+  };
+
+  /*!
+   * @brief The late rows not merged yet in a scan's range, merged into the spans they fall in
+   */
+  struct LateCursor {
+    std::vector<Sample> rows;           ///<by timestamp
+    size_t next;                        ///<first row not visited yet
+    std::vector<int64_t> timestamps;    ///<a span with late rows merged in
+    std::vector<float> values;
+  };
+
+  struct Series {
+    std::string dir;
+    std::unique_ptr<std::atomic<Segment*>[]> segments;    ///<fixed array, never moves while readers look at it
+    std::atomic<uint32_t> segmentCount{0};
+    std::atomic<uint32_t> segmentFirst{0};  ///<segments before it moved to the cold tier
+    int64_t last;                           ///<writer only, timestamp of the newest row
+    uint64_t dropped;
+    uint32_t columns;                       ///<STORE_COLUMNS_* of new segments
+    int64_t retain;                         ///<us, 0: for ever
+    std::atomic<int64_t> coldEnd;
+    std::mutex replacing;                   ///<held while a segment of the series is packed or rewritten
+    mutable std::mutex lateMutex;
+    std::vector<LateRow> late;              ///<in arrival order, guarded by lateMutex
+    std::atomic<uint32_t> lateCount{0};     ///<late rows not merged yet
+    std::atomic<uint32_t> lateVersion{0};   ///<odd while merged rows may be in a segment and in late too
+    mutable std::atomic<uint32_t> lateReaders{0};   ///<scans merging late rows they took, a merge waits for them
+    int lateFd;                             ///<<sensor>/late while there are late rows, guarded by lateMutex
+  };
+
+  /*!
+   * @brief Keeps the segments a reader may look at mapped while it lives
+   */
+  class ReadGuard
+  {
+  public:
+    ReadGuard(const ColumnStore& store);
+    ~ReadGuard() { this->_readers->fetch_sub(1); }
+
+  private:
+    std::atomic<uint32_t>* _readers;
+  };
+
+  const DeviceMap& _map;
+  uint32_t _segmentRows;
+  std::string _dir;
+  std::vector<std::unique_ptr<Series>> _series;
+  int _retainDays[QUANTITY_VOLTAGE + 1];                   ///<by QUANTITY_*, [0] for the others
+  mutable std::atomic<uint64_t> _epoch;
+  mutable std::atomic<uint32_t> _readers[2];              ///<readers that began in an even / odd epoch
+  std::mutex _retiring;
+  // packing thread
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::deque<uint32_t> _pending;                          ///<sensors that may have a segment to pack
+  std::atomic<bool> _stopping;
+  std::thread _packer;
+  int64_t _ioUntil;                                       ///<the packing thread's I/O budget is used up to then
+
+private:
+  bool openSegment(Series& series, const std::string& path, bool create);
+  bool openPacked(Series& series, const std::string& path);
+  Segment* mapPacked(const std::string& path);
+  bool loadSeries(Series& series);
+  bool loadLate(Series& series);
+  Segment* appendSegment(uint32_t sensor, Series& series);
+  bool appendLate(uint32_t sensor, Series& series, const LateRow& row);
+  void mergeLate(Series& series);
+  bool writeLate(Series& series);
+  size_t scanSegments(const Series& series, int64_t from, int64_t to, SpanVisitor& visitor, LateCursor* late) const;
+  uint32_t firstSegment(const Series& series, uint32_t n, int64_t from) const;
+  void packLoop();
+  void packSeries(uint32_t sensor);
+  bool expire(Series& series);
+  bool loadCold(const Series& series, std::vector<ColdBucket>& buckets, int64_t* end) const;
+  void throttle(size_t bytes);
+  bool replace(Series& series, uint32_t index, const Columns& columns, size_t count, uint32_t columnSet);
+  void retire(Segment* segment);
+  static size_t scanPacked(const Segment& s, int64_t from, int64_t to, SpanVisitor& visitor, LateCursor* late);
+  static size_t visit(SpanVisitor& visitor, const int64_t* timestamps, const float* values, size_t count,
+                      LateCursor* late);
+  static void decode(const Segment& s, uint32_t block, int64_t* timestamps, float* values);
+  static void decodeAll(const Segment& s, Columns& columns);
+  static void pack(const Columns& columns, size_t count, uint32_t columnSet, uint32_t sequence,
+                   std::vector<uint8_t>& file);
+  static uint32_t published(const Segment& s)
+  {
+    return s.packed ? s.packed->count : __atomic_load_n(&s.header->count, __ATOMIC_ACQUIRE);
+  }
+  static int64_t firstTimestamp(const Segment& s) { return s.packed ? s.packed->first : s.timestamps[0]; }
+  static int64_t lastTimestamp(const Segment& s, uint32_t count)
+  {
+    return s.packed ? s.packed->last : s.timestamps[count-1];
+  }
+  static std::atomic<Segment*>& slot(const Series& series, uint32_t index)
+  {
+    // a ring: expired segments free their slot. A slot is taken again STORE_MAX_SEGMENTS segments later, long
+    // after any reader that could still be looking at the one before
+    return series.segments[index % STORE_MAX_SEGMENTS];
+  }
+  static size_t lowerBound(const int64_t* timestamps, size_t count, int64_t timestamp);
+};
+
+#endif
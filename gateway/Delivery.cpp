@@ -0,0 +1,271 @@
+/*!
+ * @file Delivery.cpp
+ * @brief Define the basic structure of classes DedupWindow and Delivery
+ * @details Drops resent copies of sequenced readings and acknowledges them once they are durable.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Delivery.h"
+#include "FrameDecoder.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <string.h>
+
+#define WINDOW_MASK  (DEDUP_WINDOW - 1)
+
+DedupWindow::DedupWindow()
+{
+  this->_epoch = -1;
+  this->_high = 0;
+  memset(this->_window, 0, sizeof(this->_window));
+  this->_floor[0] = this->_floor[1] = UINT32_MAX;
+  this->_added = 0;
+}
+
+void DedupWindow::reset(uint8_t epoch, uint32_t sequence)
+{
+  this->_epoch = epoch;
+  this->_high = sequence;
+  memset(this->_window, 0, sizeof(this->_window));
+  for(int g = 0; g < 2; g++) std::fill(this->_bloom[g].begin(), this->_bloom[g].end(), 0);
+  this->_floor[0] = this->_floor[1] = UINT32_MAX;
+  this->_added = 0;
+  this->_window[(sequence & WINDOW_MASK) >> 6] |= 1ull << (sequence & 63);
+}
+
+/*!
+ * @brief DEDUP_BLOOM_HASHES bit indexes from the high, well mixed bits of one multiplication
+ */
+static inline uint32_t bloomBit(uint64_t hash, int i)
+{
+  return (uint32_t)(hash >> (50 - 12*i)) & (DEDUP_BLOOM_BITS - 1);
+}
+
+void DedupWindow::forget(uint32_t sequence)
+{
+  if(this->_added == DEDUP_BLOOM_ENTRIES){
+    this->_bloom[0].swap(this->_bloom[1]);
+    std::fill(this->_bloom[0].begin(), this->_bloom[0].end(), 0);
+    this->_floor[1] = this->_floor[0];
+    this->_floor[0] = UINT32_MAX;
+    this->_added = 0;
+  }
+  std::vector<uint64_t>& bloom = this->_bloom[0];
+  if(bloom.empty()) bloom.assign(DEDUP_BLOOM_BITS/64, 0);
+  uint64_t hash = (uint64_t)sequence * 0x9E3779B97F4A7C15ull;
+  for(int i = 0; i < DEDUP_BLOOM_HASHES; i++){
+    uint32_t bit = bloomBit(hash, i);
+    bloom[bit >> 6] |= 1ull << (bit & 63);
+  }
+  if(sequence < this->_floor[0]) this->_floor[0] = sequence;
+  this->_added++;
+}
+
+bool DedupWindow::remembered(uint32_t sequence) const
+{
+  uint64_t hash = (uint64_t)sequence * 0x9E3779B97F4A7C15ull;
+  for(int g = 0; g < 2; g++){
+    const std::vector<uint64_t>& bloom = this->_bloom[g];
+    if(bloom.empty() || sequence < this->_floor[g]) continue;
+    int i = 0;
+    while(i < DEDUP_BLOOM_HASHES && (bloom[bloomBit(hash, i) >> 6] >> (bloomBit(hash, i) & 63) & 1)) i++;
+    if(i == DEDUP_BLOOM_HASHES) return true;
+  }
+  return false;
+}
+
+bool DedupWindow::insert(uint8_t epoch, uint32_t sequence)
+{
+  if(this->_epoch != epoch){
+    reset(epoch, sequence);
+    return true;
+  }
+  if(sequence > this->_high){
+    // the numbers sliding out of the window go to the filter
+    int64_t from = (int64_t)this->_high - DEDUP_WINDOW + 1;
+    int64_t to = std::min<int64_t>((int64_t)sequence - DEDUP_WINDOW, this->_high);
+    for(int64_t s = std::max<int64_t>(from, 1); s <= to; s++){
+      uint64_t& word = this->_window[(s & WINDOW_MASK) >> 6];
+      uint64_t bit = 1ull << (s & 63);
+      if(word & bit){
+        forget((uint32_t)s);
+        word &= ~bit;
+      }
+    }
+    this->_high = sequence;
+    this->_window[(sequence & WINDOW_MASK) >> 6] |= 1ull << (sequence & 63);
+    return true;
+  }
+  if(sequence + DEDUP_WINDOW > this->_high){
+    uint64_t& word = this->_window[(sequence & WINDOW_MASK) >> 6];
+    uint64_t bit = 1ull << (sequence & 63);
+    if(word & bit) return false;
+    word |= bit;
+    return true;
+  }
+  // older than the window: below what the filter covers the device can't still hold it unless it never came
+  if(remembered(sequence)) return false;
+  forget(sequence);
+  return true;
+}
+
+Delivery::Delivery(const DeviceMap& map, ReadingSink& next)
+  : _map(map), _next(next)
+{
+  this->_wal = NULL;
+  this->_sequenced = 0;
+  this->_duplicates = 0;
+  this->_acked = 0;
+  for(size_t i = 0; i < map.devices().size(); i++){
+    this->_devices.emplace_back(new Device());
+    this->_devices[i]->epoch = 0;
+  }
+}
+
+void Delivery::Logged::push(const Reading* readings, size_t count)
+{
+  for(size_t i = 0; i < count; i++){
+    if(readings[i].sequence == 0) continue;
+    this->owner->remember(readings[i]);
+    this->found++;
+  }
+}
+
+size_t Delivery::begin(WriteAheadLog* wal)
+{
+  this->_wal = wal;
+  if(wal == NULL) return 0;
+  // what the log has is durable: a device resending it gets it acknowledged again
+  Logged logged;
+  logged.owner = this;
+  logged.found = 0;
+  wal->recover(0, logged);
+  if(logged.found) LOG("delivery: %zu sequenced readings in the log remembered", logged.found);
+  return logged.found;
+}
+
+void Delivery::remember(const Reading& r)
+{
+  this->_devices[this->_map.sensor(r.sensor).device]->window.insert(r.epoch, r.sequence);
+}
+
+void Delivery::push(const Reading* readings, size_t count)
+{
+  size_t i = 0;
+  while(i < count && readings[i].sequence == 0) i++;
+  if(i == count){
+    this->_next.push(readings, count);                   // nothing sequenced, nothing copied
+    return;
+  }
+  this->_batch.assign(readings, readings + i);
+  this->_fresh.clear();
+  this->_again.clear();
+  for(; i < count; i++){
+    const Reading& r = readings[i];
+    if(r.sequence == 0){
+      this->_batch.push_back(r);
+      continue;
+    }
+    Fresh f;
+    f.device = this->_map.sensor(r.sensor).device;
+    f.epoch = r.epoch;
+    f.sequence = r.sequence;
+    if(this->_devices[f.device]->window.insert(r.epoch, r.sequence)){
+      this->_batch.push_back(r);
+      this->_fresh.push_back(f);
+    }else{
+      this->_again.push_back(f);
+    }
+  }
+  this->_sequenced += this->_fresh.size();
+  this->_duplicates += this->_again.size();
+  if(!this->_batch.empty()) this->_next.push(this->_batch.data(), this->_batch.size());
+  uint64_t lsn = this->_wal ? this->_wal->appended() : 0;   // the log is the first sink
+  for(size_t k = 0; k < this->_fresh.size(); k++) pend(this->_fresh[k], lsn);
+  for(size_t k = 0; k < this->_again.size(); k++) pend(this->_again[k], 0);
+}
+
+void Delivery::pend(const Fresh& f, uint64_t lsn)
+{
+  Device& d = *this->_devices[f.device];
+  std::lock_guard<std::mutex> lock(d.mutex);
+  if(d.epoch != f.epoch){
+    d.pending.clear();                                   // the device rebooted, what it kept is gone
+    d.epoch = f.epoch;
+  }
+  if(lsn == 0){
+    // a duplicate: the first copy is acknowledged when it is durable, or was already
+    for(size_t i = 0; i < d.pending.size(); i++)
+      if(d.pending[i].sequence == f.sequence) return;
+  }
+  Pending p;
+  p.sequence = f.sequence;
+  p.lsn = lsn;
+  d.pending.push_back(p);
+  d.waiting.store(d.pending.size(), std::memory_order_relaxed);
+}
+
+void Delivery::discard(uint32_t device, uint8_t epoch, uint32_t sequence)
+{
+  Fresh f;
+  f.device = device;
+  f.epoch = epoch;
+  f.sequence = sequence;
+  pend(f, 0);                                            // nothing to wait for, a resent copy is dropped again
+}
+
+size_t Delivery::ackFrame(uint8_t* frame, uint8_t epoch, uint32_t first, uint32_t mask)
+{
+  frame[0] = FRAME_SYNC1;
+  frame[1] = FRAME_SYNC2;
+  frame[2] = FRAME_TYPE_ACK;
+  frame[3] = 9;
+  frame[4] = epoch;
+  memcpy(frame + 5, &first, 4);                          // little endian like the devices
+  memcpy(frame + 9, &mask, 4);
+  uint16_t crc = FrameDecoder::crc16(0xFFFF, frame + 2, 11);
+  frame[13] = crc & 0xFF;
+  frame[14] = crc >> 8;
+  return ACK_FRAME_SIZE;
+}
+
+size_t Delivery::acks(uint32_t device, uint8_t* buf, size_t capacity)
+{
+  Device& d = *this->_devices[device];
+  if(d.waiting.load(std::memory_order_relaxed) == 0) return 0;
+  uint64_t durable = this->_wal ? this->_wal->durable() : UINT64_MAX;
+  std::vector<uint32_t> due;
+  std::lock_guard<std::mutex> lock(d.mutex);
+  size_t kept = 0;
+  for(size_t i = 0; i < d.pending.size(); i++){
+    if(d.pending[i].lsn <= durable) due.push_back(d.pending[i].sequence);
+    else d.pending[kept++] = d.pending[i];
+  }
+  d.pending.resize(kept);
+  std::sort(due.begin(), due.end());
+  size_t used = 0, i = 0;
+  while(i < due.size() && used + ACK_FRAME_SIZE <= capacity){
+    uint32_t first = due[i], mask = 0;
+    for(; i < due.size() && due[i] - first < ACK_SPAN; i++) mask |= 1u << (due[i] - first);
+    used += ackFrame(buf + used, d.epoch, first, mask);
+  }
+  this->_acked += i;
+  for(; i < due.size(); i++){
+    Pending p;                                           // no room this round, durable already
+    p.sequence = due[i];
+    p.lsn = 0;
+    d.pending.push_back(p);
+  }
+  d.waiting.store(d.pending.size(), std::memory_order_relaxed);
+  return used;
+}
+
+DeliveryCounters Delivery::counters() const
+{
+  DeliveryCounters c;
+  c.sequenced = this->_sequenced;
+  c.duplicates = this->_duplicates;
+  c.acked = this->_acked.load();
+  return c;
+}
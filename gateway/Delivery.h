@@ -0,0 +1,149 @@
+/*!
+ * @file Delivery.h
+ * @brief Define the basic structure of classes DedupWindow and Delivery
+ * @details At-least-once delivery of sequenced readings (FRAME_TYPE_SEQUENCED): a device numbers its readings
+ * @n within a boot epoch and keeps each one until the gateway acknowledges it, resending what stays
+ * @n unacknowledged, so a reading lost on the line or in a gateway crash comes again and one that did arrive may
+ * @n come twice. Delivery sits between the pipeline and the sinks and drops the second copy, the device is the
+ * @n serial port it came in on:
+ * @n   - DedupWindow: a bitmap of the last DEDUP_WINDOW sequence numbers below the highest one, one bit test per
+ * @n     reading; numbers leaving it go to a Bloom filter of two generations of DEDUP_BLOOM_ENTRIES each, so a
+ * @n     reading resent long after its successors is still recognized (false positives about 0.5%)
+ * @n   - a new epoch (the device rebooted and lost what it kept) starts the window again
+ * @n A reading is acknowledged once the WriteAheadLog has it on disk (without a log once the sinks have it).
+ * @n Acknowledgements are collected per device and written by the reader threads (AckSource) every
+ * @n GATEWAY_ACK_MS, one frame covering up to 32 sequence numbers:
+ * @n   0xA5 0x5A | FRAME_TYPE_ACK | 9 | epoch (1) | first sequence (4) | mask (4, bit i: first + i) | CRC-16
+ * @n A duplicate is acknowledged again, the first acknowledgement may have been lost. At start the windows
+ * @n are filled from the readings still in the log, so readings a device resends after a gateway restart are
+ * @n not doubled either.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_DELIVERY_H_
+#define _GATEWAY_DELIVERY_H_
+
+#include "DeviceMap.h"
+#include "Reading.h"
+#include "SerialGateway.h"
+#include "WriteAheadLog.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#define DEDUP_WINDOW          1024    ///<sequence numbers below the highest one tracked exactly, a power of 2
+#define DEDUP_BLOOM_BITS      16384   ///<bits per filter generation, a power of 2
+#define DEDUP_BLOOM_HASHES    4
+#define DEDUP_BLOOM_ENTRIES   1024    ///<sequence numbers per generation
+
+#define ACK_FRAME_SIZE        15
+#define ACK_SPAN              32      ///<sequence numbers one acknowledgement frame covers
+
+/*!
+ * @brief Sequence numbers of one device seen so far
+ */
+class DedupWindow
+{
+public:
+  DedupWindow();
+
+  /*!
+   * @fn insert
+   * @brief Record a sequence number
+   * @return false if it was seen before in this epoch
+   */
+  bool insert(uint8_t epoch, uint32_t sequence);
+
+private:
+  int _epoch;                           ///<-1 before the first sequence number
+  uint32_t _high;                       ///<highest sequence number seen
+  uint64_t _window[DEDUP_WINDOW/64];    ///<bit sequence % DEDUP_WINDOW, for (_high - DEDUP_WINDOW, _high]
+  std::vector<uint64_t> _bloom[2];      ///<numbers that left the window, the current and the previous generation
+  uint32_t _floor[2];                   ///<lowest number in each generation
+  uint32_t _added;                      ///<numbers in the current generation
+
+private:
+  void reset(uint8_t epoch, uint32_t sequence);
+  void forget(uint32_t sequence);
+  bool remembered(uint32_t sequence) const;
+};
+
+struct DeliveryCounters {
+  uint64_t sequenced;     ///<sequenced readings passed on
+  uint64_t duplicates;    ///<dropped
+  uint64_t acked;         ///<sequence numbers acknowledged, again ones included
+};
+
+class Delivery : public ReadingSink, public AckSource
+{
+public:
+  /*!
+   * @fn Delivery
+   * @brief Constructor
+   * @param next  Gets every reading that is not a duplicate
+   */
+  Delivery(const DeviceMap& map, ReadingSink& next);
+
+  /*!
+   * @fn begin
+   * @brief Fill the windows from the readings in the log and acknowledge readings once it has them on disk,
+   * @n call after wal.begin() and before the first push()
+   * @param wal  NULL: no log, acknowledge readings once the sinks have them
+   * @return Number of sequenced readings found in the log
+   */
+  size_t begin(WriteAheadLog* wal);
+
+  virtual void push(const Reading* readings, size_t count);
+  virtual void pushStats(const WindowStats* stats, size_t count) { this->_next.pushStats(stats, count); }
+  virtual size_t acks(uint32_t device, uint8_t* buf, size_t capacity);
+  virtual void discard(uint32_t device, uint8_t epoch, uint32_t sequence);
+
+  DeliveryCounters counters() const;
+
+private:
+  struct Pending {
+    uint32_t sequence;
+    uint64_t lsn;         ///<acknowledge once the log is durable up to here, 0: now
+  };
+
+  struct Device {
+    DedupWindow window;                 ///<sink thread only
+    std::mutex mutex;
+    uint8_t epoch;                      ///<of the pending sequence numbers, guarded by mutex
+    std::vector<Pending> pending;       ///<guarded by mutex
+    std::atomic<size_t> waiting{0};     ///<pending.size(), read without the lock
+  };
+
+  struct Logged : public ReadingSink {
+    Delivery* owner;
+    size_t found;
+    virtual void push(const Reading* readings, size_t count);
+  };
+
+  struct Fresh {
+    uint32_t device;
+    uint8_t epoch;
+    uint32_t sequence;
+  };
+
+  const DeviceMap& _map;
+  ReadingSink& _next;
+  WriteAheadLog* _wal;
+  std::vector<std::unique_ptr<Device>> _devices;
+  std::vector<Reading> _batch;
+  std::vector<Fresh> _fresh;
+  std::vector<Fresh> _again;
+  uint64_t _sequenced;
+  uint64_t _duplicates;
+  std::atomic<uint64_t> _acked;
+
+private:
+  void remember(const Reading& r);
+  void pend(const Fresh& f, uint64_t lsn);
+  static size_t ackFrame(uint8_t* frame, uint8_t epoch, uint32_t first, uint32_t mask);
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*!
+ * @file DeviceMap.cpp
+ * @brief Define the basic structure of class DeviceMap
+ * @details Maps (device, channel, quantity) of incoming readings to rows of the app's `sensor` table.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "DeviceMap.h"
+#include "Log.h"
+#include "ProbeMath.h"
+#include "Reading.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+static inline uint32_t mapKey(uint32_t device, uint8_t channel, uint8_t quantity)
+{
+  return (device << 16) | ((uint32_t)channel << 8) | quantity;
+}
+
+bool DeviceMap::load(const char* path)
+{
+  FILE* f = fopen(path, "r");
+  if(f == NULL){
+    LOG("can't open device map %s", path);
+    return false;
+  }
+  char line[512];
+  int lineNo = 0;
+  bool ok = true;
+  while(fgets(line, sizeof(line), f)){
+    lineNo++;
+    char* hash = strchr(line, '#');
+    if(hash) *hash = '\0';
+    char device[256], quantity[32], sensorId[64], farmId[64], probe[64];
+    int channel;
+    int n = sscanf(line, "%255s %d %31s %63s %63s %63s", device, &channel, quantity, sensorId, farmId, probe);
+    if(n <= 0) continue;                               // blank or comment line
+    uint8_t q = quantityFromName(quantity);
+    if(n < 5 || channel < 0 || channel > 255 || q == 0){
+      LOG("%s:%d: expected <device> <channel> <ph|ec|temperature|voltage> <sensor_id> <farm_id> [probe]", path, lineNo);
+      ok = false;
+      continue;
+    }
+    uint32_t sensor = add(device, (uint8_t)channel, q, sensorId, farmId);
+    if(n == 6 && !setProbe(sensor, probe)){
+      LOG("%s:%d: bad probe \"%s\", expected ph[:<neutral mV>:<acid mV>] or ec10[:<kvalue>] on a voltage channel",
+          path, lineNo, probe);
+      ok = false;
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+uint32_t DeviceMap::add(const std::string& device, uint8_t channel, uint8_t quantity,
+                        const std::string& sensorId, const std::string& farmId)
+{
+  uint32_t deviceIndex = 0;
+  while(deviceIndex < this->_devices.size() && this->_devices[deviceIndex] != device) deviceIndex++;
+  if(deviceIndex == this->_devices.size()) this->_devices.push_back(device);
+
+  uint32_t key = mapKey(deviceIndex, channel, quantity);
+  auto it = this->_index.find(key);
+  if(it != this->_index.end()){
+    LOG("%s channel %d %s mapped twice, keeping %s", device.c_str(), channel, quantityName(quantity),
+        this->_sensors[it->second].sensorId.c_str());
+    return it->second;
+  }
+  SensorInfo info;
+  info.sensorId = sensorId;
+  info.farmId = farmId;
+  info.device = deviceIndex;
+  info.channel = channel;
+  info.quantity = quantity;
+  info.probe = PROBE_NONE;
+  info.calibration[0] = 0;
+  info.calibration[1] = 0;
+  this->_sensors.push_back(info);
+  this->_index[key] = this->_sensors.size() - 1;
+  this->_ids.insert(std::make_pair(sensorId, this->_sensors.size() - 1));
+  return this->_sensors.size() - 1;
+}
+
+bool DeviceMap::setProbe(uint32_t sensor, const char* spec)
+{
+  SensorInfo& info = this->_sensors[sensor];
+  if(info.quantity != QUANTITY_VOLTAGE) return false;
+  return parseProbe(spec, &info.probe, info.calibration);
+}
+
+bool DeviceMap::parseProbe(const char* spec, uint8_t* probe, float* calibration)
+{
+  float a = PH_NEUTRAL_MV, b = PH_ACID_MV;
+  if(strcasecmp(spec, "ph") == 0 || (sscanf(spec, "ph:%f:%f", &a, &b) == 2 && a != b)){
+    *probe = PROBE_PH;
+    calibration[0] = a;
+    calibration[1] = b;
+    return true;
+  }
+  a = EC10_KVALUE;
+  if(strcasecmp(spec, "ec10") == 0 || (sscanf(spec, "ec10:%f", &a) == 1 && a > 0)){
+    *probe = PROBE_EC10;
+    calibration[0] = a;
+    calibration[1] = 0;
+    return true;
+  }
+  return false;
+}
+
+std::string DeviceMap::formatProbe(uint8_t probe, const float* calibration)
+{
+  char spec[64];
+  if(probe == PROBE_PH) snprintf(spec, sizeof(spec), "ph:%.9g:%.9g", calibration[0], calibration[1]);
+  else if(probe == PROBE_EC10) snprintf(spec, sizeof(spec), "ec10:%.9g", calibration[0]);
+  else snprintf(spec, sizeof(spec), "none");
+  return spec;
+}
+
+int32_t DeviceMap::lookup(uint32_t device, uint8_t channel, uint8_t quantity) const
+{
+  auto it = this->_index.find(mapKey(device, channel, quantity));
+  return it == this->_index.end() ? SENSOR_UNMAPPED : (int32_t)it->second;
+}
+
+int32_t DeviceMap::find(const std::string& sensorId) const
+{
+  auto it = this->_ids.find(sensorId);
+  return it == this->_ids.end() ? SENSOR_UNMAPPED : (int32_t)it->second;
+}
+
+uint8_t DeviceMap::quantityFromName(const char* name)
+{
+  if(strcasecmp(name, "ph") == 0) return QUANTITY_PH;
+  if(strcasecmp(name, "ec") == 0) return QUANTITY_EC;
+  if(strcasecmp(name, "temperature") == 0) return QUANTITY_TEMPERATURE;
+  if(strcasecmp(name, "voltage") == 0) return QUANTITY_VOLTAGE;
+  return 0;
+}
+
+const char* DeviceMap::quantityName(uint8_t quantity)
+{
+  switch(quantity){
+    case QUANTITY_PH:          return "ph";
+    case QUANTITY_EC:          return "ec";
+    case QUANTITY_TEMPERATURE: return "temperature";
+    case QUANTITY_VOLTAGE:     return "voltage";
+  }
+  return "unknown";
+}
+
+const char* DeviceMap::sensorType(uint8_t quantity)
+{
+  switch(quantity){
+    case QUANTITY_PH:          return "Analog pH Sensor";
+    case QUANTITY_EC:          return "Electrical Conductivity";
+    case QUANTITY_TEMPERATURE: return "Digital Temperature";
+    case QUANTITY_VOLTAGE:     return "Voltage";
+  }
+  return "Unknown";
+}
+
+const char* DeviceMap::unit(uint8_t quantity)
+{
+  switch(quantity){
+    case QUANTITY_PH:          return "pH";
+    case QUANTITY_EC:          return "mS/cm";
+    case QUANTITY_TEMPERATURE: return "°C";
+    case QUANTITY_VOLTAGE:     return "mV";
+  }
+  return "";
+}
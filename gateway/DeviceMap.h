@@ -0,0 +1,120 @@
+/*!
+ * @file DeviceMap.h
+ * @brief Define the basic structure of class DeviceMap
+ * @details Maps (device, channel, quantity) of incoming readings to rows of the app's `sensor` table.
+ * @n Config file, one sensor per line, '#' starts a comment:
+ * @n   <device path> <channel> <quantity: ph|ec|temperature|voltage> <sensor.sensor_id> <sensor.farm_id> [probe]
+ * @n A voltage channel with a probe field is converted by the gateway (ProbeMath.h) and stored as pH or EC:
+ * @n   ph[:<neutral mV>:<acid mV>]   DFRobot_PH probe, defaults 1500 / 2032.44
+ * @n   ec10[:<kvalue>]               DFRobot_EC10 probe, default K 1.0, compensated with the device's temperature
+ * @n Sensors get a dense index in the order they are listed, all per sensor state of the gateway is
+ * @n kept in arrays indexed by it.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_DEVICEMAP_H_
+#define _GATEWAY_DEVICEMAP_H_
+
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define SENSOR_UNMAPPED  (-1)
+
+struct SensorInfo {
+  std::string sensorId;   ///<sensor.sensor_id
+  std::string farmId;     ///<sensor.farm_id
+  uint32_t    device;     ///<index in DeviceMap::devices()
+  uint8_t     channel;
+  uint8_t     quantity;   ///<QUANTITY_* sent by the device
+  uint8_t     probe;      ///<PROBE_*, converts a voltage channel
+  float       calibration[2];  ///<PROBE_PH: neutral, acid mV; PROBE_EC10: kvalue
+};
+
+class DeviceMap
+{
+public:
+  /*!
+   * @fn load
+   * @brief Read a config file, see the file comment for the format
+   * @return false if the file can't be read or has a malformed line
+   */
+  bool load(const char* path);
+
+  /*!
+   * @fn add
+   * @brief Map one device channel to a sensor
+   * @return Sensor index
+   */
+  uint32_t add(const std::string& device, uint8_t channel, uint8_t quantity,
+               const std::string& sensorId, const std::string& farmId);
+
+  /*!
+   * @fn setProbe
+   * @brief Convert the voltages of a sensor, see the file comment
+   * @param spec  e.g. "ph:1498.2:2030.1" or "ec10:1.02"
+   * @return false if spec is malformed or the sensor is not a voltage channel
+   */
+  bool setProbe(uint32_t sensor, const char* spec);
+
+  /*!
+   * @fn lookup
+   * @brief Find the sensor of a reading
+   * @return Sensor index or SENSOR_UNMAPPED
+   */
+  int32_t lookup(uint32_t device, uint8_t channel, uint8_t quantity) const;
+
+  /*!
+   * @fn find
+   * @brief Find a sensor by its sensor.sensor_id
+   * @return Sensor index or SENSOR_UNMAPPED
+   */
+  int32_t find(const std::string& sensorId) const;
+
+  const std::vector<std::string>& devices() const { return this->_devices; }
+  const SensorInfo& sensor(uint32_t index) const { return this->_sensors[index]; }
+  size_t sensorCount() const { return this->_sensors.size(); }
+
+  /*!
+   * @fn parseProbe
+   * @brief Parse a probe field, see the file comment
+   * @param calibration  Receives the PROBE_PH neutral and acid mV or the PROBE_EC10 kvalue
+   * @return false if spec is malformed
+   */
+  static bool parseProbe(const char* spec, uint8_t* probe, float* calibration);
+
+  /*!
+   * @fn formatProbe
+   * @brief Inverse of parseProbe(), "none" for PROBE_NONE
+   */
+  static std::string formatProbe(uint8_t probe, const float* calibration);
+
+  /*!
+   * @fn quantityFromName
+   * @brief Parse "ph", "ec", "temperature" or "voltage", case insensitive
+   * @return QUANTITY_* or 0
+   */
+  static uint8_t quantityFromName(const char* name);
+  static const char* quantityName(uint8_t quantity);
+
+  /*!
+   * @fn sensorType
+   * @brief sensor.sensor_type used by the app for a quantity, e.g. "Electrical Conductivity"
+   */
+  static const char* sensorType(uint8_t quantity);
+
+  /*!
+   * @fn unit
+   * @brief sensor.units used by the app for a quantity, e.g. "mS/cm"
+   */
+  static const char* unit(uint8_t quantity);
+
+private:
+  std::vector<std::string> _devices;
+  std::vector<SensorInfo> _sensors;
+  std::unordered_map<uint32_t, uint32_t> _index;  ///<device << 16 | channel << 8 | quantity -> sensor
+  std::unordered_map<std::string, uint32_t> _ids;  ///<sensor_id -> sensor
+};
+
+#endif
@@ -0,0 +1,164 @@
+/*!
+ * @file Downsample.cpp
+ * @brief Largest-Triangle-Three-Buckets downsampling of chart series
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Downsample.h"
+
+#include <math.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+/*!
+ * @brief Sums of x and y over [begin, end)
+ */
+static void bucketSum(const float* x, const float* y, size_t begin, size_t end, float* sx, float* sy)
+{
+  size_t i = begin;
+  float a = 0, b = 0;
+#if defined(__SSE2__)
+  __m128 va = _mm_setzero_ps(), vb = _mm_setzero_ps();
+  for(; i + 4 <= end; i += 4){
+    va = _mm_add_ps(va, _mm_loadu_ps(x + i));
+    vb = _mm_add_ps(vb, _mm_loadu_ps(y + i));
+  }
+  float la[4], lb[4];
+  _mm_storeu_ps(la, va);
+  _mm_storeu_ps(lb, vb);
+  a = (la[0] + la[1]) + (la[2] + la[3]);
+  b = (lb[0] + lb[1]) + (lb[2] + lb[3]);
+#elif defined(__ARM_NEON)
+  float32x4_t va = vdupq_n_f32(0), vb = vdupq_n_f32(0);
+  for(; i + 4 <= end; i += 4){
+    va = vaddq_f32(va, vld1q_f32(x + i));
+    vb = vaddq_f32(vb, vld1q_f32(y + i));
+  }
+  float la[4], lb[4];
+  vst1q_f32(la, va);
+  vst1q_f32(lb, vb);
+  a = (la[0] + la[1]) + (la[2] + la[3]);
+  b = (lb[0] + lb[1]) + (lb[2] + lb[3]);
+#endif
+  for(; i < end; i++){
+    a += x[i];
+    b += y[i];
+  }
+  *sx = a;
+  *sy = b;
+}
+
+/*!
+ * @brief Index in [begin, end) maximizing |ka*x + kb*y + kc|, the first one on ties
+ */
+static size_t bucketArgmax(const float* x, const float* y, size_t begin, size_t end, float ka, float kb, float kc)
+{
+  size_t i = begin, best = begin;
+  float bestArea = -1;
+#if defined(__SSE2__)
+  if(end - begin >= 8){
+    const __m128 a = _mm_set1_ps(ka), b = _mm_set1_ps(kb), c = _mm_set1_ps(kc);
+    const __m128 sign = _mm_set1_ps(-0.0f);
+    __m128 top = _mm_set1_ps(-1);
+    __m128i topIndex = _mm_setzero_si128();
+    __m128i index = _mm_setr_epi32(0, 1, 2, 3);
+    const __m128i four = _mm_set1_epi32(4);
+    for(; i + 4 <= end; i += 4){
+      __m128 area = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, _mm_loadu_ps(x + i)), _mm_mul_ps(b, _mm_loadu_ps(y + i))), c);
+      area = _mm_andnot_ps(sign, area);
+      __m128 gt = _mm_cmpgt_ps(area, top);
+      top = _mm_or_ps(_mm_and_ps(gt, area), _mm_andnot_ps(gt, top));
+      __m128i m = _mm_castps_si128(gt);
+      topIndex = _mm_or_si128(_mm_and_si128(m, index), _mm_andnot_si128(m, topIndex));
+      index = _mm_add_epi32(index, four);
+    }
+    float lanes[4];
+    int32_t lanesIndex[4];
+    _mm_storeu_ps(lanes, top);
+    _mm_storeu_si128((__m128i*)lanesIndex, topIndex);
+    for(int k = 0; k < 4; k++){
+      if(lanes[k] > bestArea || (lanes[k] == bestArea && begin + lanesIndex[k] < best)){
+        bestArea = lanes[k];
+        best = begin + lanesIndex[k];
+      }
+    }
+  }
+#elif defined(__ARM_NEON)
+  if(end - begin >= 8){
+    const float32x4_t a = vdupq_n_f32(ka), b = vdupq_n_f32(kb), c = vdupq_n_f32(kc);
+    float32x4_t top = vdupq_n_f32(-1);
+    uint32x4_t topIndex = vdupq_n_u32(0);
+    static const uint32_t first[4] = { 0, 1, 2, 3 };
+    uint32x4_t index = vld1q_u32(first);
+    const uint32x4_t four = vdupq_n_u32(4);
+    for(; i + 4 <= end; i += 4){
+      float32x4_t area = vmlaq_f32(vmlaq_f32(c, a, vld1q_f32(x + i)), b, vld1q_f32(y + i));
+      area = vabsq_f32(area);
+      uint32x4_t gt = vcgtq_f32(area, top);
+      top = vbslq_f32(gt, area, top);
+      topIndex = vbslq_u32(gt, index, topIndex);
+      index = vaddq_u32(index, four);
+    }
+    float lanes[4];
+    uint32_t lanesIndex[4];
+    vst1q_f32(lanes, top);
+    vst1q_u32(lanesIndex, topIndex);
+    for(int k = 0; k < 4; k++){
+      if(lanes[k] > bestArea || (lanes[k] == bestArea && begin + lanesIndex[k] < best)){
+        bestArea = lanes[k];
+        best = begin + lanesIndex[k];
+      }
+    }
+  }
+#endif
+  for(; i < end; i++){
+    float area = fabsf(ka*x[i] + kb*y[i] + kc);
+    if(area > bestArea){
+      bestArea = area;
+      best = i;
+    }
+  }
+  return best;
+}
+
+size_t lttb(const float* x, const float* y, size_t n, size_t points, uint32_t* selected)
+{
+  if(points < LTTB_MIN_POINTS) points = LTTB_MIN_POINTS;
+  if(n <= points){
+    for(size_t i = 0; i < n; i++) selected[i] = i;
+    return n;
+  }
+  // bucket k of points - 2 covers [1 + k*every, 1 + (k+1)*every), the first and the last point stand alone
+  double every = (double)(n - 2)/(points - 2);
+  size_t out = 0;
+  size_t a = 0;
+  selected[out++] = 0;
+  size_t begin = 1;
+  size_t end = 1 + (size_t)every;
+  for(size_t k = 0; k < points - 2; k++){
+    size_t nextEnd = k + 2 < points - 2 ? 1 + (size_t)((k + 2)*every) : n - 1;
+    float cx, cy;
+    if(k + 1 < points - 2){
+      bucketSum(x, y, end, nextEnd, &cx, &cy);
+      cx /= (nextEnd - end);
+      cy /= (nextEnd - end);
+    }else{
+      cx = x[n-1];                                       // the last bucket looks at the last point
+      cy = y[n-1];
+    }
+    float ax = x[a], ay = y[a];
+    // 2*area = |(ax - cx)*(y - ay) - (ax - x)*(cy - ay)| = |(cy - ay)*x + (ax - cx)*y + kc|
+    float ka = cy - ay, kb = ax - cx;
+    float kc = -(ax - cx)*ay - ax*(cy - ay);
+    a = bucketArgmax(x, y, begin, end, ka, kb, kc);
+    selected[out++] = a;
+    begin = end;
+    end = nextEnd;
+  }
+  selected[out++] = n - 1;
+  return out;
+}
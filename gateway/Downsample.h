@@ -0,0 +1,30 @@
+/*!
+ * @file Downsample.h
+ * @brief Largest-Triangle-Three-Buckets downsampling of chart series
+ * @details lttb() keeps the first and the last point and splits the rest into points - 2 buckets of equal
+ * @n count. From every bucket it keeps the point spanning the largest triangle with the point kept from the
+ * @n previous bucket and the average of the next bucket, so peaks and dips survive where plain averaging
+ * @n would flatten them. For a fixed previous point a and average c the doubled triangle area at (x, y) is
+ * @n |(cy - ay)*x + (ax - cx)*y + k|, linear in x and y, so a bucket is scanned 4 points at a time with
+ * @n SSE2 or NEON. The next bucket's average is summed the same way; every point is read twice in total.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_DOWNSAMPLE_H_
+#define _GATEWAY_DOWNSAMPLE_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LTTB_MIN_POINTS   3
+
+/*!
+ * @fn lttb
+ * @brief Select at most points of n (x, y) points, x ascending
+ * @param x  e.g. seconds since the start of the chart; floats are exact enough to rank triangles
+ * @param selected  Receives the indices of the kept points in ascending order, room for min(n, points)
+ * @return Number of indices written: n if n <= points (all are kept)
+ */
+size_t lttb(const float* x, const float* y, size_t n, size_t points, uint32_t* selected);
+
+#endif
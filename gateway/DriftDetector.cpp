@@ -0,0 +1,219 @@
+/*!
+ * @file DriftDetector.cpp
+ * @brief Define the basic structure of class DriftDetector
+ * @details Online drift and fault detection on the stream of readings.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "DriftDetector.h"
+#include "ProbeMath.h"
+
+#include <map>
+#include <math.h>
+#include <string.h>
+#include <utility>
+
+/*!
+ * @brief Values a quantity can't leave without a fault, and the finest step it resolves
+ */
+struct QuantityLimits {
+  float low;
+  float high;
+  float resolution;       ///<lower bound of the noise level drift is measured in
+};
+
+static QuantityLimits limits(uint8_t quantity)
+{
+  switch(quantity){
+    case QUANTITY_PH:          return QuantityLimits{0.0f, 14.0f, 0.01f};
+    case QUANTITY_EC:          return QuantityLimits{0.0f, 100.0f, 0.01f};   // K=10 probe range
+    case QUANTITY_TEMPERATURE: return QuantityLimits{-55.0f, 85.0f, 0.0625f}; // DS18B20: -127 unplugged, 85 at reset
+  }
+  return QuantityLimits{0.0f, DRIFT_RAIL_MV, 1.0f};
+}
+
+DriftDetector::DriftDetector(const DeviceMap& map, const CalibrationRegistry& calibrations, DriftListener& listener)
+  : _map(map), _calibrations(calibrations), _listener(listener), _faults(map.sensorCount())
+{
+  this->_states.resize(map.sensorCount());
+  memset(this->_states.data(), 0, this->_states.size()*sizeof(State));
+  this->_backfill.resize(map.sensorCount());
+  memset(this->_backfill.data(), 0, this->_backfill.size()*sizeof(State));
+  std::map<std::pair<std::string, uint8_t>, uint32_t> groups;
+  for(uint32_t i = 0; i < map.sensorCount(); i++){
+    const SensorInfo& info = map.sensor(i);
+    uint8_t quantity = info.probe == PROBE_NONE ? info.quantity : probeQuantity(info.probe);
+    auto it = groups.emplace(std::make_pair(info.farmId, quantity), (uint32_t)this->_groups.size()).first;
+    if(it->second == this->_groups.size()) this->_groups.push_back(Group{0, 0, 0});
+    this->_groups[it->second].members++;
+    this->_groupOf.push_back(it->second);
+    this->_faults[i] = 0;
+  }
+  this->_detections = 0;
+}
+
+void DriftDetector::push(const Reading* readings, size_t count)
+{
+  int64_t now = nowMicros();
+  for(size_t i = 0; i < count; i++)
+    update(readings[i], isBackfill(readings[i], now));   // old levels would pass for a shift in the live CUSUM
+}
+
+bool DriftDetector::save(std::string& out) const
+{
+  uint32_t counts[2] = {(uint32_t)this->_states.size(), (uint32_t)this->_groups.size()};
+  out.append((const char*)counts, sizeof(counts));
+  out.append((const char*)this->_states.data(), this->_states.size()*sizeof(State));
+  out.append((const char*)this->_groups.data(), this->_groups.size()*sizeof(Group));
+  out.append((const char*)this->_backfill.data(), this->_backfill.size()*sizeof(State));
+  return true;
+}
+
+bool DriftDetector::restore(const uint8_t* data, size_t size)
+{
+  uint32_t counts[2];
+  if(size < sizeof(counts)) return false;
+  memcpy(counts, data, sizeof(counts));
+  if(counts[0] != this->_states.size() || counts[1] != this->_groups.size() ||
+     size != sizeof(counts) + 2*counts[0]*sizeof(State) + counts[1]*sizeof(Group)) return false;
+  data += sizeof(counts);
+  memcpy(this->_states.data(), data, counts[0]*sizeof(State));
+  data += counts[0]*sizeof(State);
+  memcpy(this->_groups.data(), data, counts[1]*sizeof(Group));
+  data += counts[1]*sizeof(Group);
+  memcpy(this->_backfill.data(), data, counts[0]*sizeof(State));
+  for(size_t i = 0; i < this->_states.size(); i++) this->_faults[i].store(this->_states[i].active);
+  return true;
+}
+
+bool DriftDetector::calibrationValid(uint32_t sensor) const
+{
+  const Calibration* c = this->_calibrations.current(sensor);
+  switch(c->probe){
+    case PROBE_PH:
+      return c->values[0] > 1322 && c->values[0] < 1678 && c->values[1] > 1854 && c->values[1] < 2210;
+    case PROBE_EC10:
+      return c->values[0] > 0.5f && c->values[0] < 1.5f;
+  }
+  return true;
+}
+
+void DriftDetector::raise(State& s, const Reading& r, bool backfill, uint8_t fault, float amount, float reference,
+                          bool grouped)
+{
+  s.active |= fault;
+  if(!backfill) this->_faults[r.sensor].store(s.active, std::memory_order_relaxed);
+  this->_detections.fetch_add(1, std::memory_order_relaxed);
+  Detection d;
+  d.sensor = r.sensor;
+  d.fault = fault;
+  d.timestamp = r.timestamp;
+  d.value = r.value;
+  d.amount = amount;
+  d.reference = reference;
+  d.grouped = grouped;
+  d.backfill = backfill;
+  this->_listener.detected(d);
+}
+
+void DriftDetector::clear(State& s, uint32_t sensor, bool backfill, uint8_t fault)
+{
+  if((s.active & fault) == 0) return;
+  s.active &= ~fault;
+  if(!backfill) this->_faults[sensor].store(s.active, std::memory_order_relaxed);
+}
+
+void DriftDetector::update(const Reading& r, bool backfill)
+{
+  float x = r.value;
+  if(!isfinite(x)) return;
+  State& s = backfill ? this->_backfill[r.sensor] : this->_states[r.sensor];
+  QuantityLimits q = limits(r.quantity);
+
+  if(r.calibration != s.calibration){
+    if(s.calibration){
+      // recalibrated: the level moves on purpose, learn it again
+      s.samples = 0;
+      clear(s, r.sensor, backfill, FAULT_DRIFT | FAULT_NOISY);
+    }
+    s.calibration = r.calibration;
+    // the registry's current version is checked once, by the live readings
+    if(backfill || calibrationValid(r.sensor)) clear(s, r.sensor, backfill, FAULT_CALIBRATION);
+    else if((s.active & FAULT_CALIBRATION) == 0) raise(s, r, backfill, FAULT_CALIBRATION, 0, 0, false);
+  }
+
+  // raw voltages only exist for readings converted here, see Pipeline::convert()
+  bool saturated = x <= q.low || x >= q.high || (r.calibration && (r.raw <= 0 || r.raw >= DRIFT_RAIL_MV));
+  if(saturated){
+    if(s.saturated < DRIFT_SATURATED_READINGS && ++s.saturated == DRIFT_SATURATED_READINGS)
+      raise(s, r, backfill, FAULT_SATURATED, 0, 0, false);
+  }else if(s.saturated && --s.saturated == 0){
+    clear(s, r.sensor, backfill, FAULT_SATURATED);
+  }
+
+  if(s.samples && x == s.last){
+    if(s.stuck < UINT16_MAX && ++s.stuck == DRIFT_STUCK_READINGS)
+      raise(s, r, backfill, FAULT_STUCK, s.stuck, 0, false);
+  }else{
+    s.stuck = 0;
+    clear(s, r.sensor, backfill, FAULT_STUCK);
+  }
+  if(s.active & (FAULT_STUCK | FAULT_SATURATED)){
+    s.last = x;
+    return;                                              // keeps a dead probe out of its statistics and group
+  }
+
+  Group& g = this->_groups[this->_groupOf[r.sensor]];
+  bool grouped = !backfill && g.members >= DRIFT_GROUP_MIN;   // the group level is today's, not the backfill's
+  if(g.updates == 0 && !backfill) g.level = x;
+  float residual = grouped ? x - g.level : x;
+  if(s.active == 0 && !backfill){                        // a drifting or noisy member would pull the others
+    g.updates++;
+    uint32_t window = g.members*DRIFT_GROUP_ROUNDS;
+    g.level += (x - g.level)/(g.updates < window ? g.updates : window);
+  }
+
+  if(s.samples == 0){
+    s.last = x;
+    s.noise = s.floor = 0;
+    s.offset = residual;
+    s.cusumUp = s.cusumDown = 0;
+    s.samples = 1;
+    return;
+  }
+  if(s.samples < UINT16_MAX) s.samples++;
+  float diff = fabsf(x - s.last);
+  s.last = x;
+  s.noise += (diff - s.noise)*(s.samples < 16 ? 1.0f/s.samples : DRIFT_NOISE_ALPHA);
+  if((s.active & FAULT_NOISY) == 0)
+    s.floor += (diff - s.floor)/(s.samples < DRIFT_FLOOR_WINDOW ? s.samples : DRIFT_FLOOR_WINDOW);
+  if(s.samples <= DRIFT_WARMUP){
+    s.offset += (residual - s.offset)/s.samples;
+    return;
+  }
+  if(!grouped) s.offset += (residual - s.offset)/DRIFT_OFFSET_WINDOW;
+
+  float floor = fmaxf(s.floor, q.resolution);
+  if(s.noise > DRIFT_NOISE_FACTOR*floor){
+    if((s.active & FAULT_NOISY) == 0) raise(s, r, backfill, FAULT_NOISY, s.noise, floor, false);
+  }else if(s.noise < 0.5f*DRIFT_NOISE_FACTOR*floor){
+    clear(s, r.sensor, backfill, FAULT_NOISY);
+  }
+  if(s.active & FAULT_NOISY) return;
+
+  // |x[t] - x[t-1]| of white noise averages 2 sigma / sqrt(pi)
+  float z = fminf(fmaxf((residual - s.offset)/(0.886f*floor), -DRIFT_CUSUM_CLIP), DRIFT_CUSUM_CLIP);
+  s.cusumUp = fmaxf(0.0f, s.cusumUp + z - DRIFT_CUSUM_SLACK);
+  s.cusumDown = fmaxf(0.0f, s.cusumDown - z - DRIFT_CUSUM_SLACK);
+  if(s.cusumUp > DRIFT_CUSUM_LIMIT || s.cusumDown > DRIFT_CUSUM_LIMIT){
+    uint32_t now = (uint32_t)(r.timestamp/1000000);
+    float shift = residual - s.offset;
+    if(s.alerted == 0 || (int64_t)now - (int64_t)s.alerted >= DRIFT_REALERT_S){   // an older reading doesn't wrap
+      s.alerted = now;
+      raise(s, r, backfill, FAULT_DRIFT, shift, 0, grouped);
+    }
+    // take the new level as the reference, a further shift is reported again after DRIFT_REALERT_S
+    s.offset = residual;
+    s.cusumUp = s.cusumDown = 0;
+  }
+}
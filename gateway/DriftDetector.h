@@ -0,0 +1,162 @@
+/*!
+ * @file DriftDetector.h
+ * @brief Define the basic structure of class DriftDetector
+ * @details Online drift and fault detection on the stream of readings, so a drifting probe is reported when it
+ * @n starts to wander instead of when somebody notices it in the charts. Per sensor it keeps 36 bytes and
+ * @n every reading costs a few float operations, no allocation and no lock.
+ * @n   residual  value minus the level of its group (sensors of the same farm and quantity, an EWMA over all
+ * @n             of them) when the group has DRIFT_GROUP_MIN sensors, else the value itself
+ * @n   offset    the sensor's usual residual, learned during warm-up; a sensor without a group follows its own
+ * @n             level slowly (DRIFT_OFFSET_WINDOW), so for it only sudden lasting shifts count
+ * @n   noise     EWMA of |value - previous value|, and its long average, the sensor's noise floor
+ * @n A two sided CUSUM of (residual - offset) / noise floor finds drift: a dosing change moves the whole group
+ * @n and leaves residuals alone, a drifting probe moves only its own (groups assume one nutrient solution per
+ * @n farm). Drift stays raised until the sensor gets a new calibration version. Faults are raised and cleared with
+ * @n hysteresis and reported once per episode:
+ * @n   stuck       the same value DRIFT_STUCK_READINGS times in a row
+ * @n   saturated   raw voltage at the ADC rails, converted value outside the quantity's range, for
+ * @n               DRIFT_SATURATED_READINGS readings
+ * @n   noisy       noise above DRIFT_NOISE_FACTOR times the floor
+ * @n   calibration a new calibration version outside the buffer windows of DFRobot_PH::phCalibration()
+ * @n               (neutral 1322..1678 mV, acid 1854..2210 mV) or the K range of DFRobot_EC10 (0.5..1.5)
+ * @n Backfill (isBackfill(), readings a device kept while it was offline) runs through a state of its own per
+ * @n sensor, its levels are not the current ones: it is judged against its own past only (the group level is
+ * @n today's), learns its noise floor and offset from scratch, leaves the calibration check and the faults
+ * @n raised now to the live readings, and its detections carry the backfill flag. Detections go to a
+ * @n DriftListener. The state is kept across restarts by checkpoints (Checkpointable); without
+ * @n one, or after a new calibration version, a sensor learns its offset and noise floor again for
+ * @n DRIFT_WARMUP readings before drift is reported.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_DRIFTDETECTOR_H_
+#define _GATEWAY_DRIFTDETECTOR_H_
+
+#include "CalibrationRegistry.h"
+#include "Checkpoint.h"
+#include "DeviceMap.h"
+#include "Reading.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+#define DRIFT_WARMUP              256     ///<readings before drift and noise are judged
+#define DRIFT_NOISE_ALPHA         (1.0f/16)
+#define DRIFT_FLOOR_WINDOW        2048    ///<readings the noise floor averages over
+#define DRIFT_OFFSET_WINDOW       8192    ///<readings the offset of a sensor without a group averages over
+#define DRIFT_CUSUM_SLACK         2.0f    ///<k, in noise floors: smaller shifts are ignored
+#define DRIFT_CUSUM_LIMIT         24.0f   ///<h, in noise floors
+#define DRIFT_CUSUM_CLIP          4.0f    ///<a single reading adds at most this, so the lag of the group level after
+                                          ///<a farm wide change adds up to less than h
+#define DRIFT_GROUP_MIN           3
+#define DRIFT_GROUP_ROUNDS        2       ///<group level time constant, in readings per member
+#define DRIFT_STUCK_READINGS      360     ///<an hour at one reading per 10 s
+#define DRIFT_SATURATED_READINGS  6
+#define DRIFT_NOISE_FACTOR        4.0f
+#define DRIFT_REALERT_S           (6*3600)  ///<drift of a sensor is reported at most this often
+#define DRIFT_RAIL_MV             4995.0f   ///<DFRobot boards sample probes against 5 V
+
+#define FAULT_DRIFT        0x01
+#define FAULT_STUCK        0x02
+#define FAULT_SATURATED    0x04
+#define FAULT_NOISY        0x08
+#define FAULT_CALIBRATION  0x10
+
+/*!
+ * @brief A drift or a fault found on a sensor
+ */
+struct Detection {
+  uint32_t sensor;
+  uint8_t  fault;         ///<FAULT_*
+  int64_t  timestamp;     ///<of the reading that raised it
+  float    value;
+  float    amount;        ///<FAULT_DRIFT: shift against the sensor's offset; FAULT_NOISY: noise; FAULT_STUCK: readings
+  float    reference;     ///<FAULT_NOISY: noise floor; else 0
+  bool     grouped;       ///<FAULT_DRIFT: measured against the group, else against the sensor's own past
+  bool     backfill;      ///<found in backfill, the fault may be over
+};
+
+class DriftListener
+{
+public:
+  virtual ~DriftListener() {}
+
+  /*!
+   * @fn detected
+   * @brief Called on the ingest thread, must not block
+   */
+  virtual void detected(const Detection& detection) = 0;
+};
+
+class DriftDetector : public ReadingSink, public Checkpointable
+{
+public:
+  /*!
+   * @fn DriftDetector
+   * @brief Constructor
+   * @param calibrations  Checked when a sensor's readings come with a new calibration version
+   */
+  DriftDetector(const DeviceMap& map, const CalibrationRegistry& calibrations, DriftListener& listener);
+
+  virtual void push(const Reading* readings, size_t count);
+
+  /*!
+   * @fn faults
+   * @brief FAULT_* currently raised on a sensor, from any thread
+   */
+  uint8_t faults(uint32_t sensor) const { return this->_faults[sensor].load(std::memory_order_relaxed); }
+
+  /*!
+   * @fn detections
+   * @brief Detections since the start
+   */
+  uint64_t detections() const { return this->_detections.load(std::memory_order_relaxed); }
+
+  /*!
+   * @fn save
+   * @brief sensors (4) | groups (4) | per sensor state | per group level | per sensor backfill state
+   */
+  virtual bool save(std::string& out) const;
+  virtual bool restore(const uint8_t* data, size_t size);
+
+private:
+  struct State {
+    float    last;
+    float    noise;
+    float    floor;
+    float    offset;
+    float    cusumUp;
+    float    cusumDown;
+    uint32_t alerted;     ///<unix s of the last drift report
+    uint16_t samples;     ///<saturates at UINT16_MAX
+    uint16_t stuck;
+    uint16_t calibration;
+    uint8_t  saturated;
+    uint8_t  active;      ///<FAULT_* raised
+  };
+
+  struct Group {
+    float    level;
+    uint32_t members;
+    uint32_t updates;
+  };
+
+  const DeviceMap& _map;
+  const CalibrationRegistry& _calibrations;
+  DriftListener& _listener;
+  std::vector<State> _states;
+  std::vector<State> _backfill;                        ///<per sensor, the state of its backfill
+  std::vector<uint32_t> _groupOf;                      ///<sensor -> group
+  std::vector<Group> _groups;
+  std::vector<std::atomic<uint8_t>> _faults;           ///<copy of State::active for other threads
+  std::atomic<uint64_t> _detections;
+
+private:
+  void update(const Reading& r, bool backfill);
+  void raise(State& s, const Reading& r, bool backfill, uint8_t fault, float amount, float reference, bool grouped);
+  void clear(State& s, uint32_t sensor, bool backfill, uint8_t fault);
+  bool calibrationValid(uint32_t sensor) const;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*!
+ * @file FarmSnapshot.cpp
+ * @brief Define the basic structure of class FarmSnapshot
+ * @details The current state of every sensor of a farm in one lookup.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "FarmSnapshot.h"
+#include "Json.h"
+#include "ProbeMath.h"
+
+#include <math.h>
+
+int SensorSnapshot::direction() const
+{
+  float change = this->trend*this->hours;
+  if(this->hours < 2 || fabsf(change) <= SNAPSHOT_TREND_SHARE*(this->max - this->min)) return 0;
+  return change > 0 ? 1 : -1;
+}
+
+FarmSnapshot::FarmSnapshot(const DeviceMap& map, const Rollups& rollups, const DriftDetector& detector)
+  : _map(map), _rollups(rollups), _detector(detector), _latest(new Latest[map.sensorCount()])
+{
+  for(uint32_t i = 0; i < map.sensorCount(); i++){
+    this->_latest[i].sequence = 0;
+    this->_latest[i].value = 0;
+    this->_latest[i].timestamp = 0;
+    this->_farms[map.sensor(i).farmId].push_back(i);
+  }
+}
+
+void FarmSnapshot::begin(const ColumnStore* store)
+{
+  if(store == NULL) return;
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    Sample s;
+    if(store->latest(i, &s)) this->store(i, s.value, s.timestamp);
+  }
+}
+
+void FarmSnapshot::store(uint32_t sensor, float value, int64_t timestamp)
+{
+  Latest& l = this->_latest[sensor];
+  uint32_t sequence = l.sequence.load(std::memory_order_relaxed);
+  l.sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  l.value.store(value, std::memory_order_relaxed);
+  l.timestamp.store(timestamp, std::memory_order_relaxed);
+  l.sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void FarmSnapshot::latest(uint32_t sensor, float* value, int64_t* timestamp) const
+{
+  const Latest& l = this->_latest[sensor];
+  while(true){
+    uint32_t sequence = l.sequence.load(std::memory_order_acquire);
+    *value = l.value.load(std::memory_order_relaxed);
+    *timestamp = l.timestamp.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if((sequence & 1) == 0 && l.sequence.load(std::memory_order_relaxed) == sequence) return;
+  }
+}
+
+const std::vector<uint32_t>* FarmSnapshot::sensors(const std::string& farmId) const
+{
+  auto it = this->_farms.find(farmId);
+  return it == this->_farms.end() ? NULL : &it->second;
+}
+
+void FarmSnapshot::push(const Reading* readings, size_t count)
+{
+  for(size_t i = 0; i < count; i++){
+    const Reading& r = readings[i];
+    if(r.timestamp >= this->_latest[r.sensor].timestamp.load(std::memory_order_relaxed))
+      store(r.sensor, r.value, r.timestamp);
+  }
+}
+
+bool FarmSnapshot::farm(const std::string& farmId, std::vector<SensorSnapshot>& sensors) const
+{
+  auto it = this->_farms.find(farmId);
+  if(it == this->_farms.end()) return false;
+  int64_t now = nowMicros();
+  int64_t hour = Rollups::width(ROLLUP_1H);
+  int64_t from = Rollups::floor(now - SNAPSHOT_WINDOW, ROLLUP_1H) + hour;    // 24 hourly buckets, the last one open
+  std::vector<RollupBucket> buckets;
+  sensors.clear();
+  for(size_t i = 0; i < it->second.size(); i++){
+    SensorSnapshot s;
+    s.sensor = it->second[i];
+    latest(s.sensor, &s.value, &s.timestamp);
+    s.faults = this->_detector.faults(s.sensor);
+    s.count = 0;
+    s.min = s.max = s.mean = s.trend = 0;
+    s.hours = 0;
+    buckets.clear();
+    this->_rollups.buckets(s.sensor, ROLLUP_1H, from, now + 1, buckets);
+    if(!buckets.empty()){
+      RollupBucket day = buckets[0];
+      double sx = 0, sy = 0, sxx = 0, sxy = 0;
+      for(size_t b = 0; b < buckets.size(); b++){
+        if(b) day.merge(buckets[b]);
+        double x = (double)(buckets[b].start - buckets[0].start)/hour;
+        double y = buckets[b].mean();
+        sx += x;
+        sy += y;
+        sxx += x*x;
+        sxy += x*y;
+      }
+      size_t n = buckets.size();
+      double d = n*sxx - sx*sx;
+      s.count = day.count;
+      s.min = day.min;
+      s.max = day.max;
+      s.mean = day.mean();
+      s.trend = d > 0 ? (n*sxy - sx*sy)/d : 0;
+      s.hours = (buckets.back().start - buckets[0].start)/hour + 1;
+    }
+    sensors.push_back(s);
+  }
+  return true;
+}
+
+bool FarmSnapshot::document(const std::string& farmId, std::string& body) const
+{
+  static const char* directions[] = { "falling", "steady", "rising" };
+  std::vector<SensorSnapshot> sensors;
+  bool known = farm(farmId, sensors);
+  char ts[32];
+  BatchWriter::formatTimestamp(ts, nowMicros());
+  body += "{\"farm_id\":";
+  appendString(body, farmId);
+  body += ",\"generated_at\":\"";
+  body += ts;
+  body += "\",\"sensors\":[";
+  for(size_t i = 0; i < sensors.size(); i++){
+    const SensorSnapshot& s = sensors[i];
+    const SensorInfo& info = this->_map.sensor(s.sensor);
+    uint8_t quantity = info.probe == PROBE_NONE ? info.quantity : probeQuantity(info.probe);
+    if(i) body += ',';
+    body += "{\"sensor_id\":";
+    appendString(body, info.sensorId);
+    body += ",\"sensor_type\":";
+    appendString(body, DeviceMap::sensorType(quantity));
+    body += ",\"units\":";
+    appendString(body, DeviceMap::unit(quantity));
+    body += ",\"latest\":";
+    if(s.timestamp) appendRow(body, s.timestamp, s.value);
+    else body += "null";
+    body += ",\"day\":";
+    if(s.count){
+      body += "{\"count\":";
+      appendNumber(body, s.count);
+      body += ",\"min\":";
+      appendNumber(body, s.min);
+      body += ",\"max\":";
+      appendNumber(body, s.max);
+      body += ",\"mean\":";
+      appendNumber(body, s.mean);
+      body += ",\"trend_per_hour\":";
+      appendNumber(body, s.trend);
+      body += ",\"trend\":\"";
+      body += directions[s.direction() + 1];
+      body += "\"}";
+    }else{
+      body += "null";
+    }
+    body += ",\"faults\":[";
+    appendFaults(body, s.faults);
+    body += "]}";
+  }
+  body += "]}";
+  return known;
+}
@@ -0,0 +1,108 @@
+/*!
+ * @file FarmSnapshot.h
+ * @brief Define the basic structure of class FarmSnapshot
+ * @details The current state of every sensor of a farm in one lookup: latest reading, 24 h count, min, max and
+ * @n mean, the trend over the day and the faults raised by DriftDetector. Made for the app's AI context builder,
+ * @n which otherwise asks the database for each sensor's latest row one by one.
+ * @n The latest reading of each sensor is kept as it arrives (a seqlock per sensor, the ingest thread never
+ * @n waits for a reader); the 24 h figures come from the hourly rollups, which ingest keeps up to date as well.
+ * @n The trend is the least squares slope of the hourly means, per hour.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_FARMSNAPSHOT_H_
+#define _GATEWAY_FARMSNAPSHOT_H_
+
+#include "ColumnStore.h"
+#include "DeviceMap.h"
+#include "DriftDetector.h"
+#include "Reading.h"
+#include "Rollups.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define SNAPSHOT_WINDOW      (86400LL*1000000)   ///<us covered by the day figures
+#define SNAPSHOT_TREND_SHARE 0.25f                ///<a trend moving less than this share of the day's spread is steady
+
+struct SensorSnapshot {
+  uint32_t sensor;
+  int64_t  timestamp;     ///<of the latest reading, 0 if there is none
+  float    value;
+  uint32_t count;         ///<readings of the last 24 h
+  float    min;
+  float    max;
+  float    mean;
+  float    trend;         ///<per hour
+  uint32_t hours;         ///<from the first to the last hour with readings, the span the trend was fitted on
+  uint8_t  faults;        ///<FAULT_*
+
+  /*!
+   * @fn direction
+   * @brief 1 rising, -1 falling, 0 steady
+   */
+  int direction() const;
+};
+
+class FarmSnapshot : public ReadingSink
+{
+public:
+  FarmSnapshot(const DeviceMap& map, const Rollups& rollups, const DriftDetector& detector);
+
+  /*!
+   * @fn begin
+   * @brief Take the latest rows of earlier runs from a store (may be NULL)
+   */
+  void begin(const ColumnStore* store);
+
+  virtual void push(const Reading* readings, size_t count);
+
+  /*!
+   * @fn farm
+   * @brief Snapshot of every sensor of a farm, in device map order
+   * @return false if the farm has no sensors in the device map
+   */
+  bool farm(const std::string& farmId, std::vector<SensorSnapshot>& sensors) const;
+
+  /*!
+   * @fn document
+   * @brief Append the JSON snapshot of a farm: {"farm_id", "generated_at", "sensors": [{"sensor_id",
+   * @n "sensor_type", "units", "latest", "day", "faults"}]}
+   * @return false if the farm has no sensors in the device map (its document then has none)
+   */
+  bool document(const std::string& farmId, std::string& body) const;
+
+  /*!
+   * @fn latest
+   * @brief Latest reading of a sensor, timestamp 0 if there is none. Safe from any thread
+   */
+  void latest(uint32_t sensor, float* value, int64_t* timestamp) const;
+
+  /*!
+   * @fn sensors
+   * @brief Sensors of a farm in device map order, NULL if it has none
+   */
+  const std::vector<uint32_t>* sensors(const std::string& farmId) const;
+
+private:
+  struct Latest {
+    std::atomic<uint32_t> sequence;                    ///<odd while the ingest thread writes
+    std::atomic<float> value;
+    std::atomic<int64_t> timestamp;
+  };
+
+  const DeviceMap& _map;
+  const Rollups& _rollups;
+  const DriftDetector& _detector;
+  std::unique_ptr<Latest[]> _latest;
+  std::unordered_map<std::string, std::vector<uint32_t>> _farms;
+
+private:
+  void store(uint32_t sensor, float value, int64_t timestamp);
+};
+
+#endif
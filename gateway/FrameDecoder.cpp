@@ -0,0 +1,228 @@
+/*!
+ * @file FrameDecoder.cpp
+ * @brief Define the basic structure of class FrameDecoder
+ * @details Incremental decoder for the byte stream of one device, text lines and binary frames.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "FrameDecoder.h"
+#include "Reading.h"
+#include "TextScanner.h"
+
+#include <math.h>
+#include <string.h>
+
+#define LINE_MAX_VALUES 8
+
+FrameDecoder::FrameDecoder()
+{
+  memset(&this->_counters, 0, sizeof(this->_counters));
+}
+
+void FrameDecoder::reset()
+{
+  this->_pending.clear();
+}
+
+uint16_t FrameDecoder::crc16(uint16_t crc, const uint8_t* data, size_t length)
+{
+  while(length--){
+    crc ^= (uint16_t)(*data++) << 8;
+    for(int i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+void FrameDecoder::feed(const uint8_t* data, size_t length, FrameHandler& handler)
+{
+  size_t pos = 0;
+  // finish the record cut off by the previous read: append only its missing bytes, not the whole buffer
+  while(!this->_pending.empty() && pos < length){
+    size_t take;
+    if(this->_pending[0] == FRAME_SYNC1 && this->_pending.size() < 4){
+      take = 4 - this->_pending.size();                  // up to the length byte
+    }else if(this->_pending[0] == FRAME_SYNC1){
+      size_t total = 4 + this->_pending[3] + 2;
+      take = total > this->_pending.size() ? total - this->_pending.size() : 1;
+    }else{
+      take = findDelimiter(data + pos, length - pos) + 1;
+    }
+    if(take > length - pos) take = length - pos;
+    this->_pending.insert(this->_pending.end(), data + pos, data + pos + take);
+    pos += take;
+    size_t used = decode(this->_pending.data(), this->_pending.size(), handler);
+    this->_pending.erase(this->_pending.begin(), this->_pending.begin() + used);
+  }
+  if(pos == length) return;
+  size_t used = pos + decode(data + pos, length - pos, handler);   // the rest is decoded in place
+  this->_pending.assign(data + used, data + length);
+}
+
+size_t FrameDecoder::decode(const uint8_t* data, size_t length, FrameHandler& handler)
+{
+  size_t pos = 0;
+  while(pos < length){
+    if(data[pos] == FRAME_SYNC1){
+      if(pos + 1 >= length) return pos;                  // need the second sync byte
+      if(data[pos+1] != FRAME_SYNC2){
+        pos++;
+        this->_counters.dropped++;
+        continue;
+      }
+      size_t used = decodeFrame(data + pos, length - pos, handler);
+      if(used == 0) return pos;                          // frame not complete yet
+      pos += used;
+      continue;
+    }
+    // text: runs up to the line end, or up to a frame start if the line was cut off
+    size_t end = pos + findDelimiter(data + pos, length - pos);
+    if(end == length){
+      if(length - pos <= DECODER_MAX_LINE) return pos;   // wait for the rest of the line
+      this->_counters.dropped += length - pos;
+      return length;
+    }
+    if(data[end] == FRAME_SYNC1){
+      this->_counters.dropped += end - pos;
+      pos = end;
+      continue;
+    }
+    size_t lineLength = end - pos;
+    if(lineLength && data[end-1] == '\r') lineLength--;
+    if(lineLength <= DECODER_MAX_LINE)
+      decodeLine((const char*)data + pos, lineLength, handler);
+    else
+      this->_counters.dropped += lineLength;
+    pos = end + 1;
+  }
+  return pos;
+}
+
+size_t FrameDecoder::decodeFrame(const uint8_t* data, size_t length, FrameHandler& handler)
+{
+  if(length < 4) return 0;
+  size_t payloadLength = data[3];
+  size_t total = 4 + payloadLength + 2;
+  if(length < total) return 0;
+  uint16_t crc = crc16(0xFFFF, data + 2, 2 + payloadLength);
+  if((data[total-2] | (data[total-1] << 8)) != crc){
+    this->_counters.crcErrors++;
+    this->_counters.dropped++;
+    return 1;                                            // resynchronize on the next sync byte
+  }
+  this->_counters.frames++;
+  const uint8_t* payload = data + 4;
+  float f[4];
+  uint32_t count, sequence, age;
+  switch(data[2]){
+    case FRAME_TYPE_READING:
+    if(payloadLength >= 6){
+      memcpy(f, payload + 2, 4);
+      if(isfinite(f[0])) handler.reading(payload[0], payload[1], f[0]);
+      else this->_counters.invalid++;                    // as in text lines: would poison the sums it goes into
+    }
+    break;
+
+    case FRAME_TYPE_SEQUENCED:
+    if(payloadLength >= 15){
+      memcpy(&sequence, payload + 1, 4);
+      memcpy(&age, payload + 5, 4);
+      memcpy(f, payload + 11, 4);
+      if(isfinite(f[0])){
+        handler.sequenced(payload[0], sequence, age, payload[9], payload[10], f[0]);
+      }else{
+        this->_counters.invalid++;
+        handler.discarded(payload[0], sequence);
+      }
+    }
+    break;
+
+    case FRAME_TYPE_STATS:
+    if(payloadLength >= 23){
+      memcpy(&count, payload + 3, 4);
+      memcpy(f, payload + 7, 16);
+      handler.stats(payload[0], payload[1], payload[2], count, f[0], f[1], f[2], f[3]);
+    }
+    break;
+  }
+  return total;                                          // unknown types are skipped whole
+}
+
+static inline bool isKeyChar(char c)
+{
+  return (unsigned)((c | 0x20) - 'a') < 26 || c == '_';
+}
+
+#define KEY_CHANNEL  0xFF
+#define KEY_OTHER    0xFE
+
+/*!
+ * @brief Case insensitive match of the key ending at colon against a lower case name
+ */
+static inline bool keyIs(const char* colon, const char* start, const char* name, size_t length)
+{
+  if((size_t)(colon - start) < length) return false;
+  const char* key = colon - length;
+  for(size_t i = 0; i < length; i++)
+    if((key[i] | 0x20) != name[i]) return false;
+  return key == start || !isKeyChar(key[-1]);           // whole word, "xph:" is not "ph:"
+}
+
+/*!
+ * @brief Identify the key in front of a ':' from its last letters, without scanning it backwards first
+ * @return QUANTITY_*, KEY_CHANNEL, KEY_OTHER for unknown keys or 0 if there is no key
+ */
+static uint8_t lineKey(const char* colon, const char* start)
+{
+  if(colon == start || !isKeyChar(colon[-1])) return 0;
+  switch(colon[-1] | 0x20){
+    case 'h':
+    if(keyIs(colon, start, "ph", 2)) return QUANTITY_PH;
+    if(keyIs(colon, start, "ch", 2)) return KEY_CHANNEL;
+    break;
+
+    case 'c':
+    if(keyIs(colon, start, "ec", 2)) return QUANTITY_EC;
+    break;
+
+    case 'e':
+    if(keyIs(colon, start, "temperature", 11)) return QUANTITY_TEMPERATURE;
+    if(keyIs(colon, start, "voltage", 7)) return QUANTITY_VOLTAGE;
+    break;
+  }
+  return KEY_OTHER;
+}
+
+void FrameDecoder::decodeLine(const char* line, size_t length, FrameHandler& handler)
+{
+  uint8_t quantity[LINE_MAX_VALUES];
+  float value[LINE_MAX_VALUES];
+  int n = 0;
+  uint8_t channel = 0;
+  const char* end = line + length;
+  const char* p = line;
+  while(p < end){
+    // jump from field to field: a field is the run of letters before a ':', prompts and RIG lines have none
+    const char* colon = (const char*)memchr(p, ':', end - p);
+    if(colon == NULL) break;
+    uint8_t key = lineKey(colon, p);
+    float v;
+    const char* next = key ? parseDecimal(colon + 1, end, &v) : NULL;
+    if(next == NULL || !isfinite(v)){                    // "nan" / "inf" from Print::printFloat()
+      p = colon + 1;
+      continue;
+    }
+    p = next;
+    while(p < end && *p != ' ' && *p != ',' && *p != '\t') p++;  // unit, e.g. "ms/cm" or "^C"
+    if(key == KEY_CHANNEL){
+      channel = (uint8_t)v;
+    }else if(key != KEY_OTHER && n < LINE_MAX_VALUES){
+      quantity[n] = key;
+      value[n++] = v;
+    }
+  }
+  if(n == 0) return;
+  this->_counters.lines++;
+  for(int k = 0; k < n; k++)
+    handler.reading(channel, quantity[k], value[k]);
+}
@@ -0,0 +1,104 @@
+/*!
+ * @file FrameDecoder.h
+ * @brief Define the basic structure of class FrameDecoder
+ * @details Incremental decoder for the byte stream of one device. It understands both output formats of the sketches:
+ * @n  - legacy text lines, e.g. "pH:7.00, EC:1.41ms/cm", "voltage:1523.44  temperature:25.0^C  EC:1.4ms/cm"
+ * @n    or "ch:3  pH:7.02" (DFRobot_AnalogMux example); lines without a "ch:" field are channel 0
+ * @n  - binary frames of DFRobot_SensorLink/DFRobot_SensorFrame.h (0xA5 0x5A, type, length, payload, CRC-16)
+ * @n Sequenced readings (FRAME_TYPE_SEQUENCED) carry the device's boot epoch, a sequence number and their age in
+ * @n ms; the device resends them until an acknowledgement (FRAME_TYPE_ACK, see Delivery) comes back.
+ * @n Records may be split across reads at any byte, the unfinished tail is kept until the next feed().
+ * @n Everything else is decoded in place in the caller's buffer (TextScanner.h), nothing is copied per line.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_FRAMEDECODER_H_
+#define _GATEWAY_FRAMEDECODER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define FRAME_SYNC1            0xA5
+#define FRAME_SYNC2            0x5A
+#define FRAME_TYPE_READING     0x01
+#define FRAME_TYPE_STATS       0x02
+#define FRAME_TYPE_SEQUENCED   0x03   ///<reading the device keeps until it is acknowledged
+#define FRAME_TYPE_ACK         0x04   ///<gateway to device
+
+#define DECODER_MAX_LINE       256   ///<longer text lines are dropped
+
+/*!
+ * @brief Receives the decoded records of one device
+ */
+class FrameHandler
+{
+public:
+  virtual ~FrameHandler() {}
+  virtual void reading(uint8_t channel, uint8_t quantity, float value) = 0;
+
+  /*!
+   * @fn sequenced
+   * @brief A reading of a FRAME_TYPE_SEQUENCED frame, possibly one received before
+   * @param age  Milliseconds since the device measured it
+   */
+  virtual void sequenced(uint8_t epoch, uint32_t sequence, uint32_t age, uint8_t channel, uint8_t quantity,
+                         float value) = 0;
+
+  /*!
+   * @fn discarded
+   * @brief A FRAME_TYPE_SEQUENCED reading dropped for its value (nan, inf), to be acknowledged all the same:
+   * @n the device would send it again for ever
+   */
+  virtual void discarded(uint8_t epoch, uint32_t sequence) = 0;
+  virtual void stats(uint8_t channel, uint8_t quantity, uint8_t window, uint32_t count,
+                     float mean, float stddev, float min, float max) = 0;
+};
+
+struct DecoderCounters {
+  uint64_t lines;         ///<text lines with at least one reading
+  uint64_t frames;        ///<binary frames with a valid CRC
+  uint64_t crcErrors;
+  uint64_t dropped;       ///<bytes skipped while resynchronizing
+  uint64_t invalid;       ///<readings dropped for a value that is nan or inf
+};
+
+class FrameDecoder
+{
+public:
+  FrameDecoder();
+
+  /*!
+   * @fn feed
+   * @brief Decode the next bytes of the stream
+   * @param data  Bytes as read from the device
+   * @param length  Number of bytes
+   * @param handler  Gets every complete reading and window summary
+   */
+  void feed(const uint8_t* data, size_t length, FrameHandler& handler);
+
+  /*!
+   * @fn reset
+   * @brief Drop the unfinished tail, e.g. after the device was reopened
+   */
+  void reset();
+
+  const DecoderCounters& counters() const { return this->_counters; }
+
+  /*!
+   * @fn crc16
+   * @brief CRC-16/CCITT-FALSE as computed by DFRobot_SensorFrame::crc16()
+   */
+  static uint16_t crc16(uint16_t crc, const uint8_t* data, size_t length);
+
+private:
+  std::vector<uint8_t> _pending;
+  DecoderCounters _counters;
+
+private:
+  size_t decode(const uint8_t* data, size_t length, FrameHandler& handler);
+  size_t decodeFrame(const uint8_t* data, size_t length, FrameHandler& handler);
+  void   decodeLine(const char* line, size_t length, FrameHandler& handler);
+};
+
+#endif
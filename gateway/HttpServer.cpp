@@ -0,0 +1,425 @@
+/*!
+ * @file HttpServer.cpp
+ * @brief Define the basic structure of class HttpServer
+ * @details Minimal HTTP/1.1 server for the gateway's query API.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "HttpServer.h"
+#include "Log.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define LISTEN_TAG  (-1)
+#define WAKE_TAG    (-2)
+
+static int64_t monotonicMillis()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+static int hexValue(char c)
+{
+  if(c >= '0' && c <= '9') return c - '0';
+  c |= 0x20;
+  if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+  return -1;
+}
+
+/*!
+ * @brief Percent-decode a URL part, '+' is a space in query strings
+ */
+static std::string urlDecode(const char* p, size_t length, bool query)
+{
+  std::string s;
+  s.reserve(length);
+  for(size_t i = 0; i < length; i++){
+    if(p[i] == '%' && i + 2 < length && hexValue(p[i+1]) >= 0 && hexValue(p[i+2]) >= 0){
+      s.push_back((char)(hexValue(p[i+1])*16 + hexValue(p[i+2])));
+      i += 2;
+    }else if(p[i] == '+' && query){
+      s.push_back(' ');
+    }else{
+      s.push_back(p[i]);
+    }
+  }
+  return s;
+}
+
+/*!
+ * @brief Value of a header of a 0 terminated head, blanks trimmed, empty if it is missing
+ * @param name  "\r\n<header>:"
+ */
+static std::string headerValue(const char* head, const char* name)
+{
+  const char* p = strcasestr(head, name);
+  if(p == NULL) return std::string();
+  p += strlen(name);
+  while(*p == ' ' || *p == '\t') p++;
+  const char* end = strchr(p, '\r');
+  if(end == NULL) end = p + strlen(p);
+  while(end > p && (end[-1] == ' ' || end[-1] == '\t')) end--;
+  return std::string(p, end - p);
+}
+
+const char* HttpRequest::param(const char* name, const char* def) const
+{
+  std::unordered_map<std::string, std::string>::const_iterator it = this->params.find(name);
+  return it == this->params.end() ? def : it->second.c_str();
+}
+
+const char* HttpServer::statusText(int status)
+{
+  switch(status){
+    case 200: return "OK";
+    case 202: return "Accepted";
+    case 204: return "No Content";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 403: return "Forbidden";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 409: return "Conflict";
+    case 413: return "Payload Too Large";
+    case 500: return "Internal Server Error";
+    case 503: return "Service Unavailable";
+  }
+  return "Unknown";
+}
+
+HttpServer::HttpServer()
+{
+  this->_listen = -1;
+  this->_epoll = -1;
+  this->_wake = -1;
+  this->_running = false;
+  this->_tick = 0;
+}
+
+HttpServer::~HttpServer()
+{
+  while(!this->_clients.empty()) closeClient(this->_clients.begin()->first);
+  if(this->_listen >= 0) close(this->_listen);
+  if(this->_wake >= 0) close(this->_wake);
+  if(this->_epoll >= 0) close(this->_epoll);
+}
+
+void HttpServer::route(const char* prefix, HttpHandler* handler)
+{
+  this->_routes.push_back(std::make_pair(std::string(prefix), handler));
+}
+
+void HttpServer::stream(const char* prefix, HttpStreamHandler* handler)
+{
+  route(prefix, handler);
+  this->_streams.push_back(handler);
+}
+
+bool HttpServer::send(int client, const std::string& data)
+{
+  std::unordered_map<int, Client>::iterator it = this->_clients.find(client);
+  if(it == this->_clients.end()) return false;
+  Client& c = it->second;
+  if(c.out.size() == c.sent){
+    // written from the loop rather than here: a failed write closes the client, which calls back the handler
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+    ev.data.fd = c.fd;
+    epoll_ctl(this->_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+  }
+  c.out += data;
+  return true;
+}
+
+size_t HttpServer::unsent(int client) const
+{
+  std::unordered_map<int, Client>::const_iterator it = this->_clients.find(client);
+  return it == this->_clients.end() ? 0 : it->second.out.size() - it->second.sent;
+}
+
+bool HttpServer::begin(const char* listen)
+{
+  std::string address = "0.0.0.0";
+  const char* colon = strrchr(listen, ':');
+  int port = atoi(colon ? colon + 1 : listen);
+  if(colon) address.assign(listen, colon - listen);
+  struct sockaddr_in sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sin_family = AF_INET;
+  sa.sin_port = htons(port);
+  if(port <= 0 || port > 65535 || inet_pton(AF_INET, address.c_str(), &sa.sin_addr) != 1){
+    LOG("bad listen address %s, expected [a.b.c.d:]port", listen);
+    return false;
+  }
+  this->_listen = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  int one = 1;
+  setsockopt(this->_listen, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if(this->_listen < 0 || bind(this->_listen, (struct sockaddr*)&sa, sizeof(sa)) < 0 ||
+     ::listen(this->_listen, 64) < 0){
+    LOG("http %s: %s", listen, strerror(errno));
+    return false;
+  }
+  this->_epoll = epoll_create1(EPOLL_CLOEXEC);
+  this->_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(this->_epoll < 0 || this->_wake < 0){
+    LOG("epoll setup failed: %s", strerror(errno));
+    return false;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.fd = LISTEN_TAG;
+  epoll_ctl(this->_epoll, EPOLL_CTL_ADD, this->_listen, &ev);
+  ev.data.fd = WAKE_TAG;
+  epoll_ctl(this->_epoll, EPOLL_CTL_ADD, this->_wake, &ev);
+  LOG("http listening on %s:%d", address.c_str(), port);
+  this->_running = true;                                 // here, not in run(): a stop() before run() must hold
+  return true;
+}
+
+void HttpServer::accept()
+{
+  while(true){
+    int fd = accept4(this->_listen, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if(fd < 0) return;                                   // EAGAIN: all pending connections taken
+    if(this->_clients.size() >= HTTP_MAX_CLIENTS){
+      close(fd);
+      continue;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLRDHUP;
+    ev.data.fd = fd;
+    epoll_ctl(this->_epoll, EPOLL_CTL_ADD, fd, &ev);
+    Client& c = this->_clients[fd];
+    c.fd = fd;
+    c.sent = 0;
+    c.close = false;
+    c.active = monotonicMillis();
+    c.stream = NULL;
+  }
+}
+
+void HttpServer::closeClient(int fd)
+{
+  std::unordered_map<int, Client>::iterator it = this->_clients.find(fd);
+  if(it != this->_clients.end() && it->second.stream) it->second.stream->closed(fd);
+  epoll_ctl(this->_epoll, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+  this->_clients.erase(fd);
+}
+
+void HttpServer::dispatch(Client& c, const char* head, size_t length)
+{
+  HttpRequest request;
+  HttpResponse response;
+  HttpHandler* handler = NULL;
+  response.status = 200;
+  response.contentType = "application/json";
+  response.stream = false;
+  request.client = c.fd;
+  const char* end = head + length;
+  const char* sp1 = (const char*)memchr(head, ' ', length);
+  const char* sp2 = sp1 ? (const char*)memchr(sp1 + 1, ' ', end - sp1 - 1) : NULL;
+  const char* eol = (const char*)memchr(head, '\r', length);
+  if(sp1 == NULL || sp2 == NULL || eol == NULL || sp2 > eol){
+    response.status = 400;
+    c.close = true;
+  }else{
+    request.method.assign(head, sp1 - head);
+    const char* target = sp1 + 1;
+    const char* q = (const char*)memchr(target, '?', sp2 - target);
+    request.path = urlDecode(target, (q ? q : sp2) - target, false);
+    for(const char* p = q ? q + 1 : sp2; p < sp2;){
+      const char* amp = (const char*)memchr(p, '&', sp2 - p);
+      if(amp == NULL) amp = sp2;
+      const char* eq = (const char*)memchr(p, '=', amp - p);
+      if(eq) request.params[urlDecode(p, eq - p, true)] = urlDecode(eq + 1, amp - eq - 1, true);
+      else if(amp > p) request.params[urlDecode(p, amp - p, true)] = "";
+      p = amp + 1;
+    }
+    bool http10 = (size_t)(eol - sp2) >= 9 && strncmp(sp2 + 1, "HTTP/1.0", 8) == 0;
+    const char* connection = strcasestr(head, "\r\nConnection:");   // head is 0 terminated by readClient()
+    if(connection){
+      connection += 13;
+      while(*connection == ' ') connection++;
+      if(strncasecmp(connection, "close", 5) == 0) c.close = true;
+      else if(strncasecmp(connection, "keep-alive", 10) == 0) http10 = false;
+    }
+    if(http10) c.close = true;
+    request.origin = headerValue(head, "\r\nOrigin:");
+    request.authorization = headerValue(head, "\r\nAuthorization:");
+
+    const char* length = strcasestr(head, "\r\nContent-Length:");
+    if(strcasestr(head, "\r\nTransfer-Encoding:") || (length && atol(length + 17) != 0)){
+      response.status = 413;                             // bodies are not read, the connection can't continue
+      c.close = true;
+    }else if(request.method != "GET" && request.method != "HEAD" && request.method != "POST"){
+      response.status = 405;
+    }else{
+      size_t best = 0;
+      for(size_t i = 0; i < this->_routes.size(); i++){
+        const std::string& prefix = this->_routes[i].first;
+        if(prefix.size() >= best && request.path.compare(0, prefix.size(), prefix) == 0){
+          handler = this->_routes[i].second;
+          best = prefix.size();
+        }
+      }
+      if(handler) handler->handle(request, response);
+      else response.status = 404;
+    }
+  }
+  if(response.stream && response.status == 200){
+    for(size_t i = 0; i < this->_streams.size(); i++)
+      if(this->_streams[i] == handler) c.stream = this->_streams[i];
+    if(c.stream){
+      static const char header[] = "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                                   "Access-Control-Allow-Origin: *\r\nConnection: keep-alive\r\n\r\n";
+      c.out.append(header, sizeof(header) - 1);
+      c.out += response.body;
+      c.close = false;                                   // an HTTP/1.0 stream ends when either side closes
+      return;
+    }
+  }
+  if(response.status >= 300 && response.body.empty()){
+    response.body = "{\"error\":\"";
+    response.body += statusText(response.status);
+    response.body += "\"}";
+  }
+  bool readOnly = request.method == "GET" || request.method == "HEAD";
+  char header[256];
+  int n = snprintf(header, sizeof(header),
+                   "HTTP/1.1 %d %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\n"
+                   "%sConnection: %s\r\n\r\n",
+                   response.status, statusText(response.status), response.contentType, response.body.size(),
+                   readOnly ? "Access-Control-Allow-Origin: *\r\n" : "", c.close ? "close" : "keep-alive");
+  c.out.append(header, n);
+  if(request.method != "HEAD") c.out += response.body;
+}
+
+void HttpServer::readClient(Client& c)
+{
+  char buf[4096];
+  while(true){
+    ssize_t n = read(c.fd, buf, sizeof(buf));
+    if(n > 0){
+      c.in.append(buf, n);
+      continue;
+    }
+    if(n < 0 && errno == EINTR) continue;
+    if(n < 0 && errno == EAGAIN) break;
+    closeClient(c.fd);                                   // EOF or error
+    return;
+  }
+  c.active = monotonicMillis();
+  size_t start = 0;
+  while(!c.close && c.stream == NULL){                 // pipelined requests are answered in order
+    size_t end = c.in.find("\r\n\r\n", start);
+    if(end == std::string::npos) break;
+    c.in[end + 2] = '\0';                                // terminate the head for the header search
+    dispatch(c, c.in.data() + start, end + 2 - start);
+    start = end + 4;
+  }
+  c.in.erase(0, start);
+  if(c.stream) c.in.clear();                             // nothing more is expected from a stream client
+  if(c.in.size() > HTTP_MAX_REQUEST && !c.close){
+    c.out += "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+    c.close = true;
+  }
+  if(!c.out.empty()) writeClient(c);
+}
+
+bool HttpServer::writeClient(Client& c)
+{
+  while(c.sent < c.out.size()){
+    ssize_t n = write(c.fd, c.out.data() + c.sent, c.out.size() - c.sent);
+    if(n > 0){
+      c.sent += n;
+      continue;
+    }
+    if(n < 0 && errno == EINTR) continue;
+    if(n < 0 && errno == EAGAIN){
+      struct epoll_event ev;
+      ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP;
+      ev.data.fd = c.fd;
+      epoll_ctl(this->_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+      return true;
+    }
+    closeClient(c.fd);
+    return false;
+  }
+  c.out.clear();
+  c.sent = 0;
+  if(c.close){
+    closeClient(c.fd);
+    return false;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.fd = c.fd;
+  epoll_ctl(this->_epoll, EPOLL_CTL_MOD, c.fd, &ev);
+  return true;
+}
+
+void HttpServer::closeIdle()
+{
+  int64_t now = monotonicMillis();
+  std::vector<int> idle;
+  for(std::unordered_map<int, Client>::iterator it = this->_clients.begin(); it != this->_clients.end(); ++it)
+    if(it->second.stream == NULL && now - it->second.active > HTTP_IDLE_MS) idle.push_back(it->first);
+  for(size_t i = 0; i < idle.size(); i++) closeClient(idle[i]);
+}
+
+void HttpServer::run()
+{
+  struct epoll_event events[64];
+  while(this->_running){
+    int n = epoll_wait(this->_epoll, events, 64, this->_streams.empty() ? HTTP_IDLE_MS/4 : HTTP_TICK_MS);
+    if(n < 0 && errno != EINTR){
+      LOG("epoll_wait: %s", strerror(errno));
+      return;
+    }
+    for(int i = 0; i < n; i++){
+      int fd = events[i].data.fd;
+      if(fd == LISTEN_TAG){
+        accept();
+        continue;
+      }
+      if(fd == WAKE_TAG){
+        uint64_t v;
+        if(read(this->_wake, &v, sizeof(v)) < 0) {}
+        continue;
+      }
+      std::unordered_map<int, Client>::iterator it = this->_clients.find(fd);
+      if(it == this->_clients.end()) continue;
+      if((events[i].events & EPOLLOUT) && !writeClient(it->second)) continue;
+      if(events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) readClient(it->second);
+    }
+    int64_t now = monotonicMillis();
+    if(!this->_streams.empty() && now >= this->_tick){
+      this->_tick = now + HTTP_TICK_MS;
+      for(size_t i = 0; i < this->_streams.size(); i++) this->_streams[i]->tick(*this, now);
+    }
+    closeIdle();
+  }
+}
+
+void HttpServer::stop()
+{
+  this->_running = false;
+  uint64_t one = 1;
+  if(write(this->_wake, &one, sizeof(one)) < 0) {}
+}
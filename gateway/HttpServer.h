@@ -0,0 +1,165 @@
+/*!
+ * @file HttpServer.h
+ * @brief Define the basic structure of class HttpServer
+ * @details Minimal HTTP/1.1 server for the gateway's query API: one thread, one epoll loop, non-blocking
+ * @n sockets and keep-alive. Requests are GET / HEAD / POST without a body (parameters go in the query
+ * @n string); each one is answered by the handler of the longest matching path prefix. Responses are built
+ * @n in memory and sent with Content-Length. Only GET / HEAD responses allow every origin (CORS), so a web
+ * @n page on another site can read the API but never sees the answer to a POST.
+ * @n A handler registered with stream() may instead keep the connection as a server-sent event stream
+ * @n (text/event-stream): its response body is the first events, later ones are queued with send() from its
+ * @n tick(), which the loop calls every HTTP_TICK_MS while such handlers exist. Nothing more is read from a
+ * @n stream connection and it is never closed for being idle.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_HTTPSERVER_H_
+#define _GATEWAY_HTTPSERVER_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#define HTTP_MAX_REQUEST   8192     ///<bytes of request line and headers
+#define HTTP_MAX_CLIENTS   256
+#define HTTP_IDLE_MS       30000    ///<keep-alive connections idle longer are closed
+#define HTTP_TICK_MS       100      ///<period of HttpStreamHandler::tick()
+
+struct HttpRequest {
+  std::string method;
+  std::string path;       ///<decoded, without the query string
+  std::unordered_map<std::string, std::string> params;  ///<decoded query string
+  std::string origin;        ///<Origin header, empty without one (not sent by the browser: same origin or no page)
+  std::string authorization; ///<Authorization header, empty without one
+  int client;             ///<connection, for HttpServer::send() once it is a stream
+
+  /*!
+   * @fn param
+   * @brief Query parameter or def if it is missing
+   */
+  const char* param(const char* name, const char* def = NULL) const;
+};
+
+struct HttpResponse {
+  int status;
+  const char* contentType;
+  std::string body;
+  bool stream;            ///<keep the connection as an event stream, body holds the first events
+};
+
+/*!
+ * @brief Answers the requests below a path prefix, called on the server thread
+ */
+class HttpHandler
+{
+public:
+  virtual ~HttpHandler() {}
+  virtual void handle(const HttpRequest& request, HttpResponse& response) = 0;
+};
+
+class HttpServer;
+
+/*!
+ * @brief A handler whose responses can be event streams, called on the server thread
+ */
+class HttpStreamHandler : public HttpHandler
+{
+public:
+  /*!
+   * @fn closed
+   * @brief A stream connection was closed, client is no longer valid
+   */
+  virtual void closed(int client) = 0;
+
+  /*!
+   * @fn tick
+   * @brief Called every HTTP_TICK_MS, nowMs is monotonic
+   */
+  virtual void tick(HttpServer& server, int64_t nowMs) = 0;
+};
+
+class HttpServer
+{
+public:
+  HttpServer();
+  ~HttpServer();
+
+  /*!
+   * @fn route
+   * @brief Send requests whose path starts with prefix to handler
+   */
+  void route(const char* prefix, HttpHandler* handler);
+
+  /*!
+   * @fn stream
+   * @brief Like route(), and let handler turn responses into event streams
+   */
+  void stream(const char* prefix, HttpStreamHandler* handler);
+
+  /*!
+   * @fn send
+   * @brief Queue data on a stream connection, it is written as the socket accepts it
+   * @return false if the client is gone
+   */
+  bool send(int client, const std::string& data);
+
+  /*!
+   * @fn unsent
+   * @brief Bytes queued on a connection and not yet written
+   */
+  size_t unsent(int client) const;
+
+  /*!
+   * @fn begin
+   * @brief Listen on [address:]port, e.g. "8080" or "127.0.0.1:8080"
+   * @return false if the socket can't be bound
+   */
+  bool begin(const char* listen);
+
+  /*!
+   * @fn run
+   * @brief Serve until stop() is called
+   */
+  void run();
+
+  /*!
+   * @fn stop
+   * @brief Make run() return, safe to call from a signal handler or another thread
+   */
+  void stop();
+
+  static const char* statusText(int status);
+
+private:
+  struct Client {
+    int fd;
+    std::string in;
+    std::string out;
+    size_t sent;
+    bool close;           ///<close after out is sent
+    int64_t active;       ///<monotonic ms of the last activity
+    HttpStreamHandler* stream;  ///<NULL unless the connection is an event stream
+  };
+
+  std::vector<std::pair<std::string, HttpHandler*>> _routes;
+  std::vector<HttpStreamHandler*> _streams;
+  std::unordered_map<int, Client> _clients;
+  int _listen;
+  int _epoll;
+  int _wake;
+  std::atomic<bool> _running;
+  int64_t _tick;          ///<monotonic ms of the next tick
+
+private:
+  void accept();
+  void readClient(Client& c);
+  bool writeClient(Client& c);
+  void closeClient(int fd);
+  void dispatch(Client& c, const char* head, size_t length);
+  void closeIdle();
+};
+
+#endif
@@ -0,0 +1,77 @@
+/*!
+ * @file Json.h
+ * @brief JSON writing helpers shared by the gateway's HTTP API, live feed and notifications
+ * @details Values are appended to a std::string; non-finite numbers are written as null.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_JSON_H_
+#define _GATEWAY_JSON_H_
+
+#include "BatchWriter.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+inline void appendString(std::string& body, const std::string& s)
+{
+  body += '"';
+  for(size_t i = 0; i < s.size(); i++){
+    unsigned char c = s[i];
+    if(c == '"' || c == '\\'){
+      body += '\\';
+      body += c;
+    }else if(c < 0x20){
+      char esc[8];
+      snprintf(esc, sizeof(esc), "\\u%04x", c);
+      body += esc;
+    }else{
+      body += c;
+    }
+  }
+  body += '"';
+}
+
+inline void appendNumber(std::string& body, double v)
+{
+  char buf[32];
+  if(isfinite(v)) body.append(buf, snprintf(buf, sizeof(buf), "%.7g", v));
+  else body += "null";
+}
+
+/*!
+ * @fn appendRow
+ * @brief {"created_at": ISO 8601, "value": number}, the shape of the app's `sensor_data` rows
+ */
+inline void appendRow(std::string& body, int64_t timestamp, float value)
+{
+  char ts[32];
+  BatchWriter::formatTimestamp(ts, timestamp);
+  body += "{\"created_at\":\"";
+  body += ts;
+  body += "\",\"value\":";
+  appendNumber(body, value);
+  body += '}';
+}
+
+/*!
+ * @fn appendFaults
+ * @brief Names of FAULT_* bits, comma separated, without the brackets
+ */
+inline void appendFaults(std::string& body, uint8_t faults)
+{
+  static const char* names[] = {"drift", "stuck", "saturated", "noisy", "calibration"};
+  bool first = true;
+  for(int i = 0; i < 5; i++){
+    if((faults & (1 << i)) == 0) continue;
+    if(!first) body += ',';
+    body += '"';
+    body += names[i];
+    body += '"';
+    first = false;
+  }
+}
+
+#endif
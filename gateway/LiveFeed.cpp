@@ -0,0 +1,227 @@
+/*!
+ * @file LiveFeed.cpp
+ * @brief Define the basic structure of class LiveFeed
+ * @details Server-sent event streams of coalesced latest readings.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "LiveFeed.h"
+#include "BatchWriter.h"
+#include "Json.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unordered_set>
+
+static void fail(HttpResponse& response, int status, const char* message)
+{
+  response.status = status;
+  response.body = "{\"error\":";
+  appendString(response.body, message);
+  response.body += '}';
+}
+
+LiveFeed::LiveFeed(const DeviceMap& map, const FarmSnapshot& snapshot)
+  : _map(map), _snapshot(snapshot), _subscribers(0), _dirty(new std::atomic<uint8_t>[map.sensorCount()])
+{
+  for(size_t i = 0; i < map.sensorCount(); i++) this->_dirty[i].store(0, std::memory_order_relaxed);
+  this->_now = 0;
+}
+
+void LiveFeed::push(const Reading* readings, size_t count)
+{
+  if(this->_subscribers.load(std::memory_order_relaxed) == 0) return;
+  // FarmSnapshot has stored these readings: either tick() sees them or we see its cleared flags, see tick()
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  this->_fresh.clear();
+  for(size_t i = 0; i < count; i++){
+    std::atomic<uint8_t>& dirty = this->_dirty[readings[i].sensor];
+    if(dirty.load(std::memory_order_relaxed)) continue;  // already queued, tick() reads the latest value
+    dirty.store(1, std::memory_order_relaxed);
+    this->_fresh.push_back(readings[i].sensor);
+  }
+  if(this->_fresh.empty()) return;
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  this->_changed.insert(this->_changed.end(), this->_fresh.begin(), this->_fresh.end());
+}
+
+void LiveFeed::appendReading(std::string& body, uint32_t sensor)
+{
+  float value;
+  int64_t timestamp;
+  this->_snapshot.latest(sensor, &value, &timestamp);
+  const SensorInfo& info = this->_map.sensor(sensor);
+  char ts[32];
+  BatchWriter::formatTimestamp(ts, timestamp);
+  body += "{\"sensor_id\":";
+  appendString(body, info.sensorId);
+  body += ",\"farm_id\":";
+  appendString(body, info.farmId);
+  body += ",\"created_at\":\"";
+  body += ts;
+  body += "\",\"value\":";
+  appendNumber(body, value);
+  body += '}';
+}
+
+bool LiveFeed::subscribe(const HttpRequest& request, HttpResponse& response, Subscriber& s)
+{
+  const char* farms = request.param("farms", "");
+  const char* ids = request.param("sensors", "");
+  const char* interval = request.param("interval");
+  if(*farms == '\0' && *ids == '\0'){
+    fail(response, 400, "farms or sensors is required");
+    return false;
+  }
+  s.interval = LIVE_DEFAULT_INTERVAL_MS;
+  if(interval){
+    char* end;
+    long ms = strtol(interval, &end, 10);
+    if(*interval == '\0' || *end != '\0' || ms < LIVE_MIN_INTERVAL_MS || ms > LIVE_MAX_INTERVAL_MS){
+      fail(response, 400, "interval must be milliseconds between 250 and 60000");
+      return false;
+    }
+    s.interval = ms;
+  }
+
+  std::string& body = response.body;
+  std::unordered_set<uint32_t> seen;
+  char retry[32];
+  body.assign(retry, snprintf(retry, sizeof(retry), "retry: %d\n\n", LIVE_RETRY_MS));
+  for(const char* p = farms; *p; p++){
+    const char* comma = strchr(p, ',');
+    std::string farmId(p, comma ? comma - p : strlen(p));
+    if(!farmId.empty()){
+      body += "event: snapshot\ndata: ";
+      this->_snapshot.document(farmId, body);            // a farm without gateway sensors has none
+      body += "\n\n";
+      const std::vector<uint32_t>* sensors = this->_snapshot.sensors(farmId);
+      for(size_t i = 0; sensors && i < sensors->size(); i++)
+        if(seen.insert((*sensors)[i]).second) s.sensors.push_back((*sensors)[i]);
+    }
+    if(comma == NULL) break;
+    p = comma;
+  }
+  std::string readings;
+  for(const char* p = ids; *p; p++){
+    const char* comma = strchr(p, ',');
+    std::string sensorId(p, comma ? comma - p : strlen(p));
+    if(!sensorId.empty()){
+      int32_t sensor = this->_map.find(sensorId);
+      if(sensor < 0){
+        fail(response, 404, "no such sensors");
+        return false;
+      }
+      if(seen.insert(sensor).second){
+        s.sensors.push_back(sensor);
+        float value;
+        int64_t timestamp;
+        this->_snapshot.latest(sensor, &value, &timestamp);
+        if(timestamp){
+          readings += readings.empty() ? "event: readings\ndata: [" : ",";
+          appendReading(readings, sensor);
+        }
+      }
+    }
+    if(comma == NULL) break;
+    p = comma;
+  }
+  if(!readings.empty()) body += readings + "]\n\n";
+  if(s.sensors.empty()){
+    fail(response, 404, "no such sensors");
+    return false;
+  }
+  return true;
+}
+
+void LiveFeed::handle(const HttpRequest& request, HttpResponse& response)
+{
+  if(request.method != "GET" || (request.path != "/stream" && request.path != "/stream/")){
+    fail(response, request.method != "GET" ? 405 : 404, request.method != "GET" ? "use GET" : "not found");
+    return;
+  }
+  if(this->_clients.size() >= LIVE_MAX_SUBSCRIBERS){
+    fail(response, 503, "too many streams");
+    return;
+  }
+  Subscriber s;
+  if(!subscribe(request, response, s)) return;
+  s.client = request.client;
+  s.next = this->_now;
+  s.sent = this->_now;
+  Subscriber& added = this->_clients[s.client] = std::move(s);
+  added.pending.assign(added.sensors.size(), 0);
+  for(uint32_t e = 0; e < added.sensors.size(); e++) this->_watchers[added.sensors[e]].push_back(Watch{&added, e});
+  this->_subscribers.store(this->_clients.size(), std::memory_order_relaxed);
+  response.stream = true;
+}
+
+void LiveFeed::closed(int client)
+{
+  auto it = this->_clients.find(client);
+  if(it == this->_clients.end()) return;
+  Subscriber& s = it->second;
+  for(size_t e = 0; e < s.sensors.size(); e++){
+    auto w = this->_watchers.find(s.sensors[e]);
+    std::vector<Watch>& watches = w->second;
+    for(size_t i = 0; i < watches.size(); i++){
+      if(watches[i].subscriber != &s) continue;
+      watches[i] = watches.back();
+      watches.pop_back();
+      break;
+    }
+    if(watches.empty()) this->_watchers.erase(w);
+  }
+  this->_clients.erase(it);
+  this->_subscribers.store(this->_clients.size(), std::memory_order_relaxed);
+}
+
+void LiveFeed::flush(HttpServer& server, Subscriber& s, int64_t nowMs)
+{
+  this->_event = "event: readings\ndata: [";
+  for(size_t i = 0; i < s.queue.size(); i++){
+    uint32_t e = s.queue[i];
+    s.pending[e] = 0;
+    if(i) this->_event += ',';
+    appendReading(this->_event, s.sensors[e]);
+  }
+  this->_event += "]\n\n";
+  s.queue.clear();
+  server.send(s.client, this->_event);
+  s.next = nowMs + s.interval;
+  s.sent = nowMs;
+}
+
+void LiveFeed::tick(HttpServer& server, int64_t nowMs)
+{
+  this->_now = nowMs;
+  this->_taken.clear();
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_taken.swap(this->_changed);
+  }
+  for(size_t i = 0; i < this->_taken.size(); i++) this->_dirty[this->_taken[i]].store(0, std::memory_order_relaxed);
+  // a reading push() skipped because its flag was still set is in FarmSnapshot before the values are read below
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  for(size_t i = 0; i < this->_taken.size(); i++){
+    auto it = this->_watchers.find(this->_taken[i]);
+    if(it == this->_watchers.end()) continue;
+    for(size_t w = 0; w < it->second.size(); w++){
+      Subscriber* s = it->second[w].subscriber;
+      uint32_t e = it->second[w].entry;
+      if(s->pending[e]) continue;
+      s->pending[e] = 1;
+      s->queue.push_back(e);
+    }
+  }
+  for(auto it = this->_clients.begin(); it != this->_clients.end(); ++it){
+    Subscriber& s = it->second;
+    if(!s.queue.empty() && nowMs >= s.next && server.unsent(s.client) == 0){
+      flush(server, s, nowMs);                           // values as of now, however many readings came since
+    }else if(nowMs - s.sent >= LIVE_PING_MS && server.unsent(s.client) == 0){
+      server.send(s.client, ": ping\n\n");
+      s.sent = nowMs;
+    }
+  }
+}
@@ -0,0 +1,96 @@
+/*!
+ * @file LiveFeed.h
+ * @brief Define the basic structure of class LiveFeed
+ * @details Pushes new readings to dashboards as server-sent events, so an open chart no longer polls the API
+ * @n (or the database) for each of its sensors:
+ * @n   GET /stream?farms=<farm_id>,<farm_id>&sensors=<id>,<id>&interval=<ms>
+ * @n The stream starts with an `event: snapshot` per farm, the document of GET /farms/<farm_id>/snapshot,
+ * @n and an `event: readings` with the latest rows of the sensors asked for one by one. After that, each
+ * @n `event: readings` is a JSON array of {"sensor_id", "farm_id", "created_at", "value"} for the sensors
+ * @n that have a new reading since the previous event.
+ * @n Updates are coalesced: a sensor reading many times between two events appears once, with its latest
+ * @n value. A subscriber gets at most one event per interval (default LIVE_DEFAULT_INTERVAL_MS), and none
+ * @n while it hasn't taken the previous one off its socket, so a slow client sees fewer, fresher updates
+ * @n instead of a growing backlog. Idle streams get a comment line every LIVE_PING_MS.
+ * @n The ingest thread only flags the sensors that changed (nothing at all while nobody is subscribed);
+ * @n events are built on the HTTP server thread from FarmSnapshot's latest values.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_LIVEFEED_H_
+#define _GATEWAY_LIVEFEED_H_
+
+#include "DeviceMap.h"
+#include "FarmSnapshot.h"
+#include "HttpServer.h"
+#include "Reading.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define LIVE_DEFAULT_INTERVAL_MS 1000
+#define LIVE_MIN_INTERVAL_MS     250
+#define LIVE_MAX_INTERVAL_MS     60000
+#define LIVE_PING_MS             15000   ///<keeps proxies from closing a quiet stream
+#define LIVE_MAX_SUBSCRIBERS     128     ///<further subscriptions are refused with 503
+#define LIVE_RETRY_MS            3000    ///<reconnection delay suggested to EventSource
+
+class LiveFeed : public ReadingSink, public HttpStreamHandler
+{
+public:
+  LiveFeed(const DeviceMap& map, const FarmSnapshot& snapshot);
+
+  virtual void push(const Reading* readings, size_t count);
+
+  virtual void handle(const HttpRequest& request, HttpResponse& response);
+  virtual void closed(int client);
+  virtual void tick(HttpServer& server, int64_t nowMs);
+
+  /*!
+   * @fn subscribers
+   * @brief Open streams
+   */
+  size_t subscribers() const { return this->_subscribers.load(std::memory_order_relaxed); }
+
+private:
+  struct Subscriber {
+    int client;
+    int64_t interval;                                   ///<ms between events
+    int64_t next;                                       ///<monotonic ms the next event may go
+    int64_t sent;                                       ///<monotonic ms of the last write
+    std::vector<uint32_t> sensors;
+    std::vector<uint8_t> pending;                       ///<per entry of sensors
+    std::vector<uint32_t> queue;                        ///<entries of sensors with a pending update
+  };
+
+  struct Watch {
+    Subscriber* subscriber;
+    uint32_t entry;
+  };
+
+  const DeviceMap& _map;
+  const FarmSnapshot& _snapshot;
+  std::atomic<size_t> _subscribers;
+  std::unique_ptr<std::atomic<uint8_t>[]> _dirty;      ///<per sensor: changed and not yet taken by tick()
+  std::vector<uint32_t> _fresh;                         ///<ingest thread scratch
+  std::mutex _mutex;
+  std::vector<uint32_t> _changed;                       ///<guarded by _mutex
+  // server thread only
+  std::vector<uint32_t> _taken;
+  std::unordered_map<int, Subscriber> _clients;
+  std::unordered_map<uint32_t, std::vector<Watch>> _watchers;
+  std::string _event;
+  int64_t _now;                                         ///<monotonic ms of the last tick
+
+private:
+  bool subscribe(const HttpRequest& request, HttpResponse& response, Subscriber& s);
+  void appendReading(std::string& body, uint32_t sensor);
+  void flush(HttpServer& server, Subscriber& s, int64_t nowMs);
+};
+
+#endif
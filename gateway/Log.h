@@ -0,0 +1,21 @@
+/*!
+ * @file Log.h
+ * @brief Logging macros of the gateway, everything goes to stderr
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_LOG_H_
+#define _GATEWAY_LOG_H_
+
+#include <stdio.h>
+
+#define LOG(...) do { fprintf(stderr, "[gateway] " __VA_ARGS__); fputc('\n', stderr); } while(0)
+
+//#define ENABLE_DBG
+#ifdef ENABLE_DBG
+#define DBG(...) do { fprintf(stderr, "[%s(): %d] ", __FUNCTION__, __LINE__); fprintf(stderr, __VA_ARGS__); fputc('\n', stderr); } while(0)
+#else
+#define DBG(...)
+#endif
+
+#endif
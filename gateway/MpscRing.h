@@ -0,0 +1,113 @@
+/*!
+ * @file MpscRing.h
+ * @brief Define the basic structure of class MpscRing
+ * @details Bounded lock-free ring for many producer threads and one consumer thread.
+ * @n Every slot carries a sequence number (Vyukov's bounded queue): producers claim a slot with one
+ * @n compare-and-swap on the tail and publish it by advancing the slot's sequence, so producers never
+ * @n wait for each other and the consumer needs no atomic read-modify-write at all.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_MPSCRING_H_
+#define _GATEWAY_MPSCRING_H_
+
+#include "SpscRing.h"
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+template <typename T>
+class MpscRing
+{
+public:
+  /*!
+   * @fn MpscRing
+   * @brief Constructor
+   * @param capacity  Rounded up to a power of two
+   */
+  explicit MpscRing(size_t capacity)
+    : _slots(roundUp(capacity))
+  {
+    this->_mask = this->_slots.size() - 1;
+    for(size_t i = 0; i < this->_slots.size(); i++)
+      this->_slots[i].sequence.store(i, std::memory_order_relaxed);
+    this->_head = 0;
+    this->_tail.store(0, std::memory_order_relaxed);
+  }
+
+  /*!
+   * @fn push
+   * @brief Producer, any thread
+   * @return false if the ring is full
+   */
+  bool push(const T& item)
+  {
+    size_t pos = this->_tail.load(std::memory_order_relaxed);
+    while(true){
+      Slot& s = this->_slots[pos & this->_mask];
+      size_t seq = s.sequence.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if(diff == 0){
+        if(this->_tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+          s.item = item;
+          s.sequence.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }else if(diff < 0){
+        return false;                                    // full: the slot still holds an unconsumed item
+      }else{
+        pos = this->_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  /*!
+   * @fn pop
+   * @brief Consumer, one thread only
+   * @return false if the ring is empty
+   */
+  bool pop(T& item)
+  {
+    Slot& s = this->_slots[this->_head & this->_mask];
+    if(s.sequence.load(std::memory_order_acquire) != this->_head + 1) return false;
+    item = s.item;
+    s.sequence.store(this->_head + this->_mask + 1, std::memory_order_release);
+    this->_head++;
+    this->_headShared.store(this->_head, std::memory_order_relaxed);
+    return true;
+  }
+
+  /*!
+   * @fn size
+   * @brief Approximate number of queued items, for statistics from any thread
+   */
+  size_t size() const
+  {
+    return this->_tail.load(std::memory_order_relaxed) - this->_headShared.load(std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return this->_mask + 1; }
+
+private:
+  struct Slot {
+    std::atomic<size_t> sequence;
+    T item;
+  };
+
+  static size_t roundUp(size_t capacity)
+  {
+    size_t size = 2;
+    while(size < capacity) size <<= 1;
+    return size;
+  }
+
+  std::vector<Slot> _slots;
+  size_t _mask;
+  alignas(CACHE_LINE) size_t _head;                  ///<consumer only
+  std::atomic<size_t> _headShared{0};                ///<copy of _head for size()
+  alignas(CACHE_LINE) std::atomic<size_t> _tail;     ///<claimed by producers
+  char _pad[CACHE_LINE - sizeof(size_t)];
+};
+
+#endif
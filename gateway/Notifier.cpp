@@ -0,0 +1,255 @@
+/*!
+ * @file Notifier.cpp
+ * @brief Define the basic structure of class Notifier
+ * @details Turns detections of DriftDetector and alerts of RuleEngine into rows of the app's `notifications` table.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Notifier.h"
+#include "Json.h"
+#include "Log.h"
+#include "ProbeMath.h"
+
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/*!
+ * @brief Value of "name": in one object of a PostgREST response, quoted or not
+ */
+static bool field(const char* object, const char* end, const char* name, std::string& value)
+{
+  char key[32];
+  int n = snprintf(key, sizeof(key), "\"%s\":", name);
+  const char* p = object;
+  while(p < end && (p = strstr(p, key)) != NULL && p < end){
+    p += n;
+    while(*p == ' ') p++;
+    const char* q = p;
+    if(*p == '"'){
+      q = ++p;
+      while(q < end && *q != '"') q++;
+    }else{
+      while(q < end && *q != ',' && *q != '}') q++;
+    }
+    value.assign(p, q - p);
+    return value != "null";
+  }
+  return false;
+}
+
+Notifier::Notifier(const DeviceMap& map, const CalibrationRegistry& calibrations)
+  : _map(map), _calibrations(calibrations)
+{
+  this->_client = NULL;
+  this->_dropped = 0;
+  this->_muted = false;
+  this->_silenced = 0;
+  this->_stopping = false;
+  this->_usersAt = 0;
+}
+
+Notifier::~Notifier()
+{
+  end();
+}
+
+void Notifier::begin(PostgrestClient* client)
+{
+  this->_client = client;
+  this->_stopping = false;
+  if(client) this->_thread = std::thread(&Notifier::run, this);
+}
+
+void Notifier::end()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_stopping = true;
+  }
+  this->_wake.notify_all();
+  if(this->_thread.joinable()) this->_thread.join();
+}
+
+void Notifier::mute(bool muted)
+{
+  if(this->_muted && !muted && this->_silenced)
+    LOG("%llu alerts raised by replayed readings not sent", (unsigned long long)this->_silenced);
+  this->_muted = muted;
+  this->_silenced = 0;
+}
+
+void Notifier::missed(std::string& title, std::string& message, int64_t timestamp)
+{
+  char ts[32];
+  BatchWriter::formatTimestamp(ts, timestamp);
+  title = "Missed while offline: " + title;
+  message += " (read at ";
+  message += ts;
+  message += ", sent by the device after it reconnected)";
+}
+
+void Notifier::describe(const Detection& d, std::string& title, std::string& message, const char** type) const
+{
+  const SensorInfo& info = this->_map.sensor(d.sensor);
+  uint8_t quantity = info.probe == PROBE_NONE ? info.quantity : probeQuantity(info.probe);
+  const char* name = DeviceMap::sensorType(quantity);
+  const char* unit = DeviceMap::unit(quantity);
+  const char* id = info.sensorId.c_str();
+  char buf[320];
+  *type = "error";
+  switch(d.fault){
+    case FAULT_DRIFT:
+      snprintf(buf, sizeof(buf), "%s drifting", name);
+      title = buf;
+      snprintf(buf, sizeof(buf), "Sensor %s reads %.3g %s %s %s (now %.4g %s). Recalibrate the probe.",
+               id, fabsf(d.amount), unit, d.amount > 0 ? "higher than" : "lower than",
+               d.grouped ? "usual against the other sensors of the farm" : "its usual level", d.value, unit);
+      *type = "warning";
+      break;
+    case FAULT_STUCK:
+      snprintf(buf, sizeof(buf), "%s stuck", name);
+      title = buf;
+      snprintf(buf, sizeof(buf), "Sensor %s has read %.4g %s %.0f times in a row. Check the probe and its cable.",
+               id, d.value, unit, d.amount);
+      break;
+    case FAULT_SATURATED:
+      snprintf(buf, sizeof(buf), "%s out of range", name);
+      title = buf;
+      snprintf(buf, sizeof(buf), "Sensor %s reads %.4g %s, at the limit of what it can measure. The probe may be "
+               "dry, unplugged or broken.", id, d.value, unit);
+      break;
+    case FAULT_NOISY:
+      snprintf(buf, sizeof(buf), "%s noisy", name);
+      title = buf;
+      snprintf(buf, sizeof(buf), "Sensor %s jumps by %.3g %s between readings, %.0f times its usual %.3g %s. Check "
+               "the probe, its cable and grounding.", id, d.amount, unit, d.amount/d.reference, d.reference, unit);
+      *type = "warning";
+      break;
+    case FAULT_CALIBRATION: {
+      const Calibration* c = this->_calibrations.current(d.sensor);
+      snprintf(buf, sizeof(buf), "%s calibration out of range", name);
+      title = buf;
+      snprintf(buf, sizeof(buf), "Calibration %u of sensor %s (%s) is outside the range of the buffer solutions. "
+               "Calibrate the probe again.", c->version, id, DeviceMap::formatProbe(c->probe, c->values).c_str());
+      break;
+    }
+    default:
+      title = "Sensor fault";
+      snprintf(buf, sizeof(buf), "Sensor %s", id);
+  }
+  message = buf;
+  if(d.backfill) missed(title, message, d.timestamp);
+}
+
+void Notifier::detected(const Detection& detection)
+{
+  std::string title, message;
+  const char* type;
+  describe(detection, title, message, &type);
+  notify(this->_map.sensor(detection.sensor).farmId, title, message, type);
+}
+
+void Notifier::notify(const std::string& farmId, const std::string& title, const std::string& message,
+                      const char* type)
+{
+  if(this->_muted){
+    this->_silenced++;
+    return;
+  }
+  LOG("%s: %s", title.c_str(), message.c_str());
+  if(this->_client == NULL) return;
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    if(this->_queue.size() >= NOTIFY_QUEUE){
+      if(this->_dropped++ == 0) LOG("notification queue full, dropping alerts");
+      return;
+    }
+    this->_queue.push_back(Alert{farmId, title, message, type});
+  }
+  this->_wake.notify_one();
+}
+
+bool Notifier::refreshUsers()
+{
+  std::string response;
+  int status = this->_client->get("farm_users", "select=farm_id,user_id", response);
+  if(status != 200){
+    LOG("farm_users fetch failed (%d): %s", status, this->_client->lastError().c_str());
+    return false;
+  }
+  std::map<std::string, std::vector<std::string>> users;
+  const char* p = response.c_str();
+  while((p = strchr(p, '{')) != NULL){
+    const char* end = strchr(p, '}');
+    if(end == NULL) break;
+    std::string farm, user;
+    if(field(p, end, "farm_id", farm) && field(p, end, "user_id", user)) users[farm].push_back(user);
+    p = end + 1;
+  }
+  this->_users.swap(users);
+  this->_usersAt = nowMicros();
+  return true;
+}
+
+bool Notifier::insert(const std::vector<Alert>& alerts)
+{
+  std::string body = "[";
+  size_t rows = 0;
+  for(size_t i = 0; i < alerts.size(); i++){
+    const Alert& a = alerts[i];
+    auto it = this->_users.find(a.farmId);
+    if(it == this->_users.end()) continue;                // nobody to tell
+    for(size_t u = 0; u < it->second.size(); u++){
+      body += rows++ ? ",{\"user_id\":" : "{\"user_id\":";
+      appendString(body, it->second[u]);
+      body += ",\"title\":";
+      appendString(body, a.title);
+      body += ",\"message\":";
+      appendString(body, a.message);
+      body += ",\"type\":\"";
+      body += a.type;
+      body += "\"}";
+    }
+  }
+  body += ']';
+  if(rows == 0) return true;
+  int status = this->_client->post("notifications", "", body, "return=minimal");
+  if(status >= 200 && status < 300) return true;
+  LOG("notifications insert failed (%d): %s", status, this->_client->lastError().c_str());
+  return status >= 400 && status < 500 && status != 408 && status != 429;   // refused, retrying would not help
+}
+
+void Notifier::run()
+{
+  std::vector<Alert> batch;
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  while(true){
+    if(this->_queue.empty()){
+      if(this->_stopping) break;
+      this->_wake.wait(lock);
+      continue;
+    }
+    batch.clear();
+    batch.swap(this->_queue);
+    bool stopping = this->_stopping;
+    lock.unlock();
+    bool ok = true;
+    if(this->_usersAt == 0 || nowMicros() - this->_usersAt > (int64_t)NOTIFY_USERS_REFRESH_S*1000000)
+      ok = refreshUsers() || this->_usersAt;             // stale users are better than none
+    if(ok) ok = insert(batch);
+    lock.lock();
+    if(!ok){
+      if(stopping){
+        LOG("stopping with the database unreachable, %zu alerts not sent", batch.size());
+        break;
+      }
+      // keep them in front of newer ones, within the queue's bound
+      size_t keep = NOTIFY_QUEUE > this->_queue.size() ? NOTIFY_QUEUE - this->_queue.size() : 0;
+      if(keep < batch.size()) batch.resize(keep);
+      this->_queue.insert(this->_queue.begin(), batch.begin(), batch.end());
+      this->_wake.wait_for(lock, std::chrono::milliseconds(NOTIFY_RETRY_MS), [this]{ return this->_stopping; });
+    }
+  }
+}
@@ -0,0 +1,107 @@
+/*!
+ * @file Notifier.h
+ * @brief Define the basic structure of class Notifier
+ * @details Turns detections of DriftDetector and alerts of RuleEngine into rows of the app's `notifications`
+ * @n table, one per user of the sensor's farm (`farm_users`, fetched again every NOTIFY_USERS_REFRESH_S). Alerts are
+ * @n queued by the ingest thread without waiting and inserted by the notifier's own thread with its own
+ * @n connection; when the queue is full further alerts are logged and dropped. Without a server alerts are only
+ * @n logged. Alerts found in backfill say so (missed()). While muted (replaying the log after a checkpoint, whose
+ * @n readings raised their alerts before the restart) alerts are only counted.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_NOTIFIER_H_
+#define _GATEWAY_NOTIFIER_H_
+
+#include "CalibrationRegistry.h"
+#include "DeviceMap.h"
+#include "DriftDetector.h"
+#include "PostgrestClient.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define NOTIFY_QUEUE             1024     ///<alerts waiting for the database
+#define NOTIFY_USERS_REFRESH_S   600
+#define NOTIFY_RETRY_MS          5000
+
+class Notifier : public DriftListener
+{
+public:
+  Notifier(const DeviceMap& map, const CalibrationRegistry& calibrations);
+  ~Notifier();
+
+  /*!
+   * @fn begin
+   * @brief Start the insert thread
+   * @param client  Connection used only by the notifier, NULL to only log alerts
+   */
+  void begin(PostgrestClient* client);
+
+  /*!
+   * @fn end
+   * @brief Insert what is queued (one attempt) and stop
+   */
+  void end();
+
+  virtual void detected(const Detection& detection);
+
+  /*!
+   * @fn notify
+   * @brief Queue a notification for every user of a farm
+   * @param type  "normal", "warning" or "error"
+   */
+  void notify(const std::string& farmId, const std::string& title, const std::string& message, const char* type);
+
+  /*!
+   * @fn mute
+   * @brief Count alerts instead of sending them, call while no ingest thread runs
+   */
+  void mute(bool muted);
+
+  /*!
+   * @fn missed
+   * @brief Turn the texts of an alert found in backfill into "missed while offline" ones
+   * @param timestamp  Of the reading that raised it
+   */
+  static void missed(std::string& title, std::string& message, int64_t timestamp);
+
+  /*!
+   * @fn describe
+   * @brief Title, message and notification type ("warning" or "error") of a detection
+   */
+  void describe(const Detection& detection, std::string& title, std::string& message, const char** type) const;
+
+private:
+  struct Alert {
+    std::string farmId;
+    std::string title;
+    std::string message;
+    const char* type;
+  };
+
+  const DeviceMap& _map;
+  const CalibrationRegistry& _calibrations;
+  PostgrestClient* _client;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::vector<Alert> _queue;
+  uint64_t _dropped;
+  bool _muted;
+  uint64_t _silenced;     ///<alerts counted while muted
+  bool _stopping;
+  std::thread _thread;
+  std::map<std::string, std::vector<std::string>> _users;  ///<farm_id -> user_ids, notifier thread only
+  int64_t _usersAt;
+
+private:
+  void run();
+  bool refreshUsers();
+  bool insert(const std::vector<Alert>& alerts);
+};
+
+#endif
@@ -0,0 +1,549 @@
+/*!
+ * @file Pipeline.cpp
+ * @brief Define the basic structure of class Pipeline
+ * @details Multi-threaded ingest: readers, decoders, conversion workers and the sink on their own threads.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Pipeline.h"
+#include "FrameDecoder.h"
+#include "Log.h"
+#include "ProbeMath.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#define SPIN_PAUSES   64     ///<empty polls spent spinning before yielding
+#define SPIN_YIELDS   128    ///<empty polls before sleeping
+#define IDLE_SLEEP_US 100
+
+static const char* stageNames[PIPELINE_STAGES] = { "read", "decode", "convert", "sink" };
+
+static inline void cpuRelax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+  __asm__ __volatile__("yield");
+#endif
+}
+
+/*!
+ * @brief Back off while a ring is empty or full: spin first (low latency under load), then give the core away
+ */
+static void idle(unsigned& spins)
+{
+  spins++;
+  if(spins < SPIN_PAUSES) cpuRelax();
+  else if(spins < SPIN_YIELDS) sched_yield();
+  else usleep(IDLE_SLEEP_US);
+}
+
+void Pipeline::WorkerCounters::add(std::atomic<uint64_t>& counter, uint64_t n)
+{
+  counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+void Pipeline::WorkerCounters::latency(int64_t since)
+{
+  int64_t us = nowMicros() - since;
+  if(us < 0) us = 0;                                     // wall clock stepped back
+  add(this->latencySum, us);
+  add(this->latencySamples, 1);
+  if((uint64_t)us > this->latencyMax.load(std::memory_order_relaxed))
+    this->latencyMax.store(us, std::memory_order_relaxed);
+}
+
+uint8_t* Pipeline::Reader::acquire(size_t* capacity)
+{
+  unsigned spins = 0;
+  while(true){
+    Chunk* c = this->ring->slot();
+    if(c){
+      *capacity = sizeof(c->data);
+      return c->data;
+    }
+    if(!this->owner->_running.load(std::memory_order_relaxed)) return NULL;
+    if(spins == 0) this->counters.add(this->counters.waits, 1);
+    idle(spins);
+  }
+}
+
+void Pipeline::Reader::commit(uint32_t device, size_t length, int64_t timestamp)
+{
+  Chunk* c = this->ring->slot();                         // the slot acquire() returned
+  c->device = device;
+  c->length = length;
+  c->timestamp = timestamp;
+  this->ring->publish();
+  this->counters.add(this->counters.items, 1);        // latency of this stage is 0 by definition
+}
+
+Pipeline::Pipeline(const DeviceMap& map, const CalibrationRegistry& calibrations, ReadingSink& sink,
+                   const PipelineConfig& config)
+  : _map(map), _calibrations(calibrations), _sink(sink)
+{
+  this->_config = config;
+  if(this->_config.readers == 0) this->_config.readers = 1;
+  if(this->_config.converters == 0) this->_config.converters = 1;
+  this->_running = false;
+  this->_wake = -1;
+  this->_nextCpu = 0;
+  for(int i = 0; i < PIPELINE_STAGES; i++){
+    this->_live[i] = 0;
+    this->_lastSum[i] = 0;
+    this->_lastSamples[i] = 0;
+  }
+}
+
+Pipeline::~Pipeline()
+{
+  end();
+  if(this->_wake >= 0) close(this->_wake);
+}
+
+void Pipeline::startThread(Worker& worker, const char* name, uint32_t index)
+{
+  char threadName[16];
+  snprintf(threadName, sizeof(threadName), "gw-%s%u", name, index);
+  pthread_setname_np(worker.thread.native_handle(), threadName);
+  if(!this->_config.pin) return;
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(this->_nextCpu++ % (cpus > 0 ? cpus : 1), &set);
+  int err = pthread_setaffinity_np(worker.thread.native_handle(), sizeof(set), &set);
+  if(err) LOG("%s: can't pin to a core: %s", threadName, strerror(err));
+}
+
+bool Pipeline::begin()
+{
+  this->_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(this->_wake < 0){
+    LOG("eventfd: %s", strerror(errno));
+    return false;
+  }
+  size_t devices = this->_map.devices().size();
+  this->_temperatures.reset(new Temperatures[devices ? devices : 1]);
+  memset(this->_temperatures.get(), 0, (devices ? devices : 1)*sizeof(Temperatures));
+
+  uint32_t readers = this->_config.readers, converters = this->_config.converters;
+  for(uint32_t i = 0; i < converters; i++){
+    this->_convertRings.emplace_back(new MpscRing<Reading>(PIPELINE_READINGS));
+    this->_backfillRings.emplace_back(new MpscRing<Reading>(PIPELINE_READINGS));
+  }
+  this->_sinkRing.reset(new MpscRing<Reading>(PIPELINE_READINGS));
+  this->_sinkBackfill.reset(new MpscRing<Reading>(PIPELINE_READINGS));
+  this->_statsRing.reset(new MpscRing<WindowStats>(PIPELINE_STATS));
+
+  this->_running = true;
+  for(uint32_t i = 0; i < readers; i++){
+    this->_chunkRings.emplace_back(new SpscRing<Chunk>(PIPELINE_CHUNKS));
+    Reader* r = new Reader();
+    this->_workers[STAGE_READ].emplace_back(r);
+    r->owner = this;
+    r->ring = this->_chunkRings[i].get();
+    r->gateway.reset(new SerialGateway(this->_map, *r, this->_config.baud, i, readers));
+    r->gateway->acknowledge(this->_config.acks);
+    if(!r->gateway->begin()){
+      this->_running = false;
+      return false;
+    }
+  }
+
+  // a stage exits once its producers are gone and its input is empty: count them all before any thread starts
+  this->_live[STAGE_READ] = readers;
+  this->_live[STAGE_DECODE] = readers;
+  this->_live[STAGE_CONVERT] = converters;
+  this->_live[STAGE_SINK] = 1;
+  this->_workers[STAGE_SINK].emplace_back(new Worker());
+  this->_workers[STAGE_SINK][0]->thread = std::thread(&Pipeline::sinkLoop, this);
+  startThread(*this->_workers[STAGE_SINK][0], stageNames[STAGE_SINK], 0);
+
+  for(uint32_t i = 0; i < converters; i++){
+    this->_workers[STAGE_CONVERT].emplace_back(new Worker());
+    this->_workers[STAGE_CONVERT][i]->thread = std::thread(&Pipeline::convertLoop, this, i);
+    startThread(*this->_workers[STAGE_CONVERT][i], stageNames[STAGE_CONVERT], i);
+  }
+
+  for(uint32_t i = 0; i < readers; i++){
+    this->_workers[STAGE_DECODE].emplace_back(new Worker());
+    this->_workers[STAGE_DECODE][i]->thread = std::thread(&Pipeline::decodeLoop, this, i);
+    startThread(*this->_workers[STAGE_DECODE][i], stageNames[STAGE_DECODE], i);
+  }
+
+  for(uint32_t i = 0; i < readers; i++){
+    Reader& r = reader(i);
+    r.thread = std::thread([this, &r]{
+      r.gateway->run();
+      this->_live[STAGE_READ].fetch_sub(1, std::memory_order_release);
+    });
+    startThread(r, stageNames[STAGE_READ], i);
+  }
+  LOG("pipeline: %u readers, %u decoders, %u converters, 1 sink%s", readers, readers, converters,
+      this->_config.pin ? ", pinned" : "");
+  if(this->_config.backfillRate) LOG("pipeline: backfill capped at %u readings/s", this->_config.backfillRate);
+  return true;
+}
+
+/*!
+ * @brief Maps the records of one decoder thread to sensors and routes them to the converters' live or backfill
+ * @n lane
+ */
+class DecodeHandler : public FrameHandler
+{
+public:
+  DecodeHandler(const DeviceMap& map, std::vector<std::unique_ptr<MpscRing<Reading>>>& rings,
+                std::vector<std::unique_ptr<MpscRing<Reading>>>& backfill, MpscRing<WindowStats>& stats,
+                std::atomic<uint64_t>& waits, std::atomic<uint64_t>& shed, AckSource* acks)
+    : _map(map), _rings(rings), _backfill(backfill), _stats(stats), _waits(waits), _shed(shed), _acks(acks)
+  {
+    this->device = 0;
+    this->timestamp = 0;
+  }
+
+  virtual void reading(uint8_t channel, uint8_t quantity, float value)
+  {
+    route(channel, quantity, value, this->timestamp, 0, 0);
+  }
+
+  virtual void sequenced(uint8_t epoch, uint32_t sequence, uint32_t age, uint8_t channel, uint8_t quantity,
+                         float value)
+  {
+    // duplicates pass too, Delivery drops them in the sink thread and acknowledges them again
+    route(channel, quantity, value, this->timestamp - (int64_t)age*1000, epoch, sequence);
+  }
+
+  virtual void discarded(uint8_t epoch, uint32_t sequence)
+  {
+    if(this->_acks) this->_acks->discard(this->device, epoch, sequence);
+  }
+
+  virtual void stats(uint8_t channel, uint8_t quantity, uint8_t window, uint32_t count,
+                     float mean, float stddev, float min, float max)
+  {
+    int32_t sensor = this->_map.lookup(this->device, channel, quantity);
+    if(sensor == SENSOR_UNMAPPED) return;
+    WindowStats s;
+    s.sensor = sensor;
+    s.quantity = quantity;
+    s.window = window;
+    s.count = count;
+    s.mean = mean;
+    s.stddev = stddev;
+    s.min = min;
+    s.max = max;
+    s.timestamp = this->timestamp;
+    this->_stats.push(s);                                // summaries are advisory, drop if the sink lags
+  }
+
+  uint32_t device;
+  int64_t timestamp;
+
+private:
+  const DeviceMap& _map;
+  std::vector<std::unique_ptr<MpscRing<Reading>>>& _rings;
+  std::vector<std::unique_ptr<MpscRing<Reading>>>& _backfill;
+  MpscRing<WindowStats>& _stats;
+  std::atomic<uint64_t>& _waits;
+  std::atomic<uint64_t>& _shed;
+  AckSource* _acks;
+
+private:
+  void route(uint8_t channel, uint8_t quantity, float value, int64_t timestamp, uint8_t epoch, uint32_t sequence)
+  {
+    // by device: the converter compensates EC with the temperature of the same device, read before it
+    int32_t sensor = this->_map.lookup(this->device, channel, quantity);
+    if(sensor == SENSOR_UNMAPPED) return;
+    Reading r;
+    r.sensor = sensor;
+    r.quantity = quantity;
+    r.epoch = epoch;
+    r.value = value;
+    r.timestamp = timestamp;
+    r.raw = value;
+    r.temperature = NAN;
+    r.calibration = 0;
+    r.sequence = sequence;
+    if(isBackfill(r, this->timestamp)){
+      // waiting here would hold up the live readings of every device of this decoder; the reading is not
+      // acknowledged, so the device sends it again
+      if(!this->_backfill[this->device % this->_backfill.size()]->push(r))
+        this->_shed.store(this->_shed.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return;
+    }
+    MpscRing<Reading>& ring = *this->_rings[this->device % this->_rings.size()];
+    unsigned spins = 0;
+    while(!ring.push(r)){
+      if(spins == 0) this->_waits.store(this->_waits.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      idle(spins);
+    }
+  }
+};
+
+void Pipeline::decodeLoop(uint32_t index)
+{
+  WorkerCounters& counters = this->_workers[STAGE_DECODE][index]->counters;
+  SpscRing<Chunk>& ring = *this->_chunkRings[index];
+  std::vector<FrameDecoder> decoders(this->_map.devices().size());
+  DecodeHandler handler(this->_map, this->_convertRings, this->_backfillRings, *this->_statsRing, counters.waits,
+                        counters.shed, this->_config.acks);
+  unsigned spins = 0;
+  while(true){
+    bool drained = this->_live[STAGE_READ].load(std::memory_order_acquire) == 0;
+    Chunk* c = ring.front();
+    if(c == NULL){
+      if(drained) break;
+      idle(spins);
+      continue;
+    }
+    spins = 0;
+    if(c->length == 0){
+      decoders[c->device].reset();
+    }else{
+      handler.device = c->device;
+      handler.timestamp = c->timestamp;
+      decoders[c->device].feed(c->data, c->length, handler);
+    }
+    int64_t timestamp = c->timestamp;
+    ring.pop();
+    counters.add(counters.items, 1);
+    counters.latency(timestamp);
+  }
+  this->_live[STAGE_DECODE].fetch_sub(1, std::memory_order_release);
+}
+
+float Pipeline::temperatureAt(uint32_t device, int64_t timestamp) const
+{
+  const Temperatures& t = this->_temperatures[device];
+  float temperature = 25.0f;                             // as DFRobot_EC10 without a temperature probe
+  int64_t best = (int64_t)PIPELINE_TEMPERATURE_GAP_S*1000000;
+  for(int lane = 0; lane < 2; lane++){
+    for(uint8_t i = 0; i < t.count[lane]; i++){
+      int64_t gap = llabs(t.timestamps[lane][i] - timestamp);
+      if(gap <= best){
+        best = gap;
+        temperature = t.values[lane][i];
+      }
+    }
+  }
+  return temperature;
+}
+
+void Pipeline::convert(Reading& r, bool live)
+{
+  const SensorInfo& info = this->_map.sensor(r.sensor);
+  if(r.quantity == QUANTITY_TEMPERATURE){
+    // a lane each: a backlog draining would push the live readings out, and the other way round
+    Temperatures& t = this->_temperatures[info.device];
+    int lane = live ? 0 : 1;
+    t.timestamps[lane][t.next[lane]] = r.timestamp;
+    t.values[lane][t.next[lane]] = r.value;
+    t.next[lane] = (t.next[lane] + 1) % PIPELINE_TEMPERATURES;
+    if(t.count[lane] < PIPELINE_TEMPERATURES) t.count[lane]++;
+    return;
+  }
+  if(info.probe == PROBE_NONE) return;
+  const Calibration* c = this->_calibrations.current(r.sensor);
+  r.calibration = c->version;                            // r.raw keeps the voltage for reprocessing
+  if(c->probe == PROBE_PH){
+    r.value = phFromVoltage(r.raw, c->values[0], c->values[1]);
+    r.quantity = QUANTITY_PH;
+  }else if(c->probe == PROBE_EC10){
+    r.temperature = temperatureAt(info.device, r.timestamp);
+    r.value = ecFromVoltage(r.raw, r.temperature, c->values[0]);
+    r.quantity = QUANTITY_EC;
+  }
+}
+
+void Pipeline::convertLoop(uint32_t index)
+{
+  WorkerCounters& counters = this->_workers[STAGE_CONVERT][index]->counters;
+  MpscRing<Reading>& ring = *this->_convertRings[index];
+  MpscRing<Reading>& backfill = *this->_backfillRings[index];
+  unsigned spins = 0;
+  Reading r, held;
+  bool holding = false;                                  // a backfill reading the sink's lane had no room for
+  while(true){
+    bool drained = this->_live[STAGE_DECODE].load(std::memory_order_acquire) == 0;
+    uint64_t n = 0;
+    int64_t oldest = 0;
+    for(; n < PIPELINE_SINK_BATCH && ring.pop(r); n++){
+      convert(r, true);
+      if(n == 0) oldest = r.timestamp;
+      while(!this->_sinkRing->push(r)){
+        if(spins == 0) counters.add(counters.waits, 1);
+        idle(spins);
+      }
+      spins = 0;
+    }
+    // a share of the round while live readings come, the whole round while they don't
+    uint64_t quota = n ? n/PIPELINE_LIVE_WEIGHT + 1 : PIPELINE_SINK_BATCH;
+    uint64_t b = 0;
+    while(b < quota){
+      if(!holding){
+        if(!backfill.pop(held)) break;
+        convert(held, false);
+        holding = true;
+      }
+      if(!this->_sinkBackfill->push(held)) break;        // never wait for backfill, live readings may come
+      holding = false;
+      b++;
+    }
+    if(n){
+      counters.add(counters.items, n);
+      counters.latency(oldest);
+    }
+    if(b){
+      counters.add(counters.items, b);
+      counters.add(counters.backfill, b);
+    }
+    if(n || b){
+      spins = 0;
+      continue;
+    }
+    if(drained && !holding) break;
+    idle(spins);
+  }
+  this->_live[STAGE_CONVERT].fetch_sub(1, std::memory_order_release);
+}
+
+void Pipeline::sinkLoop()
+{
+  WorkerCounters& counters = this->_workers[STAGE_SINK][0]->counters;
+  std::vector<Reading> batch(PIPELINE_SINK_BATCH);
+  std::vector<Reading> backfill(PIPELINE_SINK_BATCH);
+  std::vector<WindowStats> stats;
+  uint32_t rate = this->_config.backfillRate;
+  double burst = rate < PIPELINE_SINK_BATCH ? rate : PIPELINE_SINK_BATCH;
+  double tokens = 0;
+  int64_t refilled = nowMicros();
+  unsigned spins = 0;
+  while(true){
+    bool drained = this->_live[STAGE_CONVERT].load(std::memory_order_acquire) == 0;
+    size_t n = 0;
+    while(n < batch.size() && this->_sinkRing->pop(batch[n])) n++;
+    WindowStats s;
+    while(this->_statsRing->pop(s)) stats.push_back(s);
+    if(!stats.empty()){
+      this->_sink.pushStats(stats.data(), stats.size());
+      stats.clear();
+    }
+    size_t quota = n ? n/PIPELINE_LIVE_WEIGHT + 1 : backfill.size();
+    if(rate && !drained){                                // stopping drains the backfill lane at full speed
+      int64_t now = nowMicros();
+      tokens += (now - refilled)*(double)rate/1000000;
+      refilled = now;
+      if(tokens > burst) tokens = burst;
+      if(quota > tokens) quota = (size_t)tokens;
+    }
+    size_t b = 0;
+    while(b < quota && this->_sinkBackfill->pop(backfill[b])) b++;
+    tokens -= b;
+    if(n){
+      this->_sink.push(batch.data(), n);
+      counters.add(counters.items, n);
+      counters.latency(batch[0].timestamp);
+    }
+    if(b){
+      this->_sink.push(backfill.data(), b);              // after the live batch of the round
+      counters.add(counters.items, b);
+      counters.add(counters.backfill, b);
+    }
+    if(n || b){
+      spins = 0;
+      continue;
+    }
+    if(drained) break;
+    idle(spins);
+  }
+  this->_live[STAGE_SINK].fetch_sub(1, std::memory_order_release);
+}
+
+void Pipeline::stop()
+{
+  uint64_t one = 1;
+  if(write(this->_wake, &one, sizeof(one)) < 0) {}       // async-signal-safe
+}
+
+void Pipeline::run(int statsIntervalMs)
+{
+  struct pollfd p;
+  p.fd = this->_wake;
+  p.events = POLLIN;
+  while(true){
+    int n = ::poll(&p, 1, statsIntervalMs > 0 ? statsIntervalMs : -1);
+    if(n > 0) break;
+    if(n == 0) logStats();
+  }
+}
+
+void Pipeline::end()
+{
+  if(!this->_running) return;
+  this->_running = false;
+  for(size_t i = 0; i < this->_workers[STAGE_READ].size(); i++) reader(i).gateway->stop();
+  for(int stage = 0; stage < PIPELINE_STAGES; stage++)      // upstream first, every stage drains its input
+    for(size_t i = 0; i < this->_workers[stage].size(); i++)
+      if(this->_workers[stage][i]->thread.joinable()) this->_workers[stage][i]->thread.join();
+}
+
+void Pipeline::stats(StageStats* stages)
+{
+  for(int stage = 0; stage < PIPELINE_STAGES; stage++){
+    StageStats& s = stages[stage];
+    memset(&s, 0, sizeof(s));
+    s.name = stageNames[stage];
+    s.threads = this->_workers[stage].size();
+    uint64_t sum = 0, samples = 0;
+    for(size_t i = 0; i < this->_workers[stage].size(); i++){
+      WorkerCounters& c = this->_workers[stage][i]->counters;
+      s.items += c.items.load(std::memory_order_relaxed);
+      s.waits += c.waits.load(std::memory_order_relaxed);
+      s.backfill += c.backfill.load(std::memory_order_relaxed);
+      s.shed += c.shed.load(std::memory_order_relaxed);
+      sum += c.latencySum.load(std::memory_order_relaxed);
+      samples += c.latencySamples.load(std::memory_order_relaxed);
+      uint64_t max = c.latencyMax.exchange(0, std::memory_order_relaxed);
+      if(max > s.latencyMaxUs) s.latencyMaxUs = max;
+    }
+    if(samples > this->_lastSamples[stage])
+      s.latencyUs = (sum - this->_lastSum[stage])/(samples - this->_lastSamples[stage]);
+    this->_lastSum[stage] = sum;
+    this->_lastSamples[stage] = samples;
+  }
+  for(size_t i = 0; i < this->_chunkRings.size(); i++){
+    stages[STAGE_DECODE].depth += this->_chunkRings[i]->size();
+    stages[STAGE_DECODE].capacity += this->_chunkRings[i]->capacity();
+  }
+  for(size_t i = 0; i < this->_convertRings.size(); i++){
+    stages[STAGE_CONVERT].backfillDepth += this->_backfillRings[i]->size();
+    stages[STAGE_CONVERT].depth += this->_convertRings[i]->size() + this->_backfillRings[i]->size();
+    stages[STAGE_CONVERT].capacity += this->_convertRings[i]->capacity() + this->_backfillRings[i]->capacity();
+  }
+  if(this->_sinkRing){
+    stages[STAGE_SINK].backfillDepth = this->_sinkBackfill->size();
+    stages[STAGE_SINK].depth = this->_sinkRing->size() + this->_sinkBackfill->size();
+    stages[STAGE_SINK].capacity = this->_sinkRing->capacity() + this->_sinkBackfill->capacity();
+  }
+}
+
+void Pipeline::logStats()
+{
+  StageStats s[PIPELINE_STAGES];
+  stats(s);
+  for(int i = 0; i < PIPELINE_STAGES; i++){
+    LOG("%-7s x%u  %llu out, queue %zu/%zu, latency avg %llu us max %llu us, %llu waits", s[i].name, s[i].threads,
+        (unsigned long long)s[i].items, s[i].depth, s[i].capacity, (unsigned long long)s[i].latencyUs,
+        (unsigned long long)s[i].latencyMaxUs, (unsigned long long)s[i].waits);
+    if(s[i].backfill || s[i].backfillDepth || s[i].shed)
+      LOG("%-7s     backfill: %llu out, queue %zu, %llu shed", s[i].name, (unsigned long long)s[i].backfill,
+          s[i].backfillDepth, (unsigned long long)s[i].shed);
+  }
+}
@@ -0,0 +1,207 @@
+/*!
+ * @file Pipeline.h
+ * @brief Define the basic structure of class Pipeline
+ * @details Multi-threaded ingest: serial readers, frame decoders, conversion workers and the sink each run on
+ * @n their own threads, connected by lock-free rings, so decoding and probe math scale with the cores.
+ * @n   reader i  --SpscRing<Chunk>-->  decoder i  --MpscRing<Reading>-->  converter (device % C)
+ * @n   converters  --MpscRing<Reading>-->  sink thread  -->  ReadingSink (BatchWriter / stdout)
+ * @n Reader i owns the devices with index % readers == i and has its own epoll loop (SerialGateway in raw
+ * @n mode); its decoder owns the same devices, so bytes of a device are decoded in order on one thread.
+ * @n Readings of a device always go to the same converter, so they reach the sink in order too, and its EC
+ * @n readings are compensated with its temperature readings in the order they were read.
+ * @n A full ring makes the producer wait, the backpressure of the sink reaches the serial ports' buffers.
+ * @n Backfill (isBackfill(): sequenced readings a device resends long after taking them, e.g. draining what it
+ * @n kept while disconnected) has its own rings next to the live ones at every stage, so a reconnecting device
+ * @n never makes live readings wait behind its backlog:
+ * @n   - converters and the sink take up to PIPELINE_LIVE_WEIGHT live readings per backfill reading while
+ * @n     both lanes are busy, and all of either while the other is idle
+ * @n   - the sink passes at most backfillRate backfill readings per second on (token bucket), the rest waits
+ * @n   - a full backfill lane never makes anyone wait: the decoder drops the reading instead, it is not
+ * @n     acknowledged, so the device sends it again later
+ * @n Readings of a sensor stay in order within their lane. EC is compensated with the device's temperature
+ * @n reading nearest to its own time, live or backfill, so a backlog isn't converted with today's water.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_PIPELINE_H_
+#define _GATEWAY_PIPELINE_H_
+
+#include "CalibrationRegistry.h"
+#include "DeviceMap.h"
+#include "MpscRing.h"
+#include "Reading.h"
+#include "SerialGateway.h"
+#include "SpscRing.h"
+
+#include <atomic>
+#include <memory>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#define PIPELINE_CHUNKS       256        ///<raw chunks between a reader and its decoder
+#define PIPELINE_READINGS     (1 << 16)  ///<readings queued in front of each converter and the sink
+#define PIPELINE_SINK_BATCH   4096       ///<readings per ReadingSink::push()
+#define PIPELINE_STATS        1024       ///<window summaries queued in front of the sink
+#define PIPELINE_LIVE_WEIGHT  8          ///<live readings taken per backfill reading while both lanes are busy
+#define PIPELINE_BACKFILL_RATE 20000     ///<default backfill readings per second passed to the sink
+#define PIPELINE_TEMPERATURES 16         ///<temperature readings kept per device and lane for EC compensation
+#define PIPELINE_TEMPERATURE_GAP_S 3600  ///<EC read farther from every kept temperature is compensated at 25 ^C
+
+#define STAGE_READ     0
+#define STAGE_DECODE   1
+#define STAGE_CONVERT  2
+#define STAGE_SINK     3
+#define PIPELINE_STAGES 4
+
+/*!
+ * @brief Bytes of one read() of one device
+ */
+struct Chunk {
+  uint32_t device;
+  uint32_t length;        ///<0: the device was reopened
+  int64_t  timestamp;     ///<receive time (us)
+  uint8_t  data[GATEWAY_READ_SIZE];
+};
+
+struct PipelineConfig {
+  uint32_t readers;       ///<reader/decoder thread pairs
+  uint32_t converters;    ///<conversion worker threads
+  bool     pin;           ///<pin every thread to its own core (wrapping around)
+  int      baud;
+  AckSource* acks;        ///<acknowledgements the readers send back to the devices, NULL: none
+  uint32_t backfillRate;  ///<backfill readings per second passed to the sink, 0: no cap
+};
+
+/*!
+ * @brief Snapshot of one stage, summed over its threads
+ */
+struct StageStats {
+  const char* name;
+  uint32_t threads;
+  uint64_t items;         ///<chunks (read, decode) or readings (convert, sink) that left the stage
+  uint64_t waits;         ///<times the stage found its output ring full
+  uint64_t backfill;      ///<backfill readings that left the stage (convert, sink)
+  uint64_t shed;          ///<backfill readings dropped on a full backfill lane (decode)
+  size_t   depth;         ///<items queued in front of the stage, both lanes
+  size_t   backfillDepth; ///<backfill readings queued in front of the stage
+  size_t   capacity;
+  uint64_t latencyUs;     ///<mean receive-to-exit latency of live readings since the previous stats() call
+  uint64_t latencyMaxUs;  ///<max since the previous stats() call
+};
+
+class Pipeline
+{
+public:
+  /*!
+   * @fn Pipeline
+   * @brief Constructor
+   * @param map  Devices and sensors, must outlive the pipeline
+   * @param calibrations  Probe calibrations the converters use, must outlive the pipeline
+   * @param sink  Called from the sink thread only
+   */
+  Pipeline(const DeviceMap& map, const CalibrationRegistry& calibrations, ReadingSink& sink,
+           const PipelineConfig& config);
+  ~Pipeline();
+
+  /*!
+   * @fn begin
+   * @brief Open the devices and start all threads
+   */
+  bool begin();
+
+  /*!
+   * @fn run
+   * @brief Block until stop(), logging the stage stats every statsIntervalMs (0: never)
+   */
+  void run(int statsIntervalMs);
+
+  /*!
+   * @fn stop
+   * @brief Make run() return, safe to call from a signal handler
+   */
+  void stop();
+
+  /*!
+   * @fn end
+   * @brief Stop the readers, let the other stages drain their rings and join all threads
+   */
+  void end();
+
+  /*!
+   * @fn stats
+   * @brief Fill PIPELINE_STAGES entries, call from one thread only (keeps the latency baseline)
+   */
+  void stats(StageStats* stages);
+
+private:
+  struct alignas(CACHE_LINE) WorkerCounters {
+    std::atomic<uint64_t> items{0};
+    std::atomic<uint64_t> waits{0};
+    std::atomic<uint64_t> backfill{0};
+    std::atomic<uint64_t> shed{0};
+    std::atomic<uint64_t> latencySum{0};
+    std::atomic<uint64_t> latencySamples{0};
+    std::atomic<uint64_t> latencyMax{0};
+
+    void add(std::atomic<uint64_t>& counter, uint64_t n);   ///<single writer, no locked instruction
+    void latency(int64_t since);
+  };
+
+  /*!
+   * @brief The last temperature readings of a device per lane, rings in arrival order
+   */
+  struct Temperatures {
+    int64_t timestamps[2][PIPELINE_TEMPERATURES];
+    float values[2][PIPELINE_TEMPERATURES];
+    uint8_t count[2];
+    uint8_t next[2];
+  };
+
+  struct Worker {
+    std::thread thread;
+    WorkerCounters counters;
+    virtual ~Worker() {}
+  };
+
+  struct Reader : public Worker, public ChunkSink {
+    Pipeline* owner;
+    SpscRing<Chunk>* ring;
+    std::unique_ptr<SerialGateway> gateway;
+
+    virtual uint8_t* acquire(size_t* capacity);
+    virtual void commit(uint32_t device, size_t length, int64_t timestamp);
+  };
+
+private:
+  const DeviceMap& _map;
+  const CalibrationRegistry& _calibrations;
+  ReadingSink& _sink;
+  PipelineConfig _config;
+  std::atomic<bool> _running;
+  std::atomic<uint32_t> _live[PIPELINE_STAGES];            ///<threads still running per stage
+  int _wake;                                               ///<eventfd written by stop()
+  uint32_t _nextCpu;
+  std::vector<std::unique_ptr<SpscRing<Chunk>>> _chunkRings;
+  std::vector<std::unique_ptr<MpscRing<Reading>>> _convertRings;
+  std::vector<std::unique_ptr<MpscRing<Reading>>> _backfillRings;  ///<backfill lane of each converter
+  std::unique_ptr<MpscRing<Reading>> _sinkRing;
+  std::unique_ptr<MpscRing<Reading>> _sinkBackfill;
+  std::unique_ptr<MpscRing<WindowStats>> _statsRing;
+  std::vector<std::unique_ptr<Worker>> _workers[PIPELINE_STAGES];  ///<STAGE_READ holds Readers
+  std::unique_ptr<Temperatures[]> _temperatures;           ///<per device, only the device's converter touches it
+  uint64_t _lastSum[PIPELINE_STAGES];
+  uint64_t _lastSamples[PIPELINE_STAGES];
+
+private:
+  void startThread(Worker& worker, const char* name, uint32_t index);
+  Reader& reader(uint32_t index) { return *static_cast<Reader*>(this->_workers[STAGE_READ][index].get()); }
+  void decodeLoop(uint32_t index);
+  void convertLoop(uint32_t index);
+  void convert(Reading& r, bool live);
+  float temperatureAt(uint32_t device, int64_t timestamp) const;
+  void sinkLoop();
+  void logStats();
+};
+
+#endif
@@ -0,0 +1,230 @@
+/*!
+ * @file PostgrestClient.cpp
+ * @brief Define the basic structure of class PostgrestClient
+ * @details Minimal HTTP/1.1 client for PostgREST over a keep-alive TCP connection.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "PostgrestClient.h"
+#include "Log.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+PostgrestClient::PostgrestClient()
+{
+  this->_fd = -1;
+}
+
+PostgrestClient::~PostgrestClient()
+{
+  disconnect();
+}
+
+bool PostgrestClient::begin(const std::string& url, const std::string& apiKey)
+{
+  if(url.compare(0, 7, "http://") != 0){
+    LOG("only http:// URLs are supported: %s", url.c_str());
+    return false;
+  }
+  std::string rest = url.substr(7);
+  size_t slash = rest.find('/');
+  std::string hostPort = rest.substr(0, slash);
+  this->_basePath = (slash == std::string::npos) ? "" : rest.substr(slash);
+  while(!this->_basePath.empty() && this->_basePath.back() == '/') this->_basePath.pop_back();
+  size_t colon = hostPort.rfind(':');
+  this->_host = hostPort.substr(0, colon);
+  this->_port = (colon == std::string::npos) ? "80" : hostPort.substr(colon + 1);
+  this->_apiKey = apiKey;
+  return !this->_host.empty();
+}
+
+bool PostgrestClient::connectServer()
+{
+  struct addrinfo hints, *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  int rc = getaddrinfo(this->_host.c_str(), this->_port.c_str(), &hints, &res);
+  if(rc != 0){
+    this->_error = gai_strerror(rc);
+    return false;
+  }
+  for(struct addrinfo* ai = res; ai; ai = ai->ai_next){
+    int fd = socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC, ai->ai_protocol);
+    if(fd < 0) continue;
+    if(connect(fd, ai->ai_addr, ai->ai_addrlen) == 0){
+      int one = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+      struct timeval tv = {HTTP_TIMEOUT_MS/1000, (HTTP_TIMEOUT_MS%1000)*1000};
+      setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+      setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+      this->_fd = fd;
+      break;
+    }
+    this->_error = strerror(errno);
+    close(fd);
+  }
+  freeaddrinfo(res);
+  return this->_fd >= 0;
+}
+
+void PostgrestClient::disconnect()
+{
+  if(this->_fd >= 0) close(this->_fd);
+  this->_fd = -1;
+}
+
+bool PostgrestClient::sendAll(const char* data, size_t length)
+{
+  while(length){
+    ssize_t n = send(this->_fd, data, length, MSG_NOSIGNAL);
+    if(n <= 0){
+      if(n < 0 && errno == EINTR) continue;
+      this->_error = n < 0 ? strerror(errno) : "connection closed";
+      return false;
+    }
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+bool PostgrestClient::readResponse(int* status, std::string* body)
+{
+  std::string& buf = this->_response;
+  buf.clear();
+  size_t headerEnd = std::string::npos;
+  char chunk[8192];
+  while(headerEnd == std::string::npos){
+    ssize_t n = recv(this->_fd, chunk, sizeof(chunk), 0);
+    if(n <= 0){
+      this->_error = n < 0 ? strerror(errno) : "connection closed";
+      return false;
+    }
+    buf.append(chunk, n);
+    headerEnd = buf.find("\r\n\r\n");
+  }
+  if(sscanf(buf.c_str(), "HTTP/1.%*d %d", status) != 1){
+    this->_error = "malformed status line";
+    return false;
+  }
+  // only Content-Length and chunked bodies, which is all PostgREST sends
+  long contentLength = -1;
+  bool chunked = false;
+  bool closeAfter = false;
+  size_t lineStart = buf.find("\r\n") + 2;
+  while(lineStart < headerEnd){
+    size_t lineEnd = buf.find("\r\n", lineStart);
+    const char* line = buf.c_str() + lineStart;
+    if(strncasecmp(line, "Content-Length:", 15) == 0) contentLength = atol(line + 15);
+    else if(strncasecmp(line, "Transfer-Encoding:", 18) == 0 && strcasestr(line, "chunked")) chunked = true;
+    else if(strncasecmp(line, "Connection:", 11) == 0 && strcasestr(line, "close")) closeAfter = true;
+    lineStart = lineEnd + 2;
+  }
+  std::string data = buf.substr(headerEnd + 4);
+  if(chunked){
+    std::string out;
+    size_t pos = 0;
+    while(true){
+      size_t crlf;
+      while((crlf = data.find("\r\n", pos)) == std::string::npos){
+        ssize_t n = recv(this->_fd, chunk, sizeof(chunk), 0);
+        if(n <= 0) return false;
+        data.append(chunk, n);
+      }
+      size_t size = strtoul(data.c_str() + pos, NULL, 16);
+      while(data.size() < crlf + 2 + size + 2){
+        ssize_t n = recv(this->_fd, chunk, sizeof(chunk), 0);
+        if(n <= 0) return false;
+        data.append(chunk, n);
+      }
+      if(size == 0) break;
+      out.append(data, crlf + 2, size);
+      pos = crlf + 2 + size + 2;
+    }
+    data.swap(out);
+  }else if(contentLength >= 0){
+    while((long)data.size() < contentLength){
+      ssize_t n = recv(this->_fd, chunk, sizeof(chunk), 0);
+      if(n <= 0) return false;
+      data.append(chunk, n);
+    }
+    data.resize(contentLength);
+  }
+  if(body) body->swap(data);
+  if(closeAfter) disconnect();
+  return true;
+}
+
+int PostgrestClient::request(const char* method, const std::string& target, const std::string* body,
+                             const char* prefer, std::string* response)
+{
+  std::string head;
+  head.reserve(512);
+  head += method;
+  head += ' ';
+  head += target;
+  head += " HTTP/1.1\r\nHost: ";
+  head += this->_host;
+  head += "\r\nAccept: application/json\r\n";
+  if(!this->_apiKey.empty()){
+    head += "apikey: " + this->_apiKey + "\r\n";
+    head += "Authorization: Bearer " + this->_apiKey + "\r\n";
+  }
+  if(prefer && *prefer){
+    head += "Prefer: ";
+    head += prefer;
+    head += "\r\n";
+  }
+  if(body){
+    head += "Content-Type: application/json\r\nContent-Length: ";
+    head += std::to_string(body->size());
+    head += "\r\n";
+  }
+  head += "\r\n";
+
+  for(int attempt = 0; attempt < 2; attempt++){          // a kept-alive connection may have been closed by the server
+    if(this->_fd < 0 && !connectServer()) return -1;
+    int status;
+    if(sendAll(head.data(), head.size()) && (!body || sendAll(body->data(), body->size())) &&
+       readResponse(&status, response))
+      return status;
+    disconnect();
+  }
+  return -1;
+}
+
+int PostgrestClient::post(const char* table, const char* query, const std::string& body, const char* prefer)
+{
+  std::string target = this->_basePath + "/" + table;
+  if(query && *query){
+    target += '?';
+    target += query;
+  }
+  std::string response;
+  int status = request("POST", target, &body, prefer, &response);
+  if(status >= 300) this->_error = response.substr(0, 300);
+  return status;
+}
+
+int PostgrestClient::get(const char* table, const char* query, std::string& response)
+{
+  std::string target = this->_basePath + "/" + table;
+  if(query && *query){
+    target += '?';
+    target += query;
+  }
+  int status = request("GET", target, NULL, NULL, &response);
+  if(status >= 300) this->_error = response.substr(0, 300);
+  return status;
+}
@@ -0,0 +1,70 @@
+/*!
+ * @file PostgrestClient.h
+ * @brief Define the basic structure of class PostgrestClient
+ * @details Minimal HTTP/1.1 client for PostgREST, the REST layer of Supabase, over a keep-alive TCP connection.
+ * @n Plain HTTP only: point it at a local PostgREST / `supabase start` instance, or at a local TLS
+ * @n terminating proxy in front of a hosted Supabase project.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_POSTGRESTCLIENT_H_
+#define _GATEWAY_POSTGRESTCLIENT_H_
+
+#include <string>
+
+#define HTTP_TIMEOUT_MS  10000
+
+class PostgrestClient
+{
+public:
+  PostgrestClient();
+  ~PostgrestClient();
+
+  /*!
+   * @fn begin
+   * @brief Set the server
+   * @param url  Base URL, e.g. http://localhost:3000 (PostgREST) or http://localhost:54321/rest/v1 (Supabase)
+   * @param apiKey  Sent as apikey and bearer token, a service role key for inserts; may be empty
+   * @return false if the URL can't be parsed
+   */
+  bool begin(const std::string& url, const std::string& apiKey);
+
+  /*!
+   * @fn post
+   * @brief POST a JSON body to a table
+   * @param table  Table name, e.g. "sensor_data"
+   * @param query  Query string without '?', e.g. "on_conflict=sensor_id,created_at", may be empty
+   * @param body  JSON body
+   * @param prefer  Prefer header, e.g. "return=minimal", may be empty
+   * @return HTTP status, or -1 if the server could not be reached
+   */
+  int post(const char* table, const char* query, const std::string& body, const char* prefer);
+
+  /*!
+   * @fn get
+   * @brief GET a table with a PostgREST query, the response body is stored in response
+   * @return HTTP status, or -1 if the server could not be reached
+   */
+  int get(const char* table, const char* query, std::string& response);
+
+  const std::string& lastError() const { return this->_error; }
+
+private:
+  std::string _host;
+  std::string _port;
+  std::string _basePath;
+  std::string _apiKey;
+  std::string _error;
+  std::string _response;
+  int _fd;
+
+private:
+  bool connectServer();
+  void disconnect();
+  int  request(const char* method, const std::string& target, const std::string* body,
+              const char* prefer, std::string* response);
+  bool sendAll(const char* data, size_t length);
+  bool readResponse(int* status, std::string* body);
+};
+
+#endif
@@ -0,0 +1,83 @@
+/*!
+ * @file ProbeMath.h
+ * @brief Probe conversion math of DFRobot_PH and DFRobot_EC10, ported for the gateway
+ * @details Boards that only send raw probe voltages (DFRobot_AnalogMux, DFRobot_ADS1115 sketches) are converted
+ * @n here with the same formulas and defaults as DFRobot_PH::readPH() and DFRobot_EC10::readEC(), using the
+ * @n calibration values from the device map (or CalibrationRegistry) instead of the board's EEPROM.
+ * @n The batch forms convert whole stored columns for reprocessing; they are plain loops over arrays that the
+ * @n compiler vectorizes, and give the same floats as the single reading forms.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_PROBEMATH_H_
+#define _GATEWAY_PROBEMATH_H_
+
+#include "Reading.h"
+
+#define PROBE_NONE   0   ///<value is stored as received
+#define PROBE_PH     1   ///<voltage (mV) of a DFRobot pH probe
+#define PROBE_EC10   2   ///<voltage (mV) of a DFRobot EC (K=10) probe
+
+#define PH_NEUTRAL_MV   1500.0f     ///<DFRobot_PH default, buffer solution 7.0 at 25C
+#define PH_ACID_MV      2032.44f    ///<DFRobot_PH default, buffer solution 4.0 at 25C
+#define EC10_KVALUE     1.0f        ///<DFRobot_EC10 default
+#define EC10_RES2       (7500.0f/0.66f)
+#define EC10_ECREF      20.0f
+#define EC_TEMP_COEF    0.0185f     ///<per ^C, linear compensation to 25 ^C
+
+/*!
+ * @fn phFromVoltage
+ * @brief Two point line through (neutralMv, 7.0) and (acidMv, 4.0), as DFRobot_PH::readPH()
+ */
+inline float phFromVoltage(float mv, float neutralMv, float acidMv)
+{
+  float slope = (7.0f - 4.0f)/((neutralMv - 1500.0f)/3.0f - (acidMv - 1500.0f)/3.0f);
+  float intercept = 7.0f - slope*(neutralMv - 1500.0f)/3.0f;
+  return slope*(mv - 1500.0f)/3.0f + intercept;
+}
+
+/*!
+ * @fn ecFromVoltage
+ * @brief EC in ms/cm compensated to 25 ^C, as DFRobot_EC10::readEC()
+ */
+inline float ecFromVoltage(float mv, float temperature, float kvalue)
+{
+  float raw = 1000.0f*mv/EC10_RES2/EC10_ECREF*kvalue*10.0f;
+  return raw/(1.0f + EC_TEMP_COEF*(temperature - 25.0f));
+}
+
+/*!
+ * @fn phFromVoltages
+ * @brief phFromVoltage() of count voltages
+ */
+inline void phFromVoltages(const float* mv, size_t count, float neutralMv, float acidMv, float* ph)
+{
+  float slope = (7.0f - 4.0f)/((neutralMv - 1500.0f)/3.0f - (acidMv - 1500.0f)/3.0f);
+  float intercept = 7.0f - slope*(neutralMv - 1500.0f)/3.0f;
+  for(size_t i = 0; i < count; i++) ph[i] = slope*(mv[i] - 1500.0f)/3.0f + intercept;
+}
+
+/*!
+ * @fn ecFromVoltages
+ * @brief ecFromVoltage() of count voltages with the temperature of each
+ */
+inline void ecFromVoltages(const float* mv, const float* temperature, size_t count, float kvalue, float* ec)
+{
+  for(size_t i = 0; i < count; i++)
+    ec[i] = (1000.0f*mv[i]/EC10_RES2/EC10_ECREF*kvalue*10.0f)/(1.0f + EC_TEMP_COEF*(temperature[i] - 25.0f));
+}
+
+/*!
+ * @fn probeQuantity
+ * @brief Quantity a probe's voltage is converted to
+ */
+inline uint8_t probeQuantity(uint8_t probe)
+{
+  switch(probe){
+    case PROBE_PH:   return QUANTITY_PH;
+    case PROBE_EC10: return QUANTITY_EC;
+  }
+  return QUANTITY_VOLTAGE;
+}
+
+#endif
@@ -0,0 +1,622 @@
+/*!
+ * @file QueryApi.cpp
+ * @brief Define the basic structure of class QueryApi
+ * @details Read-only JSON API over the local store and rollups.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "QueryApi.h"
+#include "BatchWriter.h"
+#include "Downsample.h"
+#include "Json.h"
+#include "ProbeMath.h"
+
+#include <algorithm>
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <vector>
+
+static const char* tierNames[ROLLUP_TIERS] = { "1m", "1h", "1d" };
+
+static void fail(HttpResponse& response, int status, const char* message)
+{
+  response.status = status;
+  response.body = "{\"error\":";
+  appendString(response.body, message);
+  response.body += '}';
+}
+
+static int digits(const char*& p, int n)
+{
+  int v = 0;
+  for(int i = 0; i < n; i++, p++){
+    if(!isdigit((unsigned char)*p)) return -1;
+    v = v*10 + (*p - '0');
+  }
+  return v;
+}
+
+bool QueryApi::parseTime(const char* text, int64_t* micros)
+{
+  const char* p = text;
+  if(*p == '-') p++;
+  while(isdigit((unsigned char)*p)) p++;
+  if(*p == '\0' && p != text){
+    *micros = strtoll(text, NULL, 10)*1000;
+    return true;
+  }
+  // YYYY-MM-DD[(T| )HH:MM[:SS[.frac]]][Z|+HH[:]MM|-HH[:]MM]
+  p = text;
+  struct tm tm;
+  memset(&tm, 0, sizeof(tm));
+  int64_t fraction = 0;
+  tm.tm_year = digits(p, 4) - 1900;
+  if(*p++ != '-' || (tm.tm_mon = digits(p, 2) - 1) < 0 || *p++ != '-' || (tm.tm_mday = digits(p, 2)) < 1) return false;
+  if(*p == 'T' || *p == ' '){
+    p++;
+    if((tm.tm_hour = digits(p, 2)) < 0 || *p++ != ':' || (tm.tm_min = digits(p, 2)) < 0) return false;
+    if(*p == ':'){
+      p++;
+      if((tm.tm_sec = digits(p, 2)) < 0) return false;
+      if(*p == '.'){
+        int64_t scale = 100000;
+        for(p++; isdigit((unsigned char)*p); p++, scale /= 10) fraction += (*p - '0')*scale;
+      }
+    }
+  }
+  int offset = 0;
+  if(*p == 'Z'){
+    p++;
+  }else if(*p == '+' || *p == '-'){
+    int sign = *p++ == '-' ? -1 : 1;
+    int h = digits(p, 2);
+    if(*p == ':') p++;
+    int m = digits(p, 2);
+    if(h < 0 || m < 0) return false;
+    offset = sign*(h*3600 + m*60);
+  }
+  if(*p != '\0' || tm.tm_year < 0 || tm.tm_mon > 11) return false;
+  *micros = ((int64_t)timegm(&tm) - offset)*1000000 + fraction;
+  return true;
+}
+
+/*!
+ * @brief Parse the from / to parameters of a request, answering 400 if they are malformed
+ */
+static bool timeWindow(const HttpRequest& request, HttpResponse& response, int64_t* from, int64_t* to)
+{
+  *to = nowMicros();
+  if(request.param("to") && !QueryApi::parseTime(request.param("to"), to)){
+    fail(response, 400, "bad to");
+    return false;
+  }
+  *from = *to - 86400LL*1000000;
+  if(request.param("from") && !QueryApi::parseTime(request.param("from"), from)){
+    fail(response, 400, "bad from");
+    return false;
+  }
+  if(*from >= *to){
+    fail(response, 400, "from must be before to");
+    return false;
+  }
+  return true;
+}
+
+QueryApi::QueryApi(const DeviceMap& map, const ColumnStore& store, const Rollups& rollups, Aggregator& aggregator,
+                   CalibrationRegistry& calibrations, Reprocessor& reprocessor, const DriftDetector& detector,
+                   const FarmSnapshot& snapshot, const SensorFusion& fusion)
+  : _map(map), _store(store), _rollups(rollups), _aggregator(aggregator), _calibrations(calibrations),
+    _reprocessor(reprocessor), _detector(detector), _snapshot(snapshot), _fusion(fusion)
+{
+}
+
+bool QueryApi::allowed(const HttpRequest& request, HttpResponse& response) const
+{
+  if(!request.origin.empty()){
+    fail(response, 403, "cross-origin requests can't change state");   // a page the browser of a user opened
+    return false;
+  }
+  if(this->_token.empty()){
+    fail(response, 403, "changes are disabled, set GATEWAY_API_TOKEN");
+    return false;
+  }
+  std::string expected = "Bearer " + this->_token;
+  const std::string& given = request.authorization;
+  unsigned char diff = given.size() != expected.size();
+  for(size_t i = 0; i < expected.size(); i++)                     // no early exit, the time tells nothing
+    diff |= (unsigned char)(expected[i] ^ (i < given.size() ? given[i] : 0));
+  if(diff){
+    fail(response, 401, "missing or wrong token");
+    return false;
+  }
+  return true;
+}
+
+void QueryApi::handle(const HttpRequest& request, HttpResponse& response)
+{
+  const std::string& path = request.path;
+  bool post = request.method == "POST";
+  if(path == "/sensors" || path == "/sensors/" || path == "/reprocess" || path == "/snapshot"){
+    if(post) fail(response, 405, "method not allowed");
+    else if(path == "/reprocess") reprocessStatus(response.body);
+    else if(path == "/snapshot") snapshots(request, response);
+    else sensors(response.body);
+    return;
+  }
+  // /sensors/<id>/<query> or /farms/<farm_id>/<query>, ids may themselves contain '/'
+  size_t slash = path.rfind('/');
+  size_t prefix = path.compare(0, 9, "/sensors/") == 0 ? 9 : path.compare(0, 7, "/farms/") == 0 ? 7 : 0;
+  if(prefix == 0 || slash < prefix){
+    fail(response, 404, "not found");
+    return;
+  }
+  std::string id = path.substr(prefix, slash - prefix);
+  std::string query = path.substr(slash + 1);
+  // the queries that change state are POST only, all others GET / HEAD only
+  bool changes = query == "reprocess" || (query == "calibrations" && post);
+  if(post != changes){
+    fail(response, 405, "method not allowed");
+    return;
+  }
+  if(changes && !allowed(request, response)) return;
+  int64_t from, to;
+  if(prefix == 7){
+    if(query == "snapshot") snapshot(id, response);
+    else if(query != "aggregate" && query != "reprocess" && query != "fused") fail(response, 404, "not found");
+    else if(!timeWindow(request, response, &from, &to)) return;
+    else if(query == "aggregate") farmAggregate(id, from, to, request, response);
+    else if(query == "fused") fused(id, from, to, response);
+    else farmReprocess(id, from, to, request, response);
+    return;
+  }
+  int32_t sensor = this->_map.find(id);
+  if(sensor == SENSOR_UNMAPPED){
+    fail(response, 404, "unknown sensor");
+    return;
+  }
+  if(query == "latest"){
+    latest(sensor, request, response);
+    return;
+  }
+  if(query == "calibrations"){
+    calibrations(sensor, request, response);
+    return;
+  }
+  if(query != "range" && query != "series" && query != "summary"){
+    fail(response, 404, "not found");
+    return;
+  }
+  if(!timeWindow(request, response, &from, &to)) return;
+  if(query == "range") range(sensor, from, to, response.body);
+  else if(query == "series") series(sensor, from, to, request, response);
+  else summary(sensor, from, to, response.body);
+}
+
+void QueryApi::sensors(std::string& body)
+{
+  body = "[";
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    const SensorInfo& info = this->_map.sensor(i);
+    if(i) body += ',';
+    body += "{\"sensor_id\":";
+    appendString(body, info.sensorId);
+    body += ",\"farm_id\":";
+    appendString(body, info.farmId);
+    uint8_t quantity = info.probe == PROBE_NONE ? info.quantity : probeQuantity(info.probe);
+    body += ",\"sensor_type\":";
+    appendString(body, DeviceMap::sensorType(quantity));
+    body += ",\"units\":";
+    appendString(body, DeviceMap::unit(quantity));
+    body += ",\"rows\":";
+    appendNumber(body, (double)this->_store.rows(i));
+    body += ",\"bytes\":";
+    appendNumber(body, (double)this->_store.bytes(i));
+    body += ",\"latest\":";
+    Sample s;
+    if(this->_store.latest(i, &s)) appendRow(body, s.timestamp, s.value);
+    else body += "null";
+    body += ",\"faults\":[";
+    appendFaults(body, this->_detector.faults(i));
+    body += "]}";
+  }
+  body += ']';
+}
+
+void QueryApi::latest(uint32_t sensor, const HttpRequest& request, HttpResponse& response)
+{
+  long limit = atol(request.param("limit", "1"));
+  if(limit < 1 || limit > QUERY_MAX_LATEST){
+    fail(response, 400, "limit must be 1..1000");
+    return;
+  }
+  std::vector<Sample> samples(limit);
+  size_t n = this->_store.latest(sensor, limit, samples.data());
+  std::string& body = response.body;
+  body.reserve(n*64 + 2);
+  body = "[";
+  for(size_t i = 0; i < n; i++){
+    if(i) body += ',';
+    appendRow(body, samples[i].timestamp, samples[i].value);
+  }
+  body += ']';
+}
+
+/*!
+ * @brief Writes the first QUERY_MAX_ROWS visited rows as JSON, scan() counts the rest
+ */
+class JsonRowVisitor : public SpanVisitor
+{
+public:
+  JsonRowVisitor(std::string& body) : _body(body), _rows(0) {}
+
+  virtual void span(const int64_t* timestamps, const float* values, size_t count)
+  {
+    for(size_t i = 0; i < count && this->_rows < QUERY_MAX_ROWS; i++, this->_rows++){
+      if(this->_rows) this->_body += ',';
+      appendRow(this->_body, timestamps[i], values[i]);
+    }
+  }
+
+private:
+  std::string& _body;
+  size_t _rows;
+};
+
+void QueryApi::range(uint32_t sensor, int64_t from, int64_t to, std::string& body)
+{
+  body = "{\"rows\":[";
+  JsonRowVisitor rows(body);
+  size_t n = this->_store.scan(sensor, from, to, rows);
+  body += "],\"truncated\":";
+  body += n > QUERY_MAX_ROWS ? "true" : "false";
+  body += '}';
+}
+
+/*!
+ * @brief Collects raw rows as chart coordinates: seconds since from and value
+ */
+class PointVisitor : public SpanVisitor
+{
+public:
+  PointVisitor(int64_t from, std::vector<int64_t>& t, std::vector<float>& x, std::vector<float>& y)
+    : _from(from), _t(t), _x(x), _y(y) {}
+
+  virtual void span(const int64_t* timestamps, const float* values, size_t count)
+  {
+    size_t base = this->_x.size();
+    this->_x.resize(base + count);
+    this->_t.insert(this->_t.end(), timestamps, timestamps + count);
+    this->_y.insert(this->_y.end(), values, values + count);
+    for(size_t i = 0; i < count; i++) this->_x[base+i] = (timestamps[i] - this->_from)*1e-6f;
+  }
+
+private:
+  int64_t _from;
+  std::vector<int64_t>& _t;
+  std::vector<float>& _x;
+  std::vector<float>& _y;
+};
+
+void QueryApi::series(uint32_t sensor, int64_t from, int64_t to, const HttpRequest& request, HttpResponse& response)
+{
+  long points = atol(request.param("points", "500"));
+  if(points < LTTB_MIN_POINTS || points > QUERY_MAX_POINTS){
+    fail(response, 400, "points must be 3..5000");
+    return;
+  }
+  std::vector<int64_t> t;
+  std::vector<float> x, y;
+  const char* source = "raw";
+  if(to - from <= QUERY_RAW_WINDOW){
+    PointVisitor collect(from, t, x, y);
+    this->_store.scan(sensor, from, to, collect);
+  }else{
+    std::vector<RollupBucket> buckets;
+    int tier = this->_rollups.series(sensor, from, to, (to - from)/(points*QUERY_BUCKETS_PER_POINT), buckets);
+    source = tierNames[tier];
+    t.resize(buckets.size());
+    x.resize(buckets.size());
+    y.resize(buckets.size());
+    for(size_t i = 0; i < buckets.size(); i++){
+      t[i] = buckets[i].start;
+      x[i] = (buckets[i].start - from)*1e-6f;
+      y[i] = buckets[i].mean();
+    }
+  }
+  std::vector<uint32_t> selected(std::min((size_t)points, x.size()));
+  size_t n = lttb(x.data(), y.data(), x.size(), points, selected.data());
+  std::string& body = response.body;
+  body.reserve(n*64 + 64);
+  body = "{\"source\":\"";
+  body += source;
+  body += "\",\"rows\":[";
+  for(size_t i = 0; i < n; i++){
+    if(i) body += ',';
+    appendRow(body, t[selected[i]], y[selected[i]]);
+  }
+  body += "],\"scanned\":";
+  appendNumber(body, (double)x.size());
+  body += '}';
+}
+
+void QueryApi::summary(uint32_t sensor, int64_t from, int64_t to, std::string& body)
+{
+  RollupBucket s;
+  body = "{\"count\":";
+  if(!this->_rollups.summary(sensor, from, to, &s)){
+    body += "0}";
+    return;
+  }
+  appendNumber(body, s.count);
+  body += ",\"min\":";
+  appendNumber(body, s.min);
+  body += ",\"max\":";
+  appendNumber(body, s.max);
+  body += ",\"mean\":";
+  appendNumber(body, s.mean());
+  body += ",\"stddev\":";
+  appendNumber(body, s.stddev());
+  body += ",\"first\":";
+  appendNumber(body, s.first);
+  body += ",\"last\":";
+  appendNumber(body, s.last);
+  body += '}';
+}
+
+bool QueryApi::farmSensors(const std::string& farmId, const HttpRequest& request, HttpResponse& response,
+                           std::vector<uint32_t>& sensors)
+{
+  uint8_t quantity = 0;
+  if(request.param("type") && (quantity = DeviceMap::quantityFromName(request.param("type"))) == 0){
+    fail(response, 400, "type must be ph, ec, temperature or voltage");
+    return false;
+  }
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    const SensorInfo& info = this->_map.sensor(i);
+    uint8_t q = info.probe == PROBE_NONE ? info.quantity : probeQuantity(info.probe);
+    if(info.farmId == farmId && (quantity == 0 || q == quantity)) sensors.push_back(i);
+  }
+  if(sensors.empty()){
+    fail(response, 404, "no such sensors");
+    return false;
+  }
+  return true;
+}
+
+static void appendAggregate(std::string& body, const ColumnAggregate& a)
+{
+  body += "\"count\":";
+  appendNumber(body, (double)a.count);
+  if(a.count){
+    body += ",\"sum\":";
+    appendNumber(body, a.sum);
+    body += ",\"min\":";
+    appendNumber(body, a.min);
+    body += ",\"max\":";
+    appendNumber(body, a.max);
+    body += ",\"mean\":";
+    appendNumber(body, a.mean());
+  }
+  body += ",\"above\":";
+  appendNumber(body, (double)a.above);
+  body += ",\"below\":";
+  appendNumber(body, (double)a.below);
+}
+
+void QueryApi::farmAggregate(const std::string& farmId, int64_t from, int64_t to, const HttpRequest& request,
+                             HttpResponse& response)
+{
+  std::vector<uint32_t> sensors;
+  if(!farmSensors(farmId, request, response, sensors)) return;
+  float high = INFINITY, low = -INFINITY;
+  char* end;
+  if(request.param("above")){
+    high = strtof(request.param("above"), &end);
+    if(*end != '\0'){
+      fail(response, 400, "bad above");
+      return;
+    }
+  }
+  if(request.param("below")){
+    low = strtof(request.param("below"), &end);
+    if(*end != '\0'){
+      fail(response, 400, "bad below");
+      return;
+    }
+  }
+  int64_t start = nowMicros();
+  std::vector<ColumnAggregate> results(sensors.size());
+  this->_aggregator.aggregate(sensors, from, to, low, high, results.data());
+  ColumnAggregate total;
+  for(size_t i = 0; i < results.size(); i++) total.merge(results[i]);
+  int64_t elapsed = nowMicros() - start;
+
+  std::string& body = response.body;
+  body = "{\"farm_id\":";
+  appendString(body, farmId);
+  body += ",\"sensors\":";
+  appendNumber(body, (double)sensors.size());
+  body += ',';
+  appendAggregate(body, total);
+  if(request.param("detail")){
+    body += ",\"per_sensor\":[";
+    for(size_t i = 0; i < results.size(); i++){
+      body += i ? ",{\"sensor_id\":" : "{\"sensor_id\":";
+      appendString(body, this->_map.sensor(sensors[i]).sensorId);
+      body += ',';
+      appendAggregate(body, results[i]);
+      body += '}';
+    }
+    body += ']';
+  }
+  body += ",\"elapsed_us\":";
+  appendNumber(body, (double)elapsed);
+  body += '}';
+}
+
+void QueryApi::calibrations(uint32_t sensor, const HttpRequest& request, HttpResponse& response)
+{
+  std::string& body = response.body;
+  if(request.method == "POST"){
+    const char* probe = request.param("probe");
+    int64_t now = nowMicros(), from = now;
+    if(probe == NULL){
+      fail(response, 400, "probe missing, e.g. probe=ph:1498.2:2030.1");
+      return;
+    }
+    if(request.param("from") && !parseTime(request.param("from"), &from)){
+      fail(response, 400, "bad from");
+      return;
+    }
+    uint16_t version = this->_calibrations.add(sensor, probe, from);
+    if(version == 0){
+      fail(response, 400, "bad probe for this sensor");
+      return;
+    }
+    // readings since from were converted with an older version
+    bool started = from < now && this->_reprocessor.start(std::vector<uint32_t>(1, sensor), from, now);
+    body = "{\"version\":";
+    appendNumber(body, version);
+    body += ",\"reprocessing\":";
+    body += started ? "true" : "false";
+    body += '}';
+    return;
+  }
+  std::vector<Calibration> versions;
+  this->_calibrations.history(sensor, versions);
+  body = "[";
+  for(size_t i = 0; i < versions.size(); i++){
+    if(i) body += ',';
+    body += "{\"version\":";
+    appendNumber(body, versions[i].version);
+    body += ",\"probe\":";
+    appendString(body, DeviceMap::formatProbe(versions[i].probe, versions[i].values));
+    body += ",\"from\":";
+    if(versions[i].from == INT64_MIN){
+      body += "null";
+    }else{
+      char ts[32];
+      BatchWriter::formatTimestamp(ts, versions[i].from);
+      appendString(body, ts);
+    }
+    body += '}';
+  }
+  body += ']';
+}
+
+void QueryApi::farmReprocess(const std::string& farmId, int64_t from, int64_t to, const HttpRequest& request,
+                             HttpResponse& response)
+{
+  std::vector<uint32_t> sensors;
+  if(!farmSensors(farmId, request, response, sensors)) return;
+  if(!this->_reprocessor.start(sensors, from, to)){
+    fail(response, 409, "a reprocessing job is running");
+    return;
+  }
+  response.status = 202;
+  reprocessStatus(response.body);
+}
+
+void QueryApi::snapshot(const std::string& farmId, HttpResponse& response)
+{
+  response.body.clear();
+  if(!this->_snapshot.document(farmId, response.body)) fail(response, 404, "no such sensors");
+}
+
+void QueryApi::snapshots(const HttpRequest& request, HttpResponse& response)
+{
+  const char* farms = request.param("farms");
+  if(farms == NULL || *farms == '\0'){
+    fail(response, 400, "farms is required");
+    return;
+  }
+  std::string& body = response.body;
+  body = "[";
+  for(const char* p = farms; ; p++){
+    const char* comma = strchr(p, ',');
+    std::string farmId(p, comma ? comma - p : strlen(p));
+    if(!farmId.empty()){
+      if(body.size() > 1) body += ',';
+      this->_snapshot.document(farmId, body);            // a farm without gateway sensors has none
+    }
+    if(comma == NULL) break;
+    p = comma;
+  }
+  body += ']';
+}
+
+void QueryApi::fused(const std::string& farmId, int64_t from, int64_t to, HttpResponse& response)
+{
+  std::vector<int64_t> timestamps;
+  std::vector<float> values;
+  std::vector<uint8_t> compensated;
+  std::string& body = response.body;
+  body = "[";
+  bool known = false;
+  for(uint32_t g = 0; g < this->_fusion.groupCount(); g++){
+    const FusionGroup& group = this->_fusion.group(g);
+    bool member = false;
+    for(size_t m = 0; m < group.sensors.size() && !member; m++)
+      member = this->_map.sensor(group.sensors[m]).farmId == farmId;
+    if(!member) continue;
+    known = true;
+    size_t members = group.sensors.size();
+    if(body.size() > 1) body += ',';
+    body += "{\"device\":";
+    appendString(body, this->_map.devices()[group.device]);
+    body += ",\"step_ms\":";
+    appendNumber(body, (double)(this->_fusion.step()/1000));
+    body += ",\"sensors\":[";
+    for(size_t m = 0; m < members; m++){
+      const SensorInfo& info = this->_map.sensor(group.sensors[m]);
+      if(m) body += ',';
+      body += "{\"sensor_id\":";
+      appendString(body, info.sensorId);
+      body += ",\"sensor_type\":";
+      appendString(body, DeviceMap::sensorType(group.quantities[m]));
+      body += ",\"units\":";
+      appendString(body, DeviceMap::unit(group.quantities[m]));
+      body += '}';
+    }
+    body += "],\"rows\":[";
+    size_t n = this->_fusion.records(g, from, to, timestamps, values, compensated);
+    for(size_t i = 0; i < n; i++){
+      char ts[32];
+      BatchWriter::formatTimestamp(ts, timestamps[i]);
+      body += i ? ",{\"created_at\":\"" : "{\"created_at\":\"";
+      body += ts;
+      body += "\",\"values\":[";
+      for(size_t m = 0; m < members; m++){
+        if(m) body += ',';
+        appendNumber(body, values[i*members + m]);
+      }
+      body += "],\"compensated\":";
+      body += compensated[i] ? "true}" : "false}";
+    }
+    body += "]}";
+  }
+  body += ']';
+  if(!known) fail(response, 404, "no fused sensors");
+}
+
+void QueryApi::reprocessStatus(std::string& body)
+{
+  ReprocessStatus s = this->_reprocessor.status();
+  body = "{\"running\":";
+  body += s.running ? "true" : "false";
+  body += ",\"sensors\":";
+  appendNumber(body, s.sensors);
+  body += ",\"done\":";
+  appendNumber(body, s.done);
+  body += ",\"rows\":";
+  appendNumber(body, (double)s.rows);
+  body += ",\"changed\":";
+  appendNumber(body, (double)s.changed);
+  body += ",\"elapsed_ms\":";
+  appendNumber(body, s.elapsedUs/1000.0);
+  body += '}';
+}
@@ -0,0 +1,113 @@
+/*!
+ * @file QueryApi.h
+ * @brief Define the basic structure of class QueryApi
+ * @details Read-only JSON API over the local store and rollups, served by HttpServer:
+ * @n   GET /sensors                                   sensors with row count, latest row and faults (DriftDetector)
+ * @n   GET /sensors/<id>/latest?limit=N               newest N rows, newest first (N <= QUERY_MAX_LATEST)
+ * @n   GET /sensors/<id>/range?from=&to=              raw rows, at most QUERY_MAX_ROWS
+ * @n   GET /sensors/<id>/series?from=&to=&points=     chart series of at most `points` rows (LTTB)
+ * @n   GET /sensors/<id>/summary?from=&to=            count, min, max, mean, stddev, first, last
+ * @n   GET /farms/<farm_id>/aggregate?type=&from=&to=&above=&below=&detail=1
+ * @n                                                  count, sum, min, max, mean and threshold counts over all
+ * @n                                                  sensors of a farm (of one quantity), computed by Aggregator
+ * @n   GET /sensors/<id>/calibrations                 calibration versions of a probe sensor
+ * @n   POST /sensors/<id>/calibrations?probe=&from=   add a version (probe as in the device map) applying from
+ * @n                                                  `from` (default now); stored readings since are converted again
+ * @n   POST /farms/<farm_id>/reprocess?type=&from=&to=  convert the probe readings of a farm again (Reprocessor)
+ * @n   GET /reprocess                                 progress of the reprocessing job
+ * @n   GET /farms/<farm_id>/snapshot                  latest reading, 24 h figures, trend and faults of every
+ * @n                                                  sensor of a farm (FarmSnapshot)
+ * @n   GET /snapshot?farms=<farm_id>,<farm_id>        the snapshots of several farms, in one response
+ * @n   GET /farms/<farm_id>/fused?from=&to=           records of SensorFusion of the devices of a farm: the values
+ * @n                                                  of all sensors of a device per grid point, EC compensated
+ * @n The POST queries change state: they need `Authorization: Bearer <token>` with the token given to
+ * @n authorize() (none given: they are refused) and are refused when they carry an Origin header, i.e. come
+ * @n from a web page.
+ * @n <id> is sensor.sensor_id. from / to are unix milliseconds or ISO 8601 (e.g. 2026-10-16T08:00:00Z),
+ * @n to defaults to now and from to 24 h before to. Rows are {"created_at": ISO 8601, "value": number} like
+ * @n the app's `sensor_data` rows, so charts take them unchanged.
+ * @n A series of up to QUERY_RAW_WINDOW is downsampled from the raw rows, a longer one from the means of
+ * @n the finest rollup tier giving about 4 buckets per point; either way the response has at most `points`
+ * @n rows, whatever the window.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_QUERYAPI_H_
+#define _GATEWAY_QUERYAPI_H_
+
+#include "Aggregator.h"
+#include "CalibrationRegistry.h"
+#include "ColumnStore.h"
+#include "DeviceMap.h"
+#include "DriftDetector.h"
+#include "FarmSnapshot.h"
+#include "HttpServer.h"
+#include "Reprocessor.h"
+#include "Rollups.h"
+#include "SensorFusion.h"
+
+#include <string>
+#include <vector>
+
+#define QUERY_MAX_LATEST     1000
+#define QUERY_MAX_ROWS       20000
+#define QUERY_MAX_POINTS     5000
+#define QUERY_DEFAULT_POINTS 500
+#define QUERY_RAW_WINDOW     (2*86400LL*1000000)   ///<us, longer series are taken from rollups
+#define QUERY_BUCKETS_PER_POINT  4
+
+class QueryApi : public HttpHandler
+{
+public:
+  QueryApi(const DeviceMap& map, const ColumnStore& store, const Rollups& rollups, Aggregator& aggregator,
+           CalibrationRegistry& calibrations, Reprocessor& reprocessor, const DriftDetector& detector,
+           const FarmSnapshot& snapshot, const SensorFusion& fusion);
+
+  virtual void handle(const HttpRequest& request, HttpResponse& response);
+
+  /*!
+   * @fn authorize
+   * @brief Set the bearer token the POST queries need, call before the server starts
+   */
+  void authorize(const char* token) { this->_token = token; }
+
+  /*!
+   * @fn parseTime
+   * @brief Parse unix milliseconds or an ISO 8601 date / date-time (UTC unless it has an offset)
+   * @return false if text is neither
+   */
+  static bool parseTime(const char* text, int64_t* micros);
+
+private:
+  const DeviceMap& _map;
+  const ColumnStore& _store;
+  const Rollups& _rollups;
+  Aggregator& _aggregator;
+  CalibrationRegistry& _calibrations;
+  Reprocessor& _reprocessor;
+  const DriftDetector& _detector;
+  const FarmSnapshot& _snapshot;
+  const SensorFusion& _fusion;
+  std::string _token;         ///<empty: POST queries are refused
+
+private:
+  void sensors(std::string& body);
+  void latest(uint32_t sensor, const HttpRequest& request, HttpResponse& response);
+  void range(uint32_t sensor, int64_t from, int64_t to, std::string& body);
+  void series(uint32_t sensor, int64_t from, int64_t to, const HttpRequest& request, HttpResponse& response);
+  void summary(uint32_t sensor, int64_t from, int64_t to, std::string& body);
+  bool farmSensors(const std::string& farmId, const HttpRequest& request, HttpResponse& response,
+                   std::vector<uint32_t>& sensors);
+  void farmAggregate(const std::string& farmId, int64_t from, int64_t to, const HttpRequest& request,
+                     HttpResponse& response);
+  void farmReprocess(const std::string& farmId, int64_t from, int64_t to, const HttpRequest& request,
+                     HttpResponse& response);
+  void calibrations(uint32_t sensor, const HttpRequest& request, HttpResponse& response);
+  void reprocessStatus(std::string& body);
+  bool allowed(const HttpRequest& request, HttpResponse& response) const;
+  void fused(const std::string& farmId, int64_t from, int64_t to, HttpResponse& response);
+  void snapshot(const std::string& farmId, HttpResponse& response);
+  void snapshots(const HttpRequest& request, HttpResponse& response);
+};
+
+#endif
@@ -0,0 +1,123 @@
+/*!
+ * @file Reading.h
+ * @brief Records passed between the gateway stages
+ * @details A Reading is one value of one sensor, already mapped from (device, channel, quantity) to the dense
+ * @n sensor index of the DeviceMap. Quantity codes are the ones of DFRobot_SensorLink/DFRobot_SensorFrame.h.
+ * @n The epoch and sequence fields fill padding, a Reading stays 32 bytes.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_READING_H_
+#define _GATEWAY_READING_H_
+
+#include <stddef.h>
+#include <math.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+#define QUANTITY_PH            1   ///<pH
+#define QUANTITY_EC            2   ///<ms/cm
+#define QUANTITY_TEMPERATURE   3   ///<^C
+#define QUANTITY_VOLTAGE       4   ///<mV
+
+#define BACKFILL_AGE_US        10000000LL  ///<readings older than this when they reach a stage take the backfill lane
+
+#define STATS_WINDOW_1MIN      0
+#define STATS_WINDOW_10MIN     1
+#define STATS_WINDOW_1H        2
+
+struct Reading {
+  uint32_t sensor;        ///<index in DeviceMap
+  uint8_t  quantity;      ///<QUANTITY_*
+  uint8_t  epoch;         ///<boot epoch of the device that sent the sequenced frame
+  uint16_t calibration;   ///<CalibrationRegistry version a probe voltage was converted with, 0: not converted
+  float    value;
+  float    raw;           ///<value as received, e.g. the probe voltage (mV) before conversion
+  int64_t  timestamp;     ///<unix time (us), taken when the bytes were read, minus the age of a sequenced frame
+  float    temperature;   ///<^C used for compensation (EC), NAN if none
+  uint32_t sequence;      ///<frame sequence number within the epoch, 0: not sequenced (text lines, plain frames)
+};
+
+/*!
+ * @brief Summary of one statistics window computed on the device (DFRobot_SensorStats)
+ */
+struct WindowStats {
+  uint32_t sensor;
+  uint8_t  quantity;
+  uint8_t  window;        ///<STATS_WINDOW_*
+  uint32_t count;
+  float    mean;
+  float    stddev;
+  float    min;
+  float    max;
+  int64_t  timestamp;     ///<time the window summary was received (us)
+};
+
+/*!
+ * @brief Consumer of the readings of one ingest round
+ */
+class ReadingSink
+{
+public:
+  virtual ~ReadingSink() {}
+
+  /*!
+   * @fn push
+   * @brief Take a batch of readings, called from the ingest thread
+   */
+  virtual void push(const Reading* readings, size_t count) = 0;
+
+  /*!
+   * @fn pushStats
+   * @brief Take window summaries sent by devices, ignored by default
+   */
+  virtual void pushStats(const WindowStats* stats, size_t count) { (void)stats; (void)count; }
+};
+
+/*!
+ * @brief Hands every batch to several sinks in turn, e.g. the local store and the database writer
+ */
+class FanoutSink : public ReadingSink
+{
+public:
+  void add(ReadingSink* sink) { this->_sinks.push_back(sink); }
+  size_t size() const { return this->_sinks.size(); }
+
+  virtual void push(const Reading* readings, size_t count)
+  {
+    for(size_t i = 0; i < this->_sinks.size(); i++) this->_sinks[i]->push(readings, count);
+  }
+
+  virtual void pushStats(const WindowStats* stats, size_t count)
+  {
+    for(size_t i = 0; i < this->_sinks.size(); i++) this->_sinks[i]->pushStats(stats, count);
+  }
+
+private:
+  std::vector<ReadingSink*> _sinks;
+};
+
+/*!
+ * @fn nowMicros
+ * @brief Unix time in microseconds
+ */
+inline int64_t nowMicros()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (int64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+/*!
+ * @fn isBackfill
+ * @brief Whether a reading is backfill: sent again long after it was taken (a device draining what it kept
+ * @n while disconnected) or replayed from the log, rather than live
+ * @param now  Unix time (us) the reading reached the stage asking
+ */
+inline bool isBackfill(const Reading& r, int64_t now)
+{
+  return now - r.timestamp > BACKFILL_AGE_US;
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*!
+ * @file Reprocessor.cpp
+ * @brief Define the basic structure of class Reprocessor
+ * @details Converts stored probe readings again after a calibration correction.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Reprocessor.h"
+#include "Log.h"
+#include "ProbeMath.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*!
+ * @brief Converts the probe rows of one calibration span and writes them back
+ */
+class ConvertVisitor : public ProbeVisitor
+{
+public:
+  ConvertVisitor(const Calibration& calibration) : _calibration(calibration), rows(0), changed(0) {}
+
+  virtual void span(const ProbeSpan& span)
+  {
+    const Calibration& c = this->_calibration;
+    for(size_t at = 0; at < span.count; at += REPROCESS_CHUNK){
+      size_t n = span.count - at < REPROCESS_CHUNK ? span.count - at : REPROCESS_CHUNK;
+      if(c.probe == PROBE_PH) phFromVoltages(span.raw + at, n, c.values[0], c.values[1], this->_converted);
+      else ecFromVoltages(span.raw + at, span.temperatures + at, n, c.values[0], this->_converted);
+      float* values = span.values + at;
+      uint16_t* versions = span.calibrations + at;
+      for(size_t i = 0; i < n; i++){
+        if(versions[i] == 0) continue;                   // stored without a raw voltage
+        this->rows++;
+        if(values[i] != this->_converted[i]){
+          values[i] = this->_converted[i];
+          this->changed++;
+        }
+        versions[i] = c.version;
+      }
+    }
+  }
+
+private:
+  const Calibration& _calibration;
+  float _converted[REPROCESS_CHUNK];
+
+public:
+  uint64_t rows;
+  uint64_t changed;
+};
+
+Reprocessor::Reprocessor(const DeviceMap& map, ColumnStore& store, Rollups& rollups,
+                         const CalibrationRegistry& calibrations)
+  : _map(map), _store(store), _rollups(rollups), _calibrations(calibrations)
+{
+  this->_threads = 1;
+  this->_from = this->_to = this->_started = 0;
+  this->_finished = 1;
+  this->_next = 0;
+  this->_done = 0;
+  this->_live = 0;
+  this->_rows = 0;
+  this->_changed = 0;
+}
+
+Reprocessor::~Reprocessor()
+{
+  end();
+}
+
+void Reprocessor::begin(unsigned threads)
+{
+  this->_threads = threads ? threads : 1;
+}
+
+void Reprocessor::join()
+{
+  for(size_t i = 0; i < this->_workers.size(); i++) this->_workers[i].join();
+  this->_workers.clear();
+}
+
+bool Reprocessor::start(const std::vector<uint32_t>& sensors, int64_t from, int64_t to)
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  if(this->_finished.load() == 0) return false;
+  join();
+  this->_sensors.clear();
+  for(size_t i = 0; i < sensors.size(); i++)
+    if(this->_map.sensor(sensors[i]).probe != PROBE_NONE) this->_sensors.push_back(sensors[i]);
+  this->_from = from;
+  this->_to = to;
+  this->_started = nowMicros();
+  this->_next = 0;
+  this->_done = 0;
+  this->_rows = 0;
+  this->_changed = 0;
+  this->_finished = 0;
+  unsigned threads = this->_threads < this->_sensors.size() ? this->_threads : this->_sensors.size();
+  if(threads == 0){
+    this->_finished = nowMicros();
+    return true;
+  }
+  this->_live = threads;
+  for(unsigned i = 0; i < threads; i++){
+    this->_workers.emplace_back(&Reprocessor::workerLoop, this);
+    char name[16];
+    snprintf(name, sizeof(name), "gw-reproc%u", (uint16_t)i);
+    pthread_setname_np(this->_workers.back().native_handle(), name);
+  }
+  LOG("reprocessing %zu probe sensors on %u threads", this->_sensors.size(), threads);
+  return true;
+}
+
+void Reprocessor::workerLoop()
+{
+  // Linux applies nice per thread; ingest threads keep their priority
+  setpriority(PRIO_PROCESS, syscall(SYS_gettid), REPROCESS_NICE);
+  while(true){
+    size_t i = this->_next.fetch_add(1);
+    if(i >= this->_sensors.size()) break;
+    reprocess(this->_sensors[i]);
+    this->_done.fetch_add(1);
+  }
+  if(this->_live.fetch_sub(1) == 1){
+    int64_t now = nowMicros();
+    this->_finished = now;
+    LOG("reprocessed %llu rows (%llu changed) of %zu sensors in %lld ms", (unsigned long long)this->_rows.load(),
+        (unsigned long long)this->_changed.load(), this->_sensors.size(), (long long)(now - this->_started)/1000);
+  }
+}
+
+void Reprocessor::reprocess(uint32_t sensor)
+{
+  std::vector<CalibrationSpan> spans;
+  this->_calibrations.spans(sensor, this->_from, this->_to, spans);
+  for(size_t i = 0; i < spans.size(); i++){
+    const Calibration& c = *spans[i].calibration;
+    if(c.probe == PROBE_NONE) continue;
+    ConvertVisitor convert(c);
+    this->_store.rewrite(sensor, spans[i].from, spans[i].to, convert);
+    this->_rows.fetch_add(convert.rows);
+    this->_changed.fetch_add(convert.changed);
+  }
+  this->_rollups.rebuild(sensor, this->_from, this->_to);
+}
+
+ReprocessStatus Reprocessor::status() const
+{
+  ReprocessStatus s;
+  int64_t finished = this->_finished.load();
+  s.running = finished == 0;
+  s.sensors = this->_sensors.size();
+  s.done = this->_done.load();
+  s.rows = this->_rows.load();
+  s.changed = this->_changed.load();
+  s.from = this->_from;
+  s.to = this->_to;
+  s.elapsedUs = this->_started ? (s.running ? nowMicros() : finished) - this->_started : 0;
+  return s;
+}
+
+void Reprocessor::end()
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  join();
+}
@@ -0,0 +1,95 @@
+/*!
+ * @file Reprocessor.h
+ * @brief Define the basic structure of class Reprocessor
+ * @details Converts stored probe readings again after their calibration was corrected in the
+ * @n CalibrationRegistry. Every row of a probe sensor keeps its raw voltage, temperature and calibration
+ * @n version in the store; a job walks the rows of [from, to) of some sensors, splits them where the applying
+ * @n version changes, converts each part with the batch kernels of ProbeMath.h and writes value and version
+ * @n back in place. Then the rollups over the range are rebuilt.
+ * @n Sensors are spread over worker threads that run at a lower priority (nice REPROCESS_NICE), so ingest
+ * @n keeps its cores; ingest itself only ever waits for the rebuild of the open rollup buckets. One job runs
+ * @n at a time, status() reports its progress.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_REPROCESSOR_H_
+#define _GATEWAY_REPROCESSOR_H_
+
+#include "CalibrationRegistry.h"
+#include "ColumnStore.h"
+#include "DeviceMap.h"
+#include "Rollups.h"
+
+#include <atomic>
+#include <mutex>
+#include <stdint.h>
+#include <thread>
+#include <vector>
+
+#define REPROCESS_NICE    10
+#define REPROCESS_CHUNK   4096     ///<rows converted per kernel call
+
+struct ReprocessStatus {
+  bool     running;
+  uint32_t sensors;       ///<sensors of the last job
+  uint32_t done;          ///<sensors finished
+  uint64_t rows;          ///<probe rows converted
+  uint64_t changed;       ///<rows whose value changed
+  int64_t  from;
+  int64_t  to;
+  int64_t  elapsedUs;
+};
+
+class Reprocessor
+{
+public:
+  Reprocessor(const DeviceMap& map, ColumnStore& store, Rollups& rollups, const CalibrationRegistry& calibrations);
+  ~Reprocessor();
+
+  /*!
+   * @fn begin
+   * @brief Set the number of worker threads of a job
+   */
+  void begin(unsigned threads);
+
+  /*!
+   * @fn start
+   * @brief Convert [from, to) of the probe sensors among sensors again, in the background
+   * @return false if a job is still running
+   */
+  bool start(const std::vector<uint32_t>& sensors, int64_t from, int64_t to);
+
+  ReprocessStatus status() const;
+
+  /*!
+   * @fn end
+   * @brief Wait for a running job
+   */
+  void end();
+
+private:
+  const DeviceMap& _map;
+  ColumnStore& _store;
+  Rollups& _rollups;
+  const CalibrationRegistry& _calibrations;
+  unsigned _threads;
+  std::mutex _mutex;                                   ///<guards starting and joining jobs
+  std::vector<std::thread> _workers;
+  std::vector<uint32_t> _sensors;
+  int64_t _from;
+  int64_t _to;
+  int64_t _started;
+  std::atomic<int64_t> _finished;                      ///<0 while running
+  std::atomic<size_t> _next;
+  std::atomic<uint32_t> _done;
+  std::atomic<uint32_t> _live;
+  std::atomic<uint64_t> _rows;
+  std::atomic<uint64_t> _changed;
+
+private:
+  void workerLoop();
+  void reprocess(uint32_t sensor);
+  void join();
+};
+
+#endif
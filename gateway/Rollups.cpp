@@ -0,0 +1,417 @@
+/*!
+ * @file Rollups.cpp
+ * @brief Define the basic structure of class Rollups
+ * @details Per sensor summaries at 1 minute, 1 hour and 1 day resolution.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Rollups.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+static const int64_t tierWidth[ROLLUP_TIERS] = { 60LL*1000000, 3600LL*1000000, 86400LL*1000000 };
+static const size_t tierKeep[ROLLUP_TIERS] = { ROLLUP_KEEP_1MIN, ROLLUP_KEEP_1H, ROLLUP_KEEP_1D };
+
+double RollupBucket::stddev() const
+{
+  if(this->count < 2) return 0;
+  double mean = this->sum/this->count;
+  double variance = this->sumsq/this->count - mean*mean;
+  return variance > 0 ? sqrt(variance) : 0;
+}
+
+void RollupBucket::merge(const RollupBucket& later)
+{
+  if(later.count == 0) return;
+  if(this->count == 0){
+    *this = later;
+    return;
+  }
+  this->count += later.count;
+  if(later.min < this->min) this->min = later.min;
+  if(later.max > this->max) this->max = later.max;
+  if(later.start < this->start) this->first = later.first, this->start = later.start;
+  else this->last = later.last;
+  this->sum += later.sum;
+  this->sumsq += later.sumsq;
+}
+
+static RollupBucket single(int64_t start, float value)
+{
+  RollupBucket b;
+  b.start = start;
+  b.count = 1;
+  b.min = b.max = b.first = b.last = value;
+  b.sum = value;
+  b.sumsq = (double)value*value;
+  return b;
+}
+
+int64_t Rollups::width(int tier)
+{
+  return tierWidth[tier];
+}
+
+int64_t Rollups::floor(int64_t timestamp, int tier)
+{
+  int64_t r = timestamp % tierWidth[tier];
+  return timestamp - (r < 0 ? r + tierWidth[tier] : r);
+}
+
+static bool startsBefore(const RollupBucket& b, int64_t start)
+{
+  return b.start < start;
+}
+
+Rollups::Rollups(const DeviceMap& map)
+  : _map(map)
+{
+  this->_store = NULL;
+  this->_refreshPending = false;
+}
+
+/*!
+ * @brief Replays the rows of the store into the tiers of one sensor
+ */
+class RebuildVisitor : public SpanVisitor
+{
+public:
+  RebuildVisitor(Rollups& rollups, uint32_t sensor) : _rollups(rollups), _sensor(sensor) {}
+
+  virtual void span(const int64_t* timestamps, const float* values, size_t count)
+  {
+    for(size_t i = 0; i < count; i++) this->_rollups.add(this->_sensor, timestamps[i], values[i]);
+  }
+
+private:
+  Rollups& _rollups;
+  uint32_t _sensor;
+};
+
+void Rollups::begin(const ColumnStore* store)
+{
+  this->_store = store;
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    Series* series = new Series();
+    for(int tier = 0; tier < ROLLUP_TIERS; tier++) series->horizon[tier] = INT64_MIN;
+    this->_series.emplace_back(series);
+  }
+}
+
+void Rollups::rebuildAll()
+{
+  if(this->_store == NULL) return;
+  uint64_t rows = 0, hours = 0;
+  std::vector<ColdBucket> cold;
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    cold.clear();
+    hours += this->_store->cold(i, cold);
+    Series& series = *this->_series[i];
+    {
+      std::lock_guard<std::mutex> lock(series.mutex);
+      for(size_t k = 0; k < cold.size(); k++){           // rows moved to the cold tier only have hours and days
+        const ColdBucket& c = cold[k];
+        RollupBucket b;
+        b.start = c.start;
+        b.count = c.count;
+        b.min = c.min;
+        b.max = c.max;
+        b.first = c.first;
+        b.last = c.last;
+        b.sum = c.sum;
+        b.sumsq = c.sumsq;
+        addLocked(series, ROLLUP_1H, b);
+        addLocked(series, ROLLUP_1D, b);
+      }
+    }
+    RebuildVisitor rebuild(*this, i);
+    rows += this->_store->scan(i, INT64_MIN, INT64_MAX, rebuild);
+  }
+  LOG("rollups rebuilt from %llu stored rows and %llu cold hours", (unsigned long long)rows,
+      (unsigned long long)hours);
+}
+
+bool Rollups::save(std::string& out) const
+{
+  if(this->_refreshPending.load()) return false;          // open buckets not recomputed yet
+  for(size_t i = 0; i < this->_series.size(); i++){
+    Series& series = *this->_series[i];
+    if(!series.mutex.try_lock()) return false;
+    int64_t head[2*ROLLUP_TIERS];
+    for(int tier = 0; tier < ROLLUP_TIERS; tier++){
+      head[tier] = series.horizon[tier];
+      head[ROLLUP_TIERS + tier] = series.tiers[tier].size();
+    }
+    out.append((const char*)head, sizeof(head));
+    for(int tier = 0; tier < ROLLUP_TIERS; tier++){
+      const std::deque<RollupBucket>& buckets = series.tiers[tier];
+      for(std::deque<RollupBucket>::const_iterator it = buckets.begin(); it != buckets.end(); ++it)
+        out.append((const char*)&*it, sizeof(RollupBucket));
+    }
+    series.mutex.unlock();
+  }
+  return true;
+}
+
+bool Rollups::restore(const uint8_t* data, size_t size)
+{
+  // check it all before touching a sensor
+  size_t at = 0;
+  int64_t head[2*ROLLUP_TIERS];
+  for(size_t i = 0; i < this->_series.size(); i++){
+    if(size - at < sizeof(head)) return false;
+    memcpy(head, data + at, sizeof(head));
+    at += sizeof(head);
+    for(int tier = 0; tier < ROLLUP_TIERS; tier++){
+      if(head[ROLLUP_TIERS + tier] < 0 || (uint64_t)head[ROLLUP_TIERS + tier] > tierKeep[tier]) return false;
+      at += head[ROLLUP_TIERS + tier]*sizeof(RollupBucket);
+    }
+    if(at > size) return false;
+  }
+  if(at != size) return false;
+  at = 0;
+  for(size_t i = 0; i < this->_series.size(); i++){
+    Series& series = *this->_series[i];
+    std::lock_guard<std::mutex> lock(series.mutex);
+    memcpy(head, data + at, sizeof(head));
+    at += sizeof(head);
+    for(int tier = 0; tier < ROLLUP_TIERS; tier++){
+      series.horizon[tier] = head[tier];
+      std::deque<RollupBucket>& buckets = series.tiers[tier];
+      buckets.resize(head[ROLLUP_TIERS + tier]);
+      for(size_t k = 0; k < buckets.size(); k++, at += sizeof(RollupBucket)) memcpy(&buckets[k], data + at, sizeof(RollupBucket));
+    }
+  }
+  return true;
+}
+
+void Rollups::addLocked(Series& series, int64_t timestamp, float value)
+{
+  RollupBucket one = single(timestamp, value);
+  for(int tier = 0; tier < ROLLUP_TIERS; tier++) addLocked(series, tier, one);
+}
+
+void Rollups::addLocked(Series& series, int tier, const RollupBucket& b)
+{
+  std::deque<RollupBucket>& buckets = series.tiers[tier];
+  int64_t start = floor(b.start, tier);
+  if(!buckets.empty() && buckets.back().start == start){
+    buckets.back().merge(b);                             // the common case: the current bucket
+    return;
+  }
+  RollupBucket fresh = b;
+  fresh.start = start;
+  if(buckets.empty() || buckets.back().start < start){
+    buckets.push_back(fresh);
+    if(buckets.size() > tierKeep[tier]){
+      series.horizon[tier] = buckets.front().start + tierWidth[tier];
+      buckets.pop_front();
+    }
+    return;
+  }
+  // late reading, e.g. after the clock was stepped back
+  std::deque<RollupBucket>::iterator it = std::lower_bound(buckets.begin(), buckets.end(), start, startsBefore);
+  if(it != buckets.end() && it->start == start){
+    it->count += b.count;                                // first and last stay with the in-order readings
+    if(b.min < it->min) it->min = b.min;
+    if(b.max > it->max) it->max = b.max;
+    it->sum += b.sum;
+    it->sumsq += b.sumsq;
+  }else if(start >= series.horizon[tier]){
+    buckets.insert(it, fresh);
+  }
+}
+
+void Rollups::add(uint32_t sensor, int64_t timestamp, float value)
+{
+  Series& series = *this->_series[sensor];
+  std::lock_guard<std::mutex> lock(series.mutex);
+  addLocked(series, timestamp, value);
+}
+
+void Rollups::push(const Reading* readings, size_t count)
+{
+  if(this->_refreshPending.load(std::memory_order_acquire)) refresh();
+  for(size_t i = 0; i < count; i++)
+    add(readings[i].sensor, readings[i].timestamp, readings[i].value);
+}
+
+/*!
+ * @brief Builds the buckets of one tier from raw rows of the store
+ */
+class BucketVisitor : public SpanVisitor
+{
+public:
+  BucketVisitor(int tier, std::vector<RollupBucket>& buckets) : _tier(tier), _buckets(buckets) {}
+
+  virtual void span(const int64_t* timestamps, const float* values, size_t count)
+  {
+    for(size_t i = 0; i < count; i++){
+      int64_t start = Rollups::floor(timestamps[i], this->_tier);
+      if(this->_buckets.empty() || this->_buckets.back().start != start) this->_buckets.push_back(single(start, values[i]));
+      else this->_buckets.back().merge(single(timestamps[i], values[i]));
+    }
+  }
+
+private:
+  int _tier;
+  std::vector<RollupBucket>& _buckets;
+};
+
+void Rollups::replace(uint32_t sensor, int tier, int64_t from, int64_t to)
+{
+  from = std::max(from, this->_store->horizon(sensor));  // the cold tier has no rows to build from
+  if(from >= to) return;
+  std::vector<RollupBucket> fresh;
+  BucketVisitor build(tier, fresh);
+  this->_store->scan(sensor, from, to, build);
+  Series& series = *this->_series[sensor];
+  std::lock_guard<std::mutex> lock(series.mutex);
+  std::deque<RollupBucket>& buckets = series.tiers[tier];
+  if(from < series.horizon[tier]){                       // dropped by retention, keep it that way
+    from = series.horizon[tier];
+    while(!fresh.empty() && fresh.front().start < from) fresh.erase(fresh.begin());
+  }
+  std::deque<RollupBucket>::iterator a = std::lower_bound(buckets.begin(), buckets.end(), from, startsBefore);
+  std::deque<RollupBucket>::iterator b = std::lower_bound(a, buckets.end(), to, startsBefore);
+  a = buckets.erase(a, b);
+  buckets.insert(a, fresh.begin(), fresh.end());
+}
+
+void Rollups::rebuild(uint32_t sensor, int64_t from, int64_t to)
+{
+  if(this->_store == NULL || from >= to) return;
+  Sample latest;
+  if(!this->_store->latest(sensor, &latest)) return;
+  std::vector<Refresh> open;
+  for(int tier = 0; tier < ROLLUP_TIERS; tier++){
+    int64_t lo = floor(from, tier), hi = floor(to - 1, tier) + tierWidth[tier];
+    int64_t current = floor(latest.timestamp, tier);    // the bucket ingest still adds to
+    if(lo < std::min(hi, current)) replace(sensor, tier, lo, std::min(hi, current));
+    if(hi > current){
+      Refresh r;
+      r.sensor = sensor;
+      r.tier = tier;
+      r.start = current;
+      open.push_back(r);
+    }
+  }
+  if(open.empty()) return;
+  std::lock_guard<std::mutex> lock(this->_refreshMutex);
+  this->_refresh.insert(this->_refresh.end(), open.begin(), open.end());
+  this->_refreshPending.store(true, std::memory_order_release);
+}
+
+void Rollups::refresh()
+{
+  std::vector<Refresh> pending;
+  {
+    std::lock_guard<std::mutex> lock(this->_refreshMutex);
+    pending.swap(this->_refresh);
+    this->_refreshPending.store(false, std::memory_order_relaxed);
+  }
+  // the store holds exactly the readings added so far, the current batch goes to both after this
+  for(size_t i = 0; i < pending.size(); i++)
+    replace(pending[i].sensor, pending[i].tier, pending[i].start, pending[i].start + tierWidth[pending[i].tier]);
+}
+
+size_t Rollups::buckets(uint32_t sensor, int tier, int64_t from, int64_t to, std::vector<RollupBucket>& out) const
+{
+  Series& series = *this->_series[sensor];
+  std::lock_guard<std::mutex> lock(series.mutex);
+  const std::deque<RollupBucket>& buckets = series.tiers[tier];
+  std::deque<RollupBucket>::const_iterator it = std::lower_bound(buckets.begin(), buckets.end(), from, startsBefore);
+  size_t n = 0;
+  for(; it != buckets.end() && it->start < to; ++it, n++) out.push_back(*it);
+  return n;
+}
+
+int Rollups::series(uint32_t sensor, int64_t from, int64_t to, int64_t step, std::vector<RollupBucket>& out) const
+{
+  int tier = ROLLUP_1MIN;
+  while(tier + 1 < ROLLUP_TIERS && tierWidth[tier+1] <= step) tier++;
+  {
+    Series& series = *this->_series[sensor];
+    std::lock_guard<std::mutex> lock(series.mutex);
+    // the finer tiers forget first: move up while the chosen one starts after from but a coarser one doesn't
+    while(tier + 1 < ROLLUP_TIERS && !series.tiers[tier].empty() && series.tiers[tier].front().start > from &&
+          (series.tiers[tier+1].empty() || series.tiers[tier+1].front().start < series.tiers[tier].front().start))
+      tier++;
+  }
+  buckets(sensor, tier, from, to, out);
+  return tier;
+}
+
+/*!
+ * @brief Merges raw rows of the store into a bucket
+ */
+class MergeVisitor : public SpanVisitor
+{
+public:
+  MergeVisitor(RollupBucket* result) : _result(result) {}
+
+  virtual void span(const int64_t* timestamps, const float* values, size_t count)
+  {
+    for(size_t i = 0; i < count; i++) this->_result->merge(single(timestamps[i], values[i]));
+  }
+
+private:
+  RollupBucket* _result;
+};
+
+void Rollups::mergeTier(const Series& series, uint32_t sensor, int tier, int64_t from, int64_t to,
+                        RollupBucket* result) const
+{
+  if(from >= to) return;
+  if(from < series.horizon[tier]){                       // the tier has dropped these buckets, fall back to raw rows
+    int64_t split = std::min(to, series.horizon[tier]);
+    if(this->_store){
+      MergeVisitor raw(result);
+      this->_store->scan(sensor, from, split, raw);
+    }
+    from = split;
+  }
+  const std::deque<RollupBucket>& buckets = series.tiers[tier];
+  std::deque<RollupBucket>::const_iterator it = std::lower_bound(buckets.begin(), buckets.end(), from, startsBefore);
+  for(; it != buckets.end() && it->start < to; ++it) result->merge(*it);
+}
+
+bool Rollups::summary(uint32_t sensor, int64_t from, int64_t to, RollupBucket* result) const
+{
+  result->start = from;
+  result->count = 0;
+  if(to <= from) return false;
+  // [from, to) = raw head | minutes | hours | days | hours | minutes | raw tail, each part as coarse as alignment allows
+  int64_t edge[ROLLUP_TIERS][2];
+  int64_t lo = from, hi = to;
+  for(int tier = 0; tier < ROLLUP_TIERS; tier++){
+    int64_t a = floor(lo + tierWidth[tier] - 1, tier), b = floor(hi, tier);
+    if(a >= b){                                          // no whole bucket of this tier fits
+      for(int t = tier; t < ROLLUP_TIERS; t++) edge[t][0] = edge[t][1] = 0;
+      break;
+    }
+    edge[tier][0] = a;
+    edge[tier][1] = b;
+    lo = a;
+    hi = b;
+  }
+  Series& series = *this->_series[sensor];
+  MergeVisitor raw(result);
+  bool whole = edge[ROLLUP_1MIN][0] < edge[ROLLUP_1MIN][1];
+  if(this->_store) this->_store->scan(sensor, from, whole ? edge[ROLLUP_1MIN][0] : to, raw);
+  if(whole){
+    std::lock_guard<std::mutex> lock(series.mutex);
+    int top = ROLLUP_1MIN;
+    while(top + 1 < ROLLUP_TIERS && edge[top+1][0] < edge[top+1][1]) top++;
+    for(int tier = ROLLUP_1MIN; tier < top; tier++)          // left edges, fine to coarse
+      mergeTier(series, sensor, tier, edge[tier][0], edge[tier+1][0], result);
+    mergeTier(series, sensor, top, edge[top][0], edge[top][1], result);
+    for(int tier = top - 1; tier >= ROLLUP_1MIN; tier--)     // right edges, coarse to fine
+      mergeTier(series, sensor, tier, edge[tier+1][1], edge[tier][1], result);
+  }
+  if(this->_store && whole) this->_store->scan(sensor, edge[ROLLUP_1MIN][1], to, raw);
+  return result->count != 0;
+}
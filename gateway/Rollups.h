@@ -0,0 +1,155 @@
+/*!
+ * @file Rollups.h
+ * @brief Define the basic structure of class Rollups
+ * @details Per sensor summaries at 1 minute, 1 hour and 1 day resolution, updated as readings arrive.
+ * @n Every bucket keeps count, sum, sum of squares, min, max, first and last, so mean and standard deviation
+ * @n of any union of buckets are exact and charts over long ranges read a few hundred buckets instead of
+ * @n millions of rows. Buckets only exist for periods with readings; old buckets of a tier are dropped after
+ * @n its retention (ROLLUP_KEEP_*); summaries reaching back further use the store's raw rows for that part.
+ * @n Buckets are aligned to UTC.
+ * @n After rows of the store were rewritten (Reprocessor), rebuild() recomputes the buckets over them. Closed
+ * @n buckets (a later row is stored) are computed on the calling thread and swapped in; the open bucket of each
+ * @n tier is recomputed on the ingest thread at the start of the next push(), where store and rollups hold the
+ * @n same readings. Rollups must come before the store in the sinks for that.
+ * @n The tiers are built from the store at start, hours and days of rows the store moved to its cold tier from
+ * @n the cold buckets, or restored from a checkpoint (Checkpointable).
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_ROLLUPS_H_
+#define _GATEWAY_ROLLUPS_H_
+
+#include "Checkpoint.h"
+#include "ColumnStore.h"
+#include "DeviceMap.h"
+#include "Reading.h"
+
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#define ROLLUP_1MIN    0
+#define ROLLUP_1H      1
+#define ROLLUP_1D      2
+#define ROLLUP_TIERS   3
+
+#define ROLLUP_KEEP_1MIN  (7*24*60)    ///<buckets kept: 7 days of minutes
+#define ROLLUP_KEEP_1H    (400*24)     ///<400 days of hours
+#define ROLLUP_KEEP_1D    (10*366)     ///<10 years of days
+
+struct RollupBucket {
+  int64_t  start;         ///<unix time (us) of the bucket start
+  uint32_t count;
+  float    min;
+  float    max;
+  float    first;
+  float    last;
+  double   sum;
+  double   sumsq;
+
+  double mean() const { return this->count ? this->sum/this->count : 0; }
+  double stddev() const;
+
+  /*!
+   * @fn merge
+   * @brief Add a later bucket (or a single reading as a bucket of count 1) to this one
+   */
+  void merge(const RollupBucket& later);
+};
+
+class Rollups : public ReadingSink, public Checkpointable
+{
+public:
+  Rollups(const DeviceMap& map);
+
+  /*!
+   * @fn begin
+   * @brief Allocate the sensors; a store (may be NULL) gives summaries their raw rows
+   */
+  void begin(const ColumnStore* store);
+
+  /*!
+   * @fn rebuildAll
+   * @brief Build the tiers from every row of the store, at start when they were not restored
+   */
+  void rebuildAll();
+
+  /*!
+   * @fn save
+   * @brief Per sensor: horizon per tier (8 each) | buckets per tier (8 each) | the buckets of each tier
+   */
+  virtual bool save(std::string& out) const;
+  virtual bool restore(const uint8_t* data, size_t size);
+
+  /*!
+   * @fn push
+   * @brief Add readings to all tiers, called from the ingest thread
+   */
+  virtual void push(const Reading* readings, size_t count);
+
+  void add(uint32_t sensor, int64_t timestamp, float value);
+
+  /*!
+   * @fn rebuild
+   * @brief Recompute the buckets over [from, to) of a sensor from the store, see the file comment
+   */
+  void rebuild(uint32_t sensor, int64_t from, int64_t to);
+
+  /*!
+   * @fn series
+   * @brief Buckets of [from, to) from the coarsest tier that still gives buckets no wider than step
+   * @n (e.g. step = range / points of a chart), falling back to a coarser tier if the chosen one no longer
+   * @n covers from. Only buckets starting in [from, to) are returned.
+   * @return The tier used
+   */
+  int series(uint32_t sensor, int64_t from, int64_t to, int64_t step, std::vector<RollupBucket>& buckets) const;
+
+  /*!
+   * @fn summary
+   * @brief Aggregate over [from, to): whole days, then hours, then minutes at the edges, and the store's raw
+   * @n rows for the partial minutes at both ends if a store was given to begin()
+   * @return false if there is no reading in the range
+   */
+  bool summary(uint32_t sensor, int64_t from, int64_t to, RollupBucket* result) const;
+
+  /*!
+   * @fn buckets
+   * @brief Buckets of one tier starting in [from, to)
+   */
+  size_t buckets(uint32_t sensor, int tier, int64_t from, int64_t to, std::vector<RollupBucket>& buckets) const;
+
+  static int64_t width(int tier);
+  static int64_t floor(int64_t timestamp, int tier);
+
+private:
+  struct Series {
+    std::mutex mutex;                                ///<taken by the ingest thread per reading and by queries
+    std::deque<RollupBucket> tiers[ROLLUP_TIERS];
+    int64_t horizon[ROLLUP_TIERS];                   ///<buckets before this were dropped by retention
+  };
+
+  struct Refresh {
+    uint32_t sensor;
+    int tier;
+    int64_t start;
+  };
+
+  const DeviceMap& _map;
+  const ColumnStore* _store;
+  std::vector<std::unique_ptr<Series>> _series;
+  std::mutex _refreshMutex;
+  std::vector<Refresh> _refresh;                     ///<open buckets to recompute on the ingest thread
+  std::atomic<bool> _refreshPending;
+
+private:
+  void addLocked(Series& series, int64_t timestamp, float value);
+  void addLocked(Series& series, int tier, const RollupBucket& bucket);
+  void replace(uint32_t sensor, int tier, int64_t from, int64_t to);
+  void refresh();
+  void mergeTier(const Series& series, uint32_t sensor, int tier, int64_t from, int64_t to, RollupBucket* result) const;
+};
+
+#endif
@@ -0,0 +1,487 @@
+/*!
+ * @file RuleEngine.cpp
+ * @brief Define the basic structure of class RuleEngine
+ * @details Alert rules compiled to postfix programs and evaluated at ingest.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "RuleEngine.h"
+#include "Log.h"
+#include "ProbeMath.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RULE_QUANTITIES  5   ///<QUANTITY_* are 1..4
+
+enum {
+  OP_END, OP_CONST, OP_VALUE, OP_RATE, OP_DEVICE,
+  OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_NEG, OP_ABS, OP_MIN, OP_MAX,
+  OP_LT, OP_LE, OP_GT, OP_GE, OP_EQ, OP_NE, OP_AND, OP_OR, OP_NOT
+};
+
+/*!
+ * @brief Recursive descent compiler of a condition to postfix, tracking the stack depth it needs
+ */
+struct Compiler {
+  const char* p;
+  std::vector<RuleOp> code;
+  int depth;
+  int maxDepth;
+  std::string error;
+
+  void emit(uint8_t op, int effect, float constant = 0, uint8_t arg = 0)
+  {
+    code.push_back(RuleOp{op, arg, constant});
+    depth += effect;
+    if(depth > maxDepth) maxDepth = depth;
+  }
+
+  void skip() { while(isspace((unsigned char)*p)) p++; }
+
+  bool fail(const char* what)
+  {
+    if(error.empty()) error = what;
+    return false;
+  }
+
+  /*!
+   * @brief Consume a keyword or operator if it comes next
+   */
+  bool accept(const char* token)
+  {
+    skip();
+    size_t n = strlen(token);
+    if(strncmp(p, token, n) != 0) return false;
+    if(isalpha((unsigned char)token[0]) && (isalnum((unsigned char)p[n]) || p[n] == '_')) return false;
+    p += n;
+    return true;
+  }
+
+  bool parseOr()
+  {
+    if(!parseAnd()) return false;
+    while(accept("or")){
+      if(!parseAnd()) return false;
+      emit(OP_OR, -1);
+    }
+    return true;
+  }
+
+  bool parseAnd()
+  {
+    if(!parseNot()) return false;
+    while(accept("and")){
+      if(!parseNot()) return false;
+      emit(OP_AND, -1);
+    }
+    return true;
+  }
+
+  bool parseNot()
+  {
+    if(accept("not")){
+      if(!parseNot()) return false;
+      emit(OP_NOT, 0);
+      return true;
+    }
+    return parseCompare();
+  }
+
+  bool parseCompare()
+  {
+    static const struct { const char* token; uint8_t op; } ops[] = {
+      {"<=", OP_LE}, {">=", OP_GE}, {"==", OP_EQ}, {"!=", OP_NE}, {"<", OP_LT}, {">", OP_GT}
+    };
+    if(!parseSum()) return false;
+    for(size_t i = 0; i < sizeof(ops)/sizeof(ops[0]); i++){
+      if(!accept(ops[i].token)) continue;
+      if(!parseSum()) return false;
+      emit(ops[i].op, -1);
+      break;
+    }
+    return true;
+  }
+
+  bool parseSum()
+  {
+    if(!parseProduct()) return false;
+    while(true){
+      uint8_t op = accept("+") ? OP_ADD : accept("-") ? OP_SUB : OP_END;
+      if(op == OP_END) return true;
+      if(!parseProduct()) return false;
+      emit(op, -1);
+    }
+  }
+
+  bool parseProduct()
+  {
+    if(!parseUnary()) return false;
+    while(true){
+      uint8_t op = accept("*") ? OP_MUL : accept("/") ? OP_DIV : OP_END;
+      if(op == OP_END) return true;
+      if(!parseUnary()) return false;
+      emit(op, -1);
+    }
+  }
+
+  bool parseUnary()
+  {
+    if(accept("-")){
+      if(!parseUnary()) return false;
+      emit(OP_NEG, 0);
+      return true;
+    }
+    return parsePrimary();
+  }
+
+  bool parsePrimary()
+  {
+    skip();
+    if(accept("(")){
+      if(!parseOr()) return false;
+      return accept(")") || fail("missing )");
+    }
+    if(isdigit((unsigned char)*p) || *p == '.'){
+      char* end;
+      float v = strtof(p, &end);
+      if(end == p) return fail("bad number");
+      p = end;
+      emit(OP_CONST, 1, v);
+      return true;
+    }
+    const char* start = p;
+    while(isalpha((unsigned char)*p) || *p == '_') p++;
+    std::string name(start, p - start);
+    if(name.empty()) return fail(*p ? "unexpected character" : "condition ends early");
+    if(name == "value"){
+      emit(OP_VALUE, 1);
+    }else if(name == "rate"){
+      emit(OP_RATE, 1);
+    }else if(name == "abs" || name == "min" || name == "max"){
+      if(!accept("(") || !parseOr()) return fail("expected ( after a function");
+      if(name != "abs" && (!accept(",") || !parseOr())) return fail("min and max take two arguments");
+      if(!accept(")")) return fail("missing )");
+      if(name == "abs") emit(OP_ABS, 0);
+      else emit(name == "min" ? OP_MIN : OP_MAX, -1);
+    }else{
+      uint8_t quantity = DeviceMap::quantityFromName(name.c_str());
+      if(quantity == 0 || quantity >= RULE_QUANTITIES) return fail("unknown name, expected value, rate, ph, ec, "
+                                                                   "temperature, voltage or a function");
+      emit(OP_DEVICE, 1, 0, quantity);
+    }
+    return true;
+  }
+};
+
+/*!
+ * @brief Next field of a rule line: a word, or key="quoted text" with the quotes removed
+ */
+static bool nextField(const char*& p, std::string& field)
+{
+  while(isspace((unsigned char)*p)) p++;
+  if(*p == '\0') return false;
+  field.clear();
+  while(*p && !isspace((unsigned char)*p)){
+    if(*p == '"'){
+      const char* close = strchr(p + 1, '"');
+      if(close == NULL) close = p + strlen(p);
+      field.append(p + 1, close - p - 1);
+      p = *close ? close + 1 : close;
+    }else{
+      field += *p++;
+    }
+  }
+  return true;
+}
+
+RuleEngine::RuleEngine(const DeviceMap& map, Notifier& notifier)
+  : _map(map), _notifier(notifier)
+{
+  this->_evaluations = 0;
+}
+
+bool RuleEngine::load(const char* path)
+{
+  FILE* f = fopen(path, "r");
+  if(f == NULL){
+    LOG("can't open rules %s", path);
+    return false;
+  }
+  char line[1024];
+  int lineNo = 0;
+  bool ok = true;
+  std::string error;
+  while(fgets(line, sizeof(line), f)){
+    lineNo++;
+    char* hash = strchr(line, '#');
+    if(hash) *hash = '\0';
+    const char* p = line;
+    while(isspace((unsigned char)*p)) p++;
+    if(*p == '\0') continue;                             // blank or comment line
+    if(!add(p, error)){
+      LOG("%s:%d: %s", path, lineNo, error.c_str());
+      ok = false;
+    }
+  }
+  fclose(f);
+  return ok;
+}
+
+bool RuleEngine::add(const char* line, std::string& error)
+{
+  Rule rule;
+  std::string target, field;
+  const char* p = line;
+  if(!nextField(p, rule.name) || !nextField(p, rule.farmId) || !nextField(p, target)){
+    error = "expected <name> <farm_id|*> <ph|ec|temperature|voltage|sensor_id> [options] when <condition>";
+    return false;
+  }
+  if(rule.farmId == "*") rule.farmId.clear();
+  int32_t quantity = DeviceMap::quantityFromName(target.c_str());
+  int32_t sensor = quantity ? SENSOR_UNMAPPED : this->_map.find(target);
+  if(quantity == 0 && sensor == SENSOR_UNMAPPED){
+    error = "unknown sensor " + target;
+    return false;
+  }
+  rule.level = "warning";
+  rule.duration = 0;
+  rule.cooldown = (int64_t)RULE_COOLDOWN_S*1000000;
+  rule.hysteresis = 0;
+  rule.title = rule.name;
+  rule.message = "Sensor {sensor} on farm {farm} reads {value} {unit} ({rule}: {condition})";
+  while(true){
+    while(isspace((unsigned char)*p)) p++;
+    if(strncmp(p, "when", 4) == 0 && isspace((unsigned char)p[4])){
+      p += 5;
+      break;
+    }
+    if(!nextField(p, field)){
+      error = "missing when <condition>";
+      return false;
+    }
+    size_t eq = field.find('=');
+    std::string key = field.substr(0, eq), value = eq == std::string::npos ? "" : field.substr(eq + 1);
+    char* end = NULL;
+    double number = strtod(value.c_str(), &end);
+    bool numeric = !value.empty() && *end == '\0' && number >= 0;
+    if(key == "for" && numeric) rule.duration = (int64_t)(number*1000000);
+    else if(key == "cooldown" && numeric) rule.cooldown = (int64_t)(number*1000000);
+    else if(key == "hysteresis" && numeric) rule.hysteresis = number;
+    else if(key == "title" && !value.empty()) rule.title = value;
+    else if(key == "message" && !value.empty()) rule.message = value;
+    else if(key == "level" && (value == "normal" || value == "warning" || value == "error"))
+      rule.level = value == "normal" ? "normal" : value == "warning" ? "warning" : "error";
+    else{
+      error = "bad option " + field + ", expected for=, hysteresis=, cooldown=, level=, title= or message=";
+      return false;
+    }
+  }
+
+  Compiler c;
+  c.p = p;
+  c.depth = c.maxDepth = 0;
+  if(!c.parseOr() || (c.skip(), *c.p != '\0')){
+    error = "condition \"" + std::string(p) + "\": " + (c.error.empty() ? "unexpected text after it" : c.error);
+    return false;
+  }
+  if(c.maxDepth > RULE_MAX_STACK || c.code.size() >= RULE_MAX_CODE){
+    error = "condition too long";
+    return false;
+  }
+  c.emit(OP_END, 0);
+  rule.condition = p;
+  while(!rule.condition.empty() && isspace((unsigned char)rule.condition.back())) rule.condition.pop_back();
+  rule.code = this->_program.size();
+  this->_program.insert(this->_program.end(), c.code.begin(), c.code.end());
+  this->_rules.push_back(rule);
+  this->_targets.push_back(quantity ? quantity : -1 - sensor);
+  return true;
+}
+
+size_t RuleEngine::begin()
+{
+  size_t sensors = this->_map.sensorCount();
+  std::vector<Instance> instances;
+  this->_first.assign(sensors + 1, 0);
+  for(uint32_t s = 0; s < sensors; s++){
+    const SensorInfo& info = this->_map.sensor(s);
+    int32_t quantity = info.probe == PROBE_NONE ? info.quantity : probeQuantity(info.probe);
+    this->_first[s] = instances.size();
+    for(uint32_t r = 0; r < this->_rules.size(); r++){
+      const Rule& rule = this->_rules[r];
+      if(!rule.farmId.empty() && rule.farmId != info.farmId) continue;
+      if(this->_targets[r] != quantity && this->_targets[r] != -1 - (int32_t)s) continue;
+      instances.push_back(Instance{r, false, 0, 0});
+    }
+  }
+  this->_first[sensors] = instances.size();
+  for(int l = 0; l < 2; l++){
+    Lane& lane = this->_lanes[l];
+    lane.instances = instances;
+    lane.previous.assign(sensors, Previous{0, 0});
+    lane.devices.assign(this->_map.devices().size()*RULE_QUANTITIES, NAN);
+  }
+  if(!this->_rules.empty())
+    LOG("%zu alert rules, %zu sensor rules", this->_rules.size(), instances.size());
+  return instances.size();
+}
+
+uint32_t RuleEngine::hash() const
+{
+  uint32_t crc = 0;
+  for(size_t r = 0; r < this->_rules.size(); r++){
+    const Rule& rule = this->_rules[r];
+    crc = WriteAheadLog::crc32c(crc, (const uint8_t*)rule.name.c_str(), rule.name.size() + 1);
+    crc = WriteAheadLog::crc32c(crc, (const uint8_t*)rule.farmId.c_str(), rule.farmId.size() + 1);
+    crc = WriteAheadLog::crc32c(crc, (const uint8_t*)rule.condition.c_str(), rule.condition.size() + 1);
+    crc = WriteAheadLog::crc32c(crc, (const uint8_t*)&this->_targets[r], sizeof(int32_t));
+  }
+  return crc;
+}
+
+bool RuleEngine::save(std::string& out) const
+{
+  const Lane& live = this->_lanes[0];
+  uint32_t head[4] = {hash(), (uint32_t)live.instances.size(), (uint32_t)live.previous.size(),
+                      (uint32_t)live.devices.size()};
+  out.append((const char*)head, sizeof(head));
+  for(int l = 0; l < 2; l++){
+    const Lane& lane = this->_lanes[l];
+    out.append((const char*)lane.instances.data(), lane.instances.size()*sizeof(Instance));
+    out.append((const char*)lane.previous.data(), lane.previous.size()*sizeof(Previous));
+    out.append((const char*)lane.devices.data(), lane.devices.size()*sizeof(float));
+  }
+  return true;
+}
+
+bool RuleEngine::restore(const uint8_t* data, size_t size)
+{
+  uint32_t head[4];
+  if(size < sizeof(head)) return false;
+  memcpy(head, data, sizeof(head));
+  const Lane& live = this->_lanes[0];
+  if(head[0] != hash() || head[1] != live.instances.size() || head[2] != live.previous.size() ||
+     head[3] != live.devices.size() ||
+     size != sizeof(head) + 2*(head[1]*sizeof(Instance) + head[2]*sizeof(Previous) + head[3]*sizeof(float)))
+    return false;
+  data += sizeof(head);
+  for(int l = 0; l < 2; l++){
+    Lane& lane = this->_lanes[l];
+    memcpy(lane.instances.data(), data, head[1]*sizeof(Instance));
+    data += head[1]*sizeof(Instance);
+    memcpy(lane.previous.data(), data, head[2]*sizeof(Previous));
+    data += head[2]*sizeof(Previous);
+    memcpy(lane.devices.data(), data, head[3]*sizeof(float));
+    data += head[3]*sizeof(float);
+  }
+  return true;
+}
+
+float RuleEngine::evaluate(uint32_t rule, float value, float rate, const float* device, float slack) const
+{
+  float stack[RULE_MAX_STACK];
+  int sp = 0;
+  for(const RuleOp* op = &this->_program[this->_rules[rule].code]; ; op++){
+    switch(op->code){
+      case OP_END:    return stack[0];
+      case OP_CONST:  stack[sp++] = op->constant; break;
+      case OP_VALUE:  stack[sp++] = value; break;
+      case OP_RATE:   stack[sp++] = rate; break;
+      case OP_DEVICE: stack[sp++] = device[op->arg]; break;
+      case OP_ADD:    sp--; stack[sp-1] += stack[sp]; break;
+      case OP_SUB:    sp--; stack[sp-1] -= stack[sp]; break;
+      case OP_MUL:    sp--; stack[sp-1] *= stack[sp]; break;
+      case OP_DIV:    sp--; stack[sp-1] /= stack[sp]; break;
+      case OP_NEG:    stack[sp-1] = -stack[sp-1]; break;
+      case OP_ABS:    stack[sp-1] = fabsf(stack[sp-1]); break;
+      case OP_MIN:    sp--; stack[sp-1] = fminf(stack[sp-1], stack[sp]); break;
+      case OP_MAX:    sp--; stack[sp-1] = fmaxf(stack[sp-1], stack[sp]); break;
+      // while a rule is active its thresholds move by slack in the direction that keeps it active
+      case OP_LT:     sp--; stack[sp-1] = stack[sp-1] < stack[sp] + slack; break;
+      case OP_LE:     sp--; stack[sp-1] = stack[sp-1] <= stack[sp] + slack; break;
+      case OP_GT:     sp--; stack[sp-1] = stack[sp-1] > stack[sp] - slack; break;
+      case OP_GE:     sp--; stack[sp-1] = stack[sp-1] >= stack[sp] - slack; break;
+      case OP_EQ:     sp--; stack[sp-1] = stack[sp-1] == stack[sp]; break;
+      case OP_NE:     sp--; stack[sp-1] = stack[sp-1] != stack[sp]; break;
+      case OP_AND:    sp--; stack[sp-1] = stack[sp-1] > 0 && stack[sp] > 0; break;
+      case OP_OR:     sp--; stack[sp-1] = stack[sp-1] > 0 || stack[sp] > 0; break;
+      case OP_NOT:    stack[sp-1] = !(stack[sp-1] > 0); break;
+    }
+  }
+}
+
+void RuleEngine::push(const Reading* readings, size_t count)
+{
+  uint64_t evaluations = 0;
+  int64_t now = nowMicros();
+  for(size_t i = 0; i < count; i++){
+    const Reading& r = readings[i];
+    if(!isfinite(r.value)) continue;
+    // backfill is history: in the live lane it would overwrite the inputs of the device and end or restart
+    // episodes, so it runs the rules against a state of its own
+    bool backfill = isBackfill(r, now);
+    Lane& lane = this->_lanes[backfill];
+    const SensorInfo& info = this->_map.sensor(r.sensor);
+    float* device = &lane.devices[info.device*RULE_QUANTITIES];
+    Previous& previous = lane.previous[r.sensor];
+    float rate = NAN;
+    if(previous.timestamp == 0 || r.timestamp > previous.timestamp){
+      if(previous.timestamp) rate = (r.value - previous.value)*60e6f/(float)(r.timestamp - previous.timestamp);
+      previous.value = r.value;
+      previous.timestamp = r.timestamp;
+      if(r.quantity < RULE_QUANTITIES) device[r.quantity] = r.value;
+    }
+    uint32_t end = this->_first[r.sensor + 1];
+    evaluations += end - this->_first[r.sensor];
+    for(uint32_t k = this->_first[r.sensor]; k < end; k++){
+      Instance& in = lane.instances[k];
+      const Rule& rule = this->_rules[in.rule];
+      if(!(evaluate(in.rule, r.value, rate, device, in.active ? rule.hysteresis : 0) > 0)){
+        in.since = 0;
+        in.active = false;
+        continue;
+      }
+      if(in.since == 0) in.since = r.timestamp;
+      if(in.active || r.timestamp - in.since < rule.duration) continue;
+      in.active = true;                                  // once per episode
+      if(in.fired && r.timestamp - in.fired < rule.cooldown) continue;
+      in.fired = r.timestamp;
+      fire(rule, r, backfill);
+    }
+  }
+  this->_evaluations += evaluations;
+}
+
+void RuleEngine::fire(const Rule& rule, const Reading& r, bool backfill)
+{
+  const SensorInfo& info = this->_map.sensor(r.sensor);
+  std::string texts[2] = { rule.title, rule.message };
+  char value[32];
+  snprintf(value, sizeof(value), "%.4g", r.value);
+  for(int t = 0; t < 2; t++){
+    std::string& s = texts[t];
+    std::string out;
+    for(size_t i = 0; i < s.size(); i++){
+      size_t close = s[i] == '{' ? s.find('}', i) : std::string::npos;
+      std::string key = close == std::string::npos ? "" : s.substr(i + 1, close - i - 1);
+      if(key == "rule") out += rule.name;
+      else if(key == "sensor") out += info.sensorId;
+      else if(key == "farm") out += info.farmId;
+      else if(key == "value") out += value;
+      else if(key == "unit") out += DeviceMap::unit(r.quantity);
+      else if(key == "condition") out += rule.condition;
+      else{
+        out += s[i];
+        continue;
+      }
+      i = close;
+    }
+    s.swap(out);
+  }
+  if(backfill) Notifier::missed(texts[0], texts[1], r.timestamp);
+  this->_notifier.notify(info.farmId, texts[0], texts[1], rule.level);
+}
@@ -0,0 +1,149 @@
+/*!
+ * @file RuleEngine.h
+ * @brief Define the basic structure of class RuleEngine
+ * @details Alert rules evaluated on every reading at ingest, raising `notifications` rows through Notifier.
+ * @n Rules file, one rule per line, '#' starts a comment:
+ * @n   <name> <farm_id|*> <ph|ec|temperature|voltage|sensor_id> [option=value ...] when <condition>
+ * @n   ph-low  *  ph  for=600 hysteresis=0.1 title="Soil pH Alert" when value < 5.5
+ * @n   ec-heat farm1 ec level=error title="Nutrient burn risk" when value > 2.5 and temperature > 28
+ * @n Options:
+ * @n   for=<s>          the condition has to hold that long before the rule fires (duration above / below)
+ * @n   hysteresis=<x>   while the rule is active its comparisons are relaxed by x, so a value hovering at the
+ * @n                    threshold doesn't make it fire and clear over and over
+ * @n   cooldown=<s>     a rule fires again for the same sensor at the earliest that long after it last fired
+ * @n                    (default RULE_COOLDOWN_S); it never fires twice while active
+ * @n   level=<normal|warning|error>   notification type, default warning
+ * @n   title="..." message="..."      texts, with {rule} {sensor} {farm} {value} {unit} {condition} replaced
+ * @n Conditions use value (the reading), rate (change per minute since the sensor's previous reading),
+ * @n ph, ec, temperature and voltage (latest reading of that quantity on the same device, to combine sensors),
+ * @n numbers, + - * /, < <= > >= == !=, and, or, not, parentheses, abs(x), min(a, b) and max(a, b).
+ * @n A comparison with a missing value (e.g. a device without a temperature sensor) is false.
+ * @n Each condition is compiled to a short postfix program run on a small float stack; the rules that apply to
+ * @n a sensor are resolved once at load, so a reading costs one program run per rule of its sensor and no
+ * @n allocation (some 30 million rule evaluations per second on one core).
+ * @n Backfill (isBackfill(), readings a device kept while it was offline) is evaluated in a lane of its own:
+ * @n its rule episodes, previous readings and device values are separate from the live ones, so history
+ * @n neither ends nor restarts a live episode, and what a rule finds in it is sent once per episode as
+ * @n "missed while offline" with the time it was read (Notifier::missed()).
+ * @n The state of the rules (active, since when, last fired) of both lanes is kept across restarts by
+ * @n checkpoints as long as the rules and their targets stay the same.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_RULEENGINE_H_
+#define _GATEWAY_RULEENGINE_H_
+
+#include "Checkpoint.h"
+#include "DeviceMap.h"
+#include "Notifier.h"
+#include "Reading.h"
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define RULE_MAX_STACK     16
+#define RULE_MAX_CODE      64       ///<instructions per condition
+#define RULE_COOLDOWN_S    3600
+
+struct RuleOp {
+  uint8_t code;
+  uint8_t arg;            ///<quantity of OP_DEVICE
+  float   constant;       ///<of OP_CONST
+};
+
+struct Rule {
+  std::string name;
+  std::string farmId;     ///<empty: every farm
+  std::string title;
+  std::string message;
+  std::string condition;  ///<as written
+  const char* level;
+  int64_t duration;       ///<us
+  int64_t cooldown;       ///<us
+  float hysteresis;
+  uint32_t code;          ///<first instruction in the engine's program
+};
+
+class RuleEngine : public ReadingSink, public Checkpointable
+{
+public:
+  RuleEngine(const DeviceMap& map, Notifier& notifier);
+
+  /*!
+   * @fn load
+   * @brief Read and compile a rules file, see the file comment for the format
+   * @return false if the file can't be read or a rule doesn't compile
+   */
+  bool load(const char* path);
+
+  /*!
+   * @fn add
+   * @brief Compile one rule line (without the comment)
+   * @param error  Receives what is wrong with it
+   */
+  bool add(const char* line, std::string& error);
+
+  /*!
+   * @fn begin
+   * @brief Resolve which rules apply to which sensors, call after the rules are added
+   * @return Number of (sensor, rule) pairs
+   */
+  size_t begin();
+
+  virtual void push(const Reading* readings, size_t count);
+
+  size_t ruleCount() const { return this->_rules.size(); }
+  uint64_t evaluations() const { return this->_evaluations; }
+
+  /*!
+   * @fn evaluate
+   * @brief Run the program of a rule, slack is the hysteresis applied to its comparisons
+   * @param device  Latest reading per QUANTITY_* of the device
+   */
+  float evaluate(uint32_t rule, float value, float rate, const float* device, float slack) const;
+
+  /*!
+   * @fn save
+   * @brief rules hash (4) | instances (4) | sensors (4) | device values (4) | the three arrays of each lane
+   */
+  virtual bool save(std::string& out) const;
+  virtual bool restore(const uint8_t* data, size_t size);
+
+private:
+  struct Instance {
+    uint32_t rule;
+    bool active;
+    int64_t since;        ///<when the condition started to hold, 0 if it doesn't
+    int64_t fired;        ///<0 if never
+  };
+
+  struct Previous {
+    float value;
+    int64_t timestamp;    ///<0 before the first reading
+  };
+
+  /*!
+   * @brief Rule state of one lane, live or backfill
+   */
+  struct Lane {
+    std::vector<Instance> instances;
+    std::vector<Previous> previous;     ///<per sensor
+    std::vector<float> devices;         ///<per device, latest reading per QUANTITY_*
+  };
+
+  const DeviceMap& _map;
+  Notifier& _notifier;
+  std::vector<Rule> _rules;
+  std::vector<int32_t> _targets;        ///<per rule: QUANTITY_* if >= 0, else -1 - sensor index
+  std::vector<RuleOp> _program;
+  std::vector<uint32_t> _first;         ///<per sensor, its instances are instances[_first[s] .. _first[s + 1])
+  Lane _lanes[2];                       ///<live, backfill
+  uint64_t _evaluations;
+
+private:
+  void fire(const Rule& rule, const Reading& r, bool backfill);
+  uint32_t hash() const;
+};
+
+#endif
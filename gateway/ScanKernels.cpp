@@ -0,0 +1,241 @@
+/*!
+ * @file ScanKernels.cpp
+ * @brief Aggregation kernels over value columns of the store
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "ScanKernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+typedef void (*AggregateKernel)(const float*, size_t, float, float, ColumnAggregate*);
+
+static void aggregateScalar(const float* values, size_t count, float low, float high, ColumnAggregate* result)
+{
+  float mn = result->min, mx = result->max;
+  double sum = 0;
+  uint64_t above = 0, below = 0;
+  for(size_t i = 0; i < count; i++){
+    float v = values[i];
+    mn = v < mn ? v : mn;
+    mx = v > mx ? v : mx;
+    sum += v;
+    above += v > high;
+    below += v < low;
+  }
+  result->count += count;
+  result->sum += sum;
+  result->min = mn;
+  result->max = mx;
+  result->above += above;
+  result->below += below;
+}
+
+#if defined(SCAN_X86)
+__attribute__((target("avx2")))
+static void aggregateAvx2(const float* values, size_t count, float low, float high, ColumnAggregate* result)
+{
+  const __m256 vlow = _mm256_set1_ps(low), vhigh = _mm256_set1_ps(high);
+  __m256 mn = _mm256_set1_ps(result->min), mx = _mm256_set1_ps(result->max);
+  double sum = 0;
+  uint64_t above = 0, below = 0;
+  size_t i = 0;
+  while(i + 8 <= count){
+    size_t end = i + SCAN_BLOCK < count ? i + SCAN_BLOCK : count;
+    __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();   // two chains hide the add latency
+    __m256i up = _mm256_setzero_si256(), down = _mm256_setzero_si256();
+    for(; i + 16 <= end; i += 16){
+      __builtin_prefetch((const char*)(values + i) + SCAN_PREFETCH);
+      __m256 a = _mm256_loadu_ps(values + i), b = _mm256_loadu_ps(values + i + 8);
+      mn = _mm256_min_ps(mn, _mm256_min_ps(a, b));
+      mx = _mm256_max_ps(mx, _mm256_max_ps(a, b));
+      s0 = _mm256_add_ps(s0, a);
+      s1 = _mm256_add_ps(s1, b);
+      // compare masks are -1 per hit
+      up = _mm256_sub_epi32(up, _mm256_castps_si256(_mm256_cmp_ps(a, vhigh, _CMP_GT_OQ)));
+      up = _mm256_sub_epi32(up, _mm256_castps_si256(_mm256_cmp_ps(b, vhigh, _CMP_GT_OQ)));
+      down = _mm256_sub_epi32(down, _mm256_castps_si256(_mm256_cmp_ps(a, vlow, _CMP_LT_OQ)));
+      down = _mm256_sub_epi32(down, _mm256_castps_si256(_mm256_cmp_ps(b, vlow, _CMP_LT_OQ)));
+    }
+    for(; i + 8 <= end; i += 8){
+      __m256 a = _mm256_loadu_ps(values + i);
+      mn = _mm256_min_ps(mn, a);
+      mx = _mm256_max_ps(mx, a);
+      s0 = _mm256_add_ps(s0, a);
+      up = _mm256_sub_epi32(up, _mm256_castps_si256(_mm256_cmp_ps(a, vhigh, _CMP_GT_OQ)));
+      down = _mm256_sub_epi32(down, _mm256_castps_si256(_mm256_cmp_ps(a, vlow, _CMP_LT_OQ)));
+    }
+    float lanes[8];
+    int32_t ups[8], downs[8];
+    _mm256_storeu_ps(lanes, _mm256_add_ps(s0, s1));
+    _mm256_storeu_si256((__m256i*)ups, up);
+    _mm256_storeu_si256((__m256i*)downs, down);
+    for(int k = 0; k < 8; k++){
+      sum += lanes[k];
+      above += ups[k];
+      below += downs[k];
+    }
+  }
+  float lanes[8];
+  _mm256_storeu_ps(lanes, mn);
+  for(int k = 0; k < 8; k++) if(lanes[k] < result->min) result->min = lanes[k];
+  _mm256_storeu_ps(lanes, mx);
+  for(int k = 0; k < 8; k++) if(lanes[k] > result->max) result->max = lanes[k];
+  result->count += i;
+  result->sum += sum;
+  result->above += above;
+  result->below += below;
+  aggregateScalar(values + i, count - i, low, high, result);
+}
+
+static void aggregateSse2(const float* values, size_t count, float low, float high, ColumnAggregate* result)
+{
+  const __m128 vlow = _mm_set1_ps(low), vhigh = _mm_set1_ps(high);
+  __m128 mn = _mm_set1_ps(result->min), mx = _mm_set1_ps(result->max);
+  double sum = 0;
+  uint64_t above = 0, below = 0;
+  size_t i = 0;
+  while(i + 4 <= count){
+    size_t end = i + SCAN_BLOCK < count ? i + SCAN_BLOCK : count;
+    __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+    __m128i up = _mm_setzero_si128(), down = _mm_setzero_si128();
+    for(; i + 8 <= end; i += 8){
+      __builtin_prefetch((const char*)(values + i) + SCAN_PREFETCH);
+      __m128 a = _mm_loadu_ps(values + i), b = _mm_loadu_ps(values + i + 4);
+      mn = _mm_min_ps(mn, _mm_min_ps(a, b));
+      mx = _mm_max_ps(mx, _mm_max_ps(a, b));
+      s0 = _mm_add_ps(s0, a);
+      s1 = _mm_add_ps(s1, b);
+      up = _mm_sub_epi32(up, _mm_castps_si128(_mm_cmpgt_ps(a, vhigh)));
+      up = _mm_sub_epi32(up, _mm_castps_si128(_mm_cmpgt_ps(b, vhigh)));
+      down = _mm_sub_epi32(down, _mm_castps_si128(_mm_cmplt_ps(a, vlow)));
+      down = _mm_sub_epi32(down, _mm_castps_si128(_mm_cmplt_ps(b, vlow)));
+    }
+    for(; i + 4 <= end; i += 4){
+      __m128 a = _mm_loadu_ps(values + i);
+      mn = _mm_min_ps(mn, a);
+      mx = _mm_max_ps(mx, a);
+      s0 = _mm_add_ps(s0, a);
+      up = _mm_sub_epi32(up, _mm_castps_si128(_mm_cmpgt_ps(a, vhigh)));
+      down = _mm_sub_epi32(down, _mm_castps_si128(_mm_cmplt_ps(a, vlow)));
+    }
+    float lanes[4];
+    int32_t ups[4], downs[4];
+    _mm_storeu_ps(lanes, _mm_add_ps(s0, s1));
+    _mm_storeu_si128((__m128i*)ups, up);
+    _mm_storeu_si128((__m128i*)downs, down);
+    for(int k = 0; k < 4; k++){
+      sum += lanes[k];
+      above += ups[k];
+      below += downs[k];
+    }
+  }
+  float lanes[4];
+  _mm_storeu_ps(lanes, mn);
+  for(int k = 0; k < 4; k++) if(lanes[k] < result->min) result->min = lanes[k];
+  _mm_storeu_ps(lanes, mx);
+  for(int k = 0; k < 4; k++) if(lanes[k] > result->max) result->max = lanes[k];
+  result->count += i;
+  result->sum += sum;
+  result->above += above;
+  result->below += below;
+  aggregateScalar(values + i, count - i, low, high, result);
+}
+
+static AggregateKernel pickKernel(const char** name)
+{
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx2")){
+    *name = "avx2";
+    return aggregateAvx2;
+  }
+  *name = "sse2";
+  return aggregateSse2;
+}
+
+#elif defined(__ARM_NEON)
+static void aggregateNeon(const float* values, size_t count, float low, float high, ColumnAggregate* result)
+{
+  const float32x4_t vlow = vdupq_n_f32(low), vhigh = vdupq_n_f32(high);
+  float32x4_t mn = vdupq_n_f32(result->min), mx = vdupq_n_f32(result->max);
+  double sum = 0;
+  uint64_t above = 0, below = 0;
+  size_t i = 0;
+  while(i + 4 <= count){
+    size_t end = i + SCAN_BLOCK < count ? i + SCAN_BLOCK : count;
+    float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+    uint32x4_t up = vdupq_n_u32(0), down = vdupq_n_u32(0);
+    for(; i + 8 <= end; i += 8){
+      __builtin_prefetch((const char*)(values + i) + SCAN_PREFETCH);
+      float32x4_t a = vld1q_f32(values + i), b = vld1q_f32(values + i + 4);
+      mn = vminq_f32(mn, vminq_f32(a, b));
+      mx = vmaxq_f32(mx, vmaxq_f32(a, b));
+      s0 = vaddq_f32(s0, a);
+      s1 = vaddq_f32(s1, b);
+      up = vsubq_u32(up, vcgtq_f32(a, vhigh));
+      up = vsubq_u32(up, vcgtq_f32(b, vhigh));
+      down = vsubq_u32(down, vcltq_f32(a, vlow));
+      down = vsubq_u32(down, vcltq_f32(b, vlow));
+    }
+    for(; i + 4 <= end; i += 4){
+      float32x4_t a = vld1q_f32(values + i);
+      mn = vminq_f32(mn, a);
+      mx = vmaxq_f32(mx, a);
+      s0 = vaddq_f32(s0, a);
+      up = vsubq_u32(up, vcgtq_f32(a, vhigh));
+      down = vsubq_u32(down, vcltq_f32(a, vlow));
+    }
+    float lanes[4];
+    uint32_t ups[4], downs[4];
+    vst1q_f32(lanes, vaddq_f32(s0, s1));
+    vst1q_u32(ups, up);
+    vst1q_u32(downs, down);
+    for(int k = 0; k < 4; k++){
+      sum += lanes[k];
+      above += ups[k];
+      below += downs[k];
+    }
+  }
+  float lanes[4];
+  vst1q_f32(lanes, mn);
+  for(int k = 0; k < 4; k++) if(lanes[k] < result->min) result->min = lanes[k];
+  vst1q_f32(lanes, mx);
+  for(int k = 0; k < 4; k++) if(lanes[k] > result->max) result->max = lanes[k];
+  result->count += i;
+  result->sum += sum;
+  result->above += above;
+  result->below += below;
+  aggregateScalar(values + i, count - i, low, high, result);
+}
+
+static AggregateKernel pickKernel(const char** name)
+{
+  *name = "neon";
+  return aggregateNeon;
+}
+
+#else
+static AggregateKernel pickKernel(const char** name)
+{
+  *name = "scalar";
+  return aggregateScalar;
+}
+#endif
+
+static const char* kernelName = "scalar";
+static const AggregateKernel kernel = pickKernel(&kernelName);
+
+void aggregateValues(const float* values, size_t count, float low, float high, ColumnAggregate* result)
+{
+  kernel(values, count, low, high, result);
+}
+
+const char* scanKernelName()
+{
+  return kernelName;
+}
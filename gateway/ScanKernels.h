@@ -0,0 +1,59 @@
+/*!
+ * @file ScanKernels.h
+ * @brief Aggregation kernels over value columns of the store
+ * @details aggregateValues() folds a span of floats into count, sum, min, max and the number of values above
+ * @n and below two thresholds in one pass. On x86-64 it uses AVX2 (8 floats per step, picked at startup if the
+ * @n CPU has it) or SSE2, on ARM NEON, elsewhere a plain loop. Sums are kept per lane in float for blocks of
+ * @n SCAN_BLOCK values and added to a double after each block, so long columns don't lose precision.
+ * @n The next cache lines are prefetched ahead of the loads; segments keep each column contiguous, so a scan
+ * @n streams through memory.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_SCANKERNELS_H_
+#define _GATEWAY_SCANKERNELS_H_
+
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define SCAN_BLOCK      1024       ///<values summed in float before flushing to double
+#define SCAN_PREFETCH   256        ///<bytes prefetched ahead
+
+struct ColumnAggregate {
+  uint64_t count;
+  double   sum;
+  float    min;
+  float    max;
+  uint64_t above;         ///<values > high
+  uint64_t below;         ///<values < low
+
+  ColumnAggregate() : count(0), sum(0), min(INFINITY), max(-INFINITY), above(0), below(0) {}
+  double mean() const { return this->count ? this->sum/this->count : 0; }
+
+  void merge(const ColumnAggregate& other)
+  {
+    this->count += other.count;
+    this->sum += other.sum;
+    if(other.min < this->min) this->min = other.min;
+    if(other.max > this->max) this->max = other.max;
+    this->above += other.above;
+    this->below += other.below;
+  }
+};
+
+/*!
+ * @fn aggregateValues
+ * @brief Add count values to result
+ * @param low  Values below it are counted in result->below, -INFINITY counts none
+ * @param high  Values above it are counted in result->above, INFINITY counts none
+ */
+void aggregateValues(const float* values, size_t count, float low, float high, ColumnAggregate* result);
+
+/*!
+ * @fn scanKernelName
+ * @brief "avx2", "sse2", "neon" or "scalar": the kernel aggregateValues() uses on this CPU
+ */
+const char* scanKernelName();
+
+#endif
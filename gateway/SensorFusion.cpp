@@ -0,0 +1,203 @@
+/*!
+ * @file SensorFusion.cpp
+ * @brief Define the basic structure of class SensorFusion
+ * @details Per device resampling of sensors onto a common time grid, with temperature compensated EC.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "SensorFusion.h"
+#include "ProbeMath.h"
+
+#include <math.h>
+
+SensorFusion::SensorFusion(const DeviceMap& map, const CalibrationRegistry& calibrations, int64_t stepUs)
+  : _map(map), _calibrations(calibrations), _step(stepUs), _groupOf(map.sensorCount(), -1)
+{
+  this->_clock = 0;
+  this->_sweep = 0;
+  if(stepUs <= 0) return;
+  std::vector<std::vector<uint32_t>> devices(map.devices().size());
+  for(uint32_t i = 0; i < map.sensorCount(); i++) devices[map.sensor(i).device].push_back(i);
+  size_t widest = 0;
+  for(uint32_t d = 0; d < devices.size(); d++){
+    if(devices[d].size() < 2) continue;                  // nothing to align
+    Group g;
+    g.info.device = d;
+    g.info.sensors = devices[d];
+    g.info.temperature = -1;
+    for(size_t m = 0; m < devices[d].size(); m++){
+      const SensorInfo& info = map.sensor(devices[d][m]);
+      uint8_t quantity = info.probe == PROBE_NONE ? info.quantity : probeQuantity(info.probe);
+      g.info.quantities.push_back(quantity);
+      if(quantity == QUANTITY_TEMPERATURE && g.info.temperature < 0) g.info.temperature = m;
+      this->_groupOf[devices[d][m]] = this->_groups.size();
+    }
+    g.next = 0;
+    g.timestamps.resize(FUSION_HISTORY);
+    g.values.resize(FUSION_HISTORY*devices[d].size());
+    g.compensated.resize(FUSION_HISTORY);
+    g.head = 0;
+    g.count = 0;
+    if(devices[d].size() > widest) widest = devices[d].size();
+    this->_groups.push_back(std::move(g));
+  }
+  this->_tracks.resize(map.sensorCount());
+  for(size_t i = 0; i < this->_tracks.size(); i++){
+    this->_tracks[i].timestamp = 0;
+    for(int s = 0; s < FUSION_SLOTS; s++) this->_tracks[i].slot[s] = -1;
+  }
+  this->_row.resize(widest);
+  this->_raw.resize(widest);
+}
+
+void SensorFusion::push(const Reading* readings, size_t count)
+{
+  if(this->_groups.empty()) return;
+  for(size_t i = 0; i < count; i++){
+    const Reading& r = readings[i];
+    int32_t index = this->_groupOf[r.sensor];
+    if(index < 0) continue;
+    if(r.timestamp > this->_clock) this->_clock = r.timestamp;
+    if(!isfinite(r.value)) continue;
+    Group& g = this->_groups[index];
+    if(g.next == 0) g.next = (r.timestamp + this->_step - 1)/this->_step;
+    resample(this->_tracks[r.sensor], r, g.next);
+    advance(index);
+  }
+  if(this->_clock >= this->_sweep){
+    // devices that went quiet still get their due grid points out
+    this->_sweep = this->_clock + this->_step;
+    for(uint32_t i = 0; i < this->_groups.size(); i++) advance(i);
+  }
+}
+
+void SensorFusion::resample(Track& t, const Reading& r, int64_t next)
+{
+  if(t.timestamp && r.timestamp <= t.timestamp) return;   // out of order, the grid behind it is taken already
+  int64_t last = r.timestamp/this->_step;
+  int64_t first = t.timestamp ? t.timestamp/this->_step + 1 : (r.timestamp + this->_step - 1)/this->_step;
+  if(first < next) first = next;                         // emitted already
+  if(first < last - FUSION_SLOTS + 1) first = last - FUSION_SLOTS + 1;
+  bool interpolate = t.timestamp && r.timestamp - t.timestamp <= FUSION_STALE_STEPS*this->_step;
+  for(int64_t i = first; i <= last; i++){
+    int64_t at = i*this->_step;
+    int s = i % FUSION_SLOTS;
+    if(at == r.timestamp){
+      t.slotValue[s] = r.value;
+      t.slotRaw[s] = r.raw;
+    }else if(interpolate){
+      float f = (float)(at - t.timestamp)/(float)(r.timestamp - t.timestamp);
+      t.slotValue[s] = t.value + f*(r.value - t.value);
+      t.slotRaw[s] = t.raw + f*(r.raw - t.raw);
+    }else{
+      continue;                                          // no reading close enough on the left
+    }
+    t.slot[s] = i;
+  }
+  t.timestamp = r.timestamp;
+  t.value = r.value;
+  t.raw = r.raw;
+}
+
+void SensorFusion::advance(uint32_t index)
+{
+  Group& g = this->_groups[index];
+  if(g.next == 0) return;
+  int64_t stale = FUSION_STALE_STEPS*this->_step;
+  int64_t due = (this->_clock - FUSION_DELAY_STEPS*this->_step)/this->_step;   // emitted whatever the members
+  if(g.next < due - FUSION_SLOTS) g.next = due - FUSION_SLOTS;                  // older points are gone anyway
+  while(true){
+    int64_t at = g.next*this->_step;
+    if(g.next > due){
+      bool ahead = false, waiting = false;
+      for(size_t m = 0; m < g.info.sensors.size(); m++){
+        const Track& t = this->_tracks[g.info.sensors[m]];
+        if(t.timestamp >= at) ahead = true;
+        else if(t.timestamp && at - t.timestamp <= stale) waiting = true;
+      }
+      if(waiting || !ahead) break;
+    }
+    if(fill(g, g.next)){
+      // EC at the temperature of the same instant
+      float temperature = g.info.temperature >= 0 ? this->_row[g.info.temperature] : NAN;
+      bool compensated = false;
+      for(size_t m = 0; isfinite(temperature) && m < g.info.sensors.size(); m++){
+        if(g.info.quantities[m] != QUANTITY_EC || !isfinite(this->_row[m])) continue;
+        const SensorInfo& info = this->_map.sensor(g.info.sensors[m]);
+        if(info.probe == PROBE_EC10){
+          const Calibration* c = this->_calibrations.current(g.info.sensors[m]);
+          if(c->probe != PROBE_EC10) continue;
+          this->_row[m] = ecFromVoltage(this->_raw[m], temperature, c->values[0]);
+        }else{
+          this->_row[m] *= (1.0f + EC_TEMP_COEF*(FUSION_BOARD_TEMPERATURE - 25.0f))/
+                           (1.0f + EC_TEMP_COEF*(temperature - 25.0f));
+        }
+        compensated = true;
+      }
+      emit(index, at, compensated);
+    }
+    g.next++;
+  }
+}
+
+bool SensorFusion::fill(Group& g, int64_t index)
+{
+  int64_t at = index*this->_step;
+  int64_t stale = FUSION_STALE_STEPS*this->_step;
+  int s = index % FUSION_SLOTS;
+  bool any = false;
+  for(size_t m = 0; m < g.info.sensors.size(); m++){
+    const Track& t = this->_tracks[g.info.sensors[m]];
+    if(t.slot[s] == index){
+      this->_row[m] = t.slotValue[s];
+      this->_raw[m] = t.slotRaw[s];
+    }else if(t.timestamp && t.timestamp <= at && at - t.timestamp <= stale){
+      this->_row[m] = t.value;                           // late: hold its last reading
+      this->_raw[m] = t.raw;
+    }else{
+      this->_row[m] = this->_raw[m] = NAN;
+      continue;
+    }
+    any = true;
+  }
+  return any;
+}
+
+void SensorFusion::emit(uint32_t index, int64_t timestamp, bool compensated)
+{
+  Group& g = this->_groups[index];
+  size_t members = g.info.sensors.size();
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    g.timestamps[g.head] = timestamp;
+    g.compensated[g.head] = compensated;
+    for(size_t m = 0; m < members; m++) g.values[g.head*members + m] = this->_row[m];
+    g.head = (g.head + 1) % FUSION_HISTORY;
+    if(g.count < FUSION_HISTORY) g.count++;
+  }
+  FusedRecord record;
+  record.group = index;
+  record.timestamp = timestamp;
+  record.values = this->_row.data();
+  record.compensated = compensated;
+  for(size_t i = 0; i < this->_listeners.size(); i++) this->_listeners[i]->fused(record);
+}
+
+size_t SensorFusion::records(uint32_t group, int64_t from, int64_t to, std::vector<int64_t>& timestamps,
+                             std::vector<float>& values, std::vector<uint8_t>& compensated) const
+{
+  const Group& g = this->_groups[group];
+  size_t members = g.info.sensors.size();
+  timestamps.clear();
+  values.clear();
+  compensated.clear();
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  for(size_t i = 0; i < g.count; i++){
+    size_t at = (g.head + FUSION_HISTORY - g.count + i) % FUSION_HISTORY;
+    if(g.timestamps[at] < from || g.timestamps[at] >= to) continue;
+    timestamps.push_back(g.timestamps[at]);
+    compensated.push_back(g.compensated[at]);
+    values.insert(values.end(), g.values.begin() + at*members, g.values.begin() + (at + 1)*members);
+  }
+  return timestamps.size();
+}
@@ -0,0 +1,144 @@
+/*!
+ * @file SensorFusion.h
+ * @brief Define the basic structure of class SensorFusion
+ * @details Aligns the sensors of each device (pH, EC and temperature probes wired to one board) on a common time
+ * @n grid and emits one fused record per grid point, with EC compensated to 25 ^C using the temperature
+ * @n interpolated at that same instant rather than whatever temperature arrived last.
+ * @n Each sensor resamples itself as its readings arrive: grid points between two consecutive readings get the
+ * @n linearly interpolated value and go into a small ring of FUSION_SLOTS points. A grid point is emitted once
+ * @n every live member of the device has read past it, or at the latest FUSION_DELAY_STEPS steps after it (the
+ * @n watermark); a member that is late then contributes its last value (zero-order hold) if that is at most
+ * @n FUSION_STALE_STEPS steps old, otherwise nothing. State is fixed per sensor and per device, whatever the
+ * @n reading rates.
+ * @n EC is compensated with DFRobot_EC10's linear formula: probe voltages converted here are converted again at
+ * @n the fused temperature; EC sent by a board is taken as compensated at FUSION_BOARD_TEMPERATURE (the
+ * @n sketches leave readTemperature() as a stub) and corrected. pH needs no compensation (DFRobot_PH ignores the
+ * @n temperature). Devices without a temperature sensor are fused uncompensated.
+ * @n The last FUSION_HISTORY records of each device are kept for the API; listeners get each record as it is
+ * @n emitted, on the ingest thread.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_SENSORFUSION_H_
+#define _GATEWAY_SENSORFUSION_H_
+
+#include "CalibrationRegistry.h"
+#include "DeviceMap.h"
+#include "Reading.h"
+
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#define FUSION_STEP_S            10      ///<default grid step
+#define FUSION_SLOTS             8       ///<grid points a sensor can be ahead of its device
+#define FUSION_DELAY_STEPS       3       ///<a grid point is emitted at the latest this many steps after it
+#define FUSION_STALE_STEPS       3       ///<a late sensor's last value is held for at most this many steps
+#define FUSION_HISTORY           360     ///<records kept per device
+#define FUSION_BOARD_TEMPERATURE 25.0f   ///<^C boards compensate the EC they send with
+
+/*!
+ * @brief The sensors of one device that are fused together
+ */
+struct FusionGroup {
+  uint32_t device;                ///<index in DeviceMap::devices()
+  std::vector<uint32_t> sensors;  ///<members, in device map order
+  std::vector<uint8_t> quantities;  ///<QUANTITY_* of each member, after probe conversion
+  int32_t temperature;            ///<member compensating the EC ones, -1 if none
+};
+
+/*!
+ * @brief All members of a group at one grid point
+ */
+struct FusedRecord {
+  uint32_t group;
+  int64_t timestamp;              ///<grid time (us)
+  const float* values;            ///<per member, NAN where a member has no value
+  bool compensated;               ///<EC members are compensated with the temperature member's value
+};
+
+class FusionListener
+{
+public:
+  virtual ~FusionListener() {}
+
+  /*!
+   * @fn fused
+   * @brief Called on the ingest thread for every record, in grid order per group
+   */
+  virtual void fused(const FusedRecord& record) = 0;
+};
+
+class SensorFusion : public ReadingSink
+{
+public:
+  /*!
+   * @fn SensorFusion
+   * @brief Group the sensors of every device that has more than one
+   * @param stepUs  Grid step, 0 to fuse nothing
+   */
+  SensorFusion(const DeviceMap& map, const CalibrationRegistry& calibrations, int64_t stepUs);
+
+  /*!
+   * @fn listen
+   * @brief Also hand each record to listener, call before ingest starts
+   */
+  void listen(FusionListener* listener) { this->_listeners.push_back(listener); }
+
+  virtual void push(const Reading* readings, size_t count);
+
+  int64_t step() const { return this->_step; }
+  size_t groupCount() const { return this->_groups.size(); }
+  const FusionGroup& group(uint32_t index) const { return this->_groups[index].info; }
+
+  /*!
+   * @fn records
+   * @brief Kept records of a group with from <= timestamp < to, oldest first
+   * @param values  Receives the member values of each record one after the other
+   * @return Number of records
+   */
+  size_t records(uint32_t group, int64_t from, int64_t to, std::vector<int64_t>& timestamps,
+                 std::vector<float>& values, std::vector<uint8_t>& compensated) const;
+
+private:
+  struct Track {
+    int64_t timestamp;            ///<of the last reading, 0 before the first
+    float value;
+    float raw;
+    int64_t slot[FUSION_SLOTS];   ///<grid index held by each slot (index % FUSION_SLOTS), -1 if none
+    float slotValue[FUSION_SLOTS];
+    float slotRaw[FUSION_SLOTS];
+  };
+
+  struct Group {
+    FusionGroup info;
+    int64_t next;                 ///<grid index to emit next, 0 before the first reading
+    // history ring, guarded by _mutex
+    std::vector<int64_t> timestamps;
+    std::vector<float> values;
+    std::vector<uint8_t> compensated;
+    size_t head;
+    size_t count;
+  };
+
+  const DeviceMap& _map;
+  const CalibrationRegistry& _calibrations;
+  int64_t _step;
+  int64_t _clock;                 ///<newest reading time seen, drives the watermark
+  int64_t _sweep;                 ///<when to advance the groups that got no readings
+  std::vector<Group> _groups;
+  std::vector<int32_t> _groupOf;  ///<per sensor, -1 if not fused
+  std::vector<Track> _tracks;     ///<per sensor
+  std::vector<float> _row;
+  std::vector<float> _raw;
+  std::vector<FusionListener*> _listeners;
+  mutable std::mutex _mutex;
+
+private:
+  void resample(Track& t, const Reading& r, int64_t next);
+  void advance(uint32_t index);
+  bool fill(Group& g, int64_t index);
+  void emit(uint32_t index, int64_t timestamp, bool compensated);
+};
+
+#endif
@@ -0,0 +1,340 @@
+/*!
+ * @file SerialGateway.cpp
+ * @brief Define the basic structure of class SerialGateway
+ * @details Reads all devices of a DeviceMap from one epoll loop.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "SerialGateway.h"
+#include "Log.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <termios.h>
+#include <unistd.h>
+
+#define WAKE_TAG  UINT64_MAX
+
+static int64_t monotonicMillis()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (int64_t)ts.tv_sec*1000 + ts.tv_nsec/1000000;
+}
+
+static speed_t baudConstant(int baud)
+{
+  switch(baud){
+    case 9600:   return B9600;
+    case 19200:  return B19200;
+    case 38400:  return B38400;
+    case 57600:  return B57600;
+    case 230400: return B230400;
+    case 460800: return B460800;
+    case 921600: return B921600;
+  }
+  return B115200;
+}
+
+SerialGateway::SerialGateway(const DeviceMap& map, ReadingSink& sink, int baud)
+  : _map(map)
+{
+  this->_sink = &sink;
+  this->_chunks = NULL;
+  this->_acks = NULL;
+  this->_shard = 0;
+  this->_shards = 1;
+  this->_baud = baud;
+  this->_epoll = -1;
+  this->_wake = -1;
+  this->_running = false;
+  this->_current = 0;
+  this->_now = 0;
+  this->_reopenCheck = 0;
+  this->_ackCheck = 0;
+}
+
+SerialGateway::SerialGateway(const DeviceMap& map, ChunkSink& chunks, int baud, uint32_t shard, uint32_t shards)
+  : _map(map)
+{
+  this->_sink = NULL;
+  this->_chunks = &chunks;
+  this->_acks = NULL;
+  this->_shard = shard;
+  this->_shards = shards;
+  this->_baud = baud;
+  this->_epoll = -1;
+  this->_wake = -1;
+  this->_running = false;
+  this->_current = 0;
+  this->_now = 0;
+  this->_reopenCheck = 0;
+  this->_ackCheck = 0;
+}
+
+SerialGateway::~SerialGateway()
+{
+  for(uint32_t i = 0; i < this->_devices.size(); i++) closeDevice(i);
+  if(this->_wake >= 0) close(this->_wake);
+  if(this->_epoll >= 0) close(this->_epoll);
+}
+
+bool SerialGateway::begin()
+{
+  this->_epoll = epoll_create1(EPOLL_CLOEXEC);
+  this->_wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  if(this->_epoll < 0 || this->_wake < 0){
+    LOG("epoll setup failed: %s", strerror(errno));
+    return false;
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.u64 = WAKE_TAG;
+  epoll_ctl(this->_epoll, EPOLL_CTL_ADD, this->_wake, &ev);
+
+  const std::vector<std::string>& paths = this->_map.devices();
+  this->_devices.resize(paths.size());
+  for(uint32_t i = 0; i < paths.size(); i++){
+    Device& d = this->_devices[i];
+    d.path = paths[i];
+    d.fd = -1;
+    d.reopenAt = 0;
+    memset(&d.counters, 0, sizeof(d.counters));
+    if(i % this->_shards != this->_shard)
+      d.reopenAt = INT64_MAX;                            // another reader's device
+    else if(!openDevice(i)) d.reopenAt = monotonicMillis() + GATEWAY_REOPEN_DELAY_MS;
+  }
+  this->_readings.reserve(1024);
+  this->_running = true;                                 // here, not in run(): a stop() before run() must hold
+  return true;
+}
+
+bool SerialGateway::openDevice(uint32_t index)
+{
+  Device& d = this->_devices[index];
+  int fd = open(d.path.c_str(), O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+  if(fd < 0){
+    DBG("%s: %s", d.path.c_str(), strerror(errno));
+    return false;
+  }
+  struct termios tio;
+  if(tcgetattr(fd, &tio) == 0){                          // not a tty (e.g. a fifo in tests): use as is
+    cfmakeraw(&tio);
+    cfsetispeed(&tio, baudConstant(this->_baud));
+    cfsetospeed(&tio, baudConstant(this->_baud));
+    tio.c_cflag |= CLOCAL | CREAD;
+    tio.c_cc[VMIN] = 1;
+    tio.c_cc[VTIME] = 0;
+    tcsetattr(fd, TCSANOW, &tio);
+  }
+  struct epoll_event ev;
+  ev.events = EPOLLIN | EPOLLRDHUP;
+  ev.data.u64 = index;
+  if(epoll_ctl(this->_epoll, EPOLL_CTL_ADD, fd, &ev) < 0){
+    LOG("%s: epoll_ctl: %s", d.path.c_str(), strerror(errno));
+    close(fd);
+    return false;
+  }
+  d.fd = fd;
+  d.reopenAt = 0;
+  d.decoder.reset();
+  size_t capacity;
+  if(this->_chunks && this->_chunks->acquire(&capacity))
+    this->_chunks->commit(index, 0, nowMicros());
+  LOG("%s opened", d.path.c_str());
+  return true;
+}
+
+void SerialGateway::closeDevice(uint32_t index)
+{
+  Device& d = this->_devices[index];
+  if(d.fd < 0) return;
+  epoll_ctl(this->_epoll, EPOLL_CTL_DEL, d.fd, NULL);
+  close(d.fd);
+  d.fd = -1;
+  d.reopenAt = monotonicMillis() + GATEWAY_REOPEN_DELAY_MS;
+  d.counters.reopens++;
+  LOG("%s closed, reopening in %d ms", d.path.c_str(), GATEWAY_REOPEN_DELAY_MS);
+}
+
+void SerialGateway::reopenDevices()
+{
+  int64_t now = monotonicMillis();
+  if(now < this->_reopenCheck) return;
+  this->_reopenCheck = now + GATEWAY_REOPEN_DELAY_MS/4;
+  for(uint32_t i = 0; i < this->_devices.size(); i++){
+    Device& d = this->_devices[i];
+    if(d.fd < 0 && d.reopenAt <= now && !openDevice(i))
+      d.reopenAt = now + GATEWAY_REOPEN_DELAY_MS;
+  }
+}
+
+void SerialGateway::readDevice(uint32_t index)
+{
+  Device& d = this->_devices[index];
+  if(this->_chunks){
+    readChunks(index);
+    return;
+  }
+  uint8_t buf[GATEWAY_READ_SIZE];
+  this->_current = index;
+  for(int i = 0; i < GATEWAY_MAX_READS; i++){
+    ssize_t n = read(d.fd, buf, sizeof(buf));
+    if(n > 0){
+      this->_now = nowMicros();
+      d.counters.bytes += n;
+      d.decoder.feed(buf, n, *this);
+      if(n < (ssize_t)sizeof(buf)) return;               // drained
+      continue;
+    }
+    if(n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    closeDevice(index);                                  // EOF or EIO: the other end went away
+    return;
+  }
+}
+
+void SerialGateway::readChunks(uint32_t index)
+{
+  Device& d = this->_devices[index];
+  for(int i = 0; i < GATEWAY_MAX_READS; i++){
+    size_t capacity;
+    uint8_t* buf = this->_chunks->acquire(&capacity);
+    if(buf == NULL) return;                              // stopping
+    ssize_t n = read(d.fd, buf, capacity);
+    if(n > 0){
+      d.counters.bytes += n;
+      this->_chunks->commit(index, n, nowMicros());
+      if(n < (ssize_t)capacity) return;
+      continue;
+    }
+    if(n < 0 && (errno == EAGAIN || errno == EINTR)) return;
+    closeDevice(index);
+    return;
+  }
+}
+
+void SerialGateway::push(uint8_t channel, uint8_t quantity, float value, int64_t timestamp, uint8_t epoch,
+                         uint32_t sequence)
+{
+  Device& d = this->_devices[this->_current];
+  int32_t sensor = this->_map.lookup(this->_current, channel, quantity);
+  if(sensor == SENSOR_UNMAPPED){
+    d.counters.unmapped++;
+    return;
+  }
+  d.counters.readings++;
+  Reading r;
+  r.sensor = sensor;
+  r.quantity = quantity;
+  r.epoch = epoch;
+  r.value = value;
+  r.timestamp = timestamp;
+  r.raw = value;
+  r.temperature = NAN;
+  r.calibration = 0;
+  r.sequence = sequence;
+  this->_readings.push_back(r);
+}
+
+void SerialGateway::reading(uint8_t channel, uint8_t quantity, float value)
+{
+  push(channel, quantity, value, this->_now, 0, 0);
+}
+
+void SerialGateway::sequenced(uint8_t epoch, uint32_t sequence, uint32_t age, uint8_t channel, uint8_t quantity,
+                              float value)
+{
+  push(channel, quantity, value, this->_now - (int64_t)age*1000, epoch, sequence);
+}
+
+void SerialGateway::discarded(uint8_t epoch, uint32_t sequence)
+{
+  if(this->_acks) this->_acks->discard(this->_current, epoch, sequence);
+}
+
+void SerialGateway::sendAcks()
+{
+  int64_t now = monotonicMillis();
+  if(this->_acks == NULL || now < this->_ackCheck) return;
+  this->_ackCheck = now + GATEWAY_ACK_MS;
+  uint8_t buf[256];
+  for(uint32_t i = this->_shard; i < this->_devices.size(); i += this->_shards){
+    Device& d = this->_devices[i];
+    if(d.fd < 0) continue;
+    size_t n = this->_acks->acks(i, buf, sizeof(buf));
+    // a full TX queue drops the acks, the device sends the readings again and gets them once more
+    if(n && write(d.fd, buf, n) < 0 && errno != EAGAIN){
+      DBG("%s: %s", d.path.c_str(), strerror(errno));
+    }
+  }
+}
+
+void SerialGateway::stats(uint8_t channel, uint8_t quantity, uint8_t window, uint32_t count,
+                          float mean, float stddev, float min, float max)
+{
+  int32_t sensor = this->_map.lookup(this->_current, channel, quantity);
+  if(sensor == SENSOR_UNMAPPED) return;
+  WindowStats s;
+  s.sensor = sensor;
+  s.quantity = quantity;
+  s.window = window;
+  s.count = count;
+  s.mean = mean;
+  s.stddev = stddev;
+  s.min = min;
+  s.max = max;
+  s.timestamp = this->_now;
+  this->_stats.push_back(s);
+}
+
+size_t SerialGateway::poll(int timeoutMs)
+{
+  struct epoll_event events[256];
+  int n = epoll_wait(this->_epoll, events, 256, timeoutMs);
+  if(n < 0 && errno != EINTR){
+    LOG("epoll_wait: %s", strerror(errno));
+    return 0;
+  }
+  for(int i = 0; i < n; i++){
+    if(events[i].data.u64 == WAKE_TAG){
+      uint64_t v;
+      if(read(this->_wake, &v, sizeof(v)) < 0) {}       // just drain it
+      continue;
+    }
+    uint32_t index = (uint32_t)events[i].data.u64;
+    if(this->_devices[index].fd < 0) continue;           // closed earlier in this round
+    if(events[i].events & EPOLLIN)
+      readDevice(index);
+    else if(events[i].events & (EPOLLHUP | EPOLLERR | EPOLLRDHUP))
+      closeDevice(index);
+  }
+  size_t pushed = this->_readings.size();
+  if(pushed){
+    this->_sink->push(this->_readings.data(), pushed);
+    this->_readings.clear();
+  }
+  if(!this->_stats.empty()){
+    this->_sink->pushStats(this->_stats.data(), this->_stats.size());
+    this->_stats.clear();
+  }
+  return pushed;
+}
+
+void SerialGateway::run()
+{
+  while(this->_running){
+    poll(this->_acks ? GATEWAY_ACK_MS : GATEWAY_REOPEN_DELAY_MS);
+    reopenDevices();
+    sendAcks();
+  }
+}
+
+void SerialGateway::stop()
+{
+  this->_running = false;
+  uint64_t one = 1;
+  if(write(this->_wake, &one, sizeof(one)) < 0) {}       // async-signal-safe wake up
+}
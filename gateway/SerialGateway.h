@@ -0,0 +1,184 @@
+/*!
+ * @file SerialGateway.h
+ * @brief Define the basic structure of class SerialGateway
+ * @details Reads all devices of a DeviceMap from one epoll loop. Every device is a serial port or pty opened
+ * @n non-blocking in raw mode; its bytes go through its own FrameDecoder, decoded readings are mapped to
+ * @n sensors and handed to the ReadingSink once per loop round, so the sink sees batches, not single readings.
+ * @n Devices that disappear (EOF, EIO, unplugged USB adapter) are closed and reopened every second.
+ * @n Acknowledgements (AckSource) are written back to the devices from the same loop.
+ * @n In raw mode (Pipeline) the gateway only reads a shard of the devices and hands the undecoded bytes to a
+ * @n ChunkSink; decoding then runs on other threads.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_SERIALGATEWAY_H_
+#define _GATEWAY_SERIALGATEWAY_H_
+
+#include "DeviceMap.h"
+#include "FrameDecoder.h"
+#include "Reading.h"
+
+#include <atomic>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+#define GATEWAY_READ_SIZE       4096   ///<bytes read per read() call
+#define GATEWAY_MAX_READS       16     ///<read() calls per device and loop round, keeps busy devices from starving others
+#define GATEWAY_REOPEN_DELAY_MS 1000
+#define GATEWAY_ACK_MS          100    ///<how often pending acknowledgements are sent to the devices
+
+struct DeviceCounters {
+  uint64_t bytes;
+  uint64_t readings;
+  uint64_t unmapped;      ///<readings without a DeviceMap entry
+  uint32_t reopens;
+};
+
+/*!
+ * @brief Consumer of raw device bytes, lets read() fill the consumer's buffer directly
+ */
+class ChunkSink
+{
+public:
+  virtual ~ChunkSink() {}
+
+  /*!
+   * @fn acquire
+   * @brief Get the buffer for the next read(), may block while the consumer is behind
+   * @param capacity  Receives the buffer size
+   * @return NULL if the gateway is stopping
+   */
+  virtual uint8_t* acquire(size_t* capacity) = 0;
+
+  /*!
+   * @fn commit
+   * @brief Hand over the buffer of the last acquire()
+   * @param length  Bytes read, 0 tells that the device was reopened and its decoder must be reset
+   */
+  virtual void commit(uint32_t device, size_t length, int64_t timestamp) = 0;
+};
+
+/*!
+ * @brief Frames to send back to the devices, the acknowledgements of Delivery
+ */
+class AckSource
+{
+public:
+  virtual ~AckSource() {}
+
+  /*!
+   * @fn acks
+   * @brief Take the frames due for a device, called from the thread that reads it
+   * @param buf  Receives whole frames only, the rest stays due
+   * @return Bytes written to buf
+   */
+  virtual size_t acks(uint32_t device, uint8_t* buf, size_t capacity) = 0;
+
+  /*!
+   * @fn discard
+   * @brief Acknowledge a sequenced reading the reader dropped, called from the thread that reads the device
+   */
+  virtual void discard(uint32_t device, uint8_t epoch, uint32_t sequence) = 0;
+};
+
+class SerialGateway : private FrameHandler
+{
+public:
+  /*!
+   * @fn SerialGateway
+   * @brief Constructor
+   * @param map  Devices and sensors, must outlive the gateway
+   * @param sink  Receives the readings, called from the thread that runs run()
+   * @param baud  Baud rate set on real serial ports, ignored for ptys
+   */
+  SerialGateway(const DeviceMap& map, ReadingSink& sink, int baud = 115200);
+
+  /*!
+   * @fn SerialGateway
+   * @brief Constructor for raw mode
+   * @param chunks  Receives the bytes read, called from the thread that runs run()
+   * @param shard  Only devices with index % shards == shard are opened
+   */
+  SerialGateway(const DeviceMap& map, ChunkSink& chunks, int baud, uint32_t shard, uint32_t shards);
+  ~SerialGateway();
+
+  /*!
+   * @fn begin
+   * @brief Create the epoll instance and open all devices, devices that can't be opened are retried later
+   * @return false if epoll could not be set up
+   */
+  bool begin();
+
+  /*!
+   * @fn acknowledge
+   * @brief Write the frames acks has due to the devices every GATEWAY_ACK_MS, call before begin()
+   */
+  void acknowledge(AckSource* acks) { this->_acks = acks; }
+
+  /*!
+   * @fn run
+   * @brief Loop until stop() is called
+   */
+  void run();
+
+  /*!
+   * @fn poll
+   * @brief One loop round: wait up to timeoutMs for data, decode it and push the readings
+   * @return Number of readings pushed
+   */
+  size_t poll(int timeoutMs);
+
+  /*!
+   * @fn stop
+   * @brief Make run() return, safe to call from a signal handler or another thread
+   */
+  void stop();
+
+  const DeviceCounters& counters(uint32_t device) const { return this->_devices[device].counters; }
+  const DecoderCounters& decoderCounters(uint32_t device) const { return this->_devices[device].decoder.counters(); }
+
+private:
+  struct Device {
+    std::string path;
+    int fd;
+    int64_t reopenAt;     ///<monotonic ms, 0 if open
+    FrameDecoder decoder;
+    DeviceCounters counters;
+  };
+
+  const DeviceMap& _map;
+  ReadingSink* _sink;
+  ChunkSink* _chunks;
+  AckSource* _acks;
+  uint32_t _shard;
+  uint32_t _shards;
+  int _baud;
+  int _epoll;
+  int _wake;              ///<eventfd written by stop()
+  std::atomic<bool> _running;
+  std::vector<Device> _devices;
+  std::vector<Reading> _readings;
+  std::vector<WindowStats> _stats;
+  uint32_t _current;      ///<device being decoded
+  int64_t _now;           ///<receive time of the bytes being decoded
+  int64_t _reopenCheck;   ///<monotonic ms of the next reopenDevices() pass
+  int64_t _ackCheck;      ///<monotonic ms of the next sendAcks() pass
+
+private:
+  bool openDevice(uint32_t index);
+  void closeDevice(uint32_t index);
+  void readDevice(uint32_t index);
+  void readChunks(uint32_t index);
+  void reopenDevices();
+  void sendAcks();
+  void push(uint8_t channel, uint8_t quantity, float value, int64_t timestamp, uint8_t epoch, uint32_t sequence);
+  virtual void reading(uint8_t channel, uint8_t quantity, float value);
+  virtual void sequenced(uint8_t epoch, uint32_t sequence, uint32_t age, uint8_t channel, uint8_t quantity,
+                         float value);
+  virtual void discarded(uint8_t epoch, uint32_t sequence);
+  virtual void stats(uint8_t channel, uint8_t quantity, uint8_t window, uint32_t count,
+                     float mean, float stddev, float min, float max);
+};
+
+#endif
@@ -0,0 +1,292 @@
+/*!
+ * @file SeriesCodec.cpp
+ * @brief Compression of the columns of sealed store segments
+ * @details Bit writer/reader and the timestamp, float and version stream codecs.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "SeriesCodec.h"
+
+#include <string.h>
+
+#define CODEC_RING   16           ///<earlier values a float can refer to
+
+/*!
+ * @brief Appends bits to a byte vector, most significant first
+ */
+class BitWriter
+{
+public:
+  BitWriter(std::vector<uint8_t>& out) : _out(out), _acc(0), _bits(0) {}
+
+  /*!
+   * @fn put
+   * @brief Append the low n bits of value, n <= 32
+   */
+  void put(uint64_t value, unsigned n)
+  {
+    this->_acc = (this->_acc << n) | (value & ((1ull << n) - 1));
+    this->_bits += n;
+    while(this->_bits >= 8){
+      this->_bits -= 8;
+      this->_out.push_back((uint8_t)(this->_acc >> this->_bits));
+    }
+  }
+
+  void flush()
+  {
+    if(this->_bits) this->_out.push_back((uint8_t)(this->_acc << (8 - this->_bits)));
+    this->_bits = 0;
+  }
+
+private:
+  std::vector<uint8_t>& _out;
+  uint64_t _acc;                        ///<the low _bits are pending
+  unsigned _bits;
+};
+
+/*!
+ * @brief Reads what BitWriter wrote; past the end it reads zeros
+ */
+class BitReader
+{
+public:
+  BitReader(const uint8_t* data, size_t bytes) : _p(data), _end(data + bytes), _buf(0), _avail(0) {}
+
+  /*!
+   * @fn fill
+   * @brief Make at least 56 bits available to peek() and skip()
+   */
+  inline void fill()
+  {
+    if(this->_avail < 56) refill();
+  }
+
+  /*!
+   * @fn peek
+   * @brief The next n bits without taking them, 1 <= n <= 32, after fill()
+   */
+  inline uint32_t peek(unsigned n) const { return (uint32_t)(this->_buf >> (64 - n)); }
+
+  inline void skip(unsigned n)
+  {
+    this->_buf <<= n;
+    this->_avail -= n;
+  }
+
+  /*!
+   * @fn get
+   * @brief Next n bits, 1 <= n <= 32
+   */
+  inline uint32_t get(unsigned n)
+  {
+    if(this->_avail < n) refill();
+    uint32_t value = peek(n);
+    skip(n);
+    return value;
+  }
+
+private:
+  const uint8_t* _p;
+  const uint8_t* _end;
+  uint64_t _buf;                        ///<the next _avail bits, most significant first
+  unsigned _avail;
+
+private:
+  void refill()
+  {
+    if(this->_end - this->_p >= 8){
+      // whole bytes that fit are added; a byte that only partly fits is read again next time
+      uint64_t word;
+      memcpy(&word, this->_p, sizeof(word));
+      this->_buf |= __builtin_bswap64(word) >> this->_avail;
+      this->_p += (63 - this->_avail) >> 3;
+      this->_avail |= 56;
+      return;
+    }
+    while(this->_avail <= 56){
+      uint64_t byte = this->_p < this->_end ? *this->_p++ : 0;
+      this->_buf |= byte << (56 - this->_avail);
+      this->_avail += 8;
+    }
+  }
+};
+
+void encodeTimestamps(const int64_t* t, size_t n, std::vector<uint8_t>& out)
+{
+  BitWriter w(out);
+  uint64_t delta = 0;
+  for(size_t i = 1; i < n; i++){
+    uint64_t d = (uint64_t)t[i] - (uint64_t)t[i-1];
+    int64_t dod = (int64_t)(d - delta);
+    delta = d;
+    uint64_t z = ((uint64_t)dod << 1) ^ (uint64_t)(dod >> 63);
+    if(z == 0){
+      w.put(0, 1);
+    }else if(z < (1u << 8)){
+      w.put(0x2, 2);
+      w.put(z, 8);
+    }else if(z < (1u << 16)){
+      w.put(0x6, 3);
+      w.put(z, 16);
+    }else if(z < (1u << 24)){
+      w.put(0xe, 4);
+      w.put(z, 24);
+    }else{
+      w.put(0xf, 4);
+      w.put(z >> 32, 32);
+      w.put(z, 32);
+    }
+  }
+  w.flush();
+}
+
+/*!
+ * @brief Length of prefix and payload and payload mask by the first 4 bits of a dod, bits 0 for '1111'
+ */
+struct TimestampCode {
+  uint8_t bits;
+  uint32_t mask;
+};
+
+static const TimestampCode timestampCodes[16] = {
+  {1, 0}, {1, 0}, {1, 0}, {1, 0}, {1, 0}, {1, 0}, {1, 0}, {1, 0},
+  {10, 0xff}, {10, 0xff}, {10, 0xff}, {10, 0xff}, {19, 0xffff}, {19, 0xffff}, {28, 0xffffff}, {0, 0}
+};
+
+void decodeTimestamps(const uint8_t* data, size_t bytes, int64_t first, size_t n, int64_t* t)
+{
+  if(n == 0) return;
+  BitReader r(data, bytes);
+  uint64_t at = first, delta = 0;
+  t[0] = first;
+  for(size_t i = 1; i < n; i++){
+    // the prefix and a payload of up to 24 bits are in the 56 bits after fill(); a table instead of branches,
+    // jitter makes the bucket of the next dod hard to predict
+    r.fill();
+    uint64_t z;
+    const TimestampCode& code = timestampCodes[r.peek(4)];
+    if(code.bits){
+      z = r.peek(code.bits) & code.mask;
+      r.skip(code.bits);
+    }else{
+      r.skip(4);
+      z = (uint64_t)r.get(32) << 32;
+      z |= r.get(32);
+    }
+    delta += (z >> 1) ^ (0 - (z & 1));
+    at += delta;
+    t[i] = (int64_t)at;
+  }
+}
+
+static inline uint32_t floatBits(float f)
+{
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+void encodeFloats(const float* v, size_t n, std::vector<uint8_t>& out)
+{
+  if(n == 0) return;
+  BitWriter w(out);
+  uint32_t ring[CODEC_RING] = {0};
+  uint32_t prev = floatBits(v[0]);
+  unsigned pos = 1, windowLead = 0, windowTrail = 0;
+  ring[0] = prev;
+  w.put(prev, 32);
+  for(size_t i = 1; i < n; i++){
+    uint32_t x = floatBits(v[i]);
+    if(x == prev){
+      w.put(0, 1);
+      continue;
+    }
+    unsigned k = 0;
+    while(k < CODEC_RING && ring[k] != x) k++;
+    if(k < CODEC_RING){
+      w.put(0x2, 2);
+      w.put(k, 4);
+    }else{
+      uint32_t xor_ = x ^ prev;
+      unsigned lead = __builtin_clz(xor_), trail = __builtin_ctz(xor_);
+      unsigned length = 32 - lead - trail;
+      unsigned window = 32 - windowLead - windowTrail;
+      if(lead >= windowLead && trail >= windowTrail && window <= length + 10){
+        w.put(0x6, 3);
+        w.put(xor_ >> windowTrail, window);
+      }else{
+        w.put(0x7, 3);
+        w.put(lead, 5);
+        w.put(length - 1, 5);
+        w.put(xor_ >> trail, length);
+        windowLead = lead;
+        windowTrail = trail;
+      }
+    }
+    ring[pos++ % CODEC_RING] = x;
+    prev = x;
+  }
+  w.flush();
+}
+
+void decodeFloats(const uint8_t* data, size_t bytes, size_t n, float* v)
+{
+  if(n == 0) return;
+  BitReader r(data, bytes);
+  uint32_t ring[CODEC_RING] = {0};
+  uint32_t prev = r.get(32);
+  unsigned pos = 1, windowLead = 0, windowTrail = 0;
+  ring[0] = prev;
+  memcpy(&v[0], &prev, sizeof(prev));
+  for(size_t i = 1; i < n; i++){
+    uint32_t x = prev;
+    r.fill();
+    uint32_t head = r.peek(3);
+    if(head < 0x4){
+      r.skip(1);
+    }else{
+      if(head < 0x6){
+        x = ring[r.peek(6) & 0xf];
+        r.skip(6);
+      }else if(head == 0x6){
+        r.skip(3);
+        x = prev ^ (r.get(32 - windowLead - windowTrail) << windowTrail);
+      }else{
+        windowLead = r.peek(8) & 0x1f;
+        unsigned length = (r.peek(13) & 0x1f) + 1;
+        r.skip(13);
+        if(windowLead + length > 32) length = 32 - windowLead;    // damaged stream
+        windowTrail = 32 - windowLead - length;
+        x = prev ^ (r.get(length) << windowTrail);
+      }
+      ring[pos++ % CODEC_RING] = x;
+      prev = x;
+    }
+    memcpy(&v[i], &x, sizeof(x));
+  }
+}
+
+void encodeVersions(const uint16_t* v, size_t n, std::vector<uint8_t>& out)
+{
+  if(n == 0) return;
+  BitWriter w(out);
+  w.put(v[0], 16);
+  for(size_t i = 1; i < n; i++){
+    if(v[i] == v[i-1]){
+      w.put(0, 1);
+    }else{
+      w.put(1, 1);
+      w.put(v[i], 16);
+    }
+  }
+  w.flush();
+}
+
+void decodeVersions(const uint8_t* data, size_t bytes, size_t n, uint16_t* v)
+{
+  if(n == 0) return;
+  BitReader r(data, bytes);
+  v[0] = r.get(16);
+  for(size_t i = 1; i < n; i++) v[i] = r.get(1) ? r.get(16) : v[i-1];
+}
@@ -0,0 +1,43 @@
+/*!
+ * @file SeriesCodec.h
+ * @brief Compression of the columns of sealed store segments
+ * @details Sensor series are sampled at a near regular interval and change slowly, so ColumnStore packs a
+ * @n segment once it is full, column by column into bit streams:
+ * @n   timestamps: delta-of-delta (Gorilla); a dod of 0 costs one bit, receipt jitter of a few ms 19 bits
+ * @n                 '0' | '10' + 8 bits | '110' + 16 bits | '1110' + 24 bits | '1111' + 64 bits (zigzag)
+ * @n   floats:     the previous value again '0', one of the 16 values before it '10' + 4 bits (Chimp128 style,
+ * @n                 a quantized reading flickers between a few values), else XOR with the previous value
+ * @n                 (Gorilla): '110' + the bits inside the last leading/trailing zero window, or '111' + 5 bits
+ * @n                 leading zeros + 5 bits length + the meaningful bits
+ * @n   versions:   '0' unchanged, '1' + 16 bits
+ * @n Streams are byte aligned, decoders read at most bytes and return zeros past them, so a damaged stream
+ * @n gives wrong rows but never reads out of bounds.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_SERIESCODEC_H_
+#define _GATEWAY_SERIESCODEC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+/*!
+ * @fn encodeTimestamps
+ * @brief Append t[1..n) to out, t[0] is kept by the caller
+ */
+void encodeTimestamps(const int64_t* t, size_t n, std::vector<uint8_t>& out);
+
+/*!
+ * @fn decodeTimestamps
+ * @brief Decode n timestamps starting with first
+ */
+void decodeTimestamps(const uint8_t* data, size_t bytes, int64_t first, size_t n, int64_t* t);
+
+void encodeFloats(const float* v, size_t n, std::vector<uint8_t>& out);
+void decodeFloats(const uint8_t* data, size_t bytes, size_t n, float* v);
+
+void encodeVersions(const uint16_t* v, size_t n, std::vector<uint8_t>& out);
+void decodeVersions(const uint8_t* data, size_t bytes, size_t n, uint16_t* v);
+
+#endif
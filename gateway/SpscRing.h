@@ -0,0 +1,123 @@
+/*!
+ * @file SpscRing.h
+ * @brief Define the basic structure of class SpscRing
+ * @details Bounded lock-free ring between exactly one producer thread and one consumer thread.
+ * @n Head and tail live on their own cache lines, and each side keeps a cached copy of the other side's
+ * @n index, so in steady state a push or pop touches no cache line written by the other thread.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_SPSCRING_H_
+#define _GATEWAY_SPSCRING_H_
+
+#include <atomic>
+#include <stddef.h>
+#include <vector>
+
+#define CACHE_LINE 64
+
+template <typename T>
+class SpscRing
+{
+public:
+  /*!
+   * @fn SpscRing
+   * @brief Constructor
+   * @param capacity  Rounded up to a power of two
+   */
+  explicit SpscRing(size_t capacity)
+  {
+    size_t size = 2;
+    while(size < capacity) size <<= 1;
+    this->_slots.resize(size);
+    this->_mask = size - 1;
+    this->_head.store(0, std::memory_order_relaxed);
+    this->_tail.store(0, std::memory_order_relaxed);
+    this->_cachedHead = 0;
+    this->_cachedTail = 0;
+  }
+
+  /*!
+   * @fn slot
+   * @brief Producer: get the next free slot to fill in place, commit it with publish()
+   * @return NULL if the ring is full
+   */
+  T* slot()
+  {
+    size_t tail = this->_tail.load(std::memory_order_relaxed);
+    if(tail - this->_cachedHead > this->_mask){
+      this->_cachedHead = this->_head.load(std::memory_order_acquire);
+      if(tail - this->_cachedHead > this->_mask) return NULL;
+    }
+    return &this->_slots[tail & this->_mask];
+  }
+
+  /*!
+   * @fn publish
+   * @brief Producer: make the slot returned by slot() visible to the consumer
+   */
+  void publish()
+  {
+    this->_tail.store(this->_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /*!
+   * @fn push
+   * @brief Producer: copy one item in
+   * @return false if the ring is full
+   */
+  bool push(const T& item)
+  {
+    T* s = slot();
+    if(s == NULL) return false;
+    *s = item;
+    publish();
+    return true;
+  }
+
+  /*!
+   * @fn front
+   * @brief Consumer: get the oldest item without removing it, release it with pop()
+   * @return NULL if the ring is empty
+   */
+  T* front()
+  {
+    size_t head = this->_head.load(std::memory_order_relaxed);
+    if(head == this->_cachedTail){
+      this->_cachedTail = this->_tail.load(std::memory_order_acquire);
+      if(head == this->_cachedTail) return NULL;
+    }
+    return &this->_slots[head & this->_mask];
+  }
+
+  /*!
+   * @fn pop
+   * @brief Consumer: release the item returned by front()
+   */
+  void pop()
+  {
+    this->_head.store(this->_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  }
+
+  /*!
+   * @fn size
+   * @brief Approximate number of queued items, for statistics from any thread
+   */
+  size_t size() const
+  {
+    return this->_tail.load(std::memory_order_relaxed) - this->_head.load(std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return this->_mask + 1; }
+
+private:
+  std::vector<T> _slots;
+  size_t _mask;
+  alignas(CACHE_LINE) std::atomic<size_t> _head;   ///<written by the consumer
+  size_t _cachedTail;                              ///<consumer's copy of _tail
+  alignas(CACHE_LINE) std::atomic<size_t> _tail;   ///<written by the producer
+  size_t _cachedHead;                              ///<producer's copy of _head
+  char _pad[CACHE_LINE - sizeof(size_t)];
+};
+
+#endif
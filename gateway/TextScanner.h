@@ -0,0 +1,121 @@
+/*!
+ * @file TextScanner.h
+ * @brief Scanning helpers of FrameDecoder for the text format, working in place on read buffers
+ * @details findDelimiter() looks for the end of a text record ('\n' or the start of a binary frame) 16 bytes
+ * @n at a time with SSE2 or NEON, falling back to a byte loop elsewhere.
+ * @n parseDecimal() parses the numbers the sketches print (Print::print(float), at most a few digits) with
+ * @n Clinger's fast path: a mantissa up to 2^24 and a power of ten up to 10^10 are both exact floats, so one
+ * @n float multiply or divide gives the correctly rounded result. Anything longer goes through strtof().
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_TEXTSCANNER_H_
+#define _GATEWAY_TEXTSCANNER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+#define SCAN_DELIMITER     '\n'
+#define SCAN_FRAME_START   0xA5       ///<FRAME_SYNC1, a binary frame cuts a text line off
+#define SCAN_MAX_NUMBER    48         ///<longest number handed to the strtof() fallback
+
+/*!
+ * @fn findDelimiter
+ * @brief Index of the first '\n' or 0xA5 in data
+ * @return length if there is none
+ */
+inline size_t findDelimiter(const uint8_t* data, size_t length)
+{
+  size_t i = 0;
+#if defined(__SSE2__)
+  const __m128i nl = _mm_set1_epi8(SCAN_DELIMITER);
+  const __m128i sync = _mm_set1_epi8((char)SCAN_FRAME_START);
+  for(; i + 16 <= length; i += 16){
+    __m128i v = _mm_loadu_si128((const __m128i*)(data + i));
+    int mask = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(v, nl), _mm_cmpeq_epi8(v, sync)));
+    if(mask) return i + __builtin_ctz(mask);
+  }
+#elif defined(__ARM_NEON)
+  const uint8x16_t nl = vdupq_n_u8(SCAN_DELIMITER);
+  const uint8x16_t sync = vdupq_n_u8(SCAN_FRAME_START);
+  for(; i + 16 <= length; i += 16){
+    uint8x16_t v = vld1q_u8(data + i);
+    uint8x16_t hit = vorrq_u8(vceqq_u8(v, nl), vceqq_u8(v, sync));
+    // narrow every byte to 4 bits: a 64-bit mask with 4 bits per input byte
+    uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(hit), 4)), 0);
+    if(mask) return i + (__builtin_ctzll(mask) >> 2);
+  }
+#endif
+  for(; i < length; i++)
+    if(data[i] == SCAN_DELIMITER || data[i] == SCAN_FRAME_START) return i;
+  return length;
+}
+
+/*!
+ * @fn parseDecimal
+ * @brief Parse [spaces][+|-]digits[.digits][e[+|-]digits] like strtof(), without needing a terminating 0
+ * @param p  First character
+ * @param end  End of the buffer
+ * @param value  Receives the number
+ * @return Character after the number, NULL if p does not start with one (also for "nan" / "inf")
+ */
+inline const char* parseDecimal(const char* p, const char* end, float* value)
+{
+  static const float powersOf10[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+  while(p < end && (*p == ' ' || *p == '\t')) p++;
+  const char* number = p;
+  bool negative = false;
+  if(p < end && (*p == '-' || *p == '+')){
+    negative = *p == '-';
+    p++;
+  }
+  uint64_t mantissa = 0;
+  int digits = 0, exponent = 0;
+  for(; p < end && (unsigned)(*p - '0') < 10; p++, digits++)
+    mantissa = mantissa*10 + (*p - '0');
+  if(p < end && *p == '.'){
+    const char* fraction = ++p;
+    for(; p < end && (unsigned)(*p - '0') < 10; p++, digits++)
+      mantissa = mantissa*10 + (*p - '0');
+    exponent = -(int)(p - fraction);
+  }
+  if(digits == 0) return NULL;
+  if(p + 1 < end && (*p == 'e' || *p == 'E')){           // only an exponent with digits, "1.4ms" keeps its unit
+    const char* e = p + 1;
+    bool negativeExp = false;
+    if(e < end && (*e == '-' || *e == '+')){
+      negativeExp = *e == '-';
+      e++;
+    }
+    if(e < end && (unsigned)(*e - '0') < 10){
+      int exp = 0;
+      for(; e < end && (unsigned)(*e - '0') < 10; e++)
+        if(exp < 10000) exp = exp*10 + (*e - '0');
+      exponent += negativeExp ? -exp : exp;
+      p = e;
+    }
+  }
+  if(digits <= 19 && mantissa <= (1u << 24) && exponent >= -10 && exponent <= 10){
+    float f = (float)mantissa;
+    f = exponent < 0 ? f/powersOf10[-exponent] : f*powersOf10[exponent];
+    *value = negative ? -f : f;
+    return p;
+  }
+  char buf[SCAN_MAX_NUMBER + 1];                         // rare: long mantissa or large exponent
+  size_t length = p - number;
+  if(length > SCAN_MAX_NUMBER) return NULL;
+  memcpy(buf, number, length);
+  buf[length] = '\0';
+  *value = strtof(buf, NULL);
+  return p;
+}
+
+#endif
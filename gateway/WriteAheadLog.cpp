@@ -0,0 +1,559 @@
+/*!
+ * @file WriteAheadLog.cpp
+ * @brief Define the basic structure of class WriteAheadLog
+ * @details Segmented, CRC framed log of the readings not yet in the database, with group commit and replay.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "WriteAheadLog.h"
+#include "Log.h"
+
+#include <algorithm>
+#include <chrono>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#define WAL_X86
+#endif
+
+#define WAL_MAGIC_READINGS  0x324C4157u   ///<"WAL2"
+#define WAL_MAGIC_V1        0x314C4157u   ///<"WAL1", WAL_RECORD_SIZE_V1 byte records, still replayed
+#define WAL_RECORD_SIZE_V1  28
+#define WAL_MAGIC_SENSORS   0x534C4157u   ///<"WALS"
+
+typedef uint32_t (*CrcKernel)(uint32_t, const uint8_t*, size_t);
+
+struct CrcTable {
+  uint32_t entries[256];
+
+  CrcTable()
+  {
+    for(uint32_t i = 0; i < 256; i++){
+      uint32_t c = i;
+      for(int k = 0; k < 8; k++) c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+      this->entries[i] = c;
+    }
+  }
+};
+
+static uint32_t crc32cTable(uint32_t crc, const uint8_t* data, size_t length)
+{
+  static const CrcTable table;
+  crc = ~crc;
+  while(length--) crc = table.entries[(crc ^ *data++) & 0xFF] ^ (crc >> 8);
+  return ~crc;
+}
+
+#if defined(WAL_X86)
+__attribute__((target("sse4.2")))
+static uint32_t crc32cSse42(uint32_t crc, const uint8_t* data, size_t length)
+{
+  uint64_t c = ~crc;
+  for(; length >= 8; data += 8, length -= 8){
+    uint64_t v;
+    memcpy(&v, data, 8);
+    c = _mm_crc32_u64(c, v);
+  }
+  uint32_t c32 = (uint32_t)c;
+  while(length--) c32 = _mm_crc32_u8(c32, *data++);
+  return ~c32;
+}
+#endif
+
+static CrcKernel pickCrc()
+{
+#if defined(WAL_X86)
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("sse4.2")) return crc32cSse42;
+#endif
+  return crc32cTable;
+}
+
+uint32_t WriteAheadLog::crc32c(uint32_t crc, const uint8_t* data, size_t length)
+{
+  static const CrcKernel kernel = pickCrc();
+  return kernel(crc, data, length);
+}
+
+template <typename T>
+static inline void put(uint8_t* p, T value) { memcpy(p, &value, sizeof(T)); }
+
+template <typename T>
+static inline T get(const uint8_t* p) { T value; memcpy(&value, p, sizeof(T)); return value; }
+
+/*!
+ * @brief Record layout: created_at (8) | sensor (4) | value (4) | raw (4) | temperature (4) | calibration (2) |
+ * @n quantity (1) | epoch (1) | sequence (4); WAL1 records end before the sequence and have 0 for the epoch
+ */
+static void encode(uint8_t* p, const Reading& r)
+{
+  put<int64_t>(p, r.timestamp);
+  put<uint32_t>(p + 8, r.sensor);
+  put<float>(p + 12, r.value);
+  put<float>(p + 16, r.raw);
+  put<float>(p + 20, r.temperature);
+  put<uint16_t>(p + 24, r.calibration);
+  p[26] = r.quantity;
+  p[27] = r.epoch;
+  put<uint32_t>(p + 28, r.sequence);
+}
+
+static void decode(const uint8_t* p, size_t size, Reading& r)
+{
+  r.timestamp = get<int64_t>(p);
+  r.sensor = get<uint32_t>(p + 8);
+  r.value = get<float>(p + 12);
+  r.raw = get<float>(p + 16);
+  r.temperature = get<float>(p + 20);
+  r.calibration = get<uint16_t>(p + 24);
+  r.quantity = p[26];
+  r.epoch = p[27];
+  r.sequence = size >= WAL_RECORD_SIZE ? get<uint32_t>(p + 28) : 0;
+}
+
+static bool writeAll(int fd, const uint8_t* data, size_t length)
+{
+  while(length){
+    ssize_t n = write(fd, data, length);
+    if(n < 0){
+      if(errno == EINTR) continue;
+      return false;
+    }
+    data += n;
+    length -= n;
+  }
+  return true;
+}
+
+WriteAheadLog::WriteAheadLog(const DeviceMap& map, size_t segmentBytes)
+  : _map(map), _done(0), _replayed(0), _confirmed(0), _durable(0), _checkpoint(UINT64_MAX)
+{
+  this->_segmentBytes = segmentBytes;
+  this->_fd = -1;
+  this->_written = 0;
+  this->_replayFrom = 0;
+  this->_confirm = false;
+  this->_bufferLsn = 0;
+  this->_next = 0;
+  this->_stopping = false;
+  this->_sessionStart = 0;
+  this->_saved = 0;
+  memset(&this->_counters, 0, sizeof(this->_counters));
+}
+
+WriteAheadLog::~WriteAheadLog()
+{
+  end();
+}
+
+void WriteAheadLog::sealFrame(uint8_t* frame, uint32_t magic, uint64_t lsn, uint32_t count, size_t bytes)
+{
+  put<uint32_t>(frame, magic);
+  put<uint32_t>(frame + 4, bytes);
+  put<uint64_t>(frame + 8, lsn);
+  put<uint32_t>(frame + 16, count);
+  uint32_t crc = crc32c(0, frame, 20);
+  put<uint32_t>(frame + 20, crc32c(crc, frame + WAL_HEADER_SIZE, bytes));
+}
+
+bool WriteAheadLog::begin(const char* dir, bool confirm)
+{
+  this->_dir = dir;
+  this->_confirm = confirm;
+  if(mkdir(dir, 0755) < 0 && errno != EEXIST){
+    LOG("%s: %s", dir, strerror(errno));
+    return false;
+  }
+  FILE* f = fopen((this->_dir + "/confirmed").c_str(), "r");
+  if(f){
+    unsigned long long confirmed;
+    if(fscanf(f, "%llu", &confirmed) == 1) this->_replayFrom = confirmed;
+    fclose(f);
+  }
+
+  DIR* d = opendir(dir);
+  if(d == NULL){
+    LOG("%s: %s", dir, strerror(errno));
+    return false;
+  }
+  struct dirent* e;
+  while((e = readdir(d)) != NULL){
+    char* end;
+    unsigned long long first = strtoull(e->d_name, &end, 10);
+    if(end != e->d_name && strcmp(end, ".wal") == 0) this->_segments.push_back(Segment{first, this->_dir + "/" + e->d_name});
+  }
+  closedir(d);
+  std::sort(this->_segments.begin(), this->_segments.end(),
+            [](const Segment& a, const Segment& b){ return a.first < b.first; });
+
+  uint64_t next = this->_replayFrom;
+  if(!this->_segments.empty()){
+    uint64_t end;
+    scanSegment(this->_segments.back(), UINT64_MAX, NULL, &end, true);
+    if(end > next) next = end;
+    if(this->_segments.back().first >= next){
+      unlink(this->_segments.back().path.c_str());       // nothing in it, and the new segment takes its name
+      this->_segments.pop_back();
+    }
+  }
+
+  // sensors frame: per sensor, in device map order, its sensor_id as length (2) | bytes
+  std::vector<uint8_t>& frame = this->_sensorsFrame;
+  frame.assign(WAL_HEADER_SIZE, 0);
+  for(uint32_t i = 0; i < this->_map.sensorCount(); i++){
+    const std::string& id = this->_map.sensor(i).sensorId;
+    size_t at = frame.size();
+    frame.resize(at + 2 + id.size());
+    put<uint16_t>(&frame[at], id.size());
+    memcpy(&frame[at + 2], id.data(), id.size());
+  }
+  sealFrame(frame.data(), WAL_MAGIC_SENSORS, next, this->_map.sensorCount(), frame.size() - WAL_HEADER_SIZE);
+
+  this->_next = this->_bufferLsn = this->_sessionStart = next;
+  this->_durable.store(next);
+  this->_confirmed.store(this->_replayFrom);
+  this->_saved = this->_replayFrom;
+  if(!openSegment(next)) return false;
+  this->_stopping = false;
+  this->_thread = std::thread(&WriteAheadLog::commitLoop, this);
+  LOG("write-ahead log %s: %zu segments, confirmed up to %llu, next %llu", dir, this->_segments.size(),
+      (unsigned long long)this->_replayFrom, (unsigned long long)next);
+  return true;
+}
+
+size_t WriteAheadLog::scanSegment(const Segment& segment, uint64_t from, ReadingSink* sink, uint64_t* end, bool repair)
+{
+  *end = segment.first;
+  int fd = open(segment.path.c_str(), (repair ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+  if(fd < 0){
+    LOG("%s: %s", segment.path.c_str(), strerror(errno));
+    return 0;
+  }
+  struct stat st;
+  size_t size = fstat(fd, &st) == 0 ? st.st_size : 0;
+  const uint8_t* data = NULL;
+  if(size){
+    void* p = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(p == MAP_FAILED){
+      LOG("%s: mmap: %s", segment.path.c_str(), strerror(errno));
+      close(fd);
+      return 0;
+    }
+    data = (const uint8_t*)p;
+    madvise(p, size, MADV_SEQUENTIAL);
+  }
+
+  std::vector<int32_t> sensors;                          // index in the segment's map -> index now, -1 if gone
+  std::vector<Reading> batch;
+  size_t replayed = 0, skipped = 0;
+  size_t at = 0;
+  while(at + WAL_HEADER_SIZE <= size){
+    const uint8_t* frame = data + at;
+    uint32_t magic = get<uint32_t>(frame);
+    uint32_t bytes = get<uint32_t>(frame + 4);
+    uint64_t lsn = get<uint64_t>(frame + 8);
+    uint32_t count = get<uint32_t>(frame + 16);
+    size_t record = magic == WAL_MAGIC_V1 ? WAL_RECORD_SIZE_V1 : WAL_RECORD_SIZE;
+    if((magic != WAL_MAGIC_READINGS && magic != WAL_MAGIC_V1 && magic != WAL_MAGIC_SENSORS) ||
+       bytes > size - at - WAL_HEADER_SIZE || (magic != WAL_MAGIC_SENSORS && (uint64_t)count*record != bytes) ||
+       crc32c(crc32c(0, frame, 20), frame + WAL_HEADER_SIZE, bytes) != get<uint32_t>(frame + 20)) break;
+    const uint8_t* payload = frame + WAL_HEADER_SIZE;
+    if(magic == WAL_MAGIC_SENSORS){
+      sensors.clear();
+      for(size_t p = 0; sensors.size() < count && p + 2 <= bytes; ){
+        uint16_t length = get<uint16_t>(payload + p);
+        if(p + 2 + length > bytes) break;
+        sensors.push_back(this->_map.find(std::string((const char*)payload + p + 2, length)));
+        p += 2 + length;
+      }
+    }else{
+      for(uint32_t i = 0; sink && i < count; i++){
+        if(lsn + i < from) continue;
+        Reading r;
+        decode(payload + (size_t)i*record, record, r);
+        if(r.sensor >= sensors.size() || sensors[r.sensor] < 0){
+          skipped++;                                     // no longer in the device map
+          continue;
+        }
+        r.sensor = sensors[r.sensor];
+        batch.push_back(r);
+        if(batch.size() == WAL_FRAME_READINGS){
+          sink->push(batch.data(), batch.size());
+          replayed += batch.size();
+          batch.clear();
+        }
+      }
+      *end = lsn + count;
+    }
+    at += WAL_HEADER_SIZE + bytes;
+  }
+  if(sink && !batch.empty()){
+    sink->push(batch.data(), batch.size());
+    replayed += batch.size();
+  }
+  if(skipped) LOG("%s: %zu readings of sensors no longer in the device map skipped", segment.path.c_str(), skipped);
+  if(at < size){
+    if(repair){
+      // a frame the crash tore apart: its readings never were durable, so nothing was promised for them
+      LOG("%s: torn frame at byte %zu, %zu bytes cut off", segment.path.c_str(), at, size - at);
+      if(ftruncate(fd, at) < 0) LOG("%s: %s", segment.path.c_str(), strerror(errno));
+    }else{
+      LOG("%s: damaged frame at byte %zu, rest of the segment skipped", segment.path.c_str(), at);
+    }
+  }
+  if(data) munmap((void*)data, size);
+  close(fd);
+  return replayed;
+}
+
+/*!
+ * @brief Raise value to at least v, whichever thread raises it last
+ */
+static void raise(std::atomic<uint64_t>& value, uint64_t v)
+{
+  uint64_t old = value.load(std::memory_order_relaxed);
+  while(old < v && !value.compare_exchange_weak(old, v, std::memory_order_relaxed)) {}
+}
+
+size_t WriteAheadLog::scan(uint64_t from, ReadingSink& sink)
+{
+  std::vector<Segment> segments;
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    segments.assign(this->_segments.begin(), this->_segments.end() - 1);  // not the one of this run
+  }
+  size_t total = 0;
+  uint64_t next = from;
+  for(size_t i = 0; i < segments.size(); i++){
+    uint64_t end;
+    if(i + 1 < segments.size() && segments[i + 1].first <= from) continue;
+    // a commit that failed after part of it got in is in the next segment again
+    total += scanSegment(segments[i], next, &sink, &end, false);
+    if(end > next) next = end;
+  }
+  return total;
+}
+
+size_t WriteAheadLog::replay(ReadingSink& sink)
+{
+  this->_replayed.store(UINT64_MAX);                     // written() can't map rows to LSNs yet
+  size_t total = scan(this->_replayFrom, sink);
+  this->_replayed.store(total);
+  uint64_t done = this->_done.load();
+  if(done >= total) raise(this->_confirmed, this->_sessionStart + done - total);
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  this->_counters.replayed = total;
+  if(total) LOG("replaying %zu readings from the write-ahead log", total);
+  return total;
+}
+
+size_t WriteAheadLog::recover(uint64_t from, ReadingSink& sink)
+{
+  return scan(from, sink);
+}
+
+bool WriteAheadLog::covers(uint64_t lsn)
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  return lsn <= this->_next && (lsn == this->_next || this->_segments.front().first <= lsn);
+}
+
+uint64_t WriteAheadLog::appended()
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  return this->_next;
+}
+
+void WriteAheadLog::written(size_t rows)
+{
+  // rows come back in the order they were pushed to the writer: first the replayed ones, then ours
+  uint64_t done = this->_done.fetch_add(rows) + rows;
+  uint64_t replayed = this->_replayed.load();
+  if(done >= replayed) raise(this->_confirmed, this->_sessionStart + done - replayed);
+}
+
+bool WriteAheadLog::openSegment(uint64_t first)
+{
+  if(this->_fd >= 0) close(this->_fd);
+  char name[32];
+  snprintf(name, sizeof(name), "/%020llu.wal", (unsigned long long)first);
+  std::string path = this->_dir + name;
+  this->_fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if(this->_fd < 0){
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    return false;
+  }
+  put<uint64_t>(&this->_sensorsFrame[8], first);
+  sealFrame(this->_sensorsFrame.data(), WAL_MAGIC_SENSORS, first, this->_map.sensorCount(),
+            this->_sensorsFrame.size() - WAL_HEADER_SIZE);
+  if(!writeAll(this->_fd, this->_sensorsFrame.data(), this->_sensorsFrame.size())){
+    LOG("%s: %s", path.c_str(), strerror(errno));
+    close(this->_fd);
+    this->_fd = -1;
+    return false;
+  }
+  this->_written = this->_sensorsFrame.size();
+  int dirFd = open(this->_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if(dirFd >= 0){
+    fsync(dirFd);                                        // the new name has to survive a crash as well
+    close(dirFd);
+  }
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  if(this->_segments.empty() || this->_segments.back().first != first)   // else a failed commit's retry took its name
+    this->_segments.push_back(Segment{first, path});
+  return true;
+}
+
+void WriteAheadLog::end()
+{
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    this->_stopping = true;
+  }
+  this->_wake.notify_all();
+  this->_room.notify_all();
+  if(this->_thread.joinable()) this->_thread.join();
+  if(this->_fd >= 0){
+    close(this->_fd);
+    this->_fd = -1;
+  }
+}
+
+void WriteAheadLog::push(const Reading* readings, size_t count)
+{
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  while(count){
+    if(this->_buffer.size() >= WAL_BUFFER_BYTES){
+      this->_counters.stalls++;
+      this->_room.wait(lock, [this]{ return this->_buffer.size() < WAL_BUFFER_BYTES || this->_stopping; });
+      if(this->_stopping) return;
+    }
+    size_t n = count < WAL_FRAME_READINGS ? count : WAL_FRAME_READINGS;
+    size_t at = this->_buffer.size();
+    this->_buffer.resize(at + WAL_HEADER_SIZE + n*WAL_RECORD_SIZE);
+    uint8_t* frame = &this->_buffer[at];
+    for(size_t i = 0; i < n; i++) encode(frame + WAL_HEADER_SIZE + i*WAL_RECORD_SIZE, readings[i]);
+    sealFrame(frame, WAL_MAGIC_READINGS, this->_next, n, n*WAL_RECORD_SIZE);
+    this->_next += n;
+    this->_counters.readings += n;
+    readings += n;
+    count -= n;
+  }
+  lock.unlock();
+  this->_wake.notify_one();
+}
+
+void WriteAheadLog::commitLoop()
+{
+  std::vector<uint8_t> batch;
+  bool failing = false;
+  int64_t retired = nowMicros();
+  std::unique_lock<std::mutex> lock(this->_mutex);
+  while(true){
+    if(this->_buffer.empty()){
+      if(this->_stopping) break;
+      this->_wake.wait_for(lock, std::chrono::milliseconds(WAL_RETIRE_MS));
+    }
+    if(!this->_buffer.empty()){
+      // everything pushed while the last fsync ran goes out with this one
+      batch.swap(this->_buffer);
+      this->_buffer.clear();
+      uint64_t first = this->_bufferLsn, end = this->_next;
+      this->_bufferLsn = end;
+      this->_room.notify_all();
+      lock.unlock();
+      bool ok = (this->_fd >= 0 && this->_written < this->_segmentBytes) || openSegment(first);
+      ok = ok && writeAll(this->_fd, batch.data(), batch.size()) && fdatasync(this->_fd) == 0;
+      if(ok){
+        this->_written += batch.size();
+        this->_durable.store(end, std::memory_order_release);
+        if(failing) LOG("write-ahead log: written again");
+        failing = false;
+      }else{
+        if(!failing) LOG("write-ahead log: %s, readings are not durable until it can be written again", strerror(errno));
+        failing = true;
+        if(this->_fd >= 0){
+          // after a failed fsync the page cache can't be trusted: cut what got in and go on in a new segment
+          if(ftruncate(this->_fd, this->_written) < 0) {}  // scan() skips LSNs it has read already anyway
+          close(this->_fd);
+        }
+        this->_fd = -1;
+      }
+      lock.lock();
+      if(ok){
+        this->_counters.commits++;
+        this->_counters.bytes += batch.size();
+      }else{
+        // the batch goes first again, a later commit must not cover it
+        batch.insert(batch.end(), this->_buffer.begin(), this->_buffer.end());
+        this->_buffer.swap(batch);
+        this->_bufferLsn = first;
+        if(this->_stopping){
+          LOG("write-ahead log: stopping with the disk failing, %llu readings not written",
+              (unsigned long long)(this->_next - first));
+          this->_counters.failed += this->_next - first;
+          this->_buffer.clear();
+          this->_bufferLsn = this->_next;
+          break;
+        }
+        this->_wake.wait_for(lock, std::chrono::milliseconds(WAL_RETRY_MS), [this]{ return this->_stopping; });
+      }
+    }
+    int64_t now = nowMicros();
+    if(now - retired >= (int64_t)WAL_RETIRE_MS*1000){
+      retired = now;
+      lock.unlock();
+      retire();
+      lock.lock();
+    }
+  }
+  lock.unlock();
+  retire();
+}
+
+void WriteAheadLog::retire()
+{
+  uint64_t confirmed = this->_confirmed.load();
+  if(this->_confirm && confirmed != this->_saved){
+    // no fsync: a stale value only replays rows the database ignores as duplicates
+    std::string path = this->_dir + "/confirmed", tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if(f == NULL || fprintf(f, "%llu\n", (unsigned long long)confirmed) < 0 || fclose(f) != 0 ||
+       rename(tmp.c_str(), path.c_str()) < 0){
+      LOG("%s: %s", path.c_str(), strerror(errno));
+      return;
+    }
+    this->_saved = confirmed;
+  }
+  uint64_t keep = this->_checkpoint.load();
+  if(this->_confirm && confirmed < keep) keep = confirmed;
+  std::vector<std::string> doomed;
+  {
+    std::lock_guard<std::mutex> lock(this->_mutex);
+    size_t n = 0;
+    while(n + 1 < this->_segments.size() && this->_segments[n + 1].first <= keep) n++;
+    for(size_t i = 0; i < n; i++) doomed.push_back(this->_segments[i].path);
+    this->_segments.erase(this->_segments.begin(), this->_segments.begin() + n);
+  }
+  for(size_t i = 0; i < doomed.size(); i++)
+    if(unlink(doomed[i].c_str()) < 0 && errno != ENOENT) LOG("%s: %s", doomed[i].c_str(), strerror(errno));
+}
+
+WalCounters WriteAheadLog::counters()
+{
+  std::lock_guard<std::mutex> lock(this->_mutex);
+  WalCounters c = this->_counters;
+  c.durable = this->_durable.load();
+  c.confirmed = this->_confirmed.load();
+  c.segments = this->_segments.size();
+  return c;
+}
@@ -0,0 +1,174 @@
+/*!
+ * @file WriteAheadLog.h
+ * @brief Define the basic structure of class WriteAheadLog
+ * @details Keeps the readings on their way to the database on disk, so a gateway crash between receiving readings
+ * @n and BatchWriter inserting them loses nothing (the boards keep at most the few readings not acknowledged yet,
+ * @n see Delivery).
+ * @n Readings get consecutive log sequence numbers (LSN) and are appended to segment files
+ * @n <dir>/<LSN of the first reading>.wal, a new one every WAL_SEGMENT_BYTES, in frames:
+ * @n   magic (4) | payload bytes (4) | LSN of the first reading (8) | readings (4) | CRC-32C (4) | payload
+ * @n The CRC covers the first 20 header bytes and the payload. Each segment starts with a sensors frame listing
+ * @n the sensor_ids in device map order, so a log still replays after the map changed.
+ * @n push() only encodes into a memory buffer; one commit thread writes the buffer and fdatasync()s it, and
+ * @n whatever arrived during that fsync goes out with the next one (group commit): a fsync per round, not per
+ * @n reading. The buffer is bounded, when the disk lags push() blocks like BatchWriter does. A commit that fails
+ * @n is written again, in a new segment, before anything pushed after it: durable() never passes a reading that
+ * @n is not on disk.
+ * @n BatchWriter reports the rows the database has (WriterListener); the confirmed LSN is kept in
+ * @n <dir>/confirmed. At start a torn frame at the end of the log is cut off and replay() hands the readings after
+ * @n the confirmed LSN to the writer again, which inserts them with ignore-duplicates, so readings that did reach
+ * @n the database before the crash are not doubled. recover() does the same from the LSN of a Checkpointer
+ * @n checkpoint for the in-memory state. Segments are deleted once they are entirely below both.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#ifndef _GATEWAY_WRITEAHEADLOG_H_
+#define _GATEWAY_WRITEAHEADLOG_H_
+
+#include "BatchWriter.h"
+#include "DeviceMap.h"
+#include "Reading.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define WAL_SEGMENT_BYTES    (64 << 20)
+#define WAL_BUFFER_BYTES     (8 << 20)  ///<encoded readings waiting for the disk at most
+#define WAL_FRAME_READINGS   4096       ///<readings per frame at most
+#define WAL_RETIRE_MS        1000       ///<how often the confirmed LSN is saved and old segments deleted
+#define WAL_RETRY_MS         100        ///<wait before writing a failed commit again
+#define WAL_HEADER_SIZE      24
+#define WAL_RECORD_SIZE      32         ///<bytes per reading
+
+struct WalCounters {
+  uint64_t readings;      ///<appended since start
+  uint64_t commits;       ///<fdatasync() calls
+  uint64_t bytes;         ///<written
+  uint64_t stalls;        ///<push() calls that had to wait for the disk
+  uint64_t failed;        ///<readings given up on when stopping with the disk failing
+  uint64_t replayed;
+  uint64_t durable;       ///<readings below this LSN are on disk
+  uint64_t confirmed;     ///<readings below this LSN are in the database
+  size_t   segments;
+};
+
+class WriteAheadLog : public ReadingSink, public WriterListener
+{
+public:
+  WriteAheadLog(const DeviceMap& map, size_t segmentBytes = WAL_SEGMENT_BYTES);
+  ~WriteAheadLog();
+
+  /*!
+   * @fn begin
+   * @brief Open the log in dir (created if missing), cut off a torn tail, start a new segment and the commit
+   * @n thread
+   * @param confirm  Keep readings until a writer confirms them (written()), else only checkpoints keep them
+   * @return false if the directory or the new segment can't be written
+   */
+  bool begin(const char* dir, bool confirm);
+
+  /*!
+   * @fn replay
+   * @brief Push the logged readings after the confirmed LSN to sink, oldest first; call once after begin()
+   * @n and before the first push(), with the writer that reports to written()
+   * @return Number of readings replayed
+   */
+  size_t replay(ReadingSink& sink);
+
+  /*!
+   * @fn recover
+   * @brief Push the logged readings from LSN from on to sink, oldest first, before the first push()
+   * @return Number of readings pushed
+   */
+  size_t recover(uint64_t from, ReadingSink& sink);
+
+  /*!
+   * @fn covers
+   * @brief Whether the log still holds every reading from lsn on
+   */
+  bool covers(uint64_t lsn);
+
+  /*!
+   * @fn checkpointed
+   * @brief The in-memory state is saved up to lsn, older readings are only kept for the writer
+   */
+  void checkpointed(uint64_t lsn) { this->_checkpoint.store(lsn); }
+
+  /*!
+   * @fn appended
+   * @brief LSN the next reading pushed gets, every reading below it was pushed
+   */
+  uint64_t appended();
+
+  /*!
+   * @fn end
+   * @brief Commit what is buffered, stop the commit thread and save the confirmed LSN
+   */
+  void end();
+
+  virtual void push(const Reading* readings, size_t count);
+  virtual void written(size_t rows);
+
+  /*!
+   * @fn durable
+   * @brief Readings below this LSN are on disk
+   */
+  uint64_t durable() const { return this->_durable.load(std::memory_order_acquire); }
+
+  WalCounters counters();
+
+  /*!
+   * @fn crc32c
+   * @brief CRC-32C (Castagnoli), with SSE4.2 where the CPU has it
+   */
+  static uint32_t crc32c(uint32_t crc, const uint8_t* data, size_t length);
+
+private:
+  struct Segment {
+    uint64_t first;       ///<LSN of its first reading
+    std::string path;
+  };
+
+  const DeviceMap& _map;
+  size_t _segmentBytes;
+  std::string _dir;
+  std::vector<uint8_t> _sensorsFrame;
+  std::vector<Segment> _segments;       ///<oldest first, the last one is written, guarded by _mutex
+  int _fd;
+  size_t _written;                      ///<bytes in the segment written
+  uint64_t _replayFrom;                 ///<confirmed LSN found at start
+  bool _confirm;
+  // guarded by _mutex
+  std::vector<uint8_t> _buffer;
+  uint64_t _bufferLsn;                  ///<LSN of the first reading in _buffer
+  uint64_t _next;                       ///<LSN of the next reading pushed
+  bool _stopping;
+  WalCounters _counters;
+  std::mutex _mutex;
+  std::condition_variable _wake;
+  std::condition_variable _room;
+  std::thread _thread;
+  // confirmation, from the writer's flush thread
+  std::atomic<uint64_t> _done;          ///<rows reported by written()
+  uint64_t _sessionStart;               ///<LSN of the first reading pushed in this run
+  std::atomic<uint64_t> _replayed;      ///<readings given to the writer by replay(), UINT64_MAX while it runs
+  std::atomic<uint64_t> _confirmed;
+  std::atomic<uint64_t> _durable;
+  std::atomic<uint64_t> _checkpoint;    ///<UINT64_MAX while no checkpoint needs the log
+  uint64_t _saved;                      ///<confirmed LSN in the file
+
+private:
+  void commitLoop();
+  bool openSegment(uint64_t first);
+  void retire();
+  static void sealFrame(uint8_t* frame, uint32_t magic, uint64_t lsn, uint32_t count, size_t bytes);
+  size_t scan(uint64_t from, ReadingSink& sink);
+  size_t scanSegment(const Segment& segment, uint64_t from, ReadingSink* sink, uint64_t* end, bool repair);
+};
+
+#endif
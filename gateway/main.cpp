@@ -0,0 +1,281 @@
+/*!
+ * @file main.cpp
+ * @brief sensor-gateway: ingest readings of many Arduino probe boards over serial
+ * @details Usage: sensor-gateway -c <device map> [-b <baud>] [-u <PostgREST URL>] [-d <store dir>] [-l [addr:]port] [-q <scan threads>] [-f <sec>] [-a <rules>] [-k <sec>] [-t <retention>] [-g <readings/s>] [-r <readers>] [-w <converters>] [-p] [-s <sec>]
+ * @n Without -u readings are printed to stdout. With -d they are also kept in a local ColumnStore, which -l serves
+ * @n over HTTP (QueryApi), new readings also as a live event stream (LiveFeed). Drifting and faulty sensors
+ * @n are logged and, with -u, become `notifications` rows (DriftDetector, Notifier). The sensors of each device
+ * @n are fused on a -f second grid (SensorFusion). Alert rules (-a, RuleEngine) are evaluated on every reading
+ * @n and notify like detections. With -d readings are logged to <dir>/wal (WriteAheadLog) until the database has
+ * @n them and the in-memory state is checkpointed every -k seconds (Checkpointer); a restart restores the
+ * @n checkpoint and replays the log after it. -t moves stored rows older than a retention per sensor type to
+ * @n hourly cold buckets. Sequenced readings are acknowledged to the devices once logged, and the copies they
+ * @n resend are dropped (Delivery). Backfill (readings resent long after they were taken) takes lanes of its own
+ * @n through the pipeline and the writer, capped at -g readings per second. The API key is read from
+ * @n GATEWAY_REST_KEY, the token the query API's POST requests need from GATEWAY_API_TOKEN (unset: they are
+ * @n refused). See README.md for the device map format.
+ * @license     The MIT License (MIT)
+ * @version  V1.0
+ */
+#include "Aggregator.h"
+#include "BatchWriter.h"
+#include "CalibrationRegistry.h"
+#include "Checkpoint.h"
+#include "ColumnStore.h"
+#include "Delivery.h"
+#include "DeviceMap.h"
+#include "DriftDetector.h"
+#include "FarmSnapshot.h"
+#include "LiveFeed.h"
+#include "Log.h"
+#include "Notifier.h"
+#include "Pipeline.h"
+#include "PostgrestClient.h"
+#include "QueryApi.h"
+#include "Reprocessor.h"
+#include "Rollups.h"
+#include "RuleEngine.h"
+#include "SensorFusion.h"
+#include "WriteAheadLog.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+#include <unistd.h>
+
+/*!
+ * @brief Prints every reading as "<created_at us> <sensor_id> <value>"
+ */
+class PrintSink : public ReadingSink
+{
+public:
+  PrintSink(const DeviceMap& map) : _map(map) {}
+
+  virtual void push(const Reading* readings, size_t count)
+  {
+    for(size_t i = 0; i < count; i++)
+      printf("%lld %s %g\n", (long long)readings[i].timestamp,
+             this->_map.sensor(readings[i].sensor).sensorId.c_str(), readings[i].value);
+    fflush(stdout);
+  }
+
+private:
+  const DeviceMap& _map;
+};
+
+static Pipeline* pipeline = NULL;
+static HttpServer* server = NULL;
+
+static void onSignal(int)
+{
+  if(pipeline) pipeline->stop();
+  if(server) server->stop();
+}
+
+static void usage()
+{
+  fprintf(stderr, "usage: sensor-gateway -c <device map> [-b <baud>] [-u <PostgREST URL>] [-d <store dir>]\n"
+                  "                      [-l [addr:]port] [-q <scan threads>] [-f <fusion step s, 0: off>]\n"
+                  "                      [-a <alert rules>] [-k <checkpoint interval s, 0: off>]\n"
+                  "                      [-t <type>=<days>,... raw row retention, e.g. ph=365,*=90]\n"
+                  "                      [-g <backfill readings/s, 0: no cap>]\n"
+                  "                      [-r <reader threads>] [-w <converter threads>] [-p] [-s <stats interval s>]\n");
+}
+
+int main(int argc, char** argv)
+{
+  const char* mapPath = NULL;
+  const char* restUrl = NULL;
+  const char* storeDir = NULL;
+  const char* listen = NULL;
+  const char* rulesPath = NULL;
+  const char* retention = NULL;
+  unsigned scanThreads = std::thread::hardware_concurrency();
+  PipelineConfig config;
+  config.readers = 1;
+  config.converters = 1;
+  config.pin = false;
+  config.baud = 115200;
+  config.acks = NULL;
+  config.backfillRate = PIPELINE_BACKFILL_RATE;
+  int statsInterval = 0;
+  int fusionStep = FUSION_STEP_S;
+  int checkpointInterval = CHECKPOINT_INTERVAL_S;
+  int opt;
+  while((opt = getopt(argc, argv, "c:b:u:d:l:q:f:a:k:t:g:r:w:ps:h")) != -1){
+    switch(opt){
+      case 'c': mapPath = optarg; break;
+      case 'b': config.baud = atoi(optarg); break;
+      case 'u': restUrl = optarg; break;
+      case 'd': storeDir = optarg; break;
+      case 'l': listen = optarg; break;
+      case 'q': scanThreads = atoi(optarg); break;
+      case 'f': fusionStep = atoi(optarg); break;
+      case 'a': rulesPath = optarg; break;
+      case 'k': checkpointInterval = atoi(optarg); break;
+      case 't': retention = optarg; break;
+      case 'g': config.backfillRate = atoi(optarg); break;
+      case 'r': config.readers = atoi(optarg); break;
+      case 'w': config.converters = atoi(optarg); break;
+      case 'p': config.pin = true; break;
+      case 's': statsInterval = atoi(optarg); break;
+      default: usage(); return 2;
+    }
+  }
+  if(mapPath == NULL){
+    usage();
+    return 2;
+  }
+  if(listen && storeDir == NULL){
+    fprintf(stderr, "-l needs a store (-d)\n");
+    return 2;
+  }
+  if(retention && storeDir == NULL){
+    fprintf(stderr, "-t needs a store (-d)\n");
+    return 2;
+  }
+
+  DeviceMap map;
+  if(!map.load(mapPath)) return 1;
+  LOG("%zu sensors on %zu devices", map.sensorCount(), map.devices().size());
+
+  PrintSink printer(map);
+  PostgrestClient client;
+  PostgrestClient notifyClient;
+  WriteAheadLog wal(map);                                // outlives the writer that reports to it
+  Checkpointer checkpoints(map, wal, checkpointInterval);
+  BatchWriter writer(map, client);
+  ColumnStore store(map);
+  Rollups rollups(map);
+  CalibrationRegistry calibrations(map);
+  Notifier notifier(map, calibrations);
+  DriftDetector detector(map, calibrations, notifier);
+  RuleEngine rules(map, notifier);
+  FarmSnapshot snapshot(map, rollups, detector);
+  LiveFeed live(map, snapshot);
+  SensorFusion fusion(map, calibrations, (int64_t)fusionStep*1000000);
+  FanoutSink sinks;
+  Delivery delivery(map, sinks);                         // drops resent readings in front of every sink
+  if(retention && !store.retain(retention)) return 1;
+  if(storeDir && !store.begin(storeDir)) return 1;
+  if(rulesPath && !rules.load(rulesPath)) return 1;
+  rules.begin();
+  std::string calibrationPath = storeDir ? std::string(storeDir) + "/calibrations" : "";
+  if(!calibrations.begin(storeDir ? calibrationPath.c_str() : NULL)) return 1;
+  rollups.begin(storeDir ? &store : NULL);
+  snapshot.begin(storeDir ? &store : NULL);
+  bool logging = storeDir && (restUrl || checkpointInterval > 0);
+  bool checkpointing = logging && checkpointInterval > 0;
+  bool recovering = false;
+  uint64_t recoverFrom = 0;
+  if(logging){
+    std::string walDir = std::string(storeDir) + "/wal";
+    if(!wal.begin(walDir.c_str(), restUrl != NULL)) return 1;
+  }
+  if(checkpointing){
+    std::string checkpointPath = std::string(storeDir) + "/checkpoint";
+    checkpoints.add(CHECKPOINT_ROLLUPS, &rollups);
+    checkpoints.add(CHECKPOINT_DRIFT, &detector);
+    if(rules.ruleCount()) checkpoints.add(CHECKPOINT_RULES, &rules);
+    recovering = checkpoints.load(checkpointPath.c_str(), &recoverFrom);
+    wal.checkpointed(recovering ? recoverFrom : 0);      // without one keep the log until the first
+  }
+  if(!checkpoints.restored(CHECKPOINT_ROLLUPS)) rollups.rebuildAll();
+  if(logging) sinks.add(&wal);                           // first, the checkpoint LSN counts what the others have
+  sinks.add(&rollups);                                   // before the store, see Rollups::rebuild()
+  if(storeDir) sinks.add(&store);
+  sinks.add(&detector);
+  if(rules.ruleCount()) sinks.add(&rules);
+  if(fusion.groupCount()) sinks.add(&fusion);
+  sinks.add(&snapshot);
+  if(checkpointing) sinks.add(&checkpoints);             // after the states it saves
+  if(listen) sinks.add(&live);                           // after the snapshot it reads the values from
+  if(restUrl){
+    const char* key = getenv("GATEWAY_REST_KEY");
+    if(!client.begin(restUrl, key ? key : "") || !notifyClient.begin(restUrl, key ? key : "")) return 1;
+    if(logging) writer.listen(&wal);
+    writer.begin();
+    if(logging) wal.replay(writer);                      // what the last run didn't get into the database
+    notifier.begin(&notifyClient);
+    sinks.add(&writer);
+  }else{
+    notifier.begin(NULL);
+    sinks.add(&printer);
+  }
+  if(recovering){
+    // the restored states take the readings logged after the checkpoint, the store has them already
+    FanoutSink recovery;
+    if(checkpoints.restored(CHECKPOINT_ROLLUPS)) recovery.add(&rollups);
+    if(checkpoints.restored(CHECKPOINT_DRIFT)) recovery.add(&detector);
+    if(checkpoints.restored(CHECKPOINT_RULES)) recovery.add(&rules);
+    recovery.add(&snapshot);
+    notifier.mute(true);                                 // their alerts went out before the restart
+    LOG("%zu readings logged after the checkpoint replayed", wal.recover(recoverFrom, recovery));
+    notifier.mute(false);
+  }
+  delivery.begin(logging ? &wal : NULL);
+  config.acks = &delivery;
+
+  HttpServer http;
+  Aggregator aggregator(store);
+  Reprocessor reprocessor(map, store, rollups, calibrations);
+  QueryApi api(map, store, rollups, aggregator, calibrations, reprocessor, detector, snapshot, fusion);
+  std::thread httpThread;
+  if(listen){
+    aggregator.begin(scanThreads);
+    reprocessor.begin(scanThreads);
+    http.route("/sensors", &api);
+    http.route("/farms", &api);
+    http.route("/reprocess", &api);
+    http.route("/snapshot", &api);
+    http.stream("/stream", &live);
+    const char* token = getenv("GATEWAY_API_TOKEN");
+    if(token && *token) api.authorize(token);
+    else LOG("GATEWAY_API_TOKEN is not set, calibrations and reprocessing can't be posted");
+    if(!http.begin(listen)) return 1;
+  }
+
+  Pipeline ingest(map, calibrations, delivery, config);
+  if(!ingest.begin()) return 1;
+
+  pipeline = &ingest;
+  signal(SIGINT, onSignal);
+  signal(SIGTERM, onSignal);
+  if(listen){
+    server = &http;
+    httpThread = std::thread(&HttpServer::run, &http);
+  }
+  ingest.run(statsInterval*1000);
+  pipeline = NULL;
+  if(listen){
+    http.stop();
+    httpThread.join();
+    server = NULL;
+  }
+  ingest.end();
+  store.end();
+  if(checkpointing) checkpoints.end();                   // restarts replay nothing
+  DeliveryCounters d = delivery.counters();
+  if(d.sequenced || d.duplicates)
+    LOG("delivery: %llu sequenced readings, %llu duplicates dropped, %llu acknowledged",
+        (unsigned long long)d.sequenced, (unsigned long long)d.duplicates, (unsigned long long)d.acked);
+
+  notifier.end();
+  if(restUrl){
+    writer.end();
+    WriterCounters c = writer.counters();
+    LOG("%llu rows (%llu backfill) in %llu batches, %llu retries, %llu rejected, %llu stalls",
+        (unsigned long long)c.rows, (unsigned long long)c.backfill, (unsigned long long)c.batches,
+        (unsigned long long)c.retries, (unsigned long long)c.rejected, (unsigned long long)c.stalls);
+  }
+  if(logging){
+    wal.end();                                           // after the writer, so its last rows are confirmed
+    WalCounters w = wal.counters();
+    LOG("write-ahead log: %llu readings in %llu commits, %llu stalls, %llu not written, %zu segments kept",
+        (unsigned long long)w.readings, (unsigned long long)w.commits, (unsigned long long)w.stalls,
+        (unsigned long long)w.failed, w.segments);
+  }
+  return 0;
+}